@@ -187,6 +187,11 @@ void signal_callback_handler(int) {
 
 int sc_main(int argc, char* argv[]) {
     Verilated::commandArgs(argc, argv);
+
+    // let the queue drivers run ahead of simulation time between
+    // synchronizations, rather than yielding on every register access
+    tlm::tlm_global_quantum::instance().set(sc_time(1, SC_US));
+
     Top top("Top");
 
     signal(SIGINT, signal_callback_handler);
@@ -3,15 +3,20 @@
 // Copyright (c) 2024 Zero ASIC Corporation
 // This code is licensed under Apache License 2.0 (see LICENSE for details)
 
+#include <memory>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "switchboard_fpga_model.hpp"
 #include "switchboard_pcie.hpp"
 
 static void usage(const char* progname) {
-    printf("%s: BDF BAR-num offset\n\n", progname);
+    printf("%s: [--doorbell] BDF|model\n\n", progname);
+    printf("  --doorbell  use doorbell mode if the device supports it\n");
+    printf("  model       ping a software model of the FPGA queues in loopback\n\n");
 }
 
 static void bad_queue(const char* name) {
@@ -21,25 +26,43 @@ static void bad_queue(const char* name) {
 }
 
 int main(int argc, char* argv[]) {
-    const char* bdf;
+    const char* bdf = NULL;
+    bool doorbell = false;
     int bar_num;
+    std::unique_ptr<SB_fpga_model> model; // must outlive the queues
     SBTX_pcie tx(0);
     SBRX_pcie rx(1);
     int i;
     struct timespec start, end;
+    double total = 0;
 
-    if (argc < 2) {
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--doorbell") == 0) {
+            doorbell = true;
+        } else {
+            bdf = argv[i];
+        }
+    }
+
+    if (!bdf) {
         usage(argv[0]);
         return EXIT_FAILURE;
     }
 
-    bdf = argv[1];
     bar_num = 0;
 
-    if (!tx.init("queue-tx", bdf, bar_num)) {
+    if (strcmp(bdf, "model") == 0) {
+        model.reset(new SB_fpga_model(2));
+        model->set_loopback(true);
+    }
+
+    tx.set_doorbell(doorbell);
+    rx.set_doorbell(doorbell);
+
+    if (!(model ? tx.init("queue-tx", model.get()) : tx.init("queue-tx", bdf, bar_num))) {
         bad_queue("tx");
     }
-    if (!rx.init("queue-rx", bdf, bar_num)) {
+    if (!(model ? rx.init("queue-rx", model.get()) : rx.init("queue-rx", bdf, bar_num))) {
         bad_queue("rx");
     }
 
@@ -54,8 +77,19 @@ int main(int argc, char* argv[]) {
 
         double tdiff = (end.tv_sec - start.tv_sec) + 1e-9 * (end.tv_nsec - start.tv_nsec);
         printf("latency: %f sec\n", tdiff);
+        total += tdiff;
+    }
+
+    printf("average latency: %f sec (doorbell mode %s)\n", total / i,
+        tx.doorbell_enabled() ? "on" : "off");
+    if (model) {
+        printf("device reads: %lu, device writes: %lu\n", (unsigned long)model->dma_reads(),
+            (unsigned long)model->dma_writes());
     }
 
+    tx.deinit();
+    rx.deinit();
+
     delete_shared_queue("queue-tx");
     delete_shared_queue("queue-rx");
     return 0;
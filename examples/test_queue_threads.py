@@ -0,0 +1,69 @@
+#!/usr/bin/env python
+
+# Copyright (c) 2024 Zero ASIC Corporation
+# This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+# checks that Python threads sharing one PySbTx and one PySbRx don't corrupt
+# the queue.  blocking calls release the GIL while they wait, so each queue
+# object has to serialize the calls made on it.
+
+import threading
+import numpy as np
+from switchboard import PySbPacket, PySbTx, PySbRx, delete_queue
+
+THREADS = 4
+PACKETS = 2000
+
+
+def test_queue_threads(tmp_path):
+    uri = str(tmp_path / 'threads.q')
+    delete_queue(uri)
+
+    tx = PySbTx(uri, fresh=True)
+    rx = PySbRx(uri)
+
+    # the queue is much smaller than the number of packets sent, so the
+    # senders regularly block on a full queue and the receivers on an
+    # empty one, which is when the GIL is released
+    def sender(thread):
+        for i in range(PACKETS):
+            data = np.zeros(52, dtype=np.uint8)
+            data[:8] = np.frombuffer(np.uint64(i).tobytes(), dtype=np.uint8)
+            assert tx.send(PySbPacket(destination=thread, flags=1, data=data), True)
+
+    received = [[] for _ in range(THREADS)]
+
+    def receiver(thread):
+        for _ in range(PACKETS):
+            p = rx.recv(True)
+            received[thread].append((p.destination, int(np.frombuffer(p.data[:8].tobytes(),
+                dtype=np.uint64)[0])))
+
+    threads = [threading.Thread(target=sender, args=(t,)) for t in range(THREADS)]
+    threads += [threading.Thread(target=receiver, args=(t,)) for t in range(THREADS)]
+
+    for t in threads:
+        t.start()
+
+    for t in threads:
+        t.join(timeout=120)
+        assert not t.is_alive(), 'queue threads did not finish'
+
+    # every packet arrives exactly once, and the packets of each sender
+    # arrive in the order that they were sent
+    for thread in range(THREADS):
+        seqs = [[s for d, s in r if d == thread] for r in received]
+        merged = sorted(s for r in seqs for s in r)
+        assert merged == list(range(PACKETS))
+        for r in seqs:
+            assert r == sorted(r)
+
+    # nothing is left over
+    assert rx.recv(False) is None
+
+
+if __name__ == '__main__':
+    import tempfile
+    import pathlib
+    with tempfile.TemporaryDirectory() as d:
+        test_queue_threads(pathlib.Path(d))
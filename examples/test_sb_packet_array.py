@@ -0,0 +1,97 @@
+#!/usr/bin/env python
+
+# Copyright (c) 2024 Zero ASIC Corporation
+# This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+# checks that sb_packet_dtype has the layout of sb_packet, and that packets
+# sent and received as structured arrays keep their destination, flags and
+# data, including when mixed with packets sent and received one at a time.
+
+import struct
+import numpy as np
+from switchboard import PySbPacket, PySbTx, PySbRx, delete_queue, sb_packet_dtype
+
+SB_DATA_SIZE = 52
+
+
+def make_packets(num, seed):
+    packets = np.zeros(num, dtype=sb_packet_dtype)
+    rng = np.random.default_rng(seed)
+    packets['destination'] = rng.integers(0, 1 << 32, num, dtype=np.uint32)
+    packets['flags'] = rng.integers(0, 1 << 32, num, dtype=np.uint32)
+    packets['data'] = rng.integers(0, 256, (num, SB_DATA_SIZE), dtype=np.uint8)
+    return packets
+
+
+def test_sb_packet_dtype():
+    # struct sb_packet { uint32_t destination; uint32_t flags; uint8_t data[52]; },
+    # packed and little-endian
+    assert sb_packet_dtype.itemsize == 60
+    assert sb_packet_dtype.names == ('destination', 'flags', 'data')
+
+    destination, offset = sb_packet_dtype.fields['destination'][:2]
+    assert (destination, offset) == (np.dtype('<u4'), 0)
+
+    flags, offset = sb_packet_dtype.fields['flags'][:2]
+    assert (flags, offset) == (np.dtype('<u4'), 4)
+
+    data, offset = sb_packet_dtype.fields['data'][:2]
+    assert (data.base, data.shape, offset) == (np.dtype('u1'), (SB_DATA_SIZE,), 8)
+
+    # the bytes of a record are those of the C struct
+    p = make_packets(1, 0)
+    expected = struct.pack('<II52s', int(p['destination'][0]), int(p['flags'][0]),
+        p['data'][0].tobytes())
+    assert p.tobytes() == expected
+
+
+def test_sb_packet_array(tmp_path):
+    uri = str(tmp_path / 'array.q')
+    delete_queue(uri)
+
+    tx = PySbTx(uri, fresh=True)
+    rx = PySbRx(uri)
+
+    # nothing to receive yet
+    assert len(rx.recv_array(10, False)) == 0
+
+    # arrays in, arrays out
+    packets = make_packets(100, 1)
+    assert tx.send_array(packets) == len(packets)
+    received = rx.recv_array(len(packets))
+    assert received.dtype == sb_packet_dtype
+    assert np.array_equal(received, packets)
+
+    # arrays in, single packets out, which checks the layout against the
+    # packets that PySbRx.recv() decodes on its own
+    packets = make_packets(10, 2)
+    assert tx.send_array(packets) == len(packets)
+    for expected in packets:
+        p = rx.recv()
+        assert p.destination == expected['destination']
+        assert p.flags == expected['flags']
+        assert np.array_equal(p.data, expected['data'])
+
+    # single packets in, arrays out
+    packets = make_packets(10, 3)
+    for p in packets:
+        assert tx.send(PySbPacket(destination=int(p['destination']), flags=int(p['flags']),
+            data=p['data'].copy()))
+    received = rx.recv_array(len(packets))
+    assert np.array_equal(received, packets)
+
+    # without blocking, only the packets that are there are returned
+    packets = make_packets(3, 4)
+    assert tx.send_array(packets, False) == len(packets)
+    received = rx.recv_array(10, False)
+    assert np.array_equal(received, packets)
+
+    assert rx.recv(False) is None
+
+
+if __name__ == '__main__':
+    import tempfile
+    import pathlib
+    test_sb_packet_dtype()
+    with tempfile.TemporaryDirectory() as d:
+        test_sb_packet_array(pathlib.Path(d))
@@ -0,0 +1,103 @@
+#!/usr/bin/env python
+
+# Copyright (c) 2024 Zero ASIC Corporation
+# This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+# checks PySbSignalBank: bits written by one bank object (possibly in
+# another process) are seen by a reader after read(), and only writes that
+# change something advance the generation.
+
+import multiprocessing
+import numpy as np
+import pytest
+from switchboard import PySbSignalBank
+
+NBITS = 4000
+
+
+def test_signal_bank(tmp_path):
+    uri = str(tmp_path / 'bank')
+
+    w = PySbSignalBank(uri, NBITS, fresh=True)
+    r = PySbSignalBank(uri, NBITS)
+    assert r.nbits == NBITS
+
+    # nothing written yet
+    assert r.generation() == 0
+    assert not r.read()
+    assert r.get_bits(0, 64) == 0
+
+    # a write that straddles two 64-bit words
+    w.set_bits(60, 8, 0xa5)
+    assert r.generation() == 1
+    assert r.read()
+    assert r.get_bits(60, 8) == 0xa5
+    words = r.words()
+    assert words.dtype == np.uint64
+    assert len(words) == (NBITS + 63) // 64
+    assert words[0] == 0x5 << 60
+    assert words[1] == 0xa
+
+    # no change until the next write
+    assert not r.read()
+
+    # a write that doesn't change anything leaves the generation alone
+    w.set_bits(60, 8, 0xa5)
+    assert r.generation() == 1
+    assert not r.read()
+
+    # full-width access at the top of the bank
+    w.set_bits(NBITS - 64, 64, (1 << 64) - 1)
+    assert r.read()
+    assert r.get_bits(NBITS - 64, 64) == (1 << 64) - 1
+    assert r.get_bits(60, 8) == 0xa5
+
+    # out of range
+    for lsb, width in [(NBITS - 1, 2), (-1, 1), (0, 0), (0, 65)]:
+        with pytest.raises(RuntimeError):
+            r.get_bits(lsb, width)
+        with pytest.raises(RuntimeError):
+            w.set_bits(lsb, width, 0)
+
+    # the width is checked against the existing bank
+    with pytest.raises(RuntimeError):
+        PySbSignalBank(uri, NBITS + 1)
+
+    # unopened banks can't be used
+    with pytest.raises(RuntimeError):
+        PySbSignalBank().read()
+
+
+def writer(uri, values):
+    w = PySbSignalBank(uri, NBITS)
+    for i, value in enumerate(values):
+        w.set_bits(32 * i, 32, value)
+
+
+def test_signal_bank_process(tmp_path):
+    uri = str(tmp_path / 'bank')
+
+    r = PySbSignalBank(uri, NBITS, fresh=True)
+
+    rng = np.random.default_rng(0)
+    values = [int(v) for v in rng.integers(1, 1 << 32, NBITS // 32)]
+
+    p = multiprocessing.Process(target=writer, args=(uri, values))
+    p.start()
+    p.join()
+    assert p.exitcode == 0
+
+    # one generation per write, and the reader catches up in one read
+    assert r.generation() == len(values)
+    assert r.read()
+    for i, value in enumerate(values):
+        assert r.get_bits(32 * i, 32) == value
+
+
+if __name__ == '__main__':
+    import tempfile
+    import pathlib
+    with tempfile.TemporaryDirectory() as d:
+        test_signal_bank(pathlib.Path(d))
+    with tempfile.TemporaryDirectory() as d:
+        test_signal_bank_process(pathlib.Path(d))
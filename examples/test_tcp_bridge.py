@@ -0,0 +1,95 @@
+#!/usr/bin/env python
+
+# Copyright (c) 2024 Zero ASIC Corporation
+# This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+# checks that the Python TCP bridge (sbtcp.py) and the native one (sbtcp.cc)
+# speak the same wire format: 60-byte packets by default, and 64-byte
+# packets carrying sim-time stamps when both ends enable tstamp.
+
+import os
+import itertools
+import subprocess
+import numpy as np
+import pytest
+from switchboard import PySbPacket, PySbTx, PySbRx, delete_queue, start_tcp_bridge
+from switchboard.switchboard import path as sb_path
+
+PACKETS = 100
+
+CASES = [
+    # native_server, native_client, tstamp
+    [True, False, False],
+    [False, True, False],
+    [True, False, True],
+    [False, True, True],
+]
+
+# each case gets its own port, so that it doesn't wait for the previous
+# server's port to be released
+ports = itertools.count(20000 + 4 * (os.getpid() % 10000))
+
+
+def build_sbtcp():
+    subprocess.run(['make', '-C', str(sb_path() / 'cpp'), 'sbtcp'], check=True)
+
+
+@pytest.fixture(scope='module', autouse=True)
+def sbtcp():
+    build_sbtcp()
+
+
+@pytest.mark.parametrize('native_server,native_client,tstamp', CASES)
+def test_tcp_bridge(tmp_path, native_server, native_client, tstamp):
+    in_uri = str(tmp_path / 'bridge-in.q')
+    out_uri = str(tmp_path / 'bridge-out.q')
+    delete_queue(in_uri)
+    delete_queue(out_uri)
+
+    tx = PySbTx(in_uri, fresh=True)
+    rx = PySbRx(out_uri, fresh=True)
+
+    port = next(ports)
+
+    # packets go in.q -> client -> TCP -> server -> out.q
+    server = start_tcp_bridge(outputs=[('*', out_uri)], port=port, native=native_server,
+        tstamp=tstamp)
+    client = start_tcp_bridge(inputs=[in_uri], port=port, native=native_client, tstamp=tstamp)
+
+    try:
+        rng = np.random.default_rng(0)
+        packets = []
+        for i in range(PACKETS):
+            p = PySbPacket(destination=int(rng.integers(0, 1 << 32)), flags=i & 1,
+                data=rng.integers(0, 256, 52, dtype=np.uint8), tstamp=1000 + 7 * i)
+            assert tx.send(p)
+            packets.append(p)
+
+        for expected in packets:
+            p = rx.recv()
+            assert p.destination == expected.destination
+            assert p.flags == expected.flags
+            assert np.array_equal(p.data, expected.data)
+
+            # without tstamp, stamps are dropped at the bridge
+            assert p.tstamp == (expected.tstamp if tstamp else 0)
+    finally:
+        # native bridges are subprocesses, and Python ones multiprocessing
+        # processes
+        for bridge in [client, server]:
+            bridge.terminate()
+            if hasattr(bridge, 'join'):
+                bridge.join()
+            else:
+                bridge.wait()
+
+    assert rx.recv(False) is None
+
+
+if __name__ == '__main__':
+    import tempfile
+    import pathlib
+    build_sbtcp()
+    for args in CASES:
+        with tempfile.TemporaryDirectory() as d:
+            test_tcp_bridge(pathlib.Path(d), *args)
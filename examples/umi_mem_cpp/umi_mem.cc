@@ -1,166 +1,525 @@
-// Fast software model large memory (2 GB), useful for booting Linux
+// Fast software model of a large, sparse memory, useful for booting Linux
 
 // Copyright (c) 2024 Zero ASIC Corporation
 // This code is licensed under Apache License 2.0 (see LICENSE for details)
 
+#include <algorithm>
+#include <atomic>
 #include <cinttypes>
-#include <stdexcept>
+#include <condition_variable>
+#include <csignal>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
 
 #include "switchboard.hpp"
 #include "umilib.h"
 #include "umilib.hpp"
+#include "umimem.hpp"
+#include "umitiming.hpp"
 
-SBTX tx;
-SBRX rx;
+// default address map, used if no regions are given on the command line
+#define SRAM_BASE 0x0
+#define SRAM_BASE_SIZE (1UL << 31) // 2 GB
 
-SBTX req_tx;
-SBRX rep_rx;
+// default number of requests on each port that may be waiting for their
+// responses to be sent
+#define MAX_OUTSTANDING 16
 
-#define SRAM_BASE 0x0
+UmiMemory mem;
 
-#define SRAM_BASE_SIZE (1UL << 31) // 2 GB
-#define MAX_FLIT_BYTES 32
+// timing model.  if enabled, each response is held until its ready cycle,
+// measured either in host time (clock_ns nanoseconds per cycle) or, if
+// clock_stamp is set, in the simulation-time stamps carried by packets.
+// in the latter case, responses are sent right away, stamped with their
+// ready cycle, and the receiver is expected to hold them (replay mode).
+
+UmiTiming timing;
+bool clock_stamp = false;
+double clock_ns = 1.0;
+uint64_t clock_start_ns;
 
-uint8_t* sram;
+uint64_t cycle_now() {
+    return (tsc_monotonic_ns() - clock_start_ns) / clock_ns;
+}
 
-uint8_t zeros[MAX_FLIT_BYTES] = {0};
+// helpers for saving the state of ports in checkpoints
 
-bool in_range(uint64_t addr, size_t bytes, uint64_t base, size_t extent) {
-    return (base <= addr) && (bytes <= extent) && ((addr - base) <= (extent - bytes));
+template <typename T> void save_value(std::string& out, const T& value) {
+    out.append((const char*)&value, sizeof(value));
 }
 
-void init(std::string tx_uri, std::string rx_uri, std::string req_tx_uri, std::string rep_rx_uri) {
-    // initialize queues
-    tx.init(tx_uri);
-    rx.init(rx_uri);
-    req_tx.init(req_tx_uri);
-    rep_rx.init(rep_rx_uri);
+template <typename T> bool load_value(const std::string& in, size_t& pos, T& value) {
+    if (pos + sizeof(value) > in.size()) {
+        return false;
+    }
+    memcpy(&value, &in[pos], sizeof(value));
+    pos += sizeof(value);
+    return true;
 }
 
-int64_t atomic_op(uint64_t dstaddr, uint8_t data_arr[], uint32_t opcode, uint32_t size) {
-    // determine whether this transaction is in cached or uncached memory
-    uint8_t* mem;
-    uint64_t offset;
-    if (in_range(dstaddr, 1 << size, SRAM_BASE, SRAM_BASE_SIZE)) {
-        mem = sram;
-        offset = dstaddr - SRAM_BASE;
-    } else {
-        fprintf(stderr, "***ERROR: dstaddr for atomic_op out of range (0x%" PRIx64 ").\n", dstaddr);
-        return 0;
+// parses a number in any base accepted by strtoull, with an optional
+// K/M/G/T suffix (e.g. "0x80000000" or "64G")
+uint64_t parse_size(std::string s) {
+    char* end;
+    uint64_t value = strtoull(s.c_str(), &end, 0);
+    switch (*end) {
+    case 'T':
+        value <<= 10;
+        // fall through
+    case 'G':
+        value <<= 10;
+        // fall through
+    case 'M':
+        value <<= 10;
+        // fall through
+    case 'K':
+        value <<= 10;
+        break;
+    default:
+        break;
+    }
+    return value;
+}
+
+// a response that is waiting to be sent.  read data is captured when the
+// request is accepted, so that later requests on the same port can't
+// change it; it is sent out in as many packets as needed.
+class response_state {
+  public:
+    SBTX* out_channel;
+
+    uint32_t cmd;
+    uint64_t dstaddr;
+    uint64_t srcaddr;
+
+    bool has_data;
+    uint32_t size;
+    uint32_t sent;
+    std::vector<uint8_t> data;
+
+    // cycle at which the response may be sent, and whether that cycle has
+    // been reached
+    uint64_t ready;
+    bool released;
+
+    // formats the next packet of the response into "p", returning the
+    // number of data bytes it carries
+    uint32_t next(sb_packet& p) {
+        memset(&p, 0, sizeof(p));
+        umi_packet* up = (umi_packet*)p.data;
+
+        up->dstaddr = dstaddr + sent;
+        up->srcaddr = srcaddr + sent;
+
+        if (!has_data) {
+            up->cmd = cmd;
+            return 0;
+        }
+
+        uint32_t flit_bytes = std::min(data.size() - sent, sizeof(up->data));
+        memcpy(up->data, &data[sent], flit_bytes);
+
+        // fill in LEN and EOM.  done in a somewhat verbose manner to avoid
+        // a warning about taking the address of a packed member
+        uint32_t c = cmd;
+        set_umi_len(&c, (flit_bytes >> size) - 1);
+        set_umi_eom(&c, (sent + flit_bytes == data.size()) ? 1 : 0);
+        up->cmd = c;
+
+        return flit_bytes;
+    }
+
+    bool done() {
+        return !has_data || (sent == data.size());
+    }
+};
+
+// responses waiting for their ready cycle, shared by the ports served by
+// one thread
+typedef UmiCalendar<response_state*> response_calendar;
+
+// one request/response port of the memory.  each port has its own pipeline
+// of responses, so it can accept new requests while earlier responses are
+// waiting for their ready cycle or for space in the outbound queue.
+class umi_port {
+  public:
+    umi_port(std::string tx_uri, std::string rx_uri, std::string req_tx_uri,
+        std::string rep_rx_uri, size_t max_outstanding)
+        : m_resp(std::max(max_outstanding, (size_t)1)), m_head(0), m_count(0),
+          m_calendar(NULL) {
+        // initialize queues
+        m_tx.init(tx_uri);
+        m_rx.init(rx_uri);
+        m_req_tx.init(req_tx_uri);
+        m_rep_rx.init(rep_rx_uri);
+
+        if (clock_stamp) {
+            m_rx.set_tstamp(true);
+            m_tx.set_tstamp(true);
+            m_req_tx.set_tstamp(true);
+        }
+    }
+
+    void set_calendar(response_calendar* calendar) {
+        m_calendar = calendar;
+    }
+
+    // appends the responses waiting to be sent, and the port's timing
+    // state, to "out"
+    void save(std::string& out) {
+        save_value(out, m_count);
+        for (size_t i = 0; i < m_count; i++) {
+            response_state& resp = m_resp[(m_head + i) % m_resp.size()];
+            save_value(out, (uint8_t)(resp.out_channel == &m_req_tx));
+            save_value(out, resp.cmd);
+            save_value(out, resp.dstaddr);
+            save_value(out, resp.srcaddr);
+            save_value(out, resp.has_data);
+            save_value(out, resp.size);
+            save_value(out, resp.sent);
+            save_value(out, resp.ready);
+            save_value(out, resp.data.size());
+            out.append((const char*)resp.data.data(), resp.data.size());
+        }
+        save_value(out, m_timing);
+        save_value(out, m_ready);
+    }
+
+    // restores the state saved by save().  in host time, the clock starts
+    // over from zero, so restored responses are released right away.
+    bool load(const std::string& in, size_t& pos) {
+        size_t count;
+        if (!load_value(in, pos, count) || (count > m_resp.size())) {
+            return false;
+        }
+
+        m_head = 0;
+        m_count = 0;
+
+        for (size_t i = 0; i < count; i++) {
+            response_state& resp = m_resp[m_count++];
+            uint8_t rdma;
+            size_t nbytes;
+            if (!load_value(in, pos, rdma) || !load_value(in, pos, resp.cmd) ||
+                !load_value(in, pos, resp.dstaddr) || !load_value(in, pos, resp.srcaddr) ||
+                !load_value(in, pos, resp.has_data) || !load_value(in, pos, resp.size) ||
+                !load_value(in, pos, resp.sent) || !load_value(in, pos, resp.ready) ||
+                !load_value(in, pos, nbytes) || (pos + nbytes > in.size())) {
+                return false;
+            }
+            resp.out_channel = rdma ? &m_req_tx : &m_tx;
+            resp.data.assign(in.begin() + pos, in.begin() + pos + nbytes);
+            resp.released = true;
+            pos += nbytes;
+        }
+
+        if (!load_value(in, pos, m_timing) || !load_value(in, pos, m_ready)) {
+            return false;
+        }
+
+        if (!clock_stamp) {
+            m_timing = UmiTiming::Port();
+            m_ready = 0;
+        }
+
+        return true;
     }
 
-    // format operands as a 64-bit signed integers
-    // the integer is signed so that shorter types
-    // will sign extend, which is needed for MAX and MIN
-    // (for other operations, whether or not there is
-    // sign-extension has no effect)
-    int64_t memval, datval;
-    uint64_t memvalu, datvalu;
-    if (size == 0) {
-        memval = *((int8_t*)(mem + offset));
-        datval = *((int8_t*)(data_arr));
-        memvalu = *((uint8_t*)(mem + offset));
-        datvalu = *((uint8_t*)(data_arr));
-    } else if (size == 1) {
-        memval = *((int16_t*)(mem + offset));
-        datval = *((int16_t*)(data_arr));
-        memvalu = *((uint16_t*)(mem + offset));
-        datvalu = *((uint16_t*)(data_arr));
-    } else if (size == 2) {
-        memval = *((int32_t*)(mem + offset));
-        datval = *((int32_t*)(data_arr));
-        memvalu = *((uint32_t*)(mem + offset));
-        datvalu = *((uint32_t*)(data_arr));
-    } else if (size == 3) {
-        memval = *((int64_t*)(mem + offset));
-        datval = *((int64_t*)(data_arr));
-        memvalu = *((uint64_t*)(mem + offset));
-        datvalu = *((uint64_t*)(data_arr));
-    } else {
-        fprintf(stderr, "***ERROR: size=%u is not supported for atomic operations\n", size);
-        return 0;
+    // accepts whatever requests can be accepted and sends whatever
+    // responses can be sent, returning true if anything happened
+    bool poll() {
+        bool progress = false;
+
+        // a request that needs a response can only be accepted if there is
+        // room for the response in the pipeline, so peek at each request
+        // before accepting it.  the number of requests handled per call is
+        // bounded, so that one busy port can't starve the others served by
+        // the same thread.
+        sb_packet rxp;
+        for (size_t i = 0; (i < m_resp.size()) && m_rx.recv_peek(rxp); i++) {
+            uint32_t opcode = umi_opcode(((umi_packet*)rxp.data)->cmd);
+            if ((opcode != UMI_REQ_POSTED) && (m_count == m_resp.size())) {
+                break;
+            }
+
+            // ACK
+            m_rx.recv();
+            handle((umi_packet*)rxp.data);
+            progress = true;
+        }
+
+        // send out as many responses as possible.  responses become ready
+        // in order, so only the oldest one needs to be checked.
+        while ((m_count > 0) && m_resp[m_head].released) {
+            response_state& resp = m_resp[m_head];
+
+            sb_packet txp;
+            uint32_t flit_bytes = resp.next(txp);
+            bool ok = clock_stamp ? resp.out_channel->send(txp, resp.ready)
+                                  : resp.out_channel->send(txp);
+            if (!ok) {
+                break;
+            }
+
+            resp.sent += flit_bytes;
+            if (resp.done()) {
+                m_head = (m_head + 1) % m_resp.size();
+                m_count--;
+            }
+            progress = true;
+        }
+
+        return progress;
     }
 
-    // perform operation
-    int64_t y;
-    uint64_t u;
-    bool sign = true;
-    if (opcode == UMI_REQ_ATOMICSWAP) {
-        y = datval;
-    } else if (opcode == UMI_REQ_ATOMICADD) {
-        y = memval + datval;
-    } else if (opcode == UMI_REQ_ATOMICAND) {
-        y = memval & datval;
-    } else if (opcode == UMI_REQ_ATOMICOR) {
-        y = memval | datval;
-    } else if (opcode == UMI_REQ_ATOMICXOR) {
-        y = memval ^ datval;
-    } else if (opcode == UMI_REQ_ATOMICMIN) {
-        y = (memval <= datval) ? memval : datval;
-    } else if (opcode == UMI_REQ_ATOMICMAX) {
-        y = (memval >= datval) ? memval : datval;
-    } else if (opcode == UMI_REQ_ATOMICMINU) {
-        sign = false;
-        u = (memvalu <= datvalu) ? memvalu : datvalu;
-    } else if (opcode == UMI_REQ_ATOMICMAXU) {
-        sign = false;
-        u = (memvalu >= datvalu) ? memvalu : datvalu;
-    } else {
-        fprintf(stderr, "***ERROR: opcode=0x%02x is not a valid atomic operation\n", opcode);
+  private:
+    // returns the next free slot in the response pipeline
+    response_state& push(SBTX* out_channel, uint32_t cmd, umi_packet* req, bool has_data,
+        uint32_t size, uint32_t nbytes) {
+
+        response_state& resp = m_resp[(m_head + m_count++) % m_resp.size()];
+        resp.out_channel = out_channel;
+        resp.cmd = cmd;
+        resp.dstaddr = req->srcaddr;
+        resp.srcaddr = req->dstaddr;
+        resp.has_data = has_data;
+        resp.size = size;
+        resp.sent = 0;
+        resp.data.resize(has_data ? nbytes : 0);
+
+        resp.ready = m_ready;
+        resp.released = !timing.enabled() || clock_stamp;
+        if (!resp.released) {
+            m_calendar->push(resp.ready, &resp);
+        }
+
+        return resp;
     }
 
-    // store result to memory address
-    // send old value back as a response
-    if (sign) {
-        memcpy(mem + offset, &y, 1 << size);
-        return memval;
-    } else {
-        memcpy(mem + offset, &u, 1 << size);
-        return memvalu;
+    void handle(umi_packet* urxp) {
+        // remove the upper bits with row/col address
+        uint64_t dstaddr = urxp->dstaddr & 0xffffffffff;
+
+        // extract important fields from the command
+        uint32_t opcode = umi_opcode(urxp->cmd);
+        uint32_t size = umi_size(urxp->cmd);
+        uint32_t len = umi_len(urxp->cmd);
+
+        // calculate the number of bytes in this transaction
+        uint32_t nbytes;
+        if (opcode == UMI_REQ_ATOMIC) {
+            // atomic transaction implies LEN=0
+            nbytes = 1 << size;
+        } else {
+            nbytes = (len + 1) << size;
+        }
+
+        // find out when the access completes.  accesses without a response
+        // still occupy the banks and the port.
+        if (timing.enabled()) {
+            uint64_t now = clock_stamp ? m_rx.last_tstamp() : cycle_now();
+            m_ready = timing.access(m_timing, now, dstaddr, nbytes);
+        }
+
+        // interpret the packet contents
+        if ((opcode == UMI_REQ_POSTED) || (opcode == UMI_REQ_WRITE)) {
+            if (nbytes > sizeof(urxp->data)) {
+                fprintf(stderr,
+                    "***ERROR: Number of bytes in write transaction (%ud)"
+                    " exceeds the data bus width (%zu).\n",
+                    nbytes, sizeof(urxp->data));
+            } else if (!mem.write(dstaddr, urxp->data, nbytes)) {
+                fprintf(stderr,
+                    "***ERROR: Memory write out of range: dstaddr=0x%" PRIx64 ", flit_bytes=%u\n",
+                    dstaddr, nbytes);
+            }
+
+            // send a response if necessary
+            if (opcode == UMI_REQ_WRITE) {
+                uint32_t cmd = umi_pack(UMI_RESP_WRITE, 0, size, len, umi_eom(urxp->cmd),
+                    umi_eof(urxp->cmd), umi_qos(urxp->cmd), umi_prot(urxp->cmd),
+                    umi_ex(urxp->cmd));
+                push(&m_tx, cmd, urxp, false, size, 0);
+            }
+        } else if ((opcode == UMI_REQ_READ) || (opcode == UMI_REQ_RDMA)) {
+            // format the response.  EOM and LEN are filled in as each
+            // response packet is sent.  RDMA responses are posted writes
+            // sent out on the request queue.
+            uint32_t resp_opcode = (opcode == UMI_REQ_READ) ? UMI_RESP_READ : UMI_REQ_POSTED;
+            uint32_t cmd = umi_pack(resp_opcode, 0, size, 0, 0, umi_eof(urxp->cmd),
+                umi_qos(urxp->cmd), umi_prot(urxp->cmd), umi_ex(urxp->cmd));
+
+            response_state& resp = push((opcode == UMI_REQ_READ) ? (&m_tx) : (&m_req_tx), cmd,
+                urxp, true, size, nbytes);
+
+            if (!mem.read(dstaddr, resp.data.data(), nbytes)) {
+                fprintf(stderr,
+                    "***ERROR: Memory read out of range: dstaddr=0x%" PRIx64 ", nbytes=%u\n",
+                    dstaddr, nbytes);
+                std::fill(resp.data.begin(), resp.data.end(), 0);
+            }
+        } else if (opcode == UMI_REQ_ATOMIC) {
+            uint32_t cmd = umi_pack(UMI_RESP_READ, 0, size, 0, 1, umi_eof(urxp->cmd),
+                umi_qos(urxp->cmd), umi_prot(urxp->cmd), umi_ex(urxp->cmd));
+
+            response_state& resp = push(&m_tx, cmd, urxp, true, size, nbytes);
+            std::fill(resp.data.begin(), resp.data.end(), 0);
+
+            // perform the atomic operation, capturing the previous value
+            if (size > 3) {
+                fprintf(stderr, "***ERROR: size=%u is not supported for atomic operations\n",
+                    size);
+            } else if (!mem.atomic(dstaddr, umi_atype(urxp->cmd), size, urxp->data,
+                           resp.data.data())) {
+                fprintf(stderr,
+                    "***ERROR: dstaddr for atomic operation out of range (0x%" PRIx64 ").\n",
+                    dstaddr);
+            }
+        } else {
+            fprintf(stderr, "***ERROR: Unsupported packet received (%s), skipping... \n",
+                umi_opcode_to_str(opcode).c_str());
+        }
     }
+
+    SBTX m_tx;
+    SBRX m_rx;
+    SBTX m_req_tx;
+    SBRX m_rep_rx;
+
+    // circular buffer of responses waiting to be sent, in request order
+    std::vector<response_state> m_resp;
+    size_t m_head;
+    size_t m_count;
+
+    UmiTiming::Port m_timing;
+    uint64_t m_ready = 0;
+    response_calendar* m_calendar;
+};
+
+std::vector<umi_port*> ports;
+size_t num_threads = 0;
+
+// checkpoints are taken on SIGUSR1, and optionally every
+// checkpoint_interval seconds.  the thread serving the first group of ports
+// pauses the others while it writes a checkpoint, so that the memory and
+// the state of the ports are consistent.
+
+std::string checkpoint_prefix;
+double checkpoint_interval = 0;
+int checkpoint_index = 0;
+std::atomic<bool> checkpoint_requested(false);
+
+std::atomic<bool> paused(false);
+std::mutex pause_mutex;
+std::condition_variable pause_cv;
+size_t num_paused = 0;
+
+void request_checkpoint(int) {
+    checkpoint_requested = true;
 }
 
-class response_state {
-  public:
-    bool in_progress;
-    uint32_t read_bytes_remaining;
-    uint64_t read_dstaddr;
-    uint32_t read_size;
-    uint32_t flit_bytes;
+void take_checkpoint() {
+    std::unique_lock<std::mutex> lock(pause_mutex);
+    paused = true;
+    pause_cv.wait(lock, [] { return num_paused == num_threads - 1; });
 
-    SBTX* out_channel;
+    std::string state;
+    for (umi_port* port : ports) {
+        port->save(state);
+    }
+
+    // never overwrite an existing file, which might be the parent of the
+    // checkpoint restored at startup
+    std::string path;
+    do {
+        path = checkpoint_prefix + "." + std::to_string(checkpoint_index++);
+    } while (access(path.c_str(), F_OK) == 0);
+
+    if (mem.checkpoint(path, state)) {
+        fprintf(stderr, "umi_mem: wrote checkpoint %s\n", path.c_str());
+    }
+
+    paused = false;
+    lock.unlock();
+    pause_cv.notify_all();
+}
+
+void wait_while_paused() {
+    std::unique_lock<std::mutex> lock(pause_mutex);
+    num_paused++;
+    pause_cv.notify_all();
+    pause_cv.wait(lock, [] { return !paused; });
+    num_paused--;
+}
+
+// serves a subset of the ports.  every port is owned by exactly one thread,
+// so the ports themselves need no locking; only the memory (and the banks
+// of the timing model) are shared.
+void serve(std::vector<umi_port*> group, bool coordinator) {
+    response_calendar calendar;
+    for (umi_port* port : group) {
+        port->set_calendar(&calendar);
+    }
+
+    uint64_t next_checkpoint_ns = tsc_monotonic_ns() + checkpoint_interval * 1e9;
+
+    while (1) {
+        bool progress = false;
 
-    response_state() : in_progress(false), read_bytes_remaining(0) {}
+        if (coordinator && (checkpoint_prefix != "")) {
+            if ((checkpoint_interval > 0) && (tsc_monotonic_ns() >= next_checkpoint_ns)) {
+                checkpoint_requested = true;
+                next_checkpoint_ns = tsc_monotonic_ns() + checkpoint_interval * 1e9;
+            }
+            if (checkpoint_requested.exchange(false)) {
+                take_checkpoint();
+            }
+        } else if (paused) {
+            wait_while_paused();
+        }
+
+        // release responses that have reached their ready cycle
+        if (calendar.size() > 0) {
+            uint64_t now = cycle_now();
+            response_state* resp;
+            while (calendar.pop(now, resp)) {
+                resp->released = true;
+                progress = true;
+            }
+        }
 
-    void done(umi_packet* utxp) {
-        if (read_bytes_remaining) {
-            read_bytes_remaining -= flit_bytes;
-            utxp->srcaddr += flit_bytes;
-            utxp->dstaddr += flit_bytes;
-            read_dstaddr += flit_bytes;
+        for (umi_port* port : group) {
+            progress |= port->poll();
+        }
+        if (!progress) {
+            std::this_thread::yield();
         }
-        in_progress = false;
     }
-} resp;
+}
 
 int main(int argc, char* argv[]) {
     // process command-line arguments
 
     int arg_idx = 1;
 
-    sram = new uint8_t[SRAM_BASE_SIZE];
-    if (!sram) {
-        // have to error out at this point, since we can't
-        // model a memory without, well, memory...
-        throw std::runtime_error("Unable to allocate memory!");
-    }
-
     std::string req_rx_uri = "mem-req-rx.q";
     std::string rep_tx_uri = "mem-rep-tx.q";
 
     std::string req_tx_uri = "mem-req-tx.q";
     std::string rep_rx_uri = "mem-rep-rx.q";
 
+    std::vector<std::string> port_specs;
+    std::vector<std::string> regions;
+    std::vector<std::string> images;
+
+    size_t max_outstanding = MAX_OUTSTANDING;
+    std::string restore_path;
+
+    UmiTimingConfig timing_config;
+
     while (arg_idx < argc) {
         char* s = argv[arg_idx++];
         if (strcmp(s, "--rep-tx") == 0) {
@@ -179,203 +538,208 @@ int main(int argc, char* argv[]) {
             if (arg_idx < argc) {
                 rep_rx_uri = std::string(argv[arg_idx++]);
             }
+        } else if (strcmp(s, "--port") == 0) {
+            // REQ_RX,REP_TX[,REQ_TX,REP_RX].  if any ports are given this
+            // way, they replace the single port set up by the options above.
+            if (arg_idx < argc) {
+                port_specs.push_back(std::string(argv[arg_idx++]));
+            }
+        } else if (strcmp(s, "--threads") == 0) {
+            if (arg_idx < argc) {
+                num_threads = atoi(argv[arg_idx++]);
+            }
+        } else if (strcmp(s, "--max-outstanding") == 0) {
+            if (arg_idx < argc) {
+                max_outstanding = atoi(argv[arg_idx++]);
+            }
+        } else if (strcmp(s, "--latency") == 0) {
+            // fixed number of cycles added to every access
+            if (arg_idx < argc) {
+                timing_config.latency = parse_size(argv[arg_idx++]);
+            }
+        } else if (strcmp(s, "--banks") == 0) {
+            // BANKS:ROW_BYTES:ROW_HIT:ROW_MISS, e.g. 16:2K:14:42
+            if (arg_idx < argc) {
+                std::string spec = argv[arg_idx++];
+                std::vector<uint64_t> values;
+                size_t start = 0;
+                while (true) {
+                    size_t sep = spec.find(':', start);
+                    values.push_back(parse_size(spec.substr(start, sep - start)));
+                    if (sep == std::string::npos) {
+                        break;
+                    }
+                    start = sep + 1;
+                }
+                if (values.size() != 4) {
+                    fprintf(stderr, "***ERROR: invalid bank spec \"%s\"\n", spec.c_str());
+                    return 1;
+                }
+                timing_config.banks = values[0];
+                timing_config.row_bytes = values[1];
+                timing_config.row_hit = values[2];
+                timing_config.row_miss = values[3];
+            }
+        } else if (strcmp(s, "--bandwidth") == 0) {
+            // bytes per cycle, per port
+            if (arg_idx < argc) {
+                timing_config.bytes_per_cycle = atof(argv[arg_idx++]);
+            }
+        } else if (strcmp(s, "--clock") == 0) {
+            // "stamp" to use the simulation-time stamps of packets, or
+            // the number of nanoseconds of host time per cycle
+            if (arg_idx < argc) {
+                char* clock = argv[arg_idx++];
+                if (strcmp(clock, "stamp") == 0) {
+                    clock_stamp = true;
+                } else {
+                    clock_ns = atof(clock);
+                    if (!(clock_ns > 0)) {
+                        fprintf(stderr, "***ERROR: invalid clock \"%s\"\n", clock);
+                        return 1;
+                    }
+                }
+            }
+        } else if (strcmp(s, "--checkpoint") == 0) {
+            // checkpoints are written to PREFIX.0, PREFIX.1, ...  the first
+            // holds all of the memory, and later ones only what changed.
+            if (arg_idx < argc) {
+                checkpoint_prefix = std::string(argv[arg_idx++]);
+            }
+        } else if (strcmp(s, "--checkpoint-interval") == 0) {
+            // seconds between checkpoints, in addition to SIGUSR1
+            if (arg_idx < argc) {
+                checkpoint_interval = atof(argv[arg_idx++]);
+            }
+        } else if (strcmp(s, "--restore") == 0) {
+            // replaces anything loaded with --load
+            if (arg_idx < argc) {
+                restore_path = std::string(argv[arg_idx++]);
+            }
+        } else if (strcmp(s, "--region") == 0) {
+            // BASE:SIZE[:NAME], e.g. 0x80000000:64G:dram
+            if (arg_idx < argc) {
+                regions.push_back(std::string(argv[arg_idx++]));
+            }
+        } else if (strcmp(s, "--load") == 0) {
+            // FILE[@ADDR]; ELF files are loaded at their physical addresses
+            if (arg_idx < argc) {
+                images.push_back(std::string(argv[arg_idx++]));
+            }
         } else {
             fprintf(stderr, "***ERROR: invalid argument, ignoring...\n");
         }
     }
 
-    // set up UMI ports
+    // set up the address map.  memory is only allocated as it is touched,
+    // so regions can be much larger than the host's memory.
 
-    init(rep_tx_uri, req_rx_uri, req_tx_uri, rep_rx_uri);
+    if (regions.empty() && !mem.add_region(SRAM_BASE, SRAM_BASE_SIZE, "sram")) {
+        return 1;
+    }
 
-    // response packet
+    for (const std::string& region : regions) {
+        size_t sep = region.find(':');
+        size_t sep2 = region.find(':', sep + 1);
+        if ((sep == std::string::npos) ||
+            !mem.add_region(parse_size(region.substr(0, sep)),
+                parse_size(region.substr(sep + 1, sep2 - sep - 1)),
+                (sep2 == std::string::npos) ? "" : region.substr(sep2 + 1))) {
+            fprintf(stderr, "***ERROR: invalid region \"%s\"\n", region.c_str());
+            return 1;
+        }
+    }
 
-    sb_packet txp;
-    umi_packet* utxp = (umi_packet*)txp.data;
+    for (const std::string& image : images) {
+        size_t sep = image.rfind('@');
+        std::string path = image.substr(0, sep);
+        uint64_t addr = (sep == std::string::npos) ? 0 : parse_size(image.substr(sep + 1));
+        if (!mem.load_image(path, addr)) {
+            fprintf(stderr, "***ERROR: unable to load \"%s\"\n", image.c_str());
+            return 1;
+        }
+    }
 
-    // response state
-    response_state resp;
+    timing.configure(timing_config);
+    clock_start_ns = tsc_monotonic_ns();
 
-    while (1) {
-        // try to receive a packet
+    // set up UMI ports
 
-        sb_packet rxp;
+    if (port_specs.empty()) {
+        ports.push_back(new umi_port(rep_tx_uri, req_rx_uri, req_tx_uri, rep_rx_uri,
+            max_outstanding));
+    }
 
-        if (rx.recv_peek(rxp)) {
-            // interpret the received SB packet as a UMI packet
-            umi_packet* urxp = (umi_packet*)rxp.data;
-
-            // remove the upper bits with row/col address
-            uint64_t dstaddr = urxp->dstaddr & 0xffffffffff;
-
-            // extract important fields from the command
-            uint32_t opcode = umi_opcode(urxp->cmd);
-            uint32_t size = umi_size(urxp->cmd);
-            uint32_t len = umi_len(urxp->cmd);
-
-            // calculate the number of bytes in this transaction
-            uint32_t nbytes;
-            if (opcode == UMI_REQ_ATOMIC) {
-                // atomic transaction implies LEN=0
-                nbytes = 1 << size;
-            } else {
-                nbytes = (len + 1) << size;
+    for (const std::string& spec : port_specs) {
+        std::vector<std::string> uris;
+        size_t start = 0;
+        while (true) {
+            size_t sep = spec.find(',', start);
+            uris.push_back(spec.substr(start, sep - start));
+            if (sep == std::string::npos) {
+                break;
             }
+            start = sep + 1;
+        }
 
-            // interpret the packet contents
-            if ((opcode == UMI_REQ_POSTED) || ((opcode == UMI_REQ_WRITE) && (!resp.in_progress))) {
-                // ACK
-                rx.recv();
-
-                if (!in_range(dstaddr, nbytes, SRAM_BASE, SRAM_BASE_SIZE)) {
-                    fprintf(stderr,
-                        "***ERROR: Memory write out of range: dstaddr=0x%" PRIx64
-                        ", flit_bytes=%u\n",
-                        dstaddr, nbytes);
-                } else if (nbytes > sizeof(urxp->data)) {
-                    fprintf(stderr,
-                        "***ERROR: Number of bytes in write transaction (%ud)"
-                        " exceeds the data bus width (%zu).\n",
-                        nbytes, sizeof(urxp->data));
-                } else {
-                    memcpy(&sram[dstaddr - SRAM_BASE], urxp->data, nbytes);
-                }
-
-                // send a response if necessary
-                if (opcode == UMI_REQ_WRITE) {
-                    // format the response
-                    utxp->cmd = umi_pack(UMI_RESP_WRITE, 0, size, len, umi_eom(urxp->cmd),
-                        umi_eof(urxp->cmd), umi_qos(urxp->cmd), umi_prot(urxp->cmd),
-                        umi_ex(urxp->cmd));
-                    utxp->dstaddr = urxp->srcaddr;
-                    utxp->srcaddr = urxp->dstaddr;
-
-                    // try to send the response
-                    if (!tx.send(txp)) {
-                        // if sending the response failed, indicate that there
-                        // is a response in progress
-                        resp.in_progress = true;
-                        resp.out_channel = &tx;
-                    }
-                }
-            } else if (((opcode == UMI_REQ_READ) || (opcode == UMI_REQ_RDMA)) &&
-                       (!resp.in_progress)) {
-
-                // ACK
-                rx.recv();
-
-                // format the response.  EOM, LEN, and DATA are filled in
-                // later in the code, and dstaddr/srcaddr are updated as
-                // each response packet is sent
-
-                uint32_t resp_opcode = (opcode == UMI_REQ_READ) ? UMI_RESP_READ : UMI_REQ_POSTED;
-
-                utxp->cmd = umi_pack(resp_opcode, 0, size, 0, 0, umi_eof(urxp->cmd),
-                    umi_qos(urxp->cmd), umi_prot(urxp->cmd), umi_ex(urxp->cmd));
-                utxp->dstaddr = urxp->srcaddr;
-                utxp->srcaddr = urxp->dstaddr;
-
-                // save parameters describing the read
-                resp.read_bytes_remaining = nbytes;
-                resp.read_dstaddr = dstaddr;
-                resp.read_size = size;
-                resp.out_channel = (opcode == UMI_REQ_READ) ? (&tx) : (&req_tx);
-            } else if ((opcode == UMI_REQ_ATOMIC) && (!resp.in_progress)) {
-                // ACK
-                rx.recv();
-
-                // perform the atomic operation
-                int64_t result = atomic_op(dstaddr, urxp->data, umi_atype(urxp->cmd), size);
-
-                // copy result into the response packet
-                if (nbytes > sizeof(utxp->data)) {
-                    fprintf(stderr,
-                        "***ERROR: Number of bytes in atomic transaction (%u)"
-                        " exceeds UMI packet data width (%zu bytes)",
-                        nbytes, sizeof(utxp->data));
-                } else if (nbytes > sizeof(result)) {
-                    fprintf(stderr,
-                        "***ERROR: Number of bytes in atomic transaction (%u)"
-                        " exceeds size of the result (%zu bytes)",
-                        nbytes, sizeof(result));
-                } else {
-                    memcpy(utxp->data, &result, nbytes);
-                }
-
-                // format the response
-                utxp->cmd = umi_pack(UMI_RESP_READ, 0, size, 0, 1, umi_eof(urxp->cmd),
-                    umi_qos(urxp->cmd), umi_prot(urxp->cmd), umi_ex(urxp->cmd));
-                utxp->dstaddr = urxp->srcaddr;
-                utxp->srcaddr = urxp->dstaddr;
-
-                // try to send the response
-                if (!tx.send(txp)) {
-                    // if sending the response fails, indicate that
-                    // a packet transmission is in progress
-                    resp.in_progress = true;
-                    resp.out_channel = &tx;
-                }
-            } else if (!resp.in_progress) {
-                // ACK
-                rx.recv();
-                fprintf(stderr, "***ERROR: Unsupported packet received (%s), skipping... \n",
-                    umi_opcode_to_str(opcode).c_str());
-            }
+        if ((uris.size() != 2) && (uris.size() != 4)) {
+            fprintf(stderr, "***ERROR: invalid port \"%s\"\n", spec.c_str());
+            return 1;
         }
 
-        // if there's an outbound packet stuck, try to send it out
-        if (resp.in_progress) {
-            if (resp.out_channel->send(txp)) {
-                resp.done(utxp);
-            }
+        // RDMA queues default to names derived from the request queue
+        if (uris.size() == 2) {
+            uris.push_back(uris[0] + "-rdma-req.q");
+            uris.push_back(uris[0] + "-rdma-rep.q");
         }
 
-        // try to complete a read if there is one in progress
-        // note that this loop cannot run if there is an outbound
-        // packet stuck, since it modifies utxp
-        while ((!resp.in_progress) && (resp.read_bytes_remaining > 0)) {
-            // calculate number of bytes in the next read response
-            resp.flit_bytes = std::min(resp.read_bytes_remaining, (uint32_t)sizeof(utxp->data));
-
-            // fill in fields of the UMI command.  done in a
-            // somewhat verbose manner to avoid a warning about
-            // taking addresses of a packed member in a structure
-            uint32_t cmd = utxp->cmd;
-
-            // fill in the LEN field.  done in a somewhat verbose
-            // manner to avoid a warning about taking the address
-            // of a packed member in a structure
-            uint32_t len = (resp.flit_bytes >> resp.read_size) - 1;
-            set_umi_len(&cmd, len);
-
-            // fill in the EOM field, same comment about the
-            // verbose style.
-            uint32_t eom = (resp.flit_bytes == resp.read_bytes_remaining) ? 1 : 0;
-            set_umi_eom(&cmd, eom);
-
-            // commit changes to the UMI command
-            utxp->cmd = cmd;
-
-            // copy read data into the response packet
-            if (in_range(resp.read_dstaddr, resp.flit_bytes, SRAM_BASE, SRAM_BASE_SIZE)) {
-                memcpy(utxp->data, sram + (resp.read_dstaddr - SRAM_BASE), resp.flit_bytes);
-            } else {
-                fprintf(stderr,
-                    "***ERROR: Memory read out of range: resp_dstaddr=0x%" PRIx64 ", flit_bytes=%u",
-                    resp.read_dstaddr, resp.flit_bytes);
-            }
+        ports.push_back(new umi_port(uris[1], uris[0], uris[2], uris[3], max_outstanding));
+    }
 
-            // try to send the response packet
-            if (resp.out_channel->send(txp)) {
-                // if that succeeds, update the state of the read transaction
-                resp.done(utxp);
-            } else {
-                // otherwise indicate that we need to retry sending this packet
-                resp.in_progress = true;
-            }
+    // restore memory and port state from a checkpoint, which must have
+    // been written with the same address map and ports
+
+    if (restore_path != "") {
+        std::string state;
+        size_t pos = 0;
+        if (!mem.restore(restore_path, &state)) {
+            return 1;
+        }
+        bool ok = true;
+        for (umi_port* port : ports) {
+            ok = ok && port->load(state, pos);
         }
+        if (!ok || (pos != state.size())) {
+            fprintf(stderr, "***ERROR: %s was written with different ports\n",
+                restore_path.c_str());
+            return 1;
+        }
+        fprintf(stderr, "umi_mem: restored checkpoint %s\n", restore_path.c_str());
+    }
+
+    if (checkpoint_prefix != "") {
+        signal(SIGUSR1, request_checkpoint);
+    }
+
+    // spread the ports across worker threads round-robin.  by default,
+    // there is one thread per port, up to the number of CPUs.
+
+    if (num_threads == 0) {
+        num_threads = std::max(std::thread::hardware_concurrency(), 1u);
     }
+    num_threads = std::min(num_threads, ports.size());
+
+    std::vector<std::vector<umi_port*>> assignment(num_threads);
+    for (size_t i = 0; i < ports.size(); i++) {
+        assignment[i % num_threads].push_back(ports[i]);
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < num_threads; i++) {
+        workers.push_back(std::thread(serve, assignment[i], false));
+    }
+
+    serve(assignment[0], true);
 
-    delete[] sram;
     return 0;
 }
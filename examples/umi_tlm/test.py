@@ -0,0 +1,27 @@
+#!/usr/bin/env python3
+
+# Runs the SystemC example in umi_tlm.cc against the umi_mem model from the
+# umi_mem_cpp example
+
+# Copyright (c) 2024 Zero ASIC Corporation
+# This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+import sys
+from pathlib import Path
+from switchboard import binary_run, delete_queue
+
+THIS_DIR = Path(__file__).resolve().parent
+
+
+def main():
+    for q in ['mem-req.q', 'mem-resp.q', 'loop-req.q', 'loop-resp.q']:
+        delete_queue(q)
+
+    # umi_mem is stopped automatically when this script exits
+    binary_run(THIS_DIR.parent / 'umi_mem_cpp' / 'umi_mem', ['--port', 'mem-req.q,mem-resp.q'])
+
+    sys.exit(binary_run(THIS_DIR / 'umi_tlm').wait())
+
+
+if __name__ == '__main__':
+    main()
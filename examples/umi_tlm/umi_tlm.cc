@@ -0,0 +1,264 @@
+// SystemC example: TLM transactions are sent to a UMI memory through
+// sb_tlm_target, and to a TLM memory through a UMI loopback made of
+// sb_tlm_target and sb_tlm_initiator
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "umisb_tlm.hpp"
+
+static int running_testers = 0;
+
+// plain TLM memory at the far end of the loopback.  it only implements
+// b_transport(), so the socket converts non-blocking calls to blocking ones.
+class tlm_memory : public sc_core::sc_module {
+  public:
+    tlm_utils::simple_target_socket<tlm_memory> socket;
+
+    tlm_memory(sc_core::sc_module_name name, size_t size)
+        : sc_core::sc_module(name), socket("socket"), m_mem(size, 0) {
+
+        socket.register_b_transport(this, &tlm_memory::b_transport);
+    }
+
+  private:
+    void b_transport(tlm::tlm_generic_payload& tr, sc_core::sc_time& delay) {
+        uint64_t addr = tr.get_address();
+        uint8_t* data = tr.get_data_ptr();
+        unsigned int len = tr.get_data_length();
+
+        if (addr + len > m_mem.size()) {
+            tr.set_response_status(tlm::TLM_ADDRESS_ERROR_RESPONSE);
+            return;
+        }
+
+        // sb_tlm_initiator never sets byte enables
+        if (tr.get_byte_enable_ptr()) {
+            tr.set_response_status(tlm::TLM_BYTE_ENABLE_ERROR_RESPONSE);
+            return;
+        }
+
+        if (tr.is_write()) {
+            memcpy(&m_mem[addr], data, len);
+        } else if (tr.is_read()) {
+            memcpy(data, &m_mem[addr], len);
+        }
+
+        delay += sc_core::sc_time(10, sc_core::SC_NS);
+        tr.set_response_status(tlm::TLM_OK_RESPONSE);
+    }
+
+    std::vector<uint8_t> m_mem;
+};
+
+// runs bursts and byte-enabled reads and writes through its socket, with
+// both the blocking and the non-blocking transport interfaces
+class tester : public sc_core::sc_module {
+  public:
+    tlm_utils::simple_initiator_socket<tester> socket;
+
+    bool passed;
+
+    SC_HAS_PROCESS(tester);
+
+    tester(sc_core::sc_module_name name, uint64_t base)
+        : sc_core::sc_module(name), socket("socket"), passed(false), m_base(base),
+          m_resp_done(false) {
+
+        socket.register_nb_transport_bw(this, &tester::nb_transport_bw);
+
+        SC_THREAD(run);
+    }
+
+  private:
+    void run(void) {
+        passed = burst(false) && burst(true) && byte_enables(false) && byte_enables(true);
+
+        printf("%s: %s\n", name(), passed ? "ok" : "FAILED");
+
+        // the bridges poll their queues forever, so the last tester to
+        // finish ends the simulation
+        if (--running_testers == 0) {
+            sc_core::sc_stop();
+        }
+    }
+
+    // a burst that isn't aligned to the UMI packets that it is split into
+    bool burst(bool nonblocking) {
+        uint64_t addr = m_base + (nonblocking ? 0x1000 : 0x0) + 3;
+        std::vector<uint8_t> wr(100);
+        std::vector<uint8_t> rd(100, 0);
+
+        for (size_t i = 0; i < wr.size(); i++) {
+            wr[i] = 7 * i + nonblocking;
+        }
+
+        if (!transport(tlm::TLM_WRITE_COMMAND, addr, wr.data(), wr.size(), NULL, 0,
+                nonblocking) ||
+            !transport(tlm::TLM_READ_COMMAND, addr, rd.data(), rd.size(), NULL, 0, nonblocking)) {
+            fprintf(stderr, "%s: burst failed\n", name());
+            return false;
+        }
+
+        if (rd != wr) {
+            fprintf(stderr, "%s: burst read back the wrong data\n", name());
+            return false;
+        }
+
+        return true;
+    }
+
+    // writes pairs of bytes over a known pattern, and reads them back with
+    // a different set of byte enables.  both byte enable arrays are shorter
+    // than the data, so they repeat.
+    bool byte_enables(bool nonblocking) {
+        const uint8_t E = tlm::TLM_BYTE_ENABLED;
+        const uint8_t D = tlm::TLM_BYTE_DISABLED;
+
+        uint64_t addr = m_base + (nonblocking ? 0x2100 : 0x2000);
+        uint8_t wr_be[] = {E, E, D, D};
+        uint8_t rd_be[] = {E, D, E};
+
+        std::vector<uint8_t> init(64, 0xaa);
+        std::vector<uint8_t> wr(64);
+        std::vector<uint8_t> rd(64, 0x55);
+        std::vector<uint8_t> expected(64);
+
+        for (size_t i = 0; i < wr.size(); i++) {
+            wr[i] = i;
+            if (rd_be[i % sizeof(rd_be)] != E) {
+                expected[i] = 0x55;
+            } else if (wr_be[i % sizeof(wr_be)] == E) {
+                expected[i] = wr[i];
+            } else {
+                expected[i] = 0xaa;
+            }
+        }
+
+        if (!transport(tlm::TLM_WRITE_COMMAND, addr, init.data(), init.size(), NULL, 0,
+                nonblocking) ||
+            !transport(tlm::TLM_WRITE_COMMAND, addr, wr.data(), wr.size(), wr_be, sizeof(wr_be),
+                nonblocking) ||
+            !transport(tlm::TLM_READ_COMMAND, addr, rd.data(), rd.size(), rd_be, sizeof(rd_be),
+                nonblocking)) {
+            fprintf(stderr, "%s: byte-enabled transfer failed\n", name());
+            return false;
+        }
+
+        if (rd != expected) {
+            fprintf(stderr, "%s: byte-enabled read back the wrong data\n", name());
+            return false;
+        }
+
+        return true;
+    }
+
+    bool transport(tlm::tlm_command cmd, uint64_t addr, uint8_t* data, unsigned int len,
+        uint8_t* be, unsigned int be_len, bool nonblocking) {
+
+        // sb_tlm_target holds on to non-blocking transactions, so they need
+        // a memory manager
+        tlm::tlm_generic_payload* tr = m_mm.allocate();
+        tr->acquire();
+
+        tr->set_command(cmd);
+        tr->set_address(addr);
+        tr->set_data_ptr(data);
+        tr->set_data_length(len);
+        tr->set_streaming_width(len);
+        tr->set_byte_enable_ptr(be);
+        tr->set_byte_enable_length(be_len);
+        tr->set_dmi_allowed(false);
+        tr->set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+
+        sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+        if (nonblocking) {
+            nb_transport(*tr, delay);
+        } else {
+            socket->b_transport(*tr, delay);
+        }
+        wait(delay);
+
+        bool ok = tr->is_response_ok();
+        if (!ok) {
+            fprintf(stderr, "%s: %s\n", name(), tr->get_response_string().c_str());
+        }
+
+        tr->release();
+        return ok;
+    }
+
+    // BEGIN_REQ, then BEGIN_RESP on the backward path, which is accepted
+    // and ended later with END_RESP, so that all four phases are used
+    void nb_transport(tlm::tlm_generic_payload& tr, sc_core::sc_time& delay) {
+        tlm::tlm_phase phase = tlm::BEGIN_REQ;
+        m_resp_done = false;
+
+        tlm::tlm_sync_enum status = socket->nb_transport_fw(tr, phase, delay);
+        if (status == tlm::TLM_COMPLETED) {
+            return;
+        }
+
+        if ((status != tlm::TLM_UPDATED) || (phase != tlm::BEGIN_RESP)) {
+            wait(delay);
+            delay = sc_core::SC_ZERO_TIME;
+            while (!m_resp_done) {
+                wait(m_resp_event);
+            }
+        }
+
+        phase = tlm::END_RESP;
+        socket->nb_transport_fw(tr, phase, delay);
+    }
+
+    tlm::tlm_sync_enum nb_transport_bw(tlm::tlm_generic_payload&, tlm::tlm_phase& phase,
+        sc_core::sc_time& delay) {
+
+        if (phase == tlm::BEGIN_RESP) {
+            m_resp_done = true;
+            m_resp_event.notify(delay);
+        }
+
+        return tlm::TLM_ACCEPTED;
+    }
+
+    uint64_t m_base;
+
+    sb_tlm_mm m_mm;
+
+    bool m_resp_done;
+    sc_core::sc_event m_resp_event;
+};
+
+int sc_main(int, char*[]) {
+    // TLM -> UMI -> umi_mem (run separately, see test.py)
+    tester mem_tester("mem_tester", 0x10000);
+    sb_tlm_target mem("mem", "mem-req.q", "mem-resp.q");
+    mem_tester.socket.bind(mem.socket);
+
+    // TLM -> UMI -> TLM, with posted writes on the way, and non-blocking
+    // transport on the way out
+    tester loop_tester("loop_tester", 0x0);
+    sb_tlm_target loop("loop", "loop-req.q", "loop-resp.q");
+    sb_tlm_initiator bridge("bridge", "loop-req.q", "loop-resp.q");
+    tlm_memory ram("ram", 0x4000);
+    loop_tester.socket.bind(loop.socket);
+    bridge.socket.bind(ram.socket);
+    loop.set_posted_writes(true);
+    bridge.set_nonblocking(true);
+
+    running_testers = 2;
+    sc_core::sc_start();
+
+    if (!mem_tester.passed || !loop_tester.passed) {
+        printf("FAIL\n");
+        return 1;
+    }
+
+    printf("PASS!\n");
+    return 0;
+}
@@ -7,21 +7,25 @@
 #include <exception>
 #include <iostream>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <stdexcept>
 #include <stdio.h>
+#include <thread>
 
 #include <pybind11/numpy.h>
 #include <pybind11/operators.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
 
+#include "axisb.hpp"
 #include "bitutil.h"
 #include "bytesobject.h"
 #include "object.h"
 #include "pybind11/buffer_info.h"
 #include "pybind11/detail/common.h"
 #include "pybind11/pytypes.h"
+#include "signal_bank.h"
 #include "switchboard.hpp"
 #include "switchboard_pcie.hpp"
 #include "umilib.h"
@@ -47,8 +51,8 @@ struct PySbPacket {
     // initialization
 
     PySbPacket(uint32_t destination = 0, uint32_t flags = 0,
-        std::optional<py::array_t<uint8_t>> data = std::nullopt)
-        : destination(destination), flags(flags) {
+        std::optional<py::array_t<uint8_t>> data = std::nullopt, uint64_t tstamp = 0)
+        : destination(destination), flags(flags), tstamp(tstamp) {
         if (data.has_value()) {
             this->data = data.value();
         } else {
@@ -67,8 +71,25 @@ struct PySbPacket {
     uint32_t destination;
     uint32_t flags;
     py::array_t<uint8_t> data;
+    // sim-time stamp (see sb_packet_ts), passed on by forwarding scripts
+    uint64_t tstamp;
 };
 
+// PySbPacketRecord: element type of the structured numpy arrays used to
+// send and receive many packets in one call.  Its layout matches sb_packet,
+// so packets are copied directly between queue slots and the array.
+
+struct PySbPacketRecord {
+    uint32_t destination;
+    uint32_t flags;
+    uint8_t data[SB_DATA_SIZE];
+};
+
+static_assert(sizeof(PySbPacketRecord) == sizeof(sb_packet),
+    "PySbPacketRecord must have the same layout as sb_packet");
+
+typedef py::array_t<PySbPacketRecord, py::array::c_style | py::array::forcecast> PySbPacketArray;
+
 // functions for allocating and accessing the pointer to pybind arrays
 
 py::array alloc_pybind_array(int num, size_t bytes_per_elem = 1) {
@@ -315,6 +336,58 @@ void check_signals() {
     }
 }
 
+// PyWait releases the GIL while a blocking call spins on a queue, so that
+// Python threads driving other queues can make progress in the meantime.
+// poll() should be called once per iteration of the wait loop: it yields
+// the CPU when no progress was made, and takes the GIL back every
+// PY_SIGNAL_CHECK_NS to run check_signals().  code between construction
+// and destruction must not touch Python objects.
+
+#define PY_SIGNAL_CHECK_NS 10000000
+
+class PyWait {
+  public:
+    PyWait() : m_next_check(tsc_monotonic_ns() + PY_SIGNAL_CHECK_NS) {}
+
+    void poll(bool progress = false) {
+        if (!progress) {
+            std::this_thread::yield();
+        }
+
+        uint64_t now = tsc_monotonic_ns();
+        if (now >= m_next_check) {
+            py::gil_scoped_acquire acquire;
+            check_signals();
+            m_next_check = now + PY_SIGNAL_CHECK_NS;
+        }
+    }
+
+  private:
+    py::gil_scoped_release m_release;
+    uint64_t m_next_check;
+};
+
+// PyLock serializes the calls made on one queue object.  the GIL used to
+// do this implicitly, but since blocking calls release it while they wait
+// (see PyWait), two Python threads sharing a PySbTx, PySbRx, PyUmi or PyAxi
+// could otherwise drive the same single-producer / single-consumer queue at
+// once.  the lock is taken before any PyWait is created, and if it's busy,
+// the GIL is released while waiting for it, since the thread holding the
+// lock may need the GIL to finish.
+
+class PyLock {
+  public:
+    PyLock(std::mutex& mutex) : m_lock(mutex, std::try_to_lock) {
+        if (!m_lock.owns_lock()) {
+            py::gil_scoped_release release;
+            m_lock.lock();
+        }
+    }
+
+  private:
+    std::unique_lock<std::mutex> m_lock;
+};
+
 // PySbTxPcie / PySbRxPcie: these objects must be created to initialize Switchboard
 // queues that are accessed over PCIe.  Care must be taken to ensure that they
 // don't go out of scope, since that will invoke destructors that deinitialize
@@ -367,6 +440,7 @@ class PySbTx {
     }
 
     void init(std::string uri, bool fresh = false, double max_rate = -1) {
+        PyLock lock(m_mutex);
         if (uri != "") {
             m_tx.init(uri, 0, fresh, max_rate);
         }
@@ -402,19 +476,61 @@ class PySbTx {
         // try to send the packet once or multiple times depending
         // on the "blocking" argument
 
+        PyLock lock(m_mutex);
+
+        uint64_t tstamp = py_packet.tstamp;
+
         if (!blocking) {
-            return m_tx.send(p);
-        } else {
-            while (!m_tx.send(p)) {
-                check_signals();
+            return m_tx.send(p, tstamp);
+        } else if (!m_tx.send(p, tstamp)) {
+            PyWait wait;
+            while (!m_tx.send(p, tstamp)) {
+                wait.poll();
             }
+        }
 
-            return true;
+        return true;
+    }
+
+    size_t send_array(PySbPacketArray packets, bool blocking = true) {
+        // sends the packets in a structured array (see sb_packet_dtype) in
+        // order.  if blocking=true (default), all of them are sent;
+        // otherwise, as many as fit in the queue right now.  returns the
+        // number of packets sent.
+
+        if (packets.ndim() != 1) {
+            throw std::runtime_error("send_array expects a one-dimensional array.");
         }
+
+        const PySbPacketRecord* ptr = packets.data();
+        size_t num = packets.shape(0);
+        size_t i = 0;
+
+        PyLock lock(m_mutex);
+
+        while ((i < num) && m_tx.send(*(sb_packet*)&ptr[i])) {
+            i++;
+        }
+
+        if ((i < num) && blocking) {
+            // "packets" is kept alive by the caller, so its buffer can be
+            // read without holding the GIL
+            PyWait wait;
+            while (i < num) {
+                bool sent = m_tx.send(*(sb_packet*)&ptr[i]);
+                if (sent) {
+                    i++;
+                }
+                wait.poll(sent);
+            }
+        }
+
+        return i;
     }
 
   private:
     SBTX m_tx;
+    std::mutex m_mutex;
 };
 
 // PySbTx: pybind-friendly version of SBTX that works with PySbPacket
@@ -426,8 +542,11 @@ class PySbRx {
     }
 
     void init(std::string uri, bool fresh = false, double max_rate = -1) {
+        PyLock lock(m_mutex);
         if (uri != "") {
             m_rx.init(uri, 0, fresh, max_rate);
+            // decode stamps, so that PySbPacket.tstamp can be passed on
+            m_rx.set_tstamp(true);
         }
     }
 
@@ -438,20 +557,27 @@ class PySbRx {
         // a PySbPacket if successful, and None otherwise
 
         sb_packet p;
-        if (!blocking) {
-            if (!m_rx.recv(p)) {
-                return nullptr;
-            }
-        } else {
-            while (!m_rx.recv(p)) {
-                check_signals();
+        uint64_t tstamp;
+        {
+            PyLock lock(m_mutex);
+            if (!blocking) {
+                if (!m_rx.recv(p)) {
+                    return nullptr;
+                }
+            } else if (!m_rx.recv(p)) {
+                PyWait wait;
+                while (!m_rx.recv(p)) {
+                    wait.poll();
+                }
             }
+            tstamp = m_rx.last_tstamp();
         }
 
         // if we get to this point, there is valid data in "p"
 
         // create "py_packet" to hold received data in a pybind-friendly manner
-        std::unique_ptr<PySbPacket> py_packet(new PySbPacket(p.destination, p.flags));
+        std::unique_ptr<PySbPacket> py_packet(
+            new PySbPacket(p.destination, p.flags, std::nullopt, tstamp));
 
         // copy data from "p" to "py_packet"
         // TODO: can this be avoided?
@@ -462,8 +588,145 @@ class PySbRx {
         return py_packet;
     }
 
+    PySbPacketArray recv_array(size_t num, bool blocking = true) {
+        // receives up to "num" packets into a structured array (see
+        // sb_packet_dtype).  if blocking=true (default), waits until all
+        // "num" packets have arrived; otherwise, returns the packets that
+        // are available right now, which may be none.
+
+        PySbPacketArray packets(num);
+        PySbPacketRecord* ptr = packets.mutable_data();
+        size_t i = 0;
+
+        PyLock lock(m_mutex);
+
+        while ((i < num) && m_rx.recv(*(sb_packet*)&ptr[i])) {
+            i++;
+        }
+
+        if ((i < num) && blocking) {
+            PyWait wait;
+            while (i < num) {
+                bool received = m_rx.recv(*(sb_packet*)&ptr[i]);
+                if (received) {
+                    i++;
+                }
+                wait.poll(received);
+            }
+        }
+
+        if (i < num) {
+            packets.resize({(py::ssize_t)i});
+        }
+
+        return packets;
+    }
+
   private:
     SBRX m_rx;
+    std::mutex m_mutex;
+};
+
+// PySbSignalBank: host side of a signal bank (see signal_bank.h).  read()
+// copies the chunks that changed since the last read into a local mirror,
+// which get_bits() and words() then look at, so that a host program can
+// follow thousands of signals without a packet per change.  set_bits()
+// publishes a group of bits as one write; as usual, only one side may
+// write to a given bank.
+
+class PySbSignalBank {
+  public:
+    PySbSignalBank(std::string uri = "", int nbits = 0, bool fresh = false) : m_bank(NULL) {
+        init(uri, nbits, fresh);
+    }
+
+    ~PySbSignalBank() {
+        sb_bank_close(m_bank);
+    }
+
+    void init(std::string uri, int nbits = 0, bool fresh = false) {
+        PyLock lock(m_mutex);
+        if (uri != "") {
+            sb_bank_close(m_bank);
+            m_bank = NULL;
+
+            if (fresh) {
+                sb_bank_remove_shmfile(uri.c_str());
+            }
+
+            m_bank = sb_bank_open(uri.c_str(), nbits);
+            if (!m_bank) {
+                throw std::runtime_error("Unable to open signal bank " + uri + ".");
+            }
+
+            m_mirror.assign(m_bank->nwords, 0);
+        }
+    }
+
+    int nbits() {
+        check_active();
+        return m_bank->nbits;
+    }
+
+    uint64_t generation() {
+        check_active();
+        return sb_bank_generation(m_bank);
+    }
+
+    bool read() {
+        // updates the mirror, retrying while a write is in progress.
+        // returns true if the bank changed since the last read.
+
+        PyLock lock(m_mutex);
+        check_active();
+
+        int r = sb_bank_read(m_bank, m_mirror.data());
+        if (r < 0) {
+            PyWait wait;
+            while ((r = sb_bank_read(m_bank, m_mirror.data())) < 0) {
+                wait.poll();
+            }
+        }
+
+        return r > 0;
+    }
+
+    uint64_t get_bits(int lsb, int width) {
+        PyLock lock(m_mutex);
+        check_range(lsb, width);
+        return sb_bank_get_bits(m_mirror.data(), lsb, width);
+    }
+
+    py::array_t<uint64_t> words() {
+        PyLock lock(m_mutex);
+        check_active();
+        return py::array_t<uint64_t>(m_mirror.size(), m_mirror.data());
+    }
+
+    void set_bits(int lsb, int width, uint64_t value) {
+        PyLock lock(m_mutex);
+        check_range(lsb, width);
+        sb_bank_set_bits(m_bank, lsb, width, value);
+    }
+
+  private:
+    void check_active() {
+        if (!m_bank) {
+            throw std::runtime_error("Using an uninitialized signal bank!");
+        }
+    }
+
+    void check_range(int lsb, int width) {
+        check_active();
+        if ((lsb < 0) || (width < 1) || (width > 64) || (lsb > (m_bank->nbits - width))) {
+            throw std::runtime_error("Bits " + std::to_string(lsb) + "+" +
+                                     std::to_string(width) + " are outside of the signal bank.");
+        }
+    }
+
+    sb_bank* m_bank;
+    std::vector<uint64_t> m_mirror;
+    std::mutex m_mutex;
 };
 
 // Functions to show a progress bar.
@@ -501,6 +764,7 @@ class PyUmi {
     }
 
     void init(std::string tx_uri, std::string rx_uri, bool fresh = false, double max_rate = -1) {
+        PyLock lock(m_mutex);
         if (tx_uri != "") {
             m_tx.init(tx_uri, 0, fresh, max_rate);
         }
@@ -516,13 +780,20 @@ class PyUmi {
         // containing the beginning of the data, followed by the rest in
         // subsequent burst packets.
 
-        return umisb_send<PyUmiPacket>(py_packet, m_tx, blocking, &check_signals);
+        PyLock lock(m_mutex);
+        return send_locked(py_packet, blocking);
     }
 
     std::unique_ptr<PyUmiPacket> recv(bool blocking = true) {
+        PyLock lock(m_mutex);
+
+        if (blocking) {
+            wait_recv();
+        }
+
         // try to receive a transaction
         std::unique_ptr<PyUmiPacket> resp = std::unique_ptr<PyUmiPacket>(new PyUmiPacket());
-        bool success = umisb_recv<PyUmiPacket>(*resp.get(), m_rx, blocking, &check_signals);
+        bool success = umisb_recv<PyUmiPacket>(*resp.get(), m_rx, false);
 
         // if we got something, return it, otherwise return a null pointer
         if (success) {
@@ -543,6 +814,8 @@ class PyUmi {
         // get access to the data
         py::buffer_info info = py::buffer(data).request();
 
+        PyLock lock(m_mutex);
+
         // make sure that max_bytes is set appropriately.
 
         // I thought about directly reading the size of the data payload
@@ -593,8 +866,14 @@ class PyUmi {
         uint32_t max_len = max_bytes / info.itemsize;
         int pb_state = 0;
 
+        // "data" is kept alive by the caller, so the rest of the transfer
+        // can run without holding the GIL
+        PyWait wait;
+
         // send all of the data
         while ((total_len > 0) || ((!posted) && (to_ack > 0))) {
+            bool progress = false;
+
             if (total_len > 0) {
                 // try to send a write request
                 uint32_t len = std::min(total_len, max_len);
@@ -602,6 +881,8 @@ class PyUmi {
                 uint32_t cmd = umi_pack(opcode, 0, size, len - 1, eom, 1, qos, prot);
                 UmiTransaction req(cmd, addr, srcaddr, ptr, len << size);
                 if (umisb_send<UmiTransaction>(req, m_tx, false)) {
+                    progress = true;
+
                     // update pointers
                     total_len -= len;
                     ptr += len << size;
@@ -617,6 +898,8 @@ class PyUmi {
             if ((!posted) && (to_ack > 0)) {
                 UmiTransaction resp(0, 0, 0, NULL, 0);
                 if (umisb_recv<UmiTransaction>(resp, m_rx, false)) {
+                    progress = true;
+
                     // check that the response makes sense
                     umisb_check_resp(resp, UMI_RESP_WRITE, size, to_ack, expected_addr, error);
 
@@ -631,7 +914,7 @@ class PyUmi {
             }
 
             // make sure there aren't outside signals trying to interrupt
-            check_signals();
+            wait.poll(progress);
         }
         if (progressbar) {
             progressbar_done();
@@ -678,7 +961,14 @@ class PyUmi {
         uint32_t to_recv = num;
         uint64_t expected_addr = srcaddr;
 
+        // "result" is only returned once the loop completes, so its buffer
+        // can be filled in without holding the GIL
+        PyLock lock(m_mutex);
+        PyWait wait;
+
         while ((num > 0) || (to_recv > 0)) {
+            bool progress = false;
+
             if (num > 0) {
                 // send read request
                 uint32_t len = std::min(num, max_len);
@@ -686,6 +976,8 @@ class PyUmi {
                 uint32_t cmd = umi_pack(UMI_REQ_READ, 0, size, len - 1, eom, 1, qos, prot);
                 UmiTransaction request(cmd, addr, srcaddr);
                 if (umisb_send<UmiTransaction>(request, m_tx, false)) {
+                    progress = true;
+
                     // update pointers
                     num -= len;
                     addr += len << size;
@@ -698,6 +990,8 @@ class PyUmi {
                 uint32_t max_resp_bytes = to_recv << size;
                 UmiTransaction resp(0, 0, 0, ptr, max_resp_bytes);
                 if (umisb_recv<UmiTransaction>(resp, m_rx, false)) {
+                    progress = true;
+
                     // check that the reply makes sense
                     umisb_check_resp<UmiTransaction>(resp, UMI_RESP_READ, size, to_recv,
                         expected_addr, error);
@@ -710,7 +1004,7 @@ class PyUmi {
             }
 
             // make sure there aren't outside signals trying to interrupt
-            check_signals();
+            wait.poll(progress);
         }
 
         return result;
@@ -743,11 +1037,13 @@ class PyUmi {
         PyUmiPacket request(cmd, addr, srcaddr, data);
 
         // send the request
-        umisb_send<PyUmiPacket>(request, m_tx, true, &check_signals);
+        PyLock lock(m_mutex);
+        send_locked(request, true);
 
         // get the response
+        wait_recv();
         PyUmiPacket resp;
-        umisb_recv<PyUmiPacket>(resp, m_rx, true, &check_signals);
+        umisb_recv<PyUmiPacket>(resp, m_rx, false);
 
         // check that the response makes sense
         umisb_check_resp(resp, UMI_RESP_READ, size, 1, srcaddr, error);
@@ -757,8 +1053,104 @@ class PyUmi {
     }
 
   private:
+    // send_locked() and wait_recv() expect m_mutex to be held by the caller
+
+    bool send_locked(PyUmiPacket& py_packet, bool blocking) {
+        bool sent = umisb_send<PyUmiPacket>(py_packet, m_tx, false);
+        if (sent || (!blocking) || (!m_tx.is_active())) {
+            return sent;
+        }
+
+        // the queue is full, so wait for space without holding the GIL.  the
+        // transaction borrows the packet's buffer, which the caller keeps alive.
+        UmiTransaction x(py_packet.cmd, py_packet.dstaddr, py_packet.srcaddr, py_packet.ptr(),
+            py_packet.nbytes());
+        PyWait wait;
+        while (!umisb_send<UmiTransaction>(x, m_tx, false)) {
+            wait.poll();
+        }
+
+        return true;
+    }
+
+    void wait_recv() {
+        // waits for a packet to arrive without holding the GIL.  the
+        // packet itself is received afterwards, since PyUmiPacket
+        // allocates a numpy array for it.
+
+        if (!m_rx.is_active()) {
+            return;
+        }
+
+        sb_packet p;
+        if (!m_rx.recv_peek(p)) {
+            PyWait wait;
+            while (!m_rx.recv_peek(p)) {
+                wait.poll();
+            }
+        }
+    }
+
     SBTX m_tx;
     SBRX m_rx;
+    std::mutex m_mutex;
+};
+
+// PyAxi: native AXI / AXI-Lite master behind AxiTxRx and AxiLiteTxRx.  the
+// Python classes handle argument defaults and data types, while the
+// channel packing, burst splitting, and pipelining happen here.
+
+class PyAxi {
+  public:
+    PyAxi(std::string uri = "", std::string suffix = ".q", bool fresh = true,
+        double max_rate = -1, uint32_t data_width = 32, uint32_t addr_width = 16,
+        uint32_t id_width = 8, bool lite = false)
+        : m_axi(uri, suffix, fresh, max_rate, data_width, addr_width, id_width, lite) {}
+
+    void set_max_outstanding(uint32_t max_outstanding) {
+        PyLock lock(m_mutex);
+        m_axi.set_max_outstanding(max_outstanding);
+    }
+
+    int write(uint64_t addr, py::array_t<uint8_t, py::array::c_style | py::array::forcecast> data,
+        uint32_t prot = 0, uint32_t id = 0, uint32_t num_ids = 1, int size = -1,
+        uint32_t max_beats = 256, int resp_expected = AXI_RESP_OKAY) {
+
+        // "data" is kept alive by the caller, so the transfer can run
+        // without holding the GIL
+        const uint8_t* ptr = data.data();
+        size_t nbytes = data.size();
+
+        PyLock lock(m_mutex);
+        PyWait wait;
+        return m_axi.write(addr, ptr, nbytes, prot, id, num_ids, size, max_beats, resp_expected,
+            [&wait](bool progress) { wait.poll(progress); });
+    }
+
+    py::tuple read(uint64_t addr, size_t nbytes, uint32_t prot = 0, uint32_t id = 0,
+        uint32_t num_ids = 1, int size = -1, uint32_t max_beats = 256,
+        int resp_expected = AXI_RESP_OKAY) {
+
+        // returns a tuple of the data read (as a uint8 array) and the
+        // response code
+
+        py::array_t<uint8_t> result(nbytes);
+        uint8_t* ptr = result.mutable_data();
+        int resp;
+
+        {
+            PyLock lock(m_mutex);
+            PyWait wait;
+            resp = m_axi.read(addr, ptr, nbytes, prot, id, num_ids, size, max_beats,
+                resp_expected, [&wait](bool progress) { wait.poll(progress); });
+        }
+
+        return py::make_tuple(result, resp);
+    }
+
+  private:
+    AxiMaster m_axi;
+    std::mutex m_mutex;
 };
 
 // convenience function to delete old queues from previous runs
@@ -790,6 +1182,20 @@ char* PySbTx_send_docstring = "Parameters\n"
                               "\tIf true, the function will pause execution until the"
                               " packet has been successfully sent.";
 
+char* PySbTx_send_array_docstring =
+    "Parameters\n"
+    "----------\n"
+    "packets: numpy.ndarray\n"
+    "\tOne-dimensional array of dtype sb_packet_dtype, with fields destination, flags and\n"
+    "\tdata, holding the packets to send in order\n"
+    "blocking: bool, optional\n"
+    "\tIf true, the function will pause execution until all packets have been sent.\n"
+    "\tOtherwise, only the packets that fit in the queue right now are sent.\n\n"
+    "Returns\n"
+    "-------\n"
+    "int\n"
+    "\tNumber of packets sent\n";
+
 char* PySbRx_init_docstring = "Parameters\n"
                               "----------\n"
                               "uri: str"
@@ -811,6 +1217,59 @@ char* PySbRx_recv_docstring =
     "\tReturns a UMI packet. If `blocking` is false, None will be returned"
     " If a packet cannot be read immediately.";
 
+char* PySbRx_recv_array_docstring =
+    "Parameters\n"
+    "----------\n"
+    "num: int\n"
+    "\tMaximum number of packets to receive\n"
+    "blocking: bool, optional\n"
+    "\tIf true, the function will pause execution until all num packets have been\n"
+    "\treceived.  Otherwise, only the packets available right now are returned.\n\n"
+    "Returns\n"
+    "-------\n"
+    "numpy.ndarray\n"
+    "\tArray of dtype sb_packet_dtype, with fields destination, flags and data\n";
+
+char* PySbSignalBank_init_docstring =
+    "Parameters\n"
+    "----------\n"
+    "uri: str\n"
+    "\tName of the signal bank file\n"
+    "nbits: int\n"
+    "\tNumber of signals in the bank, which must match the other side\n"
+    "fresh: bool, optional\n"
+    "\tIf True, an existing bank at `uri` is removed first.";
+
+char* PySbSignalBank_read_docstring =
+    "Copies the signals that changed since the last read into a local mirror, which\n"
+    "get_bits() and words() return values from.\n\n"
+    "Returns\n"
+    "-------\n"
+    "bool\n"
+    "\tTrue if the bank changed since the last read\n";
+
+char* PySbSignalBank_get_bits_docstring =
+    "Parameters\n"
+    "----------\n"
+    "lsb: int\n"
+    "\tIndex of the first signal\n"
+    "width: int\n"
+    "\tNumber of signals, at most 64\n\n"
+    "Returns\n"
+    "-------\n"
+    "int\n"
+    "\tValue of the signals as of the last read()\n";
+
+char* PySbSignalBank_set_bits_docstring =
+    "Parameters\n"
+    "----------\n"
+    "lsb: int\n"
+    "\tIndex of the first signal\n"
+    "width: int\n"
+    "\tNumber of signals, at most 64\n"
+    "value: int\n"
+    "\tNew value of the signals, published to readers as one write\n";
+
 char* PyUmi_init_docstring =
     "Parameters\n"
     "----------\n"
@@ -928,6 +1387,39 @@ char* PyUmi_atomic_docstring =
     " immediately before the atomic operation is applied.  The numpy dtype of the"
     " returned value will be the same as for `data`.";
 
+char* PyAxi_write_docstring =
+    "Parameters\n"
+    "----------\n"
+    "addr: int\n"
+    "\tAddress to write to.\n"
+    "data: np.uint8 array\n"
+    "\tBytes to write.  The transfer is split into bursts that don't cross 4 KB"
+    " boundaries, several of which are kept in flight at once.\n"
+    "prot, id, size, max_beats: int, optional\n"
+    "\tAXI attributes of the write bursts.  size=-1 means the full bus width.\n"
+    "num_ids: int, optional\n"
+    "\tNumber of consecutive IDs, starting from `id`, to spread bursts across.\n"
+    "resp_expected: int, optional\n"
+    "\tResponse code to expect, or -1 to skip checking.\n"
+    "Returns\n"
+    "-------\n"
+    "int\n"
+    "\tThe first unexpected response code, or the last one if all matched.";
+
+char* PyAxi_read_docstring =
+    "Parameters\n"
+    "----------\n"
+    "addr: int\n"
+    "\tAddress to read from.\n"
+    "nbytes: int\n"
+    "\tNumber of bytes to read.\n"
+    "prot, id, num_ids, size, max_beats, resp_expected: int, optional\n"
+    "\tSame as for write().\n"
+    "Returns\n"
+    "-------\n"
+    "tuple\n"
+    "\tThe data read as an np.uint8 array, and the response code as for write().";
+
 // Python bindings follow below.  There is some duplication of information in the default
 // values for functions, but this is unavoidable for pybind.  Note also that the "toString"
 // method of various classes is bound to "__str__", which has a special meaning in Python.
@@ -939,13 +1431,18 @@ char* PyUmi_atomic_docstring =
 PYBIND11_MODULE(_switchboard, m) {
     m.doc() = "switchboard pybind11 plugin";
 
+    PYBIND11_NUMPY_DTYPE(PySbPacketRecord, destination, flags, data);
+    m.attr("sb_packet_dtype") = py::dtype::of<PySbPacketRecord>();
+
     py::class_<PySbPacket>(m, "PySbPacket")
-        .def(py::init<uint32_t, uint32_t, std::optional<py::array_t<uint8_t>>>(),
-            py::arg("destination") = 0, py::arg("flags") = 0, py::arg("data") = py::none())
+        .def(py::init<uint32_t, uint32_t, std::optional<py::array_t<uint8_t>>, uint64_t>(),
+            py::arg("destination") = 0, py::arg("flags") = 0, py::arg("data") = py::none(),
+            py::arg("tstamp") = 0)
         .def("__str__", &PySbPacket::toString)
         .def_readwrite("destination", &PySbPacket::destination)
         .def_readwrite("flags", &PySbPacket::flags)
-        .def_readwrite("data", &PySbPacket::data);
+        .def_readwrite("data", &PySbPacket::data)
+        .def_readwrite("tstamp", &PySbPacket::tstamp);
 
     py::class_<PyUmiPacket>(m, "PyUmiPacket")
         .def(py::init<uint32_t, uint64_t, uint64_t, std::optional<py::array>>(), py::arg("cmd") = 0,
@@ -965,14 +1462,32 @@ PYBIND11_MODULE(_switchboard, m) {
         .def("init", &PySbTx::init, PySbTx_init_docstring, py::arg("uri") = "",
             py::arg("fresh") = false, py::arg("max_rate") = -1)
         .def("send", &PySbTx::send, PySbTx_send_docstring, py::arg("py_packet"),
-            py::arg("blocking") = true);
+            py::arg("blocking") = true)
+        .def("send_array", &PySbTx::send_array, PySbTx_send_array_docstring,
+            py::arg("packets"), py::arg("blocking") = true);
 
     py::class_<PySbRx>(m, "PySbRx")
         .def(py::init<std::string, bool, double>(), py::arg("uri") = "", py::arg("fresh") = false,
             py::arg("max_rate") = -1)
         .def("init", &PySbRx::init, PySbRx_init_docstring, py::arg("uri") = "",
             py::arg("fresh") = false, py::arg("max_rate") = -1)
-        .def("recv", &PySbRx::recv, PySbRx_recv_docstring, py::arg("blocking") = true);
+        .def("recv", &PySbRx::recv, PySbRx_recv_docstring, py::arg("blocking") = true)
+        .def("recv_array", &PySbRx::recv_array, PySbRx_recv_array_docstring, py::arg("num"),
+            py::arg("blocking") = true);
+
+    py::class_<PySbSignalBank>(m, "PySbSignalBank")
+        .def(py::init<std::string, int, bool>(), py::arg("uri") = "", py::arg("nbits") = 0,
+            py::arg("fresh") = false)
+        .def("init", &PySbSignalBank::init, PySbSignalBank_init_docstring, py::arg("uri"),
+            py::arg("nbits"), py::arg("fresh") = false)
+        .def("read", &PySbSignalBank::read, PySbSignalBank_read_docstring)
+        .def("get_bits", &PySbSignalBank::get_bits, PySbSignalBank_get_bits_docstring,
+            py::arg("lsb"), py::arg("width"))
+        .def("words", &PySbSignalBank::words)
+        .def("set_bits", &PySbSignalBank::set_bits, PySbSignalBank_set_bits_docstring,
+            py::arg("lsb"), py::arg("width"), py::arg("value"))
+        .def("generation", &PySbSignalBank::generation)
+        .def_property_readonly("nbits", &PySbSignalBank::nbits);
 
     py::class_<PySbTxPcie>(m, "PySbTxPcie")
         .def(py::init<std::string, int, int, std::string>(), py::arg("uri") = "",
@@ -1005,6 +1520,20 @@ PYBIND11_MODULE(_switchboard, m) {
             py::arg("opcode"), py::arg("srcaddr") = 0, py::arg("qos") = 0, py::arg("prot") = 0,
             py::arg("error") = true);
 
+    py::class_<PyAxi>(m, "PyAxi")
+        .def(py::init<std::string, std::string, bool, double, uint32_t, uint32_t, uint32_t,
+                 bool>(),
+            py::arg("uri") = "", py::arg("suffix") = ".q", py::arg("fresh") = true,
+            py::arg("max_rate") = -1, py::arg("data_width") = 32, py::arg("addr_width") = 16,
+            py::arg("id_width") = 8, py::arg("lite") = false)
+        .def("set_max_outstanding", &PyAxi::set_max_outstanding, py::arg("max_outstanding"))
+        .def("write", &PyAxi::write, PyAxi_write_docstring, py::arg("addr"), py::arg("data"),
+            py::arg("prot") = 0, py::arg("id") = 0, py::arg("num_ids") = 1, py::arg("size") = -1,
+            py::arg("max_beats") = 256, py::arg("resp_expected") = (int)AXI_RESP_OKAY)
+        .def("read", &PyAxi::read, PyAxi_read_docstring, py::arg("addr"), py::arg("nbytes"),
+            py::arg("prot") = 0, py::arg("id") = 0, py::arg("num_ids") = 1, py::arg("size") = -1,
+            py::arg("max_beats") = 256, py::arg("resp_expected") = (int)AXI_RESP_OKAY);
+
     m.def("umi_opcode_to_str", &umi_opcode_to_str,
         "Returns a string representation of a UMI opcode");
 
@@ -7,7 +7,7 @@
 from _switchboard import (PySbPacket, delete_queue, umi_opcode_to_str,
     PySbTx, PySbRx, UmiCmd, PySbTxPcie, PySbRxPcie, PyUmiPacket, umi_pack,
     umi_opcode, umi_size, umi_len, umi_atype, umi_qos, umi_prot, umi_eom,
-    umi_eof, umi_ex, UmiAtomic, delete_queues)
+    umi_eof, umi_ex, UmiAtomic, delete_queues, sb_packet_dtype, PySbSignalBank)
 
 from .umi import UmiTxRx, random_umi_packet
 from .util import binary_run, ProcessCollection
@@ -22,3 +22,4 @@ from .axi import AxiTxRx
 from .network import SbNetwork, TcpIntf
 from .autowrap import flip_intf
 from .switchboard import path as sb_path
+from . import aio
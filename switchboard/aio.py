@@ -0,0 +1,127 @@
+# asyncio helpers for driving switchboard queues from an event loop
+
+# Copyright (c) 2024 Zero ASIC Corporation
+# This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+# shared-memory queues don't have a file descriptor that the event loop
+# could wait on, so readiness is detected by polling the non-blocking
+# versions of send/recv, backing off while a queue stays idle.  this lets
+# one event loop drive many queues at once.  longer operations, such as
+# UMI reads and writes, are run in a thread pool instead: the C++ binding
+# releases the GIL while they wait, so operations on different queue
+# objects proceed in parallel.  calls made on the same object are run one
+# at a time, since each queue has a single producer and a single consumer.
+
+import asyncio
+import functools
+import numpy as np
+
+from _switchboard import PySbPacket, PySbTx, PySbRx, sb_packet_dtype
+
+# number of times to retry immediately before backing off
+POLL_SPINS = 16
+
+# range of delays (in seconds) used while backing off
+POLL_MIN_DELAY = 10e-6
+POLL_MAX_DELAY = 1e-3
+
+
+async def poll(attempt, max_delay: float = POLL_MAX_DELAY):
+    """
+    Calls attempt() until it returns something other than None or False,
+    yielding to the event loop in between, and returns that value.
+
+    Parameters
+    ----------
+    attempt: callable
+        Non-blocking operation to retry
+    max_delay: float, optional
+        Longest time in seconds to wait between attempts.
+    """
+
+    delay = POLL_MIN_DELAY
+    spins = 0
+
+    while True:
+        result = attempt()
+        if (result is not None) and (result is not False):
+            return result
+
+        if spins < POLL_SPINS:
+            spins += 1
+            await asyncio.sleep(0)
+        else:
+            await asyncio.sleep(delay)
+            delay = min(2 * delay, max_delay)
+
+
+async def send(tx: PySbTx, packet: PySbPacket):
+    """
+    Sends a packet, waiting for space in the queue without blocking the event loop.
+    """
+
+    await poll(lambda: tx.send(packet, False))
+
+
+async def recv(rx: PySbRx) -> PySbPacket:
+    """
+    Returns the next packet, waiting for one without blocking the event loop.
+    """
+
+    return await poll(lambda: rx.recv(False))
+
+
+async def send_array(tx: PySbTx, packets: np.ndarray):
+    """
+    Sends a structured array of packets (see sb_packet_dtype) in order,
+    waiting for space in the queue without blocking the event loop.
+    """
+
+    packets = np.ascontiguousarray(packets, dtype=sb_packet_dtype)
+    sent = 0
+
+    def attempt():
+        nonlocal sent
+        sent += tx.send_array(packets[sent:], False)
+        return sent == len(packets)
+
+    if len(packets) > 0:
+        await poll(attempt)
+
+
+async def recv_array(rx: PySbRx, num: int) -> np.ndarray:
+    """
+    Returns "num" packets as a structured array (see sb_packet_dtype),
+    waiting for them without blocking the event loop.
+    """
+
+    chunks = []
+    remaining = num
+
+    def attempt():
+        nonlocal remaining
+        chunk = rx.recv_array(remaining, False)
+        if len(chunk) > 0:
+            chunks.append(chunk)
+            remaining -= len(chunk)
+        return remaining == 0
+
+    if num > 0:
+        await poll(attempt)
+
+    return np.concatenate(chunks) if chunks else np.zeros(0, dtype=sb_packet_dtype)
+
+
+async def run(func, *args, **kwargs):
+    """
+    Runs a blocking switchboard call, such as UmiTxRx.write() or
+    UmiTxRx.read(), in the event loop's default thread pool and returns
+    its result.  The call releases the GIL while it waits, so calls on
+    different UmiTxRx (or PySbTx, PySbRx, ...) objects can be in flight at
+    once.  Calls that share an object are safe, but are serialized: they
+    wait for each other rather than running concurrently, so use a separate
+    object (and queue) for each operation that should proceed in parallel.
+    """
+
+    loop = asyncio.get_running_loop()
+    return await loop.run_in_executor(None, functools.partial(func, *args, **kwargs))
@@ -582,14 +582,38 @@ def make_ams_verilog_wrapper(
 
     text += [');']
 
+    # signal names are resolved to handles once, right after initialization,
+    # so that the Xyce interface doesn't have to look them up every cycle
+
     text += [
         tab + 'xyce_intf x ();',
+        ''
+    ]
+
+    for input in inputs:
+        analog = f'SB_DAC_{vlog_int_name(input).upper()}'
+        text += [tab + f'integer {analog}_ID;']
+
+    for output in outputs:
+        analog = f'SB_ADC_{vlog_int_name(output).upper()}'
+        text += [tab + f'integer {analog}_ID;']
+
+    text += [
         '',
         tab + 'initial begin',
-        tab + tab + f'x.init("{filename}");',
-        tab + 'end'
+        tab + tab + f'x.init("{filename}");'
     ]
 
+    for input in inputs:
+        analog = f'SB_DAC_{vlog_int_name(input).upper()}'
+        text += [tab + tab + f'x.dac("{analog}", {analog}_ID);']
+
+    for output in outputs:
+        analog = f'SB_ADC_{vlog_int_name(output).upper()}'
+        text += [tab + tab + f'x.adc("{analog}", {analog}_ID);']
+
+    text += [tab + 'end']
+
     for input in inputs:
         int_name = vlog_int_name(input)
         ext_name = vlog_ext_name(input)
@@ -602,7 +626,7 @@ def make_ams_verilog_wrapper(
             '',
             tab + f'real {analog};',
             tab + f'always @({analog}) begin',
-            tab + tab + f'x.put("{analog.upper()}", {analog});',
+            tab + tab + f'x.put_id({analog}_ID, {analog});',
             tab + 'end',
             tab + f'assign {analog} = {ext_name} ? {voh} : {vol};'
         ]
@@ -643,7 +667,7 @@ def make_ams_verilog_wrapper(
             cmp = f'SB_CMP_{int_name.upper()}'
 
             text += [
-                tab + tab + f'x.get("{analog}", {analog});',
+                tab + tab + f'x.get_id({analog}_ID, {analog});',
                 tab + tab + f'if ({analog} >= {vih}) begin',
                 tab + tab + tab + f'{cmp} = 1;',
                 tab + tab + f'end else if ({analog} <= {vil}) begin',
@@ -8,7 +8,7 @@ import numpy as np
 from math import floor, ceil, log2
 from numbers import Integral
 
-from _switchboard import PySbPacket, PySbTx, PySbRx
+from _switchboard import PySbPacket, PyAxi
 
 
 class AxiTxRx:
@@ -25,7 +25,9 @@ class AxiTxRx:
         max_beats: int = 256,
         resp_expected: str = 'OKAY',
         queue_suffix: str = '.q',
-        max_rate: float = -1
+        max_rate: float = -1,
+        num_ids: int = 1,
+        max_outstanding: int = 16
     ):
         """
         Parameters
@@ -67,6 +69,13 @@ class AxiTxRx:
             File extension/suffix to use when naming switchboard queues that carry
             AXI transactions.  For example, if set to ".queue", the write address
             queue name will be "{uri}-aw.queue"
+        num_ids: int, optional
+            Number of consecutive IDs, starting from "id", that bursts are spread
+            across in round-robin order.  Defaults to 1, i.e. all bursts use the
+            same ID.
+        max_outstanding: int, optional
+            Maximum number of bursts in flight in each direction.  Reads and writes
+            are split into bursts in C++ and pipelined up to this limit.
         """
 
         # check data types
@@ -81,7 +90,7 @@ class AxiTxRx:
         # check that data and address widths are supported
         SBDW = 416
         assert 0 < data_width <= floor(SBDW / (1 + (1 / 8))), 'data_width out of range'
-        assert 0 < addr_width <= SBDW - 3, 'addr_width out of range'
+        assert 0 < addr_width <= min(SBDW - 3, 64), 'addr_width out of range'
 
         # determine default size
         if size is None:
@@ -96,13 +105,12 @@ class AxiTxRx:
         self.default_size = size
         self.default_max_beats = max_beats
         self.default_resp_expected = resp_expected
+        self.num_ids = num_ids
 
-        # create the queues
-        self.aw = PySbTx(f'{uri}-aw{queue_suffix}', fresh=fresh, max_rate=max_rate)
-        self.w = PySbTx(f'{uri}-w{queue_suffix}', fresh=fresh, max_rate=max_rate)
-        self.b = PySbRx(f'{uri}-b{queue_suffix}', fresh=fresh, max_rate=max_rate)
-        self.ar = PySbTx(f'{uri}-ar{queue_suffix}', fresh=fresh, max_rate=max_rate)
-        self.r = PySbRx(f'{uri}-r{queue_suffix}', fresh=fresh, max_rate=max_rate)
+        # create the queues, which are driven by a native AXI master
+        self.axi = PyAxi(uri, queue_suffix, fresh=fresh, max_rate=max_rate,
+            data_width=data_width, addr_width=addr_width, id_width=id_width)
+        self.axi.set_max_outstanding(max_outstanding)
 
     @property
     def strb_width(self):
@@ -209,81 +217,17 @@ class AxiTxRx:
 
         assert 0 <= prot < (1 << 3), 'prot out of range'
 
-        # loop until all data is sent
-        # TODO: move to C++?
+        # split into bursts and send them out, checking the responses
 
-        bytes_sent = 0
+        resp = self.axi.write(addr, write_data, prot=prot, id=id, num_ids=self.num_ids,
+            size=size, max_beats=max_beats, resp_expected=encode_resp(resp_expected))
 
-        data_bytes = self.data_width // 8
-        data = np.empty((data_bytes,), dtype=np.uint8)
-
-        addr_mask = (1 << self.addr_width) - 1
-        addr_mask >>= size
-        addr_mask <<= size
-
-        mask_4k = (1 << self.addr_width) - 1
-        mask_4k >>= 12
-        mask_4k <<= 12
-
-        increment_4k = 1 << 12
-
-        while bytes_sent < bytes_to_send:
-            top_addr = addr + (bytes_to_send - bytes_sent) - 1
-
-            # limit transfer to the longest burst possible
-            longest_burst = max_beats * (1 << size)
-            top_addr = min(top_addr, (addr & addr_mask) + longest_burst - 1)
-
-            # don't cross a 4k boundary
-            next_4k_boundary = (addr & mask_4k) + increment_4k - 1
-            top_addr = min(top_addr, next_4k_boundary)
-
-            # calculate the number of beats
-            beats = ceil((top_addr - (addr & addr_mask) + 1) / (1 << size))
-
-            assert 1 <= beats <= max_beats
-
-            # transmit the write address
-            self.aw.send(self.pack_addr(addr & addr_mask, prot=prot, size=size,
-                len=beats - 1, id=id), True)
-
-            for beat in range(beats):
-                # find the offset into the data bus for this beat.  bytes below
-                # the offset will have write strobe de-asserted.
-                offset = addr - (addr & addr_mask)
-
-                # determine how many bytes we're sending in this cycle
-                bytes_this_beat = min(bytes_to_send - bytes_sent, (1 << size) - offset)
-
-                # extract those bytes from the whole input data array, picking
-                # up where we left off from the last beat
-                data[offset:offset + bytes_this_beat] = \
-                    write_data[bytes_sent:bytes_sent + bytes_this_beat]
-
-                # calculate strobe value based on the offset and number
-                # of bytes that we're writing.
-                strb = ((1 << bytes_this_beat) - 1) << offset
-
-                # write data and strobe
-                if beat == beats - 1:
-                    last = 1
-                else:
-                    last = 0
-                self.w.send(self.pack_w(data, strb=strb, last=last), True)
-
-                # increment pointers
-                bytes_sent += bytes_this_beat
-                addr += bytes_this_beat
-
-            # wait for response
-            resp, id = self.unpack_b(self.b.recv(True))
-
-            # decode the response
-            resp = decode_resp(resp)
+        # decode the response
+        resp = decode_resp(resp)
 
-            # check the response if desired
-            if resp_expected is not None:
-                assert resp.upper() == resp_expected.upper(), f'Unexpected response: {resp}'
+        # check the response if desired
+        if resp_expected is not None:
+            assert resp.upper() == resp_expected.upper(), f'Unexpected response: {resp}'
 
         # return the last reponse
         return resp
@@ -382,63 +326,15 @@ class AxiTxRx:
 
         assert 0 <= prot < (1 << 3), 'prot out of range'
 
-        # loop until all data is read
-        # TODO: move to C++?
+        # split into bursts and read them in, checking the responses
 
-        bytes_read = 0
+        retval, resp = self.axi.read(addr, bytes_to_read, prot=prot, id=id,
+            num_ids=self.num_ids, size=size, max_beats=max_beats,
+            resp_expected=encode_resp(resp_expected))
 
-        addr_mask = (1 << self.addr_width) - 1
-        addr_mask >>= size
-        addr_mask <<= size
-
-        mask_4k = (1 << self.addr_width) - 1
-        mask_4k >>= 12
-        mask_4k <<= 12
-
-        increment_4k = 1 << 12
-
-        retval = np.empty((bytes_to_read,), dtype=np.uint8)
-
-        while bytes_read < bytes_to_read:
-            top_addr = addr + (bytes_to_read - bytes_read) - 1
-
-            # limit transfer to the longest burst possible
-            longest_burst = max_beats * (1 << size)
-            top_addr = min(top_addr, (addr & addr_mask) + longest_burst - 1)
-
-            # don't cross a 4k boundary
-            next_4k_boundary = (addr & mask_4k) + increment_4k - 1
-            top_addr = min(top_addr, next_4k_boundary)
-
-            # calculate the number of beats
-            beats = ceil((top_addr - (addr & addr_mask) + 1) / (1 << size))
-            assert 1 <= beats <= max_beats
-
-            # transmit read address
-            self.ar.send(self.pack_addr(addr & addr_mask, prot=prot, size=size,
-                len=beats - 1, id=id), True)
-
-            for _ in range(beats):
-                # find the offset into the data bus for this beat.  bytes below
-                # the offset will have write strobe de-asserted.
-                offset = addr - (addr & addr_mask)
-
-                # determine how many bytes we're sending in this cycle
-                bytes_this_beat = min(bytes_to_read - bytes_read, (1 << size) - offset)
-
-                # wait for response
-                data, resp, id, last = self.unpack_r(self.r.recv(True))
-                retval[bytes_read:bytes_read + bytes_this_beat] = \
-                    data = data[offset:offset + bytes_this_beat]
-
-                # check the reponse
-                if resp_expected is not None:
-                    resp = decode_resp(resp)
-                    assert resp.upper() == resp_expected.upper(), f'Unexpected response: {resp}'
-
-                # increment pointers
-                bytes_read += bytes_this_beat
-                addr += bytes_this_beat
+        if resp_expected is not None:
+            resp = decode_resp(resp)
+            assert resp.upper() == resp_expected.upper(), f'Unexpected response: {resp}'
 
         if isinstance(num_or_dtype, (type, np.dtype)):
             return retval.view(num_or_dtype)[0]
@@ -556,6 +452,16 @@ def decode_resp(resp: Integral):
     return ['OKAY', 'EXOKAY', 'SLVERR', 'DECERR'][resp]
 
 
+def encode_resp(resp: str):
+    # converts an expected response to the code used by the native AXI
+    # master, where -1 means "don't check the response"
+
+    if resp is None:
+        return -1
+
+    return ['OKAY', 'EXOKAY', 'SLVERR', 'DECERR'].index(resp.upper())
+
+
 def axi_uris(prefix, suffix='.q'):
     # returns a list of the URIs associated with a given AXI or AXI-Lite
     # prefix.  For example, axi_uris('axi') returns ['axi-aw.q', 'axi-w.q',
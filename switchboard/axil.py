@@ -5,10 +5,12 @@
 
 import numpy as np
 
-from math import floor, ceil, log2
+from math import floor
 from numbers import Integral
 
-from _switchboard import PySbPacket, PySbTx, PySbRx
+from _switchboard import PyAxi
+
+from .axi import decode_resp, encode_resp
 
 
 class AxiLiteTxRx:
@@ -21,7 +23,8 @@ class AxiLiteTxRx:
         prot: int = 0,
         resp_expected: str = 'OKAY',
         queue_suffix: str = '.q',
-        max_rate: float = -1
+        max_rate: float = -1,
+        max_outstanding: int = 16
     ):
         """
         Parameters
@@ -51,6 +54,10 @@ class AxiLiteTxRx:
             File extension/suffix to use when naming switchboard queues that carry
             AXI transactions.  For example, if set to ".queue", the write address
             queue name will be "{uri}-aw.queue"
+        max_outstanding: int, optional
+            Maximum number of transactions in flight in each direction.  Reads and
+            writes are split into bus-width transactions in C++ and pipelined up to
+            this limit.
         """
 
         # check data types
@@ -65,7 +72,7 @@ class AxiLiteTxRx:
         # check that data and address widths are supported
         SBDW = 416
         assert 0 < data_width <= floor(SBDW / (1 + (1 / 8))), 'data_width out of range'
-        assert 0 < addr_width <= SBDW - 3, 'addr_width out of range'
+        assert 0 < addr_width <= min(SBDW - 3, 64), 'addr_width out of range'
 
         # save settings
         self.data_width = data_width
@@ -73,12 +80,10 @@ class AxiLiteTxRx:
         self.default_prot = prot
         self.default_resp_expected = resp_expected
 
-        # create the queues
-        self.aw = PySbTx(f'{uri}-aw{queue_suffix}', fresh=fresh, max_rate=max_rate)
-        self.w = PySbTx(f'{uri}-w{queue_suffix}', fresh=fresh, max_rate=max_rate)
-        self.b = PySbRx(f'{uri}-b{queue_suffix}', fresh=fresh, max_rate=max_rate)
-        self.ar = PySbTx(f'{uri}-ar{queue_suffix}', fresh=fresh, max_rate=max_rate)
-        self.r = PySbRx(f'{uri}-r{queue_suffix}', fresh=fresh, max_rate=max_rate)
+        # create the queues, which are driven by a native AXI-Lite master
+        self.axi = PyAxi(uri, queue_suffix, fresh=fresh, max_rate=max_rate,
+            data_width=data_width, addr_width=addr_width, lite=True)
+        self.axi.set_max_outstanding(max_outstanding)
 
     @property
     def strb_width(self):
@@ -160,65 +165,18 @@ class AxiLiteTxRx:
 
         assert 0 <= prot < (1 << 3), 'prot out of range'
 
-        # loop until all data is sent
-        # TODO: move to C++?
-
-        bytes_sent = 0
-
-        data_bytes = self.data_width // 8
-        strb_bytes = (self.strb_width + 7) // 8
-
-        addr_mask = (1 << self.addr_width) - 1
-        addr_mask >>= ceil(log2(data_bytes))
-        addr_mask <<= ceil(log2(data_bytes))
-
-        while bytes_sent < bytes_to_send:
-            # find the offset into the data bus for this cycle.  bytes below
-            # the offset will have write strobe de-asserted.
-            offset = addr % data_bytes
-
-            # determine how many bytes we're sending in this cycle
-            bytes_this_cycle = min(bytes_to_send - bytes_sent, data_bytes - offset)
-
-            # extract those bytes from the whole input data array, picking
-            # up where we left off from the last iteration
-            data_this_cycle = write_data[bytes_sent:bytes_sent + bytes_this_cycle]
-
-            # calculate strobe value based on the offset and number
-            # of bytes that we're writing.
-            strb = ((1 << bytes_this_cycle) - 1) << offset
-            strb = strb.to_bytes(strb_bytes, 'little')
-            strb = np.frombuffer(strb, dtype=np.uint8)
-
-            # transmit the write address
-            pack = (prot << self.addr_width) | (addr & addr_mask)
-            pack = pack.to_bytes((self.addr_width + 3 + 7) // 8, 'little')
-            pack = np.frombuffer(pack, dtype=np.uint8)
-            pack = PySbPacket(data=pack, flags=1, destination=0)
-            self.aw.send(pack, True)
-
-            # write data and strobe
-            pack = np.empty((data_bytes + strb_bytes,), dtype=np.uint8)
-            pack[offset:offset + bytes_this_cycle] = data_this_cycle
-            pack[data_bytes:data_bytes + strb_bytes] = strb
-            pack = PySbPacket(data=pack, flags=1, destination=0)
-            self.w.send(pack, True)
-
-            # wait for response
-            pack = self.b.recv(True)
-            pack = pack.data.tobytes()
-            pack = int.from_bytes(pack, 'little')
+        # split into bus-width transactions and send them out, checking
+        # the responses
 
-            # decode the response
-            resp = decode_resp(pack & 0b11)
+        resp = self.axi.write(addr, write_data, prot=prot,
+            resp_expected=encode_resp(resp_expected))
 
-            # check the response if desired
-            if resp_expected is not None:
-                assert resp.upper() == resp_expected.upper(), f'Unexpected response: {resp}'
+        # decode the response
+        resp = decode_resp(resp)
 
-            # increment pointers
-            bytes_sent += bytes_this_cycle
-            addr += bytes_this_cycle
+        # check the response if desired
+        if resp_expected is not None:
+            assert resp.upper() == resp_expected.upper(), f'Unexpected response: {resp}'
 
         # return the last reponse
         return resp
@@ -292,57 +250,18 @@ class AxiLiteTxRx:
 
         assert 0 <= prot < (1 << 3), 'prot out of range'
 
-        # loop until all data is read
-        # TODO: move to C++?
+        # split into bus-width transactions and read them in, checking
+        # the responses
 
-        bytes_read = 0
-        data_bytes = self.data_width // 8
+        retval, resp = self.axi.read(addr, bytes_to_read, prot=prot,
+            resp_expected=encode_resp(resp_expected))
 
-        addr_mask = (1 << self.addr_width) - 1
-        addr_mask >>= ceil(log2(data_bytes))
-        addr_mask <<= ceil(log2(data_bytes))
-
-        retval = np.empty((bytes_to_read,), dtype=np.uint8)
-
-        while bytes_read < bytes_to_read:
-            # find the offset into the data bus for this cycle
-            offset = addr % data_bytes
-
-            # determine what data we're reading this cycle
-            bytes_this_cycle = min(bytes_to_read - bytes_read, data_bytes - offset)
-
-            # transmit read address
-            pack = (prot << self.addr_width) | (addr & addr_mask)
-            pack = pack.to_bytes((self.addr_width + 3 + 7) // 8, 'little')
-            pack = np.frombuffer(pack, dtype=np.uint8)
-            pack = PySbPacket(data=pack, flags=1, destination=0)
-            self.ar.send(pack, True)
-
-            # wait for response
-            pack = self.r.recv(True)
-            data = pack.data[offset:offset + bytes_this_cycle]
-            resp = pack.data[data_bytes] & 0b11
-
-            # check the reponse
-            if resp_expected is not None:
-                resp = decode_resp(resp)
-                assert resp.upper() == resp_expected.upper(), f'Unexpected response: {resp}'
-
-            # add this data to the return value
-            retval[bytes_read:bytes_read + bytes_this_cycle] = data
-
-            # increment pointers
-            bytes_read += bytes_this_cycle
-            addr += bytes_this_cycle
+        if resp_expected is not None:
+            resp = decode_resp(resp)
+            assert resp.upper() == resp_expected.upper(), f'Unexpected response: {resp}'
 
         if isinstance(num_or_dtype, (type, np.dtype)):
             return retval.view(num_or_dtype)[0]
         else:
             return retval.view(dtype)
 
-
-def decode_resp(resp: Integral):
-    assert isinstance(resp, Integral), 'response code must be an integer'
-    assert 0 <= resp <= 3, 'response code out of range'
-
-    return ['OKAY', 'EXOKAY', 'SLVERR', 'DECERR'][resp]
@@ -0,0 +1,404 @@
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// AXI / AXI-Lite master that drives the five switchboard queues (aw, w, b,
+// ar, r) carrying an AXI interface, using the same packing as the sb_axi_m
+// and sb_axil_m bridges.  write() and read() split a transfer into bursts
+// that don't cross 4 KB boundaries, and keep several bursts in flight at
+// once, optionally spread across a range of IDs.
+
+#ifndef __AXISB_HPP__
+#define __AXISB_HPP__
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "switchboard.hpp"
+
+#define AXI_RESP_OKAY 0
+#define AXI_RESP_EXOKAY 1
+#define AXI_RESP_SLVERR 2
+#define AXI_RESP_DECERR 3
+
+#define AXI_BURST_INCR 1
+#define AXI_BOUNDARY 4096
+
+// default number of bursts that may be outstanding in each direction
+#define AXI_MAX_OUTSTANDING 16
+
+static inline const char* axi_resp_str(int resp) {
+    static const char* names[] = {"OKAY", "EXOKAY", "SLVERR", "DECERR"};
+    return names[resp & 0b11];
+}
+
+// bit-level access to the fields of an AXI channel, which are packed into
+// the data payload of an SB packet starting from the least significant bit
+
+static inline void axisb_put(uint8_t* buf, uint32_t& pos, uint64_t value, uint32_t width) {
+    for (uint32_t i = 0; i < width; i++, pos++) {
+        uint8_t mask = 1 << (pos % 8);
+        if ((value >> i) & 1) {
+            buf[pos / 8] |= mask;
+        } else {
+            buf[pos / 8] &= ~mask;
+        }
+    }
+}
+
+static inline uint64_t axisb_get(const uint8_t* buf, uint32_t& pos, uint32_t width) {
+    uint64_t value = 0;
+    for (uint32_t i = 0; i < width; i++, pos++) {
+        value |= (uint64_t)((buf[pos / 8] >> (pos % 8)) & 1) << i;
+    }
+    return value;
+}
+
+// default wait strategy: yield the CPU when no progress was made
+
+struct AxiYield {
+    void operator()(bool progress) {
+        if (!progress) {
+            std::this_thread::yield();
+        }
+    }
+};
+
+class AxiMaster {
+  public:
+    AxiMaster(std::string uri = "", std::string suffix = ".q", bool fresh = true,
+        double max_rate = -1, uint32_t data_width = 32, uint32_t addr_width = 16,
+        uint32_t id_width = 8, bool lite = false) {
+        init(uri, suffix, fresh, max_rate, data_width, addr_width, id_width, lite);
+    }
+
+    void init(std::string uri, std::string suffix = ".q", bool fresh = true,
+        double max_rate = -1, uint32_t data_width = 32, uint32_t addr_width = 16,
+        uint32_t id_width = 8, bool lite = false) {
+
+        m_data_bytes = data_width / 8;
+        m_addr_width = addr_width;
+        m_id_width = lite ? 0 : id_width;
+        m_lite = lite;
+        m_max_outstanding = AXI_MAX_OUTSTANDING;
+
+        if ((data_width % 8) || (m_data_bytes == 0) || (m_data_bytes & (m_data_bytes - 1))) {
+            throw std::runtime_error("AXI data width must be a power-of-two number of bytes.");
+        }
+
+        if ((addr_width == 0) || (addr_width > 64) || (m_id_width > 32)) {
+            throw std::runtime_error("AXI address width must be 1-64 bits, ID width 0-32 bits.");
+        }
+
+        // the W channel carries data, strobes, and last; R carries data,
+        // resp, ID, and last
+        uint32_t data_bits = 8 * m_data_bytes + std::max(m_data_bytes, 2 + m_id_width) + 1;
+        if ((addr_pack_bits() > 8 * SB_DATA_SIZE) || (data_bits > 8 * SB_DATA_SIZE)) {
+            throw std::runtime_error("AXI channels don't fit in an SB packet.");
+        }
+
+        if (uri != "") {
+            m_aw.init(uri + "-aw" + suffix, 0, fresh, max_rate);
+            m_w.init(uri + "-w" + suffix, 0, fresh, max_rate);
+            m_b.init(uri + "-b" + suffix, 0, fresh, max_rate);
+            m_ar.init(uri + "-ar" + suffix, 0, fresh, max_rate);
+            m_r.init(uri + "-r" + suffix, 0, fresh, max_rate);
+        }
+    }
+
+    void set_max_outstanding(uint32_t max_outstanding) {
+        m_max_outstanding = std::max(max_outstanding, 1u);
+    }
+
+    uint32_t data_bytes() {
+        return m_data_bytes;
+    }
+
+    // writes "nbytes" from "data" starting at "addr", using "num_ids"
+    // consecutive IDs starting from "id" in round-robin order.  returns the
+    // first response that differs from "resp_expected", or the last
+    // response if they all match (pass resp_expected=-1 to skip checking).
+    // "poll" is called once per iteration of the wait loop, with an
+    // argument indicating whether any progress was made.
+
+    template <typename P = AxiYield>
+    int write(uint64_t addr, const uint8_t* data, size_t nbytes, uint32_t prot = 0,
+        uint32_t id = 0, uint32_t num_ids = 1, int size = -1, uint32_t max_beats = 256,
+        int resp_expected = AXI_RESP_OKAY, P poll = P()) {
+
+        check_args(size, max_beats, id, num_ids);
+
+        int result = AXI_RESP_OKAY;
+        bool mismatch = false;
+
+        uint32_t next_id = 0;
+        std::vector<uint32_t> outstanding(num_ids, 0);
+        uint32_t total_outstanding = 0;
+
+        // state of the burst currently being sent
+        size_t sent = 0;
+        uint32_t beats = 0;
+        bool aw_sent = false;
+        bool w_valid = false;
+        sb_packet w;
+
+        while ((sent < nbytes) || (beats > 0) || (total_outstanding > 0)) {
+            bool progress = false;
+
+            if ((beats == 0) && (sent < nbytes) && (total_outstanding < m_max_outstanding)) {
+                // start the next burst
+                beats = burst_beats(addr, nbytes - sent, size, max_beats);
+                aw_sent = false;
+            }
+
+            if ((beats > 0) && !aw_sent) {
+                sb_packet p;
+                pack_addr(p, addr, prot, id + next_id, beats - 1, size);
+                if (m_aw.send(p)) {
+                    aw_sent = true;
+                    outstanding[next_id]++;
+                    total_outstanding++;
+                    next_id = (next_id + 1) % num_ids;
+                    progress = true;
+                }
+            }
+
+            while (aw_sent && (beats > 0)) {
+                // find the offset into the data bus for this beat.  bytes
+                // below the offset will have write strobe de-asserted.
+                uint32_t offset = addr - (addr & addr_mask(size));
+                uint32_t n = std::min(nbytes - sent, (size_t)((1u << size) - offset));
+
+                if (!w_valid) {
+                    memset(&w, 0, sizeof(w));
+                    w.flags = 1;
+                    memcpy(w.data + offset, data + sent, n);
+                    uint32_t pos = 8 * m_data_bytes;
+                    axisb_put(w.data, pos, ((1ull << n) - 1) << offset, m_data_bytes);
+                    if (!m_lite) {
+                        axisb_put(w.data, pos, beats == 1 ? 1 : 0, 1);
+                    }
+                    w_valid = true;
+                }
+
+                if (!m_w.send(w)) {
+                    break;
+                }
+
+                w_valid = false;
+                sent += n;
+                addr += n;
+                beats--;
+                progress = true;
+            }
+
+            if (total_outstanding > 0) {
+                sb_packet p;
+                if (m_b.recv(p)) {
+                    uint32_t pos = 0;
+                    int resp = axisb_get(p.data, pos, 2);
+                    uint32_t slot = response_slot(axisb_get(p.data, pos, m_id_width), id,
+                        outstanding, "write");
+                    outstanding[slot]--;
+                    total_outstanding--;
+
+                    if (!mismatch) {
+                        result = resp;
+                        mismatch = (resp_expected >= 0) && (resp != resp_expected);
+                    }
+                    progress = true;
+                }
+            }
+
+            poll(progress);
+        }
+
+        return result;
+    }
+
+    // reads "nbytes" starting at "addr" into "data".  arguments and the
+    // return value are the same as for write().
+
+    template <typename P = AxiYield>
+    int read(uint64_t addr, uint8_t* data, size_t nbytes, uint32_t prot = 0, uint32_t id = 0,
+        uint32_t num_ids = 1, int size = -1, uint32_t max_beats = 256,
+        int resp_expected = AXI_RESP_OKAY, P poll = P()) {
+
+        check_args(size, max_beats, id, num_ids);
+
+        int result = AXI_RESP_OKAY;
+        bool mismatch = false;
+
+        // bursts in flight, in the order issued for each ID.  responses
+        // for different IDs may be interleaved.
+        struct Burst {
+            uint64_t addr;
+            size_t pos;
+            size_t remaining;
+        };
+
+        uint32_t next_id = 0;
+        std::vector<std::deque<Burst>> inflight(num_ids);
+        std::vector<uint32_t> outstanding(num_ids, 0);
+        uint32_t total_outstanding = 0;
+        size_t requested = 0;
+
+        while ((requested < nbytes) || (total_outstanding > 0)) {
+            bool progress = false;
+
+            if ((requested < nbytes) && (total_outstanding < m_max_outstanding)) {
+                uint32_t beats = burst_beats(addr, nbytes - requested, size, max_beats);
+
+                // the burst covers the bytes up to the end of its last beat
+                size_t len = std::min((size_t)(((uint64_t)beats << size) -
+                                               (addr - (addr & addr_mask(size)))),
+                    nbytes - requested);
+
+                sb_packet p;
+                pack_addr(p, addr, prot, id + next_id, beats - 1, size);
+                if (m_ar.send(p)) {
+                    inflight[next_id].push_back({addr, requested, len});
+                    outstanding[next_id]++;
+                    total_outstanding++;
+                    next_id = (next_id + 1) % num_ids;
+
+                    requested += len;
+                    addr += len;
+                    progress = true;
+                }
+            }
+
+            sb_packet p;
+            while ((total_outstanding > 0) && m_r.recv(p)) {
+                uint32_t pos = 8 * m_data_bytes;
+                int resp = axisb_get(p.data, pos, 2);
+                uint32_t slot =
+                    response_slot(axisb_get(p.data, pos, m_id_width), id, outstanding, "read");
+
+                Burst& b = inflight[slot].front();
+                uint32_t offset = b.addr - (b.addr & addr_mask(size));
+                uint32_t n = std::min(b.remaining, (size_t)((1u << size) - offset));
+                memcpy(data + b.pos, p.data + offset, n);
+                b.addr += n;
+                b.pos += n;
+                b.remaining -= n;
+
+                if (b.remaining == 0) {
+                    inflight[slot].pop_front();
+                    outstanding[slot]--;
+                    total_outstanding--;
+                }
+
+                if (!mismatch) {
+                    result = resp;
+                    mismatch = (resp_expected >= 0) && (resp != resp_expected);
+                }
+                progress = true;
+            }
+
+            poll(progress);
+        }
+
+        return result;
+    }
+
+  private:
+    uint32_t addr_pack_bits() {
+        return m_lite ? (m_addr_width + 3) : (m_addr_width + 3 + m_id_width + 8 + 3 + 2 + 1 + 4);
+    }
+
+    uint64_t addr_mask(uint32_t size) {
+        uint64_t mask = (m_addr_width == 64) ? ~0ull : ((1ull << m_addr_width) - 1);
+        return (mask >> size) << size;
+    }
+
+    void check_args(int& size, uint32_t& max_beats, uint32_t& id, uint32_t& num_ids) {
+        uint32_t bus_size = __builtin_ctz(m_data_bytes);
+
+        if (m_lite) {
+            // AXI-Lite transfers are always single beats of the full bus
+            // width, without IDs
+            size = bus_size;
+            max_beats = 1;
+            id = 0;
+            num_ids = 1;
+            return;
+        }
+
+        if (size < 0) {
+            size = bus_size;
+        }
+
+        if ((uint32_t)size > bus_size) {
+            throw std::runtime_error("AXI size exceeds the data bus width.");
+        }
+
+        if ((max_beats < 1) || (max_beats > 256)) {
+            throw std::runtime_error("max_beats must be in the range 1-256.");
+        }
+
+        if ((num_ids < 1) || ((m_id_width < 32) && ((uint64_t)id + num_ids > (1ull << m_id_width)))) {
+            throw std::runtime_error("AXI ID range out of bounds.");
+        }
+    }
+
+    uint32_t burst_beats(uint64_t addr, size_t remaining, uint32_t size, uint32_t max_beats) {
+        uint64_t base = addr & addr_mask(size);
+        uint64_t top = addr + remaining - 1;
+
+        // limit the transfer to the longest burst possible
+        top = std::min(top, base + ((uint64_t)max_beats << size) - 1);
+
+        // don't cross a 4 KB boundary
+        top = std::min(top, (addr & ~(uint64_t)(AXI_BOUNDARY - 1)) + AXI_BOUNDARY - 1);
+
+        return ((top - base) >> size) + 1;
+    }
+
+    void pack_addr(sb_packet& p, uint64_t addr, uint32_t prot, uint32_t id, uint32_t len,
+        uint32_t size) {
+
+        memset(&p, 0, sizeof(p));
+        p.flags = 1;
+
+        uint32_t pos = 0;
+        axisb_put(p.data, pos, addr & addr_mask(size), m_addr_width);
+        axisb_put(p.data, pos, prot, 3);
+
+        if (!m_lite) {
+            axisb_put(p.data, pos, id, m_id_width);
+            axisb_put(p.data, pos, len, 8);
+            axisb_put(p.data, pos, size, 3);
+            axisb_put(p.data, pos, AXI_BURST_INCR, 2);
+        }
+    }
+
+    uint32_t response_slot(uint32_t rid, uint32_t id, const std::vector<uint32_t>& outstanding,
+        const char* kind) {
+
+        uint32_t slot = rid - id;
+        if ((slot >= outstanding.size()) || (outstanding[slot] == 0)) {
+            throw std::runtime_error(
+                std::string("Unexpected AXI ") + kind + " response ID: " + std::to_string(rid));
+        }
+        return slot;
+    }
+
+    SBTX m_aw;
+    SBTX m_w;
+    SBRX m_b;
+    SBTX m_ar;
+    SBRX m_r;
+
+    uint32_t m_data_bytes;
+    uint32_t m_addr_width;
+    uint32_t m_id_width;
+    uint32_t m_max_outstanding;
+    bool m_lite;
+};
+
+#endif // __AXISB_HPP__
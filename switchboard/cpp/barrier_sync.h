@@ -13,6 +13,8 @@
 #include <unistd.h>
 #include <errno.h>
 
+#include "sbtrace.h"
+
 #ifdef __cplusplus
 #include <atomic>
 using namespace std;
@@ -210,6 +212,7 @@ static inline void barrier_close(cycle_barrier* b) {
 // SEQ_CST ordering for cross-process safety via shared memory
 static inline uint64_t barrier_wait(cycle_barrier* b) {
     assert(b && b->shm);
+    SB_TRACE_START(t0);
 
     cycle_barrier_shared* shm = b->shm;
     uint32_t num_procs = __atomic_load_n(&shm->num_processes, __ATOMIC_SEQ_CST);
@@ -251,6 +254,8 @@ static inline uint64_t barrier_wait(cycle_barrier* b) {
     // flip local sense for next barrier (sense-reversing)
     b->local_sense = 1 - my_sense;
 
+    SB_TRACE_SPAN(SB_TRACE_BARRIER_WAIT, 0, 1, t0);
+
     // return current cycle count
     return __atomic_load_n(&shm->cycle_count, __ATOMIC_SEQ_CST);
 }
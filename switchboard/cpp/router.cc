@@ -23,6 +23,11 @@ bool init(int argc, char* argv[]) {
     enum MODE { RX, TX, ROUTE, UNDEF };
     MODE mode = UNDEF;
 
+    std::vector<std::string> rx_queues;
+    std::vector<std::string> tx_queues;
+    const char* cpus = NULL;
+    const char* numa = NULL;
+
     while (arg_idx < argc) {
         std::string arg = std::string(argv[arg_idx++]);
         if (arg == "--rx") {
@@ -31,13 +36,15 @@ bool init(int argc, char* argv[]) {
             mode = TX;
         } else if (arg == "--route") {
             mode = ROUTE;
+        } else if ((arg == "--cpu") && (arg_idx < argc)) {
+            // takes a single value, and doesn't change the mode
+            cpus = argv[arg_idx++];
+        } else if ((arg == "--numa") && (arg_idx < argc)) {
+            numa = argv[arg_idx++];
         } else if (mode == RX) {
-            rxconn.push_back(std::unique_ptr<SBRX>(new SBRX()));
-            rxconn.back()->init(std::string("queue-") + arg);
+            rx_queues.push_back(arg);
         } else if (mode == TX) {
-            int queue = atoi(arg.c_str());
-            txconn[queue] = std::unique_ptr<SBTX>(new SBTX());
-            txconn[queue]->init(std::string("queue-") + arg);
+            tx_queues.push_back(arg);
         } else if (mode == ROUTE) {
             size_t split = arg.find(':');
             std::string first = arg.substr(0, split);
@@ -50,6 +57,30 @@ bool init(int argc, char* argv[]) {
         }
     }
 
+    // pin the router before opening queues, so that queues placed on the
+    // consumer's node end up on the router's node
+
+    if (cpus && !sb_set_affinity(cpus)) {
+        return false;
+    }
+
+    if (numa) {
+        sb_numa_default() = sb_numa_parse(numa);
+    }
+
+    for (auto& arg : rx_queues) {
+        rxconn.push_back(std::unique_ptr<SBRX>(new SBRX()));
+        rxconn.back()->init(std::string("queue-") + arg);
+        // decode stamps, so that they can be passed on
+        rxconn.back()->set_tstamp(true);
+    }
+
+    for (auto& arg : tx_queues) {
+        int queue = atoi(arg.c_str());
+        txconn[queue] = std::unique_ptr<SBTX>(new SBTX());
+        txconn[queue]->init(std::string("queue-") + arg);
+    }
+
     return true;
 }
 
@@ -61,19 +92,21 @@ int main(int argc, char* argv[]) {
     }
 
     sb_packet p;
+    uint64_t tstamp;
     while (true) {
         // loop over all RX connection
         for (auto& rx : rxconn) {
             if (rx->is_active()) {
-                if (rx->recv_peek(p)) {
+                if (rx->recv_peek(p, tstamp)) {
                     // make sure that the destination is in the routing table and active
                     if ((routing_table.count(p.destination) > 0) &&
                         (txconn.count(routing_table[p.destination]) > 0) &&
                         (txconn[routing_table[p.destination]]->is_active())) {
 
-                        // try to send the packet, removing it from
-                        // the RX queue if the send is successful
-                        if (txconn[routing_table[p.destination]]->send(p)) {
+                        // try to send the packet with its original stamp,
+                        // removing it from the RX queue if the send is
+                        // successful
+                        if (txconn[routing_table[p.destination]]->send(p, tstamp)) {
                             rx->recv();
                         }
                     } else {
@@ -0,0 +1,340 @@
+// Switchboard packet capture and replay
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// Usage:
+//
+//   sbcap --tap <in>:<out> [<in>:<out> ...] --out <file> [--sim-time] [--count <n>]
+//       Interposes on each queue pair, forwarding packets from <in> to <out>
+//       and recording them.  The producer is pointed at <in> and the consumer
+//       at <out>, so that the tap is otherwise transparent.  Stamps (see
+//       sb_packet_ts) are always passed through and recorded with each packet.
+//       Records are written in the order that packets arrive.  With
+//       --sim-time, packets are expected to be stamped, and their stamps are
+//       used as record timestamps; records from different queues are then
+//       not necessarily in stamp order.  Otherwise, packets are recorded
+//       with CLOCK_MONOTONIC timestamps in nanoseconds.
+//
+//   sbcap --replay <file> [--map <id>:<uri> ...] [--rate]
+//       Feeds a capture back into SBTX queues, by default the <out> queues
+//       recorded in the capture.  Packets are sent as fast as possible unless
+//       --rate is given, in which case the recorded spacing is reproduced;
+//       this only applies to CLOCK_MONOTONIC captures.  Packets are always sent with their recorded stamps, leaving the timing
+//       of simulation-time captures to receivers in replay mode
+//       (set_link_latency()).
+//
+//   sbcap --dump <file> [--umi]
+//       Prints a capture, optionally decoding packets as UMI transactions.
+
+#include <cinttypes>
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "sbcap.h"
+#include "switchboard.hpp"
+#include "umilib.h"
+#include "umisb.hpp"
+
+static volatile sig_atomic_t got_sigint = 0;
+
+static void sigint_handler(int unused) {
+    got_sigint = 1;
+}
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+struct tap {
+    std::string in_uri;
+    std::string out_uri;
+    SBRX rx;
+    SBTX tx;
+
+    // a packet that was received, but could not be forwarded yet
+    bool pending;
+    sb_packet p;
+    uint64_t tstamp;
+};
+
+static int do_capture(std::vector<std::unique_ptr<tap>>& taps, std::string out_file,
+    bool sim_time, long count) {
+
+    if (taps.empty() || (out_file == "")) {
+        fprintf(stderr, "ERROR: --tap and --out are required for capture.\n");
+        return 1;
+    }
+
+    FILE* f = fopen(out_file.c_str(), "wb");
+    if (!f) {
+        perror(out_file.c_str());
+        return 1;
+    }
+
+    static char buf[1 << 20];
+    setvbuf(f, buf, _IOFBF, sizeof buf);
+
+    // the capture refers to the queues that replay should feed, which are
+    // the ones the consumers read from
+    std::vector<const char*> names;
+    for (auto& t : taps) {
+        names.push_back(t->out_uri.c_str());
+    }
+
+    if (!sbcap_write_header(f, sim_time ? SBCAP_CLOCK_SIM : SBCAP_CLOCK_MONOTONIC, names.size(),
+            names.data())) {
+        perror("fwrite");
+        fclose(f);
+        return 1;
+    }
+
+    for (auto& t : taps) {
+        t->rx.init(t->in_uri);
+        t->tx.init(t->out_uri);
+        // stamps are decoded, recorded and passed on whatever the clock
+        t->rx.set_tstamp(true);
+        t->pending = false;
+    }
+
+    signal(SIGINT, sigint_handler);
+
+    long captured = 0;
+    sbcap_record rec;
+    memset(&rec, 0, sizeof rec);
+
+    while (!got_sigint && ((count < 0) || (captured < count))) {
+        for (size_t i = 0; i < taps.size(); i++) {
+            tap& t = *taps[i];
+
+            if (!t.pending) {
+                if (!t.rx.recv(t.p)) {
+                    continue;
+                }
+
+                t.tstamp = t.rx.last_tstamp();
+                t.pending = true;
+
+                rec.tstamp = sim_time ? t.tstamp : monotonic_ns();
+                rec.queue = i;
+                rec.pkt = t.p;
+                rec.pkt_tstamp = (uint32_t)t.tstamp;
+                if (fwrite(&rec, sizeof rec, 1, f) != 1) {
+                    perror("fwrite");
+                    fclose(f);
+                    return 1;
+                }
+
+                captured++;
+            }
+
+            if (t.tx.send(t.p, t.tstamp)) {
+                t.pending = false;
+            }
+        }
+    }
+
+    // packets already taken from their input queue still have to reach
+    // the consumer, unless we're being interrupted
+    for (auto& t : taps) {
+        while (t->pending && !got_sigint) {
+            t->pending = !t->tx.send(t->p, t->tstamp);
+        }
+    }
+
+    fclose(f);
+    fprintf(stderr, "sbcap: captured %ld packets to %s\n", captured, out_file.c_str());
+    return 0;
+}
+
+static int do_replay(std::string in_file, std::map<uint32_t, std::string>& queue_map,
+    bool rate) {
+
+    sbcap_file cap;
+    if (!sbcap_open(&cap, in_file.c_str())) {
+        return 1;
+    }
+
+    bool sim_time = (cap.hdr->clock == SBCAP_CLOCK_SIM);
+
+    if (rate && sim_time) {
+        fprintf(stderr, "ERROR: --rate needs a CLOCK_MONOTONIC capture; packets of a sim-time"
+                        " capture are timed by receivers in replay mode\n");
+        sbcap_close(&cap);
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<SBTX>> txconn;
+    for (uint32_t i = 0; i < cap.hdr->num_queues; i++) {
+        std::string uri = std::string(cap.queues[i].name);
+        if (queue_map.count(i) > 0) {
+            uri = queue_map[i];
+        }
+
+        txconn.push_back(std::unique_ptr<SBTX>(new SBTX()));
+        txconn.back()->init(uri);
+    }
+
+    signal(SIGINT, sigint_handler);
+
+    uint64_t t0_rec = (cap.num_records > 0) ? cap.records[0].tstamp : 0;
+    uint64_t t0 = monotonic_ns();
+
+    size_t i;
+    for (i = 0; (i < cap.num_records) && !got_sigint; i++) {
+        sbcap_record rec;
+        memcpy(&rec, &cap.records[i], sizeof rec);
+
+        if (rec.queue >= txconn.size()) {
+            fprintf(stderr, "ERROR: record %zu refers to unknown queue %u\n", i, rec.queue);
+            sbcap_close(&cap);
+            return 1;
+        }
+
+        if (rate) {
+            // reproduce the recorded spacing.  sleep while the target is
+            // comfortably far away, then spin for the rest, since sleep
+            // granularity is much coarser than typical packet spacing.
+            uint64_t target = t0 + (rec.tstamp - t0_rec);
+            uint64_t now;
+            while (((now = monotonic_ns()) < target) && !got_sigint) {
+                if ((target - now) > 200000) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(target - now - 100000));
+                }
+            }
+        }
+
+        SBTX& tx = *txconn[rec.queue];
+        uint64_t tstamp = sim_time ? rec.tstamp : rec.pkt_tstamp;
+        while (!tx.send(rec.pkt, tstamp) && !got_sigint) {
+            std::this_thread::yield();
+        }
+    }
+
+    fprintf(stderr, "sbcap: replayed %zu of %zu packets from %s\n", i, cap.num_records,
+        in_file.c_str());
+
+    sbcap_close(&cap);
+    return 0;
+}
+
+static int do_dump(std::string in_file, bool umi) {
+    sbcap_file cap;
+    if (!sbcap_open(&cap, in_file.c_str())) {
+        return 1;
+    }
+
+    printf("clock: %s\n", (cap.hdr->clock == SBCAP_CLOCK_SIM) ? "sim" : "monotonic");
+    for (uint32_t i = 0; i < cap.hdr->num_queues; i++) {
+        printf("queue %u: %s\n", i, cap.queues[i].name);
+    }
+    printf("records: %zu\n", cap.num_records);
+
+    for (size_t i = 0; i < cap.num_records; i++) {
+        sbcap_record rec;
+        memcpy(&rec, &cap.records[i], sizeof rec);
+
+        printf("[%zu] t=%" PRIu64 " q=%u %s\n", i, rec.tstamp, rec.queue,
+            sb_packet_to_str(rec.pkt).c_str());
+
+        if (umi) {
+            umi_packet* up = (umi_packet*)rec.pkt.data;
+            UmiTransaction x(up->cmd, up->dstaddr, up->srcaddr, up->data, sizeof(up->data));
+            std::string s = x.toString();
+
+            // indent the multi-line decode under its record
+            size_t pos = 0;
+            while ((pos = s.find('\n', pos)) != std::string::npos) {
+                s.replace(pos, 1, "\n    ");
+                pos += 5;
+            }
+            printf("    %s\n", s.c_str());
+        }
+    }
+
+    sbcap_close(&cap);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    enum MODE { TAP, OUT, REPLAY, MAP, DUMP, COUNT, UNDEF };
+    MODE mode = UNDEF;
+
+    std::vector<std::unique_ptr<tap>> taps;
+    std::map<uint32_t, std::string> queue_map;
+    std::string out_file = "";
+    std::string in_file = "";
+    bool replay = false;
+    bool dump = false;
+    bool sim_time = false;
+    bool rate = false;
+    bool umi = false;
+    long count = -1;
+
+    int arg_idx = 1;
+    while (arg_idx < argc) {
+        std::string arg = std::string(argv[arg_idx++]);
+        if (arg == "--tap") {
+            mode = TAP;
+        } else if (arg == "--out") {
+            mode = OUT;
+        } else if (arg == "--replay") {
+            mode = REPLAY;
+        } else if (arg == "--map") {
+            mode = MAP;
+        } else if (arg == "--dump") {
+            mode = DUMP;
+        } else if (arg == "--count") {
+            mode = COUNT;
+        } else if (arg == "--sim-time") {
+            sim_time = true;
+        } else if (arg == "--rate") {
+            rate = true;
+        } else if (arg == "--umi") {
+            umi = true;
+        } else if ((mode == TAP) || (mode == MAP)) {
+            size_t split = arg.find(':');
+            if (split == std::string::npos) {
+                fprintf(stderr, "ERROR: expected <a>:<b>, got %s\n", arg.c_str());
+                return 1;
+            }
+            std::string first = arg.substr(0, split);
+            std::string second = arg.substr(split + 1);
+            if (mode == TAP) {
+                taps.push_back(std::unique_ptr<tap>(new tap()));
+                taps.back()->in_uri = first;
+                taps.back()->out_uri = second;
+            } else {
+                queue_map[atoi(first.c_str())] = second;
+            }
+        } else if (mode == OUT) {
+            out_file = arg;
+        } else if ((mode == REPLAY) || (mode == DUMP)) {
+            in_file = arg;
+            replay = (mode == REPLAY);
+            dump = (mode == DUMP);
+        } else if (mode == COUNT) {
+            count = atol(arg.c_str());
+        } else {
+            fprintf(stderr, "ERROR: arguments are not formed properly.\n");
+            return 1;
+        }
+    }
+
+    if (dump) {
+        return do_dump(in_file, umi);
+    } else if (replay) {
+        return do_replay(in_file, queue_map, rate);
+    } else {
+        return do_capture(taps, out_file, sim_time, count);
+    }
+}
@@ -0,0 +1,177 @@
+// Switchboard packet capture file format
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+#ifndef SBCAP_H__
+#define SBCAP_H__
+
+#include <assert.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "switchboard.hpp"
+
+/*
+ * A capture file is laid out so that it can be mmap'd and indexed directly:
+ *
+ *   sbcap_header                       (64 bytes)
+ *   sbcap_queue[num_queues]            (128 bytes each)
+ *   padding up to data_offset          (64-byte aligned)
+ *   sbcap_record[]                     (record_size bytes each)
+ *
+ * Records are appended in capture order.  A capture that was cut short
+ * (e.g. by a crash) is still readable; a trailing partial record is ignored.
+ */
+
+#define SBCAP_MAGIC "SBCAP\r\n\032"
+#define SBCAP_VERSION 1
+
+// source of the timestamps in a capture
+#define SBCAP_CLOCK_MONOTONIC 0 // nanoseconds, CLOCK_MONOTONIC
+#define SBCAP_CLOCK_SIM 1       // simulation cycles, from stamped packets
+
+#define SBCAP_NAME_SIZE 120
+
+typedef struct sbcap_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t clock;
+    uint32_t record_size;
+    uint32_t num_queues;
+    uint64_t data_offset;
+    uint8_t reserved[32];
+} sbcap_header;
+
+typedef struct sbcap_queue {
+    uint32_t id;
+    uint32_t reserved;
+    char name[SBCAP_NAME_SIZE];
+} sbcap_queue;
+
+typedef struct sbcap_record {
+    uint64_t tstamp;
+    uint32_t queue;
+    uint32_t reserved;
+    sb_packet pkt;
+    uint32_t pkt_tstamp; // stamp carried by the packet, for either clock
+} __attribute__((packed)) sbcap_record;
+
+static_assert(sizeof(sbcap_header) == 64, "sbcap_header must be 64 bytes");
+static_assert(sizeof(sbcap_queue) == 128, "sbcap_queue must be 128 bytes");
+static_assert(sizeof(sbcap_record) == 80, "sbcap_record must be 80 bytes");
+
+static inline uint64_t sbcap_data_offset(uint32_t num_queues) {
+    uint64_t offset = sizeof(sbcap_header) + num_queues * sizeof(sbcap_queue);
+    return (offset + 63) & ~((uint64_t)63);
+}
+
+// Writes the header and queue table at the start of a new capture file.
+static inline bool sbcap_write_header(FILE* f, uint32_t clock, uint32_t num_queues,
+    const char* const* names) {
+
+    sbcap_header hdr;
+    memset(&hdr, 0, sizeof hdr);
+    memcpy(hdr.magic, SBCAP_MAGIC, sizeof hdr.magic);
+    hdr.version = SBCAP_VERSION;
+    hdr.clock = clock;
+    hdr.record_size = sizeof(sbcap_record);
+    hdr.num_queues = num_queues;
+    hdr.data_offset = sbcap_data_offset(num_queues);
+
+    if (fwrite(&hdr, sizeof hdr, 1, f) != 1) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < num_queues; i++) {
+        sbcap_queue q;
+        memset(&q, 0, sizeof q);
+        q.id = i;
+        strncpy(q.name, names[i], sizeof(q.name) - 1);
+        if (fwrite(&q, sizeof q, 1, f) != 1) {
+            return false;
+        }
+    }
+
+    // pad out to the start of the records
+    long pos = ftell(f);
+    while ((uint64_t)pos < hdr.data_offset) {
+        if (fputc(0, f) == EOF) {
+            return false;
+        }
+        pos++;
+    }
+
+    return true;
+}
+
+// Read-only view of a capture file, backed by a private mapping.
+typedef struct sbcap_file {
+    void* map;
+    size_t mapsize;
+    const sbcap_header* hdr;
+    const sbcap_queue* queues;
+    const sbcap_record* records;
+    size_t num_records;
+} sbcap_file;
+
+static inline bool sbcap_open(sbcap_file* cap, const char* path) {
+    struct stat st;
+    int fd;
+
+    memset(cap, 0, sizeof *cap);
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return false;
+    }
+
+    if ((fstat(fd, &st) < 0) || ((size_t)st.st_size < sizeof(sbcap_header))) {
+        fprintf(stderr, "%s: not a switchboard capture\n", path);
+        close(fd);
+        return false;
+    }
+
+    cap->mapsize = st.st_size;
+    cap->map = mmap(NULL, cap->mapsize, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (cap->map == MAP_FAILED) {
+        perror("mmap");
+        cap->map = NULL;
+        return false;
+    }
+
+    cap->hdr = (const sbcap_header*)cap->map;
+
+    if ((memcmp(cap->hdr->magic, SBCAP_MAGIC, sizeof cap->hdr->magic) != 0) ||
+        (cap->hdr->version != SBCAP_VERSION) || (cap->hdr->record_size != sizeof(sbcap_record)) ||
+        (cap->hdr->data_offset > cap->mapsize) ||
+        (cap->hdr->data_offset < sbcap_data_offset(cap->hdr->num_queues))) {
+        fprintf(stderr, "%s: unsupported or corrupt capture header\n", path);
+        munmap(cap->map, cap->mapsize);
+        cap->map = NULL;
+        return false;
+    }
+
+    cap->queues = (const sbcap_queue*)((const char*)cap->map + sizeof(sbcap_header));
+    cap->records = (const sbcap_record*)((const char*)cap->map + cap->hdr->data_offset);
+    cap->num_records = (cap->mapsize - cap->hdr->data_offset) / sizeof(sbcap_record);
+
+    return true;
+}
+
+static inline void sbcap_close(sbcap_file* cap) {
+    if (cap->map) {
+        munmap(cap->map, cap->mapsize);
+    }
+    memset(cap, 0, sizeof *cap);
+}
+
+#endif // SBCAP_H__
@@ -0,0 +1,377 @@
+// CPU affinity and NUMA placement for queues and the threads that poll them
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// On multi-socket machines, a queue is much slower to poll when its pages
+// live on another node, or when its producer and consumer run on different
+// sockets, since every head/tail update then crosses the interconnect.
+// These helpers pin threads to a list of CPUs ("0-3,8" format) and place
+// queue pages on a NUMA node.  They use the raw system calls so that libnuma
+// isn't needed, and quietly do nothing on systems without NUMA support.
+//
+// The placement of a queue is a node number, SB_NUMA_NONE (leave it to the
+// kernel, i.e. pages end up on the node of whichever process touches them
+// first), or SB_NUMA_CONSUMER, which places the queue on the node that the
+// consumer is running on when it opens the queue.  Pages that the other
+// side allocated earlier can't always be migrated (moving pages mapped by
+// more than one process needs CAP_SYS_NICE), so when the order in which the
+// two sides open the queue isn't known, giving both sides the same node
+// number is the reliable option.
+//
+// If SB_PLACEMENT_REPORT names a file ("-" for stderr), a line is appended
+// to it for each queue opened, with the CPU and node that the process is
+// running on and the number of the queue's pages on each node.
+
+#ifndef SBPLACE_H__
+#define SBPLACE_H__
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define SB_NUMA_NONE -1
+#define SB_NUMA_CONSUMER -2
+
+#define SB_PLACE_MAX_CPUS 1024
+#define SB_PLACE_MAX_NODES 1024
+#define SB_PLACE_MASK_WORDS(n) ((n) / (8 * sizeof(unsigned long)))
+
+// from linux/mempolicy.h, which isn't always installed
+#define SB_MPOL_PREFERRED 1
+#define SB_MPOL_MF_MOVE (1 << 1)
+
+#if defined(__linux__) && defined(SYS_mbind) && defined(SYS_set_mempolicy) &&                     \
+    defined(SYS_get_mempolicy) && defined(SYS_move_pages)
+#define SB_PLACE_NUMA 1
+#else
+#define SB_PLACE_NUMA 0
+#endif
+
+// parses a queue placement: "" or "none", "consumer", or a node number.
+// returns SB_NUMA_NONE (with a warning) if the placement isn't valid.
+static inline int sb_numa_parse(const char* spec) {
+    char* end;
+    long node;
+
+    if (!spec || (spec[0] == '\0') || (strcmp(spec, "none") == 0)) {
+        return SB_NUMA_NONE;
+    }
+
+    if (strcmp(spec, "consumer") == 0) {
+        return SB_NUMA_CONSUMER;
+    }
+
+    node = strtol(spec, &end, 10);
+    if ((end == spec) || (*end != '\0') || (node < 0) || (node >= SB_PLACE_MAX_NODES)) {
+        fprintf(stderr, "warning: ignoring invalid NUMA placement \"%s\"\n", spec);
+        return SB_NUMA_NONE;
+    }
+
+    return node;
+}
+
+// parses a CPU list such as "0-3,8" into a bit mask.  returns the number of
+// CPUs in the list, or -1 if it isn't valid.
+static inline int sb_cpulist_parse(const char* spec, unsigned long* mask, int maxcpus) {
+    const char* s = spec;
+    int count = 0;
+
+    memset(mask, 0, SB_PLACE_MASK_WORDS(maxcpus) * sizeof(unsigned long));
+
+    while (*s) {
+        char* end;
+        long first = strtol(s, &end, 10);
+        long last = first;
+
+        if (end == s) {
+            return -1;
+        }
+        s = end;
+
+        if (*s == '-') {
+            s++;
+            last = strtol(s, &end, 10);
+            if (end == s) {
+                return -1;
+            }
+            s = end;
+        }
+
+        if ((first < 0) || (last < first) || (last >= maxcpus)) {
+            return -1;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++) {
+            unsigned long bit = 1UL << (cpu % (8 * sizeof(unsigned long)));
+            unsigned long* word = &mask[cpu / (8 * sizeof(unsigned long))];
+            if (!(*word & bit)) {
+                *word |= bit;
+                count++;
+            }
+        }
+
+        if (*s == ',') {
+            s++;
+        } else if (*s != '\0') {
+            return -1;
+        }
+    }
+
+    return count;
+}
+
+// pins the calling thread, and threads that it creates afterwards, to the
+// CPUs in "spec".  returns false (with a message) on failure.
+static inline bool sb_set_affinity(const char* spec) {
+#ifdef __linux__
+    unsigned long mask[SB_PLACE_MASK_WORDS(SB_PLACE_MAX_CPUS)];
+
+    if (sb_cpulist_parse(spec, mask, SB_PLACE_MAX_CPUS) <= 0) {
+        fprintf(stderr, "invalid CPU list \"%s\"\n", spec);
+        return false;
+    }
+
+    if (syscall(SYS_sched_setaffinity, 0, sizeof mask, mask) < 0) {
+        perror("sched_setaffinity");
+        return false;
+    }
+
+    return true;
+#else
+    fprintf(stderr, "warning: ignoring CPU list \"%s\", since affinity isn't supported\n", spec);
+    return false;
+#endif
+}
+
+static inline int sb_current_cpu(void) {
+#if defined(__linux__) && defined(SYS_getcpu)
+    unsigned cpu;
+
+    if (syscall(SYS_getcpu, &cpu, NULL, NULL) == 0) {
+        return cpu;
+    }
+#endif
+    return -1;
+}
+
+// returns the NUMA node of "cpu", or -1 if it isn't known
+static inline int sb_cpu_node(int cpu) {
+    char path[64];
+    struct dirent* entry;
+    DIR* dir;
+    int node = -1;
+
+    if (cpu < 0) {
+        return -1;
+    }
+
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d", cpu);
+    dir = opendir(path);
+    if (!dir) {
+        return -1;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (sscanf(entry->d_name, "node%d", &node) == 1) {
+            break;
+        }
+        node = -1;
+    }
+
+    closedir(dir);
+    return node;
+}
+
+static inline int sb_current_node(void) {
+    return sb_cpu_node(sb_current_cpu());
+}
+
+// turns a queue placement into a node number (or SB_NUMA_NONE) for the
+// side of the queue that is opening it
+static inline int sb_numa_resolve(int node, bool consumer) {
+    if (node == SB_NUMA_CONSUMER) {
+        return consumer ? sb_current_node() : SB_NUMA_NONE;
+    }
+    return node;
+}
+
+// the calling thread's memory policy, so that it can be restored after
+// temporarily preferring a node
+typedef struct sb_numa_policy {
+    int mode;
+    bool valid;
+    unsigned long mask[SB_PLACE_MASK_WORDS(SB_PLACE_MAX_NODES)];
+} sb_numa_policy;
+
+// makes the calling thread allocate new pages on "node" where possible,
+// saving its previous policy in "saved".  since page cache and tmpfs pages
+// are allocated according to the policy of the thread that faults them in,
+// this places the pages of a queue file as they are prefaulted.
+static inline void sb_numa_prefer(int node, sb_numa_policy* saved) {
+    saved->valid = false;
+
+#if SB_PLACE_NUMA
+    unsigned long mask[SB_PLACE_MASK_WORDS(SB_PLACE_MAX_NODES)];
+
+    if (syscall(SYS_get_mempolicy, &saved->mode, saved->mask, SB_PLACE_MAX_NODES, NULL, 0) < 0) {
+        return;
+    }
+
+    memset(mask, 0, sizeof mask);
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+
+    if (syscall(SYS_set_mempolicy, SB_MPOL_PREFERRED, mask, SB_PLACE_MAX_NODES) == 0) {
+        saved->valid = true;
+    } else if (errno != ENOSYS) {
+        fprintf(stderr, "warning: could not prefer NUMA node %d: %s\n", node, strerror(errno));
+    }
+#else
+    (void)node;
+#endif
+}
+
+static inline void sb_numa_restore(sb_numa_policy* saved) {
+#if SB_PLACE_NUMA
+    if (saved->valid) {
+        syscall(SYS_set_mempolicy, saved->mode, saved->mask, SB_PLACE_MAX_NODES);
+    }
+#endif
+    saved->valid = false;
+}
+
+// sets the policy of a mapping to prefer "node", which also applies to pages
+// of a tmpfs file allocated later by other processes, and moves pages that
+// are already allocated elsewhere and only mapped by this process
+static inline void sb_numa_bind(void* addr, size_t len, int node) {
+#if SB_PLACE_NUMA
+    unsigned long mask[SB_PLACE_MASK_WORDS(SB_PLACE_MAX_NODES)];
+
+    memset(mask, 0, sizeof mask);
+    mask[node / (8 * sizeof(unsigned long))] = 1UL << (node % (8 * sizeof(unsigned long)));
+
+    if ((syscall(SYS_mbind, addr, len, SB_MPOL_PREFERRED, mask, SB_PLACE_MAX_NODES,
+             SB_MPOL_MF_MOVE) < 0) &&
+        (errno != ENOSYS)) {
+        fprintf(stderr, "warning: could not bind pages to NUMA node %d: %s\n", node,
+            strerror(errno));
+    }
+#else
+    (void)addr;
+    (void)len;
+    (void)node;
+#endif
+}
+
+// counts the pages of a mapping on each node: counts[n] is incremented for
+// each page on node n < ncounts.  returns the number of resident pages
+// found, or -1 if this isn't supported.
+static inline int sb_numa_page_nodes(void* addr, size_t len, int* counts, int ncounts) {
+#if SB_PLACE_NUMA
+    long pagesize = sysconf(_SC_PAGESIZE);
+    size_t npages = (len + pagesize - 1) / pagesize;
+    void* pages[64];
+    int status[64];
+    int found = 0;
+
+    for (size_t i = 0; i < npages; i += 64) {
+        size_t n = (npages - i < 64) ? (npages - i) : 64;
+
+        for (size_t j = 0; j < n; j++) {
+            pages[j] = (char*)addr + (i + j) * pagesize;
+        }
+
+        // with no target nodes, move_pages() just reports where pages are
+        if (syscall(SYS_move_pages, 0, n, pages, NULL, status, 0) < 0) {
+            return -1;
+        }
+
+        for (size_t j = 0; j < n; j++) {
+            if (status[j] >= 0) {
+                found++;
+                if (status[j] < ncounts) {
+                    counts[status[j]]++;
+                }
+            }
+        }
+    }
+
+    return found;
+#else
+    (void)addr;
+    (void)len;
+    (void)counts;
+    (void)ncounts;
+    return -1;
+#endif
+}
+
+// appends a line describing where a queue ended up to the file named by
+// SB_PLACEMENT_REPORT, if set
+static inline void sb_place_report(const char* name, const char* role, void* addr, size_t len) {
+    const char* file = getenv("SB_PLACEMENT_REPORT");
+    char line[512];
+    int counts[64];
+    int cpu, n, found;
+    int fd;
+
+    if (!file || (file[0] == '\0')) {
+        return;
+    }
+
+    cpu = sb_current_cpu();
+    memset(counts, 0, sizeof counts);
+    found = sb_numa_page_nodes(addr, len, counts, 64);
+
+    n = snprintf(line, sizeof line, "%s: pid %d %s cpu %d node %d pages", name, (int)getpid(),
+        role, cpu, sb_cpu_node(cpu));
+
+    if (found < 0) {
+        n += snprintf(line + n, sizeof line - n, " unknown");
+    } else if (found == 0) {
+        n += snprintf(line + n, sizeof line - n, " none");
+    } else {
+        for (int i = 0; (i < 64) && (n < (int)sizeof line); i++) {
+            if (counts[i] > 0) {
+                n += snprintf(line + n, sizeof line - n, " node%d:%d", i, counts[i]);
+            }
+        }
+    }
+
+    if (n >= (int)sizeof line - 1) {
+        n = sizeof line - 2;
+    }
+    line[n++] = '\n';
+
+    // one write per line, so that processes can share a report file
+    if (strcmp(file, "-") == 0) {
+        fd = STDERR_FILENO;
+    } else {
+        fd = open(file, O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+        if (fd < 0) {
+            perror(file);
+            return;
+        }
+    }
+
+    if (write(fd, line, n) < 0) {
+        perror(file);
+    }
+
+    if (fd != STDERR_FILENO) {
+        close(fd);
+    }
+}
+
+#endif // SBPLACE_H__
@@ -0,0 +1,618 @@
+// Native TCP bridge for Switchboard packets
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// Usage:
+//
+//   sbtcp --outputs <rule>:<uri> [...] [options]
+//       Receives packets over TCP (as a server by default) and writes each
+//       one to the first queue whose rule matches its destination.  Rules
+//       are the same as for sbtcp.py, e.g. 0:a.q 1-2:b.q 3,5-7:c.q *:d.q
+//
+//   sbtcp --inputs [<dest>:]<uri> [...] [options]
+//       Reads packets from the queues in round-robin order and sends them
+//       over TCP (as a client by default).  If <dest> is given, the
+//       destination of packets read from that queue is overwritten.
+//
+// Options:
+//   --host <host>, --port <port>  address to listen on / connect to
+//   --server, --client            override the default role
+//   --max-rate <rate>             passed through to the queues
+//   --run-once                    exit after the first connection closes
+//   --batch <n>                   packets per send() (default 64)
+//   --busy-poll <us>              spin instead of yielding when idle, and
+//                                 set SO_BUSY_POLL on the socket
+//   --no-nodelay                  don't set TCP_NODELAY
+//   --tstamp                      carry sim-time stamps (both ends must set it)
+//   -q                            don't print anything
+//
+// The wire format is the same as sbtcp.py: packets are sent back to back,
+// each as the 60 bytes of an sb_packet (destination, flags, data).  With
+// --tstamp, each packet is followed by its 32-bit sim-time stamp, i.e. the
+// 64 bytes of an sb_packet_ts, so that stamps survive the bridge; since
+// the two formats can't be told apart, both ends have to agree on it.
+// Packets are moved in batches, received directly into a packet buffer and
+// sent from it with a single call, rather than one system call per packet.
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <memory>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "switchboard.hpp"
+
+#define SBTCP_BATCH 64
+
+// destinations below this are looked up in a flat table; rules covering
+// larger destinations are checked in order
+#define SBTCP_TABLE_SIZE 65536
+
+struct sbtcp_options {
+    std::string host = "localhost";
+    int port = 5555;
+    bool quiet = false;
+    bool run_once = false;
+    bool nodelay = true;
+    int busy_poll = 0;
+    size_t batch = SBTCP_BATCH;
+    bool tstamp = false;
+
+    // bytes per packet on the wire
+    size_t packet_size() const {
+        return tstamp ? sizeof(sb_packet_ts) : sizeof(sb_packet);
+    }
+};
+
+// destination rules, compiled into a lookup table
+
+class sbtcp_routes {
+  public:
+    // adds a rule such as "0", "1-2", "3,5-7", or "*" for output "idx".
+    // returns false if the rule can't be parsed.
+    bool add(const std::string& rule, int idx) {
+        size_t start = 0;
+        while (start <= rule.size()) {
+            size_t end = rule.find(',', start);
+            if (end == std::string::npos) {
+                end = rule.size();
+            }
+            std::string sub = rule.substr(start, end - start);
+
+            entry e;
+            e.idx = idx;
+            if (sub == "*") {
+                e.lo = 0;
+                e.hi = UINT32_MAX;
+            } else {
+                size_t dash = sub.find('-');
+                char* p;
+                e.lo = strtoul(sub.c_str(), &p, 10);
+                if (p == sub.c_str()) {
+                    return false;
+                }
+                e.hi = e.lo;
+                if (dash != std::string::npos) {
+                    const char* s = sub.c_str() + dash + 1;
+                    e.hi = strtoul(s, &p, 10);
+                    if ((p == s) || (e.hi < e.lo)) {
+                        return false;
+                    }
+                }
+            }
+            m_rules.push_back(e);
+
+            start = end + 1;
+        }
+
+        return true;
+    }
+
+    void compile() {
+        // fill in the table in reverse, so that the first matching rule wins
+        m_table.assign(SBTCP_TABLE_SIZE, -1);
+        for (auto it = m_rules.rbegin(); it != m_rules.rend(); ++it) {
+            for (uint64_t d = it->lo; (d <= it->hi) && (d < SBTCP_TABLE_SIZE); d++) {
+                m_table[d] = it->idx;
+            }
+        }
+
+        m_large.clear();
+        for (const entry& e : m_rules) {
+            if (e.hi >= SBTCP_TABLE_SIZE) {
+                m_large.push_back(e);
+            }
+        }
+    }
+
+    // returns the output for "dest", or -1 if no rule matches
+    int lookup(uint32_t dest) {
+        if (dest < SBTCP_TABLE_SIZE) {
+            return m_table[dest];
+        }
+        for (const entry& e : m_large) {
+            if ((e.lo <= dest) && (dest <= e.hi)) {
+                return e.idx;
+            }
+        }
+        return -1;
+    }
+
+  private:
+    struct entry {
+        uint32_t lo;
+        uint32_t hi;
+        int idx;
+    };
+
+    std::vector<entry> m_rules;
+    std::vector<entry> m_large;
+    std::vector<int> m_table;
+};
+
+struct sbtcp_input {
+    bool override;
+    uint32_t destination;
+    SBRX rx;
+};
+
+static void set_sockopts(int fd, const sbtcp_options& opts) {
+    int one = 1;
+    if (opts.nodelay) {
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+    }
+    if (opts.busy_poll > 0) {
+        // may fail without CAP_NET_ADMIN, in which case spinning alone helps
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &opts.busy_poll, sizeof opts.busy_poll);
+    }
+}
+
+static void idle(const sbtcp_options& opts) {
+    if (opts.busy_poll > 0) {
+        tsc_relax();
+    } else {
+        std::this_thread::yield();
+    }
+}
+
+// waits until "fd" is ready for "events", returning false if the peer
+// hung up, or if "fd" can't be waited on, which ends the connection
+// rather than waiting forever.  a timeout of zero just checks.
+static bool wait_fd(int ep, int fd, uint32_t events, int timeout) {
+    struct epoll_event ev;
+    ev.events = events | EPOLLRDHUP;
+    ev.data.fd = fd;
+    if (epoll_ctl(ep, EPOLL_CTL_MOD, fd, &ev) < 0) {
+        perror("epoll_ctl");
+        return false;
+    }
+
+    int n = epoll_wait(ep, &ev, 1, timeout);
+    if ((n > 0) && (ev.events & (EPOLLHUP | EPOLLERR))) {
+        return false;
+    }
+    if ((n > 0) && (ev.events & EPOLLRDHUP) && !(events & EPOLLIN)) {
+        return false;
+    }
+    return true;
+}
+
+// receives packets from "fd" and routes them to the outputs until the
+// connection is closed.  returns false on a routing error.
+static bool tcp2sb(int fd, int ep, std::vector<std::unique_ptr<SBTX>>& outputs,
+    sbtcp_routes& routes, const sbtcp_options& opts) {
+
+    size_t psize = opts.packet_size();
+    std::vector<uint8_t> buf(16 * opts.batch * psize);
+    size_t head = 0;
+    size_t tail = 0;
+
+    while (true) {
+        bool progress = false;
+
+        // forward complete packets, stopping if an output is full
+        while ((tail - head) >= psize) {
+            sb_packet_ts p;
+            memset(&p, 0, sizeof p);
+            memcpy(&p, &buf[head], psize);
+
+            int idx = routes.lookup(p.pkt.destination);
+            if (idx < 0) {
+                fprintf(stderr, "ERROR: No rule for destination %u\n", p.pkt.destination);
+                return false;
+            }
+            if (!outputs[idx]->send(p.pkt, p.tstamp)) {
+                break;
+            }
+
+            head += psize;
+            progress = true;
+        }
+
+        // make room for more data
+        if (head == tail) {
+            head = tail = 0;
+        } else if ((buf.size() - tail) < psize) {
+            memmove(&buf[0], &buf[head], tail - head);
+            tail -= head;
+            head = 0;
+        }
+
+        if (tail < buf.size()) {
+            ssize_t n = recv(fd, &buf[tail], buf.size() - tail, MSG_DONTWAIT);
+            if (n > 0) {
+                tail += n;
+                progress = true;
+            } else if (n == 0) {
+                // connection is not alive anymore
+                return true;
+            } else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)) {
+                return true;
+            } else if ((head == tail) && (opts.busy_poll == 0)) {
+                // nothing to forward, so sleep until data arrives
+                if (!wait_fd(ep, fd, EPOLLIN, -1)) {
+                    return true;
+                }
+                continue;
+            }
+        }
+
+        if (!progress) {
+            idle(opts);
+        }
+    }
+}
+
+// reads packets from the inputs in round-robin order and sends them over
+// "fd" until the connection is closed
+static void sb2tcp(int fd, int ep, std::vector<std::unique_ptr<sbtcp_input>>& inputs,
+    const sbtcp_options& opts) {
+
+    // packets are placed back to back in the wire format
+    size_t psize = opts.packet_size();
+    std::vector<uint8_t> buf(opts.batch * psize);
+    size_t count = 0;
+    size_t sent = 0;
+    size_t next = 0;
+    int idle_count = 0;
+
+    while (true) {
+        bool progress = false;
+
+        // fill up a batch, taking at most one packet per input per round
+        if (count == 0) {
+            bool got = true;
+            while (got && (count < opts.batch)) {
+                got = false;
+                for (size_t i = 0; (i < inputs.size()) && (count < opts.batch); i++) {
+                    sbtcp_input& in = *inputs[next];
+                    next = (next + 1) % inputs.size();
+
+                    // sb_packet_ts is packed, so it can live at any offset
+                    sb_packet_ts* p = (sb_packet_ts*)&buf[count * psize];
+                    if (in.rx.recv(p->pkt)) {
+                        if (opts.tstamp) {
+                            p->tstamp = (uint32_t)in.rx.last_tstamp();
+                        }
+                        if (in.override) {
+                            p->pkt.destination = in.destination;
+                        }
+                        count++;
+                        got = true;
+                    }
+                }
+            }
+        }
+
+        if (count > 0) {
+            size_t total = count * psize;
+            ssize_t n = send(fd, buf.data() + sent, total - sent, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n > 0) {
+                sent += n;
+                if (sent == total) {
+                    count = sent = 0;
+                }
+                progress = true;
+            } else if ((n < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK))) {
+                // socket buffer is full
+                if (!wait_fd(ep, fd, EPOLLOUT, -1)) {
+                    return;
+                }
+                continue;
+            } else if ((n < 0) && (errno == EINTR)) {
+                continue;
+            } else {
+                // connection is not alive anymore
+                return;
+            }
+        }
+
+        if (progress) {
+            idle_count = 0;
+        } else {
+            // check now and then whether the peer went away
+            if ((++idle_count % 4096) == 0) {
+                if (!wait_fd(ep, fd, 0, 0)) {
+                    return;
+                }
+            }
+            idle(opts);
+        }
+    }
+}
+
+static struct addrinfo* resolve(const sbtcp_options& opts, bool passive) {
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+
+    struct addrinfo* res = NULL;
+    std::string port = std::to_string(opts.port);
+    int err = getaddrinfo(opts.host.c_str(), port.c_str(), &hints, &res);
+    if (err != 0) {
+        fprintf(stderr, "ERROR: %s: %s\n", opts.host.c_str(), gai_strerror(err));
+        return NULL;
+    }
+    return res;
+}
+
+// runs the bridge over one connection, returning false on a fatal error
+static bool serve(int fd, std::vector<std::unique_ptr<SBTX>>& outputs,
+    std::vector<std::unique_ptr<sbtcp_input>>& inputs, sbtcp_routes& routes,
+    const sbtcp_options& opts) {
+
+    set_sockopts(fd, opts);
+
+    int ep = epoll_create1(0);
+    if (ep < 0) {
+        perror("epoll_create1");
+        return false;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        // drop this connection, but keep serving
+        perror("epoll_ctl");
+        close(ep);
+        close(fd);
+        return true;
+    }
+
+    bool ok = true;
+    if (!outputs.empty()) {
+        ok = tcp2sb(fd, ep, outputs, routes, opts);
+    } else {
+        sb2tcp(fd, ep, inputs, opts);
+    }
+
+    close(ep);
+    close(fd);
+    return ok;
+}
+
+static int run_server(std::vector<std::unique_ptr<SBTX>>& outputs,
+    std::vector<std::unique_ptr<sbtcp_input>>& inputs, sbtcp_routes& routes,
+    const sbtcp_options& opts) {
+
+    struct addrinfo* res = resolve(opts, true);
+    if (!res) {
+        return 1;
+    }
+
+    int server_fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (server_fd < 0) {
+        perror("socket");
+        freeaddrinfo(res);
+        return 1;
+    }
+    int one = 1;
+    // allow port to be reused immediately
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+    if (bind(server_fd, res->ai_addr, res->ai_addrlen) < 0) {
+        perror("bind");
+        freeaddrinfo(res);
+        close(server_fd);
+        return 1;
+    }
+    freeaddrinfo(res);
+    if (listen(server_fd, 1) < 0) {
+        perror("listen");
+        close(server_fd);
+        return 1;
+    }
+
+    // accept client connections in a loop
+    while (true) {
+        if (!opts.quiet) {
+            printf("Waiting for client (host=%s, port=%d)\n", opts.host.c_str(), opts.port);
+            fflush(stdout);
+        }
+        int fd = accept(server_fd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("accept");
+            close(server_fd);
+            return 1;
+        }
+        if (!opts.quiet) {
+            printf("Connected to client (host=%s, port=%d)\n", opts.host.c_str(), opts.port);
+            fflush(stdout);
+        }
+
+        if (!serve(fd, outputs, inputs, routes, opts)) {
+            close(server_fd);
+            return 1;
+        }
+
+        if (opts.run_once) {
+            break;
+        }
+    }
+
+    close(server_fd);
+    return 0;
+}
+
+static int run_client(std::vector<std::unique_ptr<SBTX>>& outputs,
+    std::vector<std::unique_ptr<sbtcp_input>>& inputs, sbtcp_routes& routes,
+    const sbtcp_options& opts) {
+
+    // connect to the server in a loop, retrying until a connection is made
+    while (true) {
+        if (!opts.quiet) {
+            printf("Waiting for server (host=%s, port=%d)\n", opts.host.c_str(), opts.port);
+            fflush(stdout);
+        }
+
+        int fd = -1;
+        while (fd < 0) {
+            struct addrinfo* res = resolve(opts, false);
+            if (!res) {
+                return 1;
+            }
+            fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+            if (fd < 0) {
+                perror("socket");
+                freeaddrinfo(res);
+                return 1;
+            }
+            if (connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+                close(fd);
+                fd = -1;
+                sleep(1);
+            }
+            freeaddrinfo(res);
+        }
+
+        if (!opts.quiet) {
+            printf("Connected to server (host=%s, port=%d)\n", opts.host.c_str(), opts.port);
+            fflush(stdout);
+        }
+
+        if (!serve(fd, outputs, inputs, routes, opts)) {
+            return 1;
+        }
+
+        if (opts.run_once) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    enum MODE { OUTPUTS, INPUTS, UNDEF };
+    MODE mode = UNDEF;
+
+    sbtcp_options opts;
+    double max_rate = -1;
+    int role = 0; // 0: auto, 1: server, 2: client
+
+    std::vector<std::unique_ptr<SBTX>> outputs;
+    std::vector<std::unique_ptr<sbtcp_input>> inputs;
+    std::vector<std::string> output_uris;
+    std::vector<std::string> input_uris;
+    sbtcp_routes routes;
+
+    int arg_idx = 1;
+    while (arg_idx < argc) {
+        std::string arg = std::string(argv[arg_idx++]);
+        bool has_value = arg_idx < argc;
+
+        if (arg == "--outputs") {
+            mode = OUTPUTS;
+        } else if (arg == "--inputs") {
+            mode = INPUTS;
+        } else if ((arg == "--host") && has_value) {
+            opts.host = argv[arg_idx++];
+        } else if ((arg == "--port") && has_value) {
+            opts.port = atoi(argv[arg_idx++]);
+        } else if ((arg == "--max-rate") && has_value) {
+            max_rate = atof(argv[arg_idx++]);
+        } else if ((arg == "--batch") && has_value) {
+            opts.batch = std::max(atoi(argv[arg_idx++]), 1);
+        } else if ((arg == "--busy-poll") && has_value) {
+            opts.busy_poll = atoi(argv[arg_idx++]);
+        } else if (arg == "--no-nodelay") {
+            opts.nodelay = false;
+        } else if (arg == "--tstamp") {
+            opts.tstamp = true;
+        } else if (arg == "--run-once") {
+            opts.run_once = true;
+        } else if (arg == "--server") {
+            role = 1;
+        } else if (arg == "--client") {
+            role = 2;
+        } else if (arg == "-q") {
+            opts.quiet = true;
+        } else if (mode == OUTPUTS) {
+            size_t split = arg.rfind(':');
+            if ((split == std::string::npos) ||
+                !routes.add(arg.substr(0, split), output_uris.size())) {
+                fprintf(stderr, "ERROR: expected <rule>:<uri>, got %s\n", arg.c_str());
+                return 1;
+            }
+            output_uris.push_back(arg.substr(split + 1));
+        } else if (mode == INPUTS) {
+            input_uris.push_back(arg);
+        } else {
+            fprintf(stderr, "ERROR: arguments are not formed properly.\n");
+            return 1;
+        }
+    }
+
+    if (output_uris.empty() == input_uris.empty()) {
+        fprintf(stderr, "ERROR: Must specify either --inputs or --outputs.\n");
+        return 1;
+    }
+
+    for (const std::string& uri : output_uris) {
+        outputs.push_back(std::unique_ptr<SBTX>(new SBTX()));
+        outputs.back()->init(uri, 0, false, max_rate);
+    }
+    routes.compile();
+
+    for (const std::string& arg : input_uris) {
+        inputs.push_back(std::unique_ptr<sbtcp_input>(new sbtcp_input()));
+        sbtcp_input& in = *inputs.back();
+
+        // an optional "<dest>:" prefix overrides the destination
+        size_t split = arg.find(':');
+        char* p = NULL;
+        unsigned long dest = 0;
+        if (split != std::string::npos) {
+            dest = strtoul(arg.c_str(), &p, 10);
+        }
+        in.override = (p != NULL) && (p == arg.c_str() + split);
+        in.destination = dest;
+        in.rx.init(in.override ? arg.substr(split + 1) : arg, 0, false, max_rate);
+        in.rx.set_tstamp(opts.tstamp);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    // by default, the side writing to queues is the server
+    bool server = (role == 1) || ((role == 0) && !outputs.empty());
+
+    if (server) {
+        return run_server(outputs, inputs, routes, opts);
+    } else {
+        return run_client(outputs, inputs, routes, opts);
+    }
+}
@@ -0,0 +1,297 @@
+// Low-overhead in-process tracing of switchboard hot-path events
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// Trace points are compiled in only when SB_TRACE is defined; otherwise the
+// SB_TRACE_* macros expand to nothing.  When compiled in, tracing is active
+// if the SB_TRACE_FILE environment variable names an output file.  Each
+// thread appends fixed-size records to its own ring (overwriting the oldest
+// records when full), and all rings are drained when the process exits.
+// If SB_TRACE_FILE ends in ".json", the output is Chrome trace / Perfetto
+// JSON; otherwise it is the binary format described by sb_trace_file_header.
+// JSON timestamps are absolute CLOCK_MONOTONIC microseconds, so traces of
+// several processes on one machine can be merged into a single timeline.
+//
+// Consecutive failed attempts of the same event on the same queue (e.g. a
+// send spinning on a full queue) are folded into one record whose duration
+// covers the whole stall, so polling loops don't flush the ring.
+
+#ifndef SBTRACE_H__
+#define SBTRACE_H__
+
+#include <stdint.h>
+
+enum sb_trace_event_id {
+    SB_TRACE_SEND = 1,
+    SB_TRACE_RECV = 2,
+    SB_TRACE_UMI_SEND = 3,
+    SB_TRACE_UMI_RECV = 4,
+    SB_TRACE_BARRIER_WAIT = 5,
+    SB_TRACE_RATE_TICK = 6
+};
+
+typedef struct sb_trace_record {
+    uint64_t tsc;
+    uint32_t dur; // in ticks, saturating
+    uint16_t queue;
+    uint8_t event;
+    uint8_t outcome;
+} sb_trace_record;
+
+#if defined(SB_TRACE) && defined(__cplusplus)
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "tsc.h"
+
+#define SB_TRACE_RING_SIZE (1 << 16) // records per thread, power of two
+#define SB_TRACE_MAGIC "SBTRACE2"
+
+// binary output: this header, then num_queues NUL-terminated queue names,
+// then for each thread a uint32_t thread index, a uint32_t record count and
+// that many sb_trace_record entries.  a record's CLOCK_MONOTONIC time in ns
+// is ns0 + (tsc - tsc0) * ns_per_tick.
+typedef struct sb_trace_file_header {
+    char magic[8];
+    double ns_per_tick;
+    uint32_t num_queues;
+    uint32_t num_threads;
+    uint64_t tsc0;
+    uint64_t ns0;
+} sb_trace_file_header;
+
+struct sb_trace_ring {
+    uint64_t head; // only written by the owning thread
+    uint32_t index;
+    sb_trace_record records[SB_TRACE_RING_SIZE];
+};
+
+struct sb_trace_state {
+    std::mutex lock;
+    bool enabled;
+    std::string file;
+    uint64_t tsc0;
+    uint64_t ns0;
+    std::vector<sb_trace_ring*> rings;
+    std::vector<std::string> queues;
+};
+
+static inline const char* sb_trace_event_name(uint8_t event) {
+    switch (event) {
+    case SB_TRACE_SEND:
+        return "send";
+    case SB_TRACE_RECV:
+        return "recv";
+    case SB_TRACE_UMI_SEND:
+        return "umisb_send";
+    case SB_TRACE_UMI_RECV:
+        return "umisb_recv";
+    case SB_TRACE_BARRIER_WAIT:
+        return "barrier_wait";
+    case SB_TRACE_RATE_TICK:
+        return "max_rate_tick";
+    default:
+        return "unknown";
+    }
+}
+
+inline void sb_trace_drain(void);
+
+inline sb_trace_state* sb_trace_new_state() {
+    // intentionally never freed, since rings have to outlive their threads
+    // and the state is used from the atexit handler
+    sb_trace_state* state = new sb_trace_state();
+
+    const char* file = getenv("SB_TRACE_FILE");
+    state->enabled = (file != NULL) && (file[0] != '\0');
+    state->file = state->enabled ? std::string(file) : "";
+    state->tsc0 = tsc_read();
+    state->ns0 = tsc_monotonic_ns();
+    state->queues.push_back("-"); // queue 0 means "no queue"
+
+    if (state->enabled) {
+        atexit(sb_trace_drain);
+    }
+
+    return state;
+}
+
+// not "static", so that all translation units share one state
+inline sb_trace_state& sb_trace_get_state() {
+    static sb_trace_state* state = sb_trace_new_state();
+    return *state;
+}
+
+inline sb_trace_ring* sb_trace_thread_ring() {
+    static thread_local sb_trace_ring* ring = NULL;
+
+    if (!ring) {
+        sb_trace_state& state = sb_trace_get_state();
+        ring = (sb_trace_ring*)calloc(1, sizeof(sb_trace_ring));
+        std::lock_guard<std::mutex> guard(state.lock);
+        ring->index = state.rings.size();
+        state.rings.push_back(ring);
+    }
+
+    return ring;
+}
+
+// Returns the id used for a queue in trace records.
+inline uint16_t sb_trace_queue(const char* name) {
+    sb_trace_state& state = sb_trace_get_state();
+
+    if (!state.enabled) {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> guard(state.lock);
+    for (size_t i = 0; i < state.queues.size(); i++) {
+        if (state.queues[i] == name) {
+            return i;
+        }
+    }
+    state.queues.push_back(name);
+    return state.queues.size() - 1;
+}
+
+static inline void sb_trace_record_event(uint8_t event, uint16_t queue, uint8_t outcome,
+    uint64_t start) {
+
+    if (!sb_trace_get_state().enabled) {
+        return;
+    }
+
+    sb_trace_ring* ring = sb_trace_thread_ring();
+    uint64_t now = tsc_read();
+    uint64_t head = ring->head;
+
+    if (start == 0) {
+        start = now;
+    }
+
+    if ((head > 0) && (outcome == 0)) {
+        sb_trace_record* prev = &ring->records[(head - 1) & (SB_TRACE_RING_SIZE - 1)];
+        if ((prev->event == event) && (prev->queue == queue) && (prev->outcome == 0)) {
+            // extend the stall that's already being recorded
+            uint64_t dur = now - prev->tsc;
+            prev->dur = (dur > UINT32_MAX) ? UINT32_MAX : dur;
+            return;
+        }
+    }
+
+    sb_trace_record* r = &ring->records[head & (SB_TRACE_RING_SIZE - 1)];
+    uint64_t dur = now - start;
+    r->tsc = start;
+    r->dur = (dur > UINT32_MAX) ? UINT32_MAX : dur;
+    r->queue = queue;
+    r->event = event;
+    r->outcome = outcome;
+
+    // publish after the record is complete, in case a drain is racing
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+inline void sb_trace_drain(void) {
+    sb_trace_state& state = sb_trace_get_state();
+    std::lock_guard<std::mutex> guard(state.lock);
+
+    // calibrate the tick rate over the lifetime of the trace
+    uint64_t tsc1 = tsc_read();
+    uint64_t ns1 = tsc_monotonic_ns();
+    double ns_per_tick = (tsc1 > state.tsc0) ? (double)(ns1 - state.ns0) / (tsc1 - state.tsc0) : 1;
+
+    FILE* f = fopen(state.file.c_str(), "wb");
+    if (!f) {
+        perror(state.file.c_str());
+        return;
+    }
+
+    bool json = (state.file.size() >= 5) &&
+                (state.file.compare(state.file.size() - 5, 5, ".json") == 0);
+
+    if (json) {
+        fprintf(f, "{\"traceEvents\":[\n");
+    } else {
+        sb_trace_file_header hdr;
+        memset(&hdr, 0, sizeof hdr);
+        memcpy(hdr.magic, SB_TRACE_MAGIC, sizeof hdr.magic);
+        hdr.ns_per_tick = ns_per_tick;
+        hdr.num_queues = state.queues.size();
+        hdr.num_threads = state.rings.size();
+        hdr.tsc0 = state.tsc0;
+        hdr.ns0 = state.ns0;
+        fwrite(&hdr, sizeof hdr, 1, f);
+        for (auto& name : state.queues) {
+            fwrite(name.c_str(), name.size() + 1, 1, f);
+        }
+    }
+
+    bool first = true;
+    for (sb_trace_ring* ring : state.rings) {
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint64_t start = (head > SB_TRACE_RING_SIZE) ? (head - SB_TRACE_RING_SIZE) : 0;
+
+        if (!json) {
+            uint32_t count = head - start;
+            fwrite(&ring->index, sizeof ring->index, 1, f);
+            fwrite(&count, sizeof count, 1, f);
+        }
+
+        for (uint64_t i = start; i < head; i++) {
+            sb_trace_record* r = &ring->records[i & (SB_TRACE_RING_SIZE - 1)];
+
+            if (!json) {
+                fwrite(r, sizeof *r, 1, f);
+                continue;
+            }
+
+            // absolute time, kept in integer ns since a double in us
+            // would lose the sub-us digits
+            uint64_t ts_ns =
+                state.ns0 + (int64_t)(ns_per_tick * (double)(int64_t)(r->tsc - state.tsc0));
+            double dur_us = 1.0e-3 * ns_per_tick * r->dur;
+            const char* queue = (r->queue < state.queues.size()) ? state.queues[r->queue].c_str()
+                                                                  : "?";
+
+            fprintf(f,
+                "%s{\"name\":\"%s\",\"cat\":\"switchboard\",\"ph\":\"X\","
+                "\"ts\":%" PRIu64 ".%03u,\"dur\":%.3f,\"pid\":%d,\"tid\":%u,"
+                "\"args\":{\"queue\":\"%s\",\"ok\":%u}}",
+                first ? "" : ",\n", sb_trace_event_name(r->event), ts_ns / 1000,
+                (unsigned)(ts_ns % 1000), dur_us, (int)getpid(), ring->index, queue, r->outcome);
+            first = false;
+        }
+    }
+
+    if (json) {
+        fprintf(f, "\n]}\n");
+    }
+
+    fclose(f);
+}
+
+#define SB_TRACE_QUEUE(name) sb_trace_queue(name)
+#define SB_TRACE_START(var) uint64_t var = tsc_read()
+#define SB_TRACE_EVENT(event, queue, outcome) sb_trace_record_event(event, queue, outcome, 0)
+#define SB_TRACE_SPAN(event, queue, outcome, start)                                                \
+    sb_trace_record_event(event, queue, outcome, start)
+
+#else
+
+#define SB_TRACE_QUEUE(name) 0
+#define SB_TRACE_START(var)
+#define SB_TRACE_EVENT(event, queue, outcome)
+#define SB_TRACE_SPAN(event, queue, outcome, start)
+
+#endif // SB_TRACE
+
+#endif // SBTRACE_H__
@@ -0,0 +1,361 @@
+// Shared-memory signal bank: a seqlock-protected array of bits
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// A signal bank holds the current value of a (possibly very wide) set of
+// signals, such as GPIOs or status registers, in a file-backed shared memory
+// area.  Unlike a queue, it carries state rather than events: the writer
+// updates words in place, and the reader copies out the latest value
+// whenever it likes.  Each bank has one writer and any number of readers,
+// so a bidirectional interface uses two banks.
+//
+// Writes are grouped with sb_bank_write_begin() / sb_bank_write_end(), which
+// bump a sequence number (odd while a write is in progress).  A write that
+// changes at least one word advances the bank's generation, and also tags
+// each cache-line-sized chunk of words it touched with that generation.
+// Readers first compare the generation with the last one they copied, which
+// is a single load when nothing changed, and then only copy the chunks
+// tagged with a newer generation.  If the sequence number changes during the
+// copy, the read reports that it should be retried.
+//
+// A writer that dies in the middle of a write leaves the sequence number
+// odd.  The next writer repairs the bank with sb_bank_recover(), either
+// explicitly after opening it, or implicitly on its first write.
+
+#ifndef SIGNAL_BANK_H__
+#define SIGNAL_BANK_H__
+
+#include <fcntl.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+#define SB_BANK_CACHE_LINE_SIZE 64
+#define SB_BANK_CHUNK_WORDS (SB_BANK_CACHE_LINE_SIZE / 8)
+
+typedef struct sb_bank_shared {
+    uint64_t seq; // even when idle, odd while a write is in progress
+    uint32_t nbits;
+    uint32_t reserved;
+} sb_bank_shared;
+
+typedef struct sb_bank {
+    sb_bank_shared* shm;
+    uint64_t* gens;  // generation of the last write to each chunk
+    uint64_t* words; // signal values, bit i is bit i%64 of word i/64
+    char* name;
+    int nbits;
+    int nwords;
+    int nchunks;
+    size_t mapsize;
+
+    uint64_t seen;   // reader: generation copied by the last read
+    uint64_t wseq;   // writer: sequence number before the open write
+    bool writing;    // writer: a write is open
+    bool wchanged;   // writer: the open write changed something
+} sb_bank;
+
+static inline int sb_bank_nwords(int nbits) {
+    return (nbits + 63) / 64;
+}
+
+static inline int sb_bank_nchunks(int nbits) {
+    return (sb_bank_nwords(nbits) + SB_BANK_CHUNK_WORDS - 1) / SB_BANK_CHUNK_WORDS;
+}
+
+// the header, chunk generations, and words each start on a cache line
+static inline size_t sb_bank_gens_offset(void) {
+    return SB_BANK_CACHE_LINE_SIZE;
+}
+
+static inline size_t sb_bank_words_offset(int nbits) {
+    size_t gens = sb_bank_nchunks(nbits) * sizeof(uint64_t);
+    gens = (gens + SB_BANK_CACHE_LINE_SIZE - 1) / SB_BANK_CACHE_LINE_SIZE;
+    return sb_bank_gens_offset() + gens * SB_BANK_CACHE_LINE_SIZE;
+}
+
+static inline size_t sb_bank_mapsize(int nbits) {
+    return sb_bank_words_offset(nbits) +
+           (size_t)sb_bank_nchunks(nbits) * SB_BANK_CHUNK_WORDS * sizeof(uint64_t);
+}
+
+// opens (creating if needed) the bank at "name" with "nbits" signals.  if
+// the bank already exists, it must have been created with the same width.
+static inline sb_bank* sb_bank_open(const char* name, int nbits) {
+    sb_bank* b = NULL;
+    struct stat st;
+    uint32_t expected = 0;
+    void* p = MAP_FAILED;
+    size_t mapsize;
+    int fd = -1;
+
+    if (nbits <= 0) {
+        fprintf(stderr, "%s: signal bank width must be positive\n", name);
+        return NULL;
+    }
+
+    mapsize = sb_bank_mapsize(nbits);
+
+    b = (sb_bank*)calloc(1, sizeof(sb_bank));
+    if (!b) {
+        perror("calloc");
+        goto err;
+    }
+
+    fd = open(name, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR);
+    if (fd < 0) {
+        perror(name);
+        goto err;
+    }
+
+    // only grow the file, so that a mismatched width is reported below
+    // rather than truncating a bank that the other side has mapped
+    if (fstat(fd, &st) < 0) {
+        perror("fstat");
+        goto err;
+    }
+
+    if ((size_t)st.st_size < mapsize) {
+        if (ftruncate(fd, mapsize) < 0) {
+            perror("ftruncate");
+            goto err;
+        }
+    }
+
+    p = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+    if (p == MAP_FAILED) {
+        perror("mmap");
+        goto err;
+    }
+
+    close(fd);
+    fd = -1;
+
+    b->shm = (sb_bank_shared*)p;
+
+    // the first side to open the bank records its width
+    if (!__atomic_compare_exchange_n(&b->shm->nbits, &expected, (uint32_t)nbits, false,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) &&
+        (expected != (uint32_t)nbits)) {
+        fprintf(stderr, "%s: signal bank has %u bits, expected %d\n", name, expected, nbits);
+        goto err;
+    }
+
+    b->gens = (uint64_t*)((char*)p + sb_bank_gens_offset());
+    b->words = (uint64_t*)((char*)p + sb_bank_words_offset(nbits));
+    b->name = strdup(name);
+    b->nbits = nbits;
+    b->nwords = sb_bank_nwords(nbits);
+    b->nchunks = sb_bank_nchunks(nbits);
+    b->mapsize = mapsize;
+
+    return b;
+
+err:
+    if (p != MAP_FAILED) {
+        munmap(p, mapsize);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    free(b);
+    return NULL;
+}
+
+static inline void sb_bank_close(sb_bank* b) {
+    if (!b) {
+        return;
+    }
+
+    munmap(b->shm, b->mapsize);
+    free(b->name);
+    free(b);
+}
+
+static inline void sb_bank_remove_shmfile(const char* name) {
+    remove(name);
+}
+
+// returns the number of writes that have changed the bank so far
+static inline uint64_t sb_bank_generation(sb_bank* b) {
+    return __atomic_load_n(&b->shm->seq, __ATOMIC_ACQUIRE) >> 1;
+}
+
+// returns the generation of the last write that changed chunk "c"
+static inline uint64_t sb_bank_chunk_generation(sb_bank* b, int c) {
+    return __atomic_load_n(&b->gens[c], __ATOMIC_RELAXED);
+}
+
+//////////
+// writer
+
+// repairs a bank whose previous writer died during a write, leaving the
+// sequence number odd.  the words of that write may be torn, so the bank
+// moves on to a new generation (rounding the sequence number up to even),
+// and every chunk is tagged with it, making readers copy the whole bank
+// again.  does nothing if no write was left open.  only the writer may
+// call this.
+static inline void sb_bank_recover(sb_bank* b) {
+    uint64_t seq = __atomic_load_n(&b->shm->seq, __ATOMIC_ACQUIRE);
+
+    if (!(seq & 1)) {
+        return;
+    }
+
+    // readers back off while the sequence number is still odd
+    for (int c = 0; c < b->nchunks; c++) {
+        __atomic_store_n(&b->gens[c], (seq + 1) >> 1, __ATOMIC_RELAXED);
+    }
+
+    __atomic_store_n(&b->shm->seq, seq + 1, __ATOMIC_RELEASE);
+}
+
+static inline void sb_bank_write_begin(sb_bank* b) {
+    if (b->writing) {
+        return;
+    }
+
+    b->wseq = __atomic_load_n(&b->shm->seq, __ATOMIC_RELAXED);
+    if (b->wseq & 1) {
+        // there is only one writer, so this write was left open by a
+        // previous writer that died
+        sb_bank_recover(b);
+        b->wseq++;
+    }
+
+    __atomic_store_n(&b->shm->seq, b->wseq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    b->writing = true;
+    b->wchanged = false;
+}
+
+static inline void sb_bank_write_end(sb_bank* b) {
+    if (!b->writing) {
+        return;
+    }
+
+    // a write that didn't change anything leaves the generation alone, so
+    // that readers don't have to look at the bank
+    uint64_t seq = b->wchanged ? (b->wseq + 2) : b->wseq;
+    __atomic_store_n(&b->shm->seq, seq, __ATOMIC_RELEASE);
+
+    b->writing = false;
+}
+
+// sets the bits selected by "mask" in word "i" to those of "value".  must be
+// called between sb_bank_write_begin() and sb_bank_write_end().
+static inline void sb_bank_write_word(sb_bank* b, int i, uint64_t value, uint64_t mask) {
+    // only the writer stores to the words, so they can be read back plainly
+    uint64_t old = __atomic_load_n(&b->words[i], __ATOMIC_RELAXED);
+    uint64_t next = (old & ~mask) | (value & mask);
+
+    if (next == old) {
+        return;
+    }
+
+    __atomic_store_n(&b->words[i], next, __ATOMIC_RELAXED);
+    __atomic_store_n(&b->gens[i / SB_BANK_CHUNK_WORDS], (b->wseq >> 1) + 1, __ATOMIC_RELAXED);
+    b->wchanged = true;
+}
+
+// sets "width" (at most 64) bits starting at bit "lsb" to "value"
+static inline void sb_bank_write_bits(sb_bank* b, int lsb, int width, uint64_t value) {
+    uint64_t mask = (width >= 64) ? ~(uint64_t)0 : (((uint64_t)1 << width) - 1);
+    int i = lsb / 64;
+    int shift = lsb % 64;
+
+    value &= mask;
+    sb_bank_write_word(b, i, value << shift, mask << shift);
+
+    if ((shift > 0) && ((shift + width) > 64)) {
+        sb_bank_write_word(b, i + 1, value >> (64 - shift), mask >> (64 - shift));
+    }
+}
+
+// sets a single group of bits, as one write
+static inline void sb_bank_set_bits(sb_bank* b, int lsb, int width, uint64_t value) {
+    sb_bank_write_begin(b);
+    sb_bank_write_bits(b, lsb, width, value);
+    sb_bank_write_end(b);
+}
+
+//////////
+// reader
+
+// copies the bank into "mirror" (an array of nwords words) if it has changed
+// since the last read.  only chunks written since then are copied.  returns
+// 1 if "mirror" was updated, 0 if nothing changed, or -1 if a write was in
+// progress, in which case the read should be retried later; "mirror" may
+// then be partially updated, but the next successful read fixes it up.
+static inline int sb_bank_read(sb_bank* b, uint64_t* mirror) {
+    uint64_t seq = __atomic_load_n(&b->shm->seq, __ATOMIC_ACQUIRE);
+
+    if (seq & 1) {
+        return -1;
+    }
+
+    if ((seq >> 1) == b->seen) {
+        return 0;
+    }
+
+    for (int c = 0; c < b->nchunks; c++) {
+        if (__atomic_load_n(&b->gens[c], __ATOMIC_RELAXED) > b->seen) {
+            int start = c * SB_BANK_CHUNK_WORDS;
+            int stop = start + SB_BANK_CHUNK_WORDS;
+            if (stop > b->nwords) {
+                stop = b->nwords;
+            }
+            for (int i = start; i < stop; i++) {
+                mirror[i] = __atomic_load_n(&b->words[i], __ATOMIC_RELAXED);
+            }
+        }
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    if (__atomic_load_n(&b->shm->seq, __ATOMIC_RELAXED) != seq) {
+        return -1;
+    }
+
+    b->seen = seq >> 1;
+    return 1;
+}
+
+// like sb_bank_read(), but retries until the read is consistent
+static inline int sb_bank_read_wait(sb_bank* b, uint64_t* mirror) {
+    int r;
+
+    while ((r = sb_bank_read(b, mirror)) < 0) {
+        sched_yield();
+    }
+
+    return r;
+}
+
+// reads "width" (at most 64) bits starting at bit "lsb" from a mirror
+static inline uint64_t sb_bank_get_bits(const uint64_t* mirror, int lsb, int width) {
+    uint64_t mask = (width >= 64) ? ~(uint64_t)0 : (((uint64_t)1 << width) - 1);
+    int i = lsb / 64;
+    int shift = lsb % 64;
+    uint64_t value = mirror[i] >> shift;
+
+    if ((shift > 0) && ((shift + width) > 64)) {
+        value |= mirror[i + 1] << (64 - shift);
+    }
+
+    return value & mask;
+}
+
+#endif // SIGNAL_BANK_H__
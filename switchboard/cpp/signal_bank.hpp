@@ -0,0 +1,134 @@
+// C++ wrapper for shared-memory signal banks
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+#ifndef __SIGNAL_BANK_HPP__
+#define __SIGNAL_BANK_HPP__
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "signal_bank.h"
+
+// SBSignalBank is used by the simulator side of a signal bank, which
+// exchanges values 32 bits at a time.  as a reader, poll() mirrors the bank
+// and makes a list of the 32-bit words that actually changed, which can
+// then be walked with next().  as a writer, put() stages 32-bit words and
+// flush() publishes them as one write.
+
+class SBSignalBank {
+  public:
+    SBSignalBank() : m_bank(NULL), m_pos(0) {}
+
+    ~SBSignalBank() {
+        deinit();
+    }
+
+    void init(std::string uri, int nbits, bool fresh = false) {
+        deinit();
+
+        if (fresh) {
+            sb_bank_remove_shmfile(uri.c_str());
+        }
+
+        m_bank = sb_bank_open(uri.c_str(), nbits);
+        if (!m_bank) {
+            throw std::runtime_error("could not open signal bank " + uri);
+        }
+
+        m_mirror.assign(m_bank->nwords, 0);
+        m_prev.assign(m_bank->nwords, 0);
+        m_changed.clear();
+        m_pos = 0;
+    }
+
+    void deinit() {
+        sb_bank_close(m_bank);
+        m_bank = NULL;
+    }
+
+    bool is_active() {
+        return m_bank != NULL;
+    }
+
+    int nbits() {
+        return m_bank->nbits;
+    }
+
+    // reader: returns true if the bank changed since the last poll.  the
+    // 32-bit words that changed are then returned by next().
+    bool poll() {
+        m_changed.clear();
+        m_pos = 0;
+
+        uint64_t seen = m_bank->seen;
+
+        if (sb_bank_read(m_bank, m_mirror.data()) <= 0) {
+            return false;
+        }
+
+        for (int c = 0; c < m_bank->nchunks; c++) {
+            if (sb_bank_chunk_generation(m_bank, c) <= seen) {
+                continue;
+            }
+
+            int start = c * SB_BANK_CHUNK_WORDS;
+            int stop = std::min(start + SB_BANK_CHUNK_WORDS, m_bank->nwords);
+
+            for (int i = start; i < stop; i++) {
+                uint64_t diff = m_mirror[i] ^ m_prev[i];
+                if (diff & 0xffffffffULL) {
+                    m_changed.push_back(2 * i);
+                }
+                if (diff >> 32) {
+                    m_changed.push_back(2 * i + 1);
+                }
+                m_prev[i] = m_mirror[i];
+            }
+        }
+
+        return !m_changed.empty();
+    }
+
+    // reader: returns the next 32-bit word that changed in the last poll()
+    bool next(int& idx, uint32_t& value) {
+        if (m_pos >= m_changed.size()) {
+            return false;
+        }
+
+        idx = m_changed[m_pos++];
+        value = word32(idx);
+        return true;
+    }
+
+    uint32_t word32(int idx) {
+        return (uint32_t)(m_mirror[idx / 2] >> (32 * (idx % 2)));
+    }
+
+    // writer: sets 32-bit word "idx", to be published by flush()
+    void put(int idx, uint32_t value) {
+        int lsb = 32 * idx;
+        int width = std::min(32, m_bank->nbits - lsb);
+
+        if (width > 0) {
+            sb_bank_write_begin(m_bank);
+            sb_bank_write_bits(m_bank, lsb, width, value);
+        }
+    }
+
+    void flush() {
+        sb_bank_write_end(m_bank);
+    }
+
+  private:
+    sb_bank* m_bank;
+    std::vector<uint64_t> m_mirror;
+    std::vector<uint64_t> m_prev;
+    std::vector<int> m_changed;
+    size_t m_pos;
+};
+
+#endif // __SIGNAL_BANK_HPP__
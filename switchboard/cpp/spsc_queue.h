@@ -7,15 +7,20 @@
 #define SPSC_QUEUE_H__
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
+#include "sbplace.h"
+
 #ifdef __cplusplus
 #include <atomic>
 using namespace std;
@@ -31,9 +36,32 @@ using namespace std;
 #define SPSC_QUEUE_MAX_PACKET_SIZE 64
 #define SPSC_QUEUE_CACHE_LINE_SIZE 64
 
+// The queue header describes the queue, so that peers opening the same file
+// agree on its layout.  It lives in the otherwise unused parts of the head
+// and tail cache lines, so the layout seen by FPGA queues (head at byte 0,
+// tail at byte 64, packets from byte 128) is unchanged.  FPGA queues write
+// head and tail as 64-bit words, so bytes 4-7 and 68-71 are left alone.
+#define SPSC_QUEUE_MAGIC 0x55514253 // "SBQU"
+#define SPSC_QUEUE_FORMING 0xffffffff
+#define SPSC_QUEUE_VERSION 1
+
+// Roles a process can attach to a queue with.
+#define SPSC_ROLE_NONE 0
+#define SPSC_ROLE_PRODUCER 1
+#define SPSC_ROLE_CONSUMER 2
+
 typedef struct spsc_queue_shared {
     int32_t head __attribute__((__aligned__(SPSC_QUEUE_CACHE_LINE_SIZE)));
+    int32_t head_pad;
+    uint32_t magic;      // SPSC_QUEUE_MAGIC once the header is valid
+    uint16_t version;    // SPSC_QUEUE_VERSION
+    uint16_t slot_size;  // bytes per packet slot
+    int32_t capacity;    // number of packet slots
+    uint32_t generation; // bumped whenever the queue is reset or reattached
+    int32_t producer;    // PID of the attached producer, or 0
     int32_t tail __attribute__((__aligned__(SPSC_QUEUE_CACHE_LINE_SIZE)));
+    int32_t tail_pad;
+    int32_t consumer; // PID of the attached consumer, or 0
     uint32_t packets[1][SPSC_QUEUE_MAX_PACKET_SIZE / 4]
         __attribute__((__aligned__(SPSC_QUEUE_CACHE_LINE_SIZE)));
 } spsc_queue_shared;
@@ -44,6 +72,7 @@ typedef struct spsc_queue {
     spsc_queue_shared* shm;
     char* name;
     int capacity;
+    int role;
 
     bool unmap_at_close;
 } spsc_queue;
@@ -86,15 +115,138 @@ static inline size_t spsc_mapsize(int capacity) {
     return mapsize;
 }
 
-static inline spsc_queue* spsc_open_mem(const char* name, size_t capacity, void* mem) {
+// Makes sure that at least "size" bytes of the file are allocated, without
+// ever shrinking it, so that a peer that has already mapped it is safe.
+static inline bool spsc_grow_file(int fd, size_t size) {
+    int r = posix_fallocate(fd, 0, size);
+
+    if (r == EOPNOTSUPP || r == EINVAL) {
+        // fall back to ftruncate on filesystems without fallocate
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            perror("fstat");
+            return false;
+        }
+        if ((size_t)st.st_size < size) {
+            r = ftruncate(fd, size) < 0 ? errno : 0;
+        } else {
+            r = 0;
+        }
+    }
+
+    if (r) {
+        fprintf(stderr, "posix_fallocate: %s\n", strerror(r));
+        return false;
+    }
+
+    return true;
+}
+
+// Validates the header of the queue at "shm", or writes it if the queue is
+// new, returning the capacity of the queue or 0 on error.  If "fd" is a
+// file descriptor, the capacity is negotiated from the file: a queue that
+// already has a header keeps its capacity, regardless of "capacity".
+// "old_size" is the size of the file before it was opened, which tells
+// whether a queue written by an older version (without a header) can keep
+// its contents.
+static inline int spsc_negotiate(const char* name, spsc_queue_shared* shm, int fd, int capacity,
+    size_t old_size) {
+
+    uint32_t magic = __atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE);
+    int waited = 0;
+
+    while (magic != SPSC_QUEUE_MAGIC) {
+        if (magic == SPSC_QUEUE_FORMING && waited < 1000) {
+            // another process is writing the header
+            usleep(1000);
+            waited++;
+            magic = __atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE);
+            continue;
+        }
+
+        if (fd >= 0 && magic != 0 && magic != SPSC_QUEUE_FORMING) {
+            fprintf(stderr, "%s: not a switchboard queue (magic 0x%08x)\n", name, magic);
+            return 0;
+        }
+
+        // the queue is new, or the process that was writing its header
+        // died, so write it ourselves.  memory that was handed to us may
+        // hold anything before it is first used.
+        if (!__atomic_compare_exchange_n(&shm->magic, &magic, SPSC_QUEUE_FORMING, false,
+                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            continue;
+        }
+
+        if (fd >= 0 && !spsc_grow_file(fd, spsc_mapsize(capacity))) {
+            __atomic_store_n(&shm->magic, 0, __ATOMIC_RELEASE);
+            return 0;
+        }
+
+        // queues from before there was a header keep their contents if
+        // they had the same size; anything else starts out empty
+        int32_t head = __atomic_load_n(&shm->head, __ATOMIC_RELAXED);
+        int32_t tail = __atomic_load_n(&shm->tail, __ATOMIC_RELAXED);
+        if ((fd >= 0 && old_size != spsc_mapsize(capacity)) || head < 0 || head >= capacity ||
+            tail < 0 || tail >= capacity) {
+            __atomic_store_n(&shm->head, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&shm->tail, 0, __ATOMIC_RELAXED);
+        }
+
+        shm->version = SPSC_QUEUE_VERSION;
+        shm->slot_size = sizeof(shm->packets[0]);
+        shm->capacity = capacity;
+        __atomic_fetch_add(&shm->generation, 1, __ATOMIC_RELAXED);
+
+        magic = SPSC_QUEUE_MAGIC;
+        __atomic_store_n(&shm->magic, magic, __ATOMIC_RELEASE);
+    }
+
+    if (shm->version != SPSC_QUEUE_VERSION || shm->slot_size != sizeof(shm->packets[0])) {
+        fprintf(stderr, "%s: unsupported queue version %d with %d-byte slots\n", name,
+            shm->version, shm->slot_size);
+        return 0;
+    }
+
+    if (shm->capacity < 2) {
+        fprintf(stderr, "%s: invalid queue capacity %d\n", name, shm->capacity);
+        return 0;
+    }
+
+    if (fd < 0 && shm->capacity != capacity) {
+        // the memory was given to us, so its size can't change
+        fprintf(stderr, "%s: queue has capacity %d, expected %d\n", name, shm->capacity,
+            capacity);
+        return 0;
+    }
+
+    // a queue whose pointers are out of range can't be recovered
+    int32_t head = __atomic_load_n(&shm->head, __ATOMIC_RELAXED);
+    int32_t tail = __atomic_load_n(&shm->tail, __ATOMIC_RELAXED);
+    if (head < 0 || head >= shm->capacity || tail < 0 || tail >= shm->capacity) {
+        fprintf(stderr, "%s: resetting corrupted queue (head %d, tail %d)\n", name, head, tail);
+        __atomic_store_n(&shm->head, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&shm->tail, 0, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&shm->generation, 1, __ATOMIC_RELEASE);
+    }
+
+    return shm->capacity;
+}
+
+// Opens a queue, either in the file "name" or at "mem".  If "node" is a NUMA
+// node number, the pages of a queue file are placed on that node as far as
+// possible (see sbplace.h).
+static inline spsc_queue* spsc_open_mem_node(const char* name, size_t capacity, void* mem,
+    int node) {
     spsc_queue* q = NULL;
+    spsc_queue_shared* hdr = (spsc_queue_shared*)MAP_FAILED;
+    sb_numa_policy policy;
+    struct stat st;
     size_t mapsize;
     void* p;
     int fd = -1;
     int r;
 
-    // Compute the size of the SHM mapping.
-    mapsize = spsc_mapsize(capacity);
+    memset(&policy, 0, sizeof policy);
 
     // Allocate a cache-line aligned spsc-queue.
     r = posix_memalign(&p, SPSC_QUEUE_CACHE_LINE_SIZE, sizeof(spsc_queue));
@@ -113,16 +265,48 @@ static inline spsc_queue* spsc_open_mem(const char* name, size_t capacity, void*
             goto err;
         }
 
-        r = ftruncate(fd, mapsize);
-        if (r < 0) {
-            perror("ftruncate");
+        if (fstat(fd, &st) < 0) {
+            perror("fstat");
+            goto err;
+        }
+
+        // Map just the header first, to find out the actual capacity.
+        if (!spsc_grow_file(fd, sizeof(spsc_queue_shared))) {
+            goto err;
+        }
+
+        // Pages are allocated on the node preferred by the thread that
+        // faults them in, so prefer the requested node until the queue is
+        // prefaulted, starting with the header (which holds head and tail).
+        if (node >= 0) {
+            sb_numa_prefer(node, &policy);
+        }
+
+        hdr = (spsc_queue_shared*)mmap(NULL, sizeof(spsc_queue_shared), PROT_READ | PROT_WRITE,
+            MAP_SHARED, fd, 0);
+        if (hdr == MAP_FAILED) {
+            perror("mmap");
+            goto err;
+        }
+
+        capacity = spsc_negotiate(name, hdr, fd, capacity, st.st_size);
+        munmap(hdr, sizeof(spsc_queue_shared));
+        if (!capacity) {
             goto err;
         }
 
+        // Compute the size of the SHM mapping.
+        mapsize = spsc_mapsize(capacity);
+
         // Map a shared file-backed mapping for the SHM area.
         // This will always be page-aligned.
         p = mmap(NULL, mapsize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
 
+        sb_numa_restore(&policy);
+        if ((node >= 0) && (p != MAP_FAILED)) {
+            sb_numa_bind(p, mapsize, node);
+        }
+
         if (p == MAP_FAILED) {
             perror("mmap");
             goto err;
@@ -131,6 +315,8 @@ static inline spsc_queue* spsc_open_mem(const char* name, size_t capacity, void*
         // We can now close the fd without affecting active mmaps.
         close(fd);
         q->unmap_at_close = true;
+    } else if (!spsc_negotiate(name, (spsc_queue_shared*)mem, -1, capacity, 0)) {
+        goto err;
     }
 
     q->shm = (spsc_queue_shared*)p;
@@ -143,23 +329,78 @@ static inline spsc_queue* spsc_open_mem(const char* name, size_t capacity, void*
     return q;
 
 err:
-    if (fd > 0) {
+    sb_numa_restore(&policy);
+    if (fd >= 0) {
         close(fd);
     }
     free(q);
     return NULL;
 }
 
+// Returns the generation of the queue, which changes whenever it is reset,
+// or a process reattaches to it after its previous producer or consumer
+// died without closing it.
+static inline uint32_t spsc_generation(spsc_queue* q) {
+    return __atomic_load_n(&q->shm->generation, __ATOMIC_ACQUIRE);
+}
+
+static inline bool spsc_pid_alive(int32_t pid) {
+    return (pid > 0) && ((kill(pid, 0) == 0) || (errno == EPERM));
+}
+
+// Records the calling process as the producer or consumer of the queue.  If
+// the previous one died without closing the queue, it is simply reattached:
+// head and tail only advance once a packet has been completely written or
+// read, so the ring is consistent as of the last completed send/recv, and
+// the other side can keep running.  The generation is bumped so that the
+// other side can tell that this happened.
+static inline void spsc_attach(spsc_queue* q, int role) {
+    int32_t* slot = (role == SPSC_ROLE_PRODUCER) ? &q->shm->producer : &q->shm->consumer;
+    int32_t pid = getpid();
+    int32_t old = __atomic_exchange_n(slot, pid, __ATOMIC_ACQ_REL);
+
+    if (old > 0 && old != pid) {
+        if (spsc_pid_alive(old)) {
+            fprintf(stderr, "%s: warning: process %d is also attached as the %s\n", q->name, old,
+                (role == SPSC_ROLE_PRODUCER) ? "producer" : "consumer");
+        } else {
+            __atomic_fetch_add(&q->shm->generation, 1, __ATOMIC_RELEASE);
+        }
+    }
+
+    q->role = role;
+}
+
+static inline void spsc_detach(spsc_queue* q) {
+    if (q->role == SPSC_ROLE_NONE) {
+        return;
+    }
+
+    int32_t* slot = (q->role == SPSC_ROLE_PRODUCER) ? &q->shm->producer : &q->shm->consumer;
+    int32_t pid = getpid();
+    __atomic_compare_exchange_n(slot, &pid, 0, false, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED);
+
+    q->role = SPSC_ROLE_NONE;
+}
+
 static inline int spsc_mlock(spsc_queue* q) {
     size_t mapsize = spsc_mapsize(q->capacity);
 
     return mlock(q->shm, mapsize);
 }
 
+static inline spsc_queue* spsc_open_mem(const char* name, size_t capacity, void* mem) {
+    return spsc_open_mem_node(name, capacity, mem, SB_NUMA_NONE);
+}
+
 static inline spsc_queue* spsc_open(const char* name, size_t capacity) {
     return spsc_open_mem(name, capacity, NULL);
 }
 
+static inline spsc_queue* spsc_open_node(const char* name, size_t capacity, int node) {
+    return spsc_open_mem_node(name, capacity, NULL, node);
+}
+
 static inline void spsc_remove_shmfile(const char* name) {
     remove(name);
 }
@@ -173,6 +414,8 @@ static inline void spsc_close(spsc_queue* q) {
 
     mapsize = spsc_mapsize(q->capacity);
 
+    spsc_detach(q);
+
     // We've already closed the file-descriptor. We now need to munmap the mmap.
     if (q->unmap_at_close) {
         munmap(q->shm, mapsize);
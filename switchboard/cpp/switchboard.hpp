@@ -4,6 +4,7 @@
 #ifndef __SWITCHBOARD_HPP__
 #define __SWITCHBOARD_HPP__
 
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <cstdio>
@@ -12,7 +13,10 @@
 #include <thread>
 #include <vector>
 
+#include "sbplace.h"
+#include "sbtrace.h"
 #include "spsc_queue.h"
+#include "tsc.h"
 
 // packet type
 // TODO: make size runtime programmable
@@ -28,35 +32,195 @@ struct sb_packet {
     uint8_t data[SB_DATA_SIZE];
 } __attribute__((packed));
 
-static inline long max_rate_timestamp_us() {
-    return std::chrono::duration_cast<std::chrono::microseconds>(
-        std::chrono::high_resolution_clock::now().time_since_epoch())
-        .count();
+// optional simulation-time stamp.  an sb_packet leaves the last four
+// bytes of each 64-byte queue slot unused, so a stamped packet carries
+// the low 32 bits of its stamp there.  the receiver extends them back to
+// 64 bits relative to the previous stamp seen on the same queue, which is
+// exact as long as consecutive packets are stamped less than 2^31 cycles
+// apart.  SBTX writes a zero stamp when stamping is disabled, so that a
+// reused queue file can't hand a stale stamp to the next receiver.  other
+// producers that only write the 60-byte sb_packet (e.g. PCIe devices)
+// leave the tail as it was, so their packets carry no meaningful stamp.
+//
+// processes that forward packets (router, sbtcp, sbcap) pass stamps on
+// unchanged, so that a replay-mode receiver sees the stamp of the original
+// sender however many hops away it is.
+
+struct sb_packet_ts {
+    sb_packet pkt;
+    uint32_t tstamp;
+} __attribute__((packed));
+
+static_assert(sizeof(sb_packet_ts) <= SPSC_QUEUE_MAX_PACKET_SIZE,
+    "sb_packet_ts must fit in a single queue slot");
+
+static inline uint64_t sb_tstamp_extend(uint64_t prev, uint32_t lo) {
+    int32_t delta = (int32_t)(lo - (uint32_t)prev);
+
+    if ((delta < 0) && ((uint64_t)(-(int64_t)delta) > prev)) {
+        // can't go back past zero, so this must be the first stamp seen
+        return lo;
+    }
+
+    return prev + delta;
 }
 
-static inline void max_rate_tick(long& last_us, long min_period_us) {
-    if (min_period_us > 0) {
-        // measure the time now
+// process-wide simulation clock.  the simulator main loop advances
+// "cycle", which is used to stamp outbound packets and to decide when
+// inbound packets are released in replay mode.  queues opened after
+// "stamp" or "latency" are set pick them up as their defaults.
+
+struct sb_sim_clock {
+    uint64_t cycle;
+    bool stamp;
+    long latency;
+};
+
+// not "static", so that all translation units linked into one simulator
+// (e.g. testbench.cc and the DPI shim) share a single clock
+inline sb_sim_clock& sb_sim_clock_get() {
+    static sb_sim_clock clock = {0, false, -1};
+    return clock;
+}
+
+// default NUMA placement of the queues opened by this process (see
+// sbplace.h), initially taken from SB_NUMA.  not "static", for the same
+// reason as sb_sim_clock_get().
+inline int& sb_numa_default() {
+    static int node = sb_numa_parse(getenv("SB_NUMA"));
+    return node;
+}
+
+// rate limiting is done with a token bucket driven by the cycle counter,
+// rather than with a clock read and sleep_for() per packet, since the
+// granularity of sleep_for() is tens of microseconds.  waits longer than
+// SB_PACER_SPIN_NS sleep for most of the time and spin for the rest.
+
+#define SB_PACER_SPIN_NS 100000
+
+// cycle counter ticks per nanosecond, measured once per process.  not
+// "static", so that all translation units share the measurement.
+inline double sb_tsc_ticks_per_ns() {
+    static double rate = []() {
+        uint64_t ns0 = tsc_monotonic_ns();
+        uint64_t t0 = tsc_read();
+        uint64_t ns1, t1;
+        do {
+            ns1 = tsc_monotonic_ns();
+            t1 = tsc_read();
+        } while ((ns1 - ns0) < 2000000);
+        return (t1 > t0) ? ((double)(t1 - t0) / (ns1 - ns0)) : 1.0;
+    }();
+    return rate;
+}
+
+// Takes one token from a bucket, waiting for it if necessary.  "tat" is the
+// time (in cycle counter ticks) at which the bucket will next be empty,
+// "period" is the time per token, and "tolerance" is how far ahead of
+// "tat" tokens may be taken, i.e. the burst allowance.
+static inline void sb_pace(uint64_t& tat, uint64_t period, uint64_t tolerance) {
+    uint64_t now = tsc_read();
+
+    // idle time earns at most a full bucket
+    if (tat < now) {
+        tat = now;
+    }
+
+    uint64_t start = tat - tolerance;
+
+    if (now < start) {
+        SB_TRACE_START(t0);
+        double ticks_per_ns = sb_tsc_ticks_per_ns();
+        while (now < start) {
+            double wait_ns = (start - now) / ticks_per_ns;
+            if (wait_ns > SB_PACER_SPIN_NS) {
+                long sleep_ns = wait_ns - (SB_PACER_SPIN_NS / 2);
+                std::this_thread::sleep_for(std::chrono::nanoseconds(sleep_ns));
+            } else {
+                tsc_relax();
+            }
+            now = tsc_read();
+        }
+        SB_TRACE_SPAN(SB_TRACE_RATE_TICK, 0, 1, t0);
+    }
+
+    tat += period;
+}
 
-        long now_us = max_rate_timestamp_us();
+class sb_pacer {
+  public:
+    sb_pacer() : m_period(0), m_frac(0), m_frac_acc(0), m_tolerance(0), m_tat(0) {}
+
+    // max_rate is in ticks per second, with values <= 0 disabling pacing.
+    // burst is the number of ticks that may go through back-to-back after
+    // an idle period.
+    void set_rate(double max_rate, double burst = 1) {
+        m_period = 0;
+        m_frac = 0;
+        m_frac_acc = 0;
+        m_tolerance = 0;
+        m_tat = 0;
 
-        // sleep if needed
+        if (max_rate > 0) {
+            // the period is kept in fixed point, since it may only be a
+            // few cycle counter ticks at high rates
+            double period = std::max(sb_tsc_ticks_per_ns() * 1.0e9 / max_rate, 1.0);
+            m_period = period;
+            m_frac = (period - m_period) * 4294967296.0;
+            if (burst > 1) {
+                m_tolerance = (burst - 1) * period;
+            }
+        }
+    }
 
-        if (last_us != -1) {
-            long dt_us = now_us - last_us;
+    bool enabled() {
+        return m_period != 0;
+    }
 
-            if (dt_us < min_period_us) {
-                long sleep_us = min_period_us - dt_us;
-                std::this_thread::sleep_for(std::chrono::microseconds(sleep_us));
+    void tick() {
+        if (m_period != 0) {
+            uint64_t period = m_period;
+            m_frac_acc += m_frac;
+            if (m_frac_acc >= (1ULL << 32)) {
+                m_frac_acc -= (1ULL << 32);
+                period++;
             }
+            sb_pace(m_tat, period, m_tolerance);
         }
+    }
+
+  private:
+    uint64_t m_period;
+    uint64_t m_frac;
+    uint64_t m_frac_acc;
+    uint64_t m_tolerance;
+    uint64_t m_tat;
+};
 
-        // update the time stamp.  it is not enough to set last_us = now_us,
-        // due to the sleep_for invocation
+// Pacers for the DPI/VPI clock generators.  The state of a pacer doesn't
+// fit in a simulator variable, so the shim keeps the pacers in a table and
+// each clock generator holds a 64-bit handle to its own (initially -1).
+class sb_pacer_table {
+  public:
+    // paces one cycle of the clock generator with "handle" to "max_rate"
+    // cycles per second, with values <= 0 disabling pacing
+    void tick(long& handle, double max_rate) {
+        if (max_rate <= 0) {
+            return;
+        }
 
-        last_us = max_rate_timestamp_us();
+        if ((handle < 0) || ((size_t)handle >= m_pacers.size())) {
+            handle = m_pacers.size();
+            m_pacers.push_back(sb_pacer());
+            m_pacers.back().set_rate(max_rate);
+        }
+
+        m_pacers[handle].tick();
     }
-}
+
+  private:
+    std::vector<sb_pacer> m_pacers;
+};
 
 static inline void start_delay(double value) {
     if (value > 0) {
@@ -65,9 +229,13 @@ static inline void start_delay(double value) {
     }
 }
 
+// placement of an SB_base queue that hasn't been given one with set_numa()
+#define SB_NUMA_DEFAULT -3
+
 class SB_base {
   public:
-    SB_base() : m_active(false), m_q(NULL) {}
+    SB_base() : m_active(false), m_tstamp(false), m_latency(-1), m_last_tstamp(0),
+          m_trace_id(0), m_role(SPSC_ROLE_NONE), m_numa(SB_NUMA_DEFAULT), m_q(NULL) {}
 
     virtual ~SB_base() {
         deinit();
@@ -88,15 +256,28 @@ class SB_base {
             spsc_remove_shmfile(uri);
         }
 
-        m_q = spsc_open(uri, capacity);
+        int node = (m_numa == SB_NUMA_DEFAULT) ? sb_numa_default() : m_numa;
+        node = sb_numa_resolve(node, m_role == SPSC_ROLE_CONSUMER);
+
+        m_q = spsc_open_node(uri, capacity, node);
+        if (!m_q) {
+            throw std::runtime_error(std::string("could not open queue ") + uri);
+        }
+        spsc_attach(m_q, m_role);
+        sb_place_report(uri, (m_role == SPSC_ROLE_PRODUCER) ? "producer" : "consumer", m_q->shm,
+            spsc_mapsize(m_q->capacity));
         m_active = true;
-        m_timestamp_us = -1;
+        m_trace_id = SB_TRACE_QUEUE(uri);
+        m_last_tstamp = 0;
 
         set_max_rate(max_rate);
+        set_tstamp(sb_sim_clock_get().stamp);
+        set_link_latency(sb_sim_clock_get().latency);
     }
 
     void deinit(void) {
         spsc_close(m_q);
+        m_q = NULL;
         m_active = false;
     }
 
@@ -120,14 +301,52 @@ class SB_base {
         return m_q->shm;
     }
 
-    void set_max_rate(double max_rate) {
-        if (max_rate > 0) {
-            m_min_period_us = (1.0e6 / max_rate) + 0.5;
-        } else {
-            m_min_period_us = -1;
+    // changes when the queue is reset, or when the process on the other
+    // side reattaches after dying without closing it (see spsc_attach)
+    uint32_t get_generation(void) {
+        check_active();
+        return spsc_generation(m_q);
+    }
+
+    // NUMA placement of the queue's pages: a node number, SB_NUMA_NONE, or
+    // SB_NUMA_CONSUMER (see sbplace.h).  takes effect at the next init();
+    // until set, the process-wide sb_numa_default() is used.
+    void set_numa(int node) {
+        m_numa = node;
+    }
+
+    // limits send/recv attempts to max_rate per second, allowing bursts of
+    // up to "burst" attempts after idle periods
+    void set_max_rate(double max_rate, double burst = 1) {
+        m_pacer.set_rate(max_rate, burst);
+    }
+
+    // if enabled, packets sent are stamped with the current simulation
+    // cycle, and stamps of received packets are decoded
+    void set_tstamp(bool enable) {
+        m_tstamp = enable;
+    }
+
+    // replay mode: if latency >= 0, a received packet is only released
+    // once the simulation cycle reaches its stamp plus this latency.
+    // replay mode implies that packets are stamped.
+    void set_link_latency(long latency) {
+        m_latency = latency;
+        if (latency >= 0) {
+            m_tstamp = true;
         }
     }
 
+    // id of this queue in trace records (see sbtrace.h)
+    uint16_t trace_id(void) {
+        return m_trace_id;
+    }
+
+    // stamp of the most recently received packet
+    uint64_t last_tstamp(void) {
+        return m_last_tstamp;
+    }
+
   protected:
     void check_active(void) {
         if (!m_active) {
@@ -135,21 +354,48 @@ class SB_base {
         }
     }
 
+    // called after every send or receive attempt, with whether a packet
+    // was moved, and after failed peeks.  since it's virtual, subclasses
+    // see transfers made through an SBTX& or SBRX& too (see SBTX_pcie).
+    virtual void transferred(bool ok) {
+        (void)ok;
+    }
+
     bool m_auto_deinit;
     bool m_active;
-    long m_min_period_us;
-    long m_timestamp_us;
+    sb_pacer m_pacer;
+    bool m_tstamp;
+    long m_latency;
+    uint64_t m_last_tstamp;
+    uint16_t m_trace_id;
+    int m_role;
+    int m_numa;
     spsc_queue* m_q;
 };
 
 class SBTX : public SB_base {
   public:
-    SBTX() {}
+    SBTX() {
+        m_role = SPSC_ROLE_PRODUCER;
+    }
 
     bool send(sb_packet& p) {
+        // unstamped packets still overwrite the stamp, see sb_packet_ts
+        return send(p, m_tstamp ? sb_sim_clock_get().cycle : 0);
+    }
+
+    // send a packet stamped with an explicit simulation cycle
+    bool send(sb_packet& p, uint64_t tstamp) {
         check_active();
-        max_rate_tick(m_timestamp_us, m_min_period_us);
-        return spsc_send(m_q, &p, sizeof p);
+        m_pacer.tick();
+
+        sb_packet_ts ts;
+        ts.pkt = p;
+        ts.tstamp = (uint32_t)tstamp;
+        bool ok = spsc_send(m_q, &ts, sizeof ts);
+        SB_TRACE_EVENT(SB_TRACE_SEND, m_trace_id, ok);
+        transferred(ok);
+        return ok;
     }
 
     void send_blocking(sb_packet& p) {
@@ -158,7 +404,7 @@ class SBTX : public SB_base {
         while (!success) {
             success = send(p);
 
-            if ((!success) && (m_min_period_us == -1)) {
+            if ((!success) && !m_pacer.enabled()) {
                 // maintain old behavior if max_rate isn't specified,
                 // i.e. yield on every iteration that the send isn't
                 // successful
@@ -175,19 +421,28 @@ class SBTX : public SB_base {
 
 class SBRX : public SB_base {
   public:
-    SBRX() {}
+    SBRX() {
+        m_role = SPSC_ROLE_CONSUMER;
+    }
 
     bool recv(sb_packet& p) {
         check_active();
-        max_rate_tick(m_timestamp_us, m_min_period_us);
-        return spsc_recv(m_q, &p, sizeof p);
+        m_pacer.tick();
+        bool ok = m_tstamp ? recv_tstamp(p, true) : spsc_recv(m_q, &p, sizeof p);
+        SB_TRACE_EVENT(SB_TRACE_RECV, m_trace_id, ok);
+        transferred(ok);
+        return ok;
     }
 
     bool recv() {
         check_active();
         sb_packet dummy_p;
-        max_rate_tick(m_timestamp_us, m_min_period_us);
-        return spsc_recv(m_q, &dummy_p, sizeof dummy_p);
+        m_pacer.tick();
+        bool ok = m_tstamp ? recv_tstamp(dummy_p, true)
+                           : spsc_recv(m_q, &dummy_p, sizeof dummy_p);
+        SB_TRACE_EVENT(SB_TRACE_RECV, m_trace_id, ok);
+        transferred(ok);
+        return ok;
     }
 
     void recv_blocking(sb_packet& p) {
@@ -196,7 +451,7 @@ class SBRX : public SB_base {
         while (!success) {
             success = recv(p);
 
-            if ((!success) && (m_min_period_us == -1)) {
+            if ((!success) && !m_pacer.enabled()) {
                 // maintain old behavior if max_rate isn't specified,
                 // i.e. yield on every iteration that the send isn't
                 // successful
@@ -206,9 +461,50 @@ class SBRX : public SB_base {
     }
 
     bool recv_peek(sb_packet& p) {
+        uint64_t tstamp;
+        return recv_peek(p, tstamp);
+    }
+
+    // also returns the stamp of the packet (zero unless stamping is
+    // enabled), which lets forwarding processes pass it on
+    bool recv_peek(sb_packet& p, uint64_t& tstamp) {
         check_active();
-        max_rate_tick(m_timestamp_us, m_min_period_us);
-        return spsc_recv_peek(m_q, &p, sizeof p);
+        m_pacer.tick();
+        tstamp = 0;
+        bool ok =
+            m_tstamp ? recv_tstamp(p, false, &tstamp) : spsc_recv_peek(m_q, &p, sizeof p);
+        if (!ok) {
+            transferred(false);
+        }
+        return ok;
+    }
+
+  private:
+    bool recv_tstamp(sb_packet& p, bool pop, uint64_t* peeked = NULL) {
+        sb_packet_ts ts;
+
+        if (!spsc_recv_peek(m_q, &ts, sizeof ts)) {
+            return false;
+        }
+
+        uint64_t tstamp = sb_tstamp_extend(m_last_tstamp, ts.tstamp);
+        if (peeked) {
+            *peeked = tstamp;
+        }
+
+        // in replay mode, hold the packet until its stamped cycle plus
+        // the link latency, independent of how fast it actually arrived
+        if ((m_latency >= 0) && ((tstamp + m_latency) > sb_sim_clock_get().cycle)) {
+            return false;
+        }
+
+        if (pop) {
+            spsc_recv(m_q, &ts, sizeof ts);
+            m_last_tstamp = tstamp;
+        }
+
+        p = ts.pkt;
+        return true;
     }
 };
 
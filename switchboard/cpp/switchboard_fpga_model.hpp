@@ -0,0 +1,391 @@
+// Software model of the sb_fpga_queues DMA engine
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// SB_fpga_model implements the register map of sb_fpga_queues (see
+// switchboard/verilog/fpga/README.md) on top of a shared-memory "BAR", and
+// runs a DMA thread that services the host queues the way the RTL does.  It
+// plugs into SB_pcie as a register backend, so that driver code can be
+// exercised without hardware:
+//
+//   SB_fpga_model model(2);
+//   model.set_loopback(true);
+//   SBTX_pcie tx(0);
+//   SBRX_pcie rx(1);
+//   tx.init("to_dev.q", &model);
+//   rx.init("from_dev.q", &model);
+//
+// The model runs in the same process as the driver, and "bus" addresses are
+// simply virtual addresses.  As with the RTL, even-numbered queues move
+// packets from the host to the device and odd-numbered queues move packets
+// from the device to the host.  The device side of each queue is a small
+// FIFO, accessed with device_recv() and device_send(); in loopback mode,
+// packets received on queue 2k are sent back on queue 2k+1.
+//
+// Unlike the RTL, the model also implements doorbell mode (REG_CAP_DOORBELL),
+// so that it can serve as a reference for that part of the register map.
+
+#ifndef __SWITCHBOARD_FPGA_MODEL_HPP__
+#define __SWITCHBOARD_FPGA_MODEL_HPP__
+
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "switchboard.hpp"
+#include "switchboard_pcie.hpp"
+
+// offsets of the queue control words and packets, as in spsc_queue.vh
+#define SB_FPGA_MODEL_HEAD_OFFSET 0
+#define SB_FPGA_MODEL_TAIL_OFFSET 64
+#define SB_FPGA_MODEL_PACKET_OFFSET 128
+#define SB_FPGA_MODEL_PACKET_SIZE 64
+
+// depth of the device-side FIFO of each queue
+#define SB_FPGA_MODEL_FIFO_DEPTH 64
+
+// packets moved per queue before the DMA thread moves on to the next queue
+#define SB_FPGA_MODEL_BURST 16
+
+class SB_fpga_model : public SB_pcie_regs {
+  public:
+    // "bar_uri" optionally names a file to hold the register space, so that
+    // it can be inspected from outside; otherwise anonymous memory is used.
+    SB_fpga_model(int num_queues = 2, const char* bar_uri = NULL)
+        : m_queues(num_queues), m_loopback(false), m_stop(false), m_dma_reads(0),
+          m_dma_writes(0) {
+
+        if ((num_queues < 1) || (num_queues > 255)) {
+            throw std::runtime_error("SB_fpga_model: num_queues must be between 1 and 255");
+        }
+
+        if (bar_uri) {
+            int fd = open(bar_uri, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+            if ((fd < 0) || (ftruncate(fd, PCIE_BAR_MAP_SIZE) < 0)) {
+                throw std::runtime_error("SB_fpga_model: unable to create BAR file");
+            }
+            m_bar = (uint32_t*)mmap(NULL, PCIE_BAR_MAP_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                fd, 0);
+            close(fd);
+        } else {
+            m_bar = (uint32_t*)mmap(NULL, PCIE_BAR_MAP_SIZE, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        }
+
+        if (m_bar == MAP_FAILED) {
+            throw std::runtime_error("SB_fpga_model: unable to map BAR");
+        }
+
+        bar_store(REG_ID, REG_ID_FPGA << 16);
+        bar_store(REG_CAP, (num_queues << 16) | REG_CAP_PAGEMAP | REG_CAP_DOORBELL);
+
+        for (int i = 0; i < num_queues; i++) {
+            reset_queue(i);
+        }
+
+        m_thread = std::thread(&SB_fpga_model::dma_loop, this);
+    }
+
+    ~SB_fpga_model() {
+        m_stop = true;
+        m_thread.join();
+        munmap(m_bar, PCIE_BAR_MAP_SIZE);
+    }
+
+    // SB_pcie_regs interface.  Register side effects take place before the
+    // access returns, as they would for a non-posted access to the RTL.
+
+    uint32_t read32(uint64_t offset) {
+        assert((offset & 3) == 0);
+        assert(offset <= PCIE_BAR_MAP_SIZE - 4);
+
+        std::lock_guard<std::mutex> guard(m_lock);
+        return bar_load(offset);
+    }
+
+    void write32(uint64_t offset, uint32_t v) {
+        assert((offset & 3) == 0);
+        assert(offset <= PCIE_BAR_MAP_SIZE - 4);
+
+        std::lock_guard<std::mutex> guard(m_lock);
+
+        int q = (offset / REG_QUEUE_ADDR_SIZE) - 1;
+        uint64_t reg = REG_ENABLE + (offset % REG_QUEUE_ADDR_SIZE);
+
+        if ((offset < REG_ENABLE) || (q >= (int)m_queues.size())) {
+            // global registers and unused queues are read-only
+            return;
+        }
+
+        switch (reg) {
+        case REG_RESET:
+            if (v & 1) {
+                reset_queue(q);
+            }
+            break;
+        case REG_ENABLE:
+            bar_store(offset, v & 1);
+            // a disabled queue finishes its current access before it is
+            // idle, which is guaranteed here by holding m_lock
+            bar_store(queue_reg(q, REG_STATUS), (v & 1) ? 0 : 1);
+            break;
+        case REG_QUEUE_ADDRESS_LO:
+        case REG_QUEUE_ADDRESS_HI:
+        case REG_QUEUE_CAPACITY:
+        case REG_QUEUE_DOORBELL:
+        case REG_QUEUE_COALESCE:
+            bar_store(offset, v);
+            break;
+        default:
+            break;
+        }
+    }
+
+    uint64_t dma_addr(void* ptr) {
+        return (uintptr_t)ptr;
+    }
+
+    // Device side of the queues.  device_recv() is for even (host-to-device)
+    // queues and device_send() for odd (device-to-host) queues.
+
+    bool device_recv(int queue, sb_packet& p) {
+        std::lock_guard<std::mutex> guard(m_lock);
+        std::deque<sb_packet>& fifo = m_queues.at(queue).fifo;
+        if (fifo.empty()) {
+            return false;
+        }
+        p = fifo.front();
+        fifo.pop_front();
+        return true;
+    }
+
+    bool device_send(int queue, const sb_packet& p) {
+        std::lock_guard<std::mutex> guard(m_lock);
+        std::deque<sb_packet>& fifo = m_queues.at(queue).fifo;
+        if (fifo.size() >= SB_FPGA_MODEL_FIFO_DEPTH) {
+            return false;
+        }
+        fifo.push_back(p);
+        return true;
+    }
+
+    void set_loopback(bool loopback) {
+        m_loopback = loopback;
+    }
+
+    // number of reads and writes of host memory issued by the DMA engine,
+    // each corresponding to a PCIe transaction on real hardware
+    uint64_t dma_reads() {
+        return m_dma_reads;
+    }
+
+    uint64_t dma_writes() {
+        return m_dma_writes;
+    }
+
+  private:
+    struct queue_state {
+        uint32_t head;
+        uint32_t tail;
+        uint32_t unreported; // packets moved since the pointer was written back
+        std::deque<sb_packet> fifo;
+    };
+
+    static uint64_t queue_reg(int q, uint64_t reg) {
+        return (q * REG_QUEUE_ADDR_SIZE) + reg;
+    }
+
+    uint32_t bar_load(uint64_t offset) {
+        return __atomic_load_n(&m_bar[offset / 4], __ATOMIC_ACQUIRE);
+    }
+
+    void bar_store(uint64_t offset, uint32_t v) {
+        __atomic_store_n(&m_bar[offset / 4], v, __ATOMIC_RELEASE);
+    }
+
+    // soft reset of a queue, matching config_registers.sv
+    void reset_queue(int q) {
+        bar_store(queue_reg(q, REG_ENABLE), 0);
+        bar_store(queue_reg(q, REG_RESET), 0);
+        bar_store(queue_reg(q, REG_STATUS), 1);
+        bar_store(queue_reg(q, REG_QUEUE_ADDRESS_LO), 0);
+        bar_store(queue_reg(q, REG_QUEUE_ADDRESS_HI), 0);
+        bar_store(queue_reg(q, REG_QUEUE_CAPACITY), 2);
+        bar_store(queue_reg(q, REG_QUEUE_DOORBELL), 0);
+        bar_store(queue_reg(q, REG_QUEUE_COALESCE), 1);
+
+        m_queues[q].head = 0;
+        m_queues[q].tail = 0;
+        m_queues[q].unreported = 0;
+        m_queues[q].fifo.clear();
+    }
+
+    // host memory accesses, through the queue's address translation
+
+    uint8_t* host_ptr(int q, uint64_t offset) {
+        uint64_t base = bar_load(queue_reg(q, REG_QUEUE_ADDRESS_LO));
+        base |= (uint64_t)bar_load(queue_reg(q, REG_QUEUE_ADDRESS_HI)) << 32;
+
+        const uint64_t* pagemap = NULL;
+        if (bar_load(queue_reg(q, REG_QUEUE_CAPACITY)) & REG_QUEUE_CAPACITY_PAGEMAP) {
+            pagemap = (const uint64_t*)(uintptr_t)base;
+        }
+
+        return (uint8_t*)(uintptr_t)sb_pcie_queue_addr(base, pagemap, offset);
+    }
+
+    uint32_t host_read32(int q, uint64_t offset) {
+        m_dma_reads++;
+        return __atomic_load_n((uint32_t*)host_ptr(q, offset), __ATOMIC_ACQUIRE);
+    }
+
+    void host_write32(int q, uint64_t offset, uint32_t v) {
+        m_dma_writes++;
+        __atomic_store_n((uint32_t*)host_ptr(q, offset), v, __ATOMIC_RELEASE);
+    }
+
+    bool doorbell_mode(int q) {
+        return bar_load(queue_reg(q, REG_QUEUE_CAPACITY)) & REG_QUEUE_CAPACITY_DOORBELL;
+    }
+
+    // Writes the device's pointer back to host memory, which is done for
+    // every packet in the default mode and coalesced in doorbell mode.
+    void report(int q, uint64_t offset, uint32_t ptr, bool idle) {
+        queue_state& s = m_queues[q];
+        uint32_t coalesce = doorbell_mode(q) ? bar_load(queue_reg(q, REG_QUEUE_COALESCE)) : 1;
+
+        if ((s.unreported > 0) && (idle || (s.unreported >= coalesce))) {
+            host_write32(q, offset, ptr);
+            s.unreported = 0;
+        }
+    }
+
+    // moves packets from the host queue into the device FIFO
+    bool service_rx(int q, uint32_t capacity) {
+        queue_state& s = m_queues[q];
+        std::deque<sb_packet>& fifo = (m_loopback && ((q + 1) < (int)m_queues.size()))
+                                          ? m_queues[q + 1].fifo
+                                          : s.fifo;
+        bool busy = false;
+
+        for (int i = 0; i < SB_FPGA_MODEL_BURST; i++) {
+            if (fifo.size() >= SB_FPGA_MODEL_FIFO_DEPTH) {
+                break;
+            }
+
+            if (s.head == s.tail) {
+                s.head = doorbell_mode(q) ? bar_load(queue_reg(q, REG_QUEUE_DOORBELL))
+                                          : host_read32(q, SB_FPGA_MODEL_HEAD_OFFSET);
+                if (s.head == s.tail) {
+                    break;
+                }
+            }
+
+            sb_packet p;
+            m_dma_reads++;
+            memcpy(&p,
+                host_ptr(q, SB_FPGA_MODEL_PACKET_OFFSET + (s.tail * SB_FPGA_MODEL_PACKET_SIZE)),
+                sizeof p);
+            fifo.push_back(p);
+
+            s.tail = ((s.tail + 1) == capacity) ? 0 : (s.tail + 1);
+            s.unreported++;
+            report(q, SB_FPGA_MODEL_TAIL_OFFSET, s.tail, false);
+            busy = true;
+        }
+
+        report(q, SB_FPGA_MODEL_TAIL_OFFSET, s.tail, !busy || (s.head == s.tail));
+        return busy;
+    }
+
+    // moves packets from the device FIFO into the host queue
+    bool service_tx(int q, uint32_t capacity) {
+        queue_state& s = m_queues[q];
+        bool busy = false;
+
+        for (int i = 0; i < SB_FPGA_MODEL_BURST; i++) {
+            if (s.fifo.empty()) {
+                break;
+            }
+
+            uint32_t head_next = ((s.head + 1) == capacity) ? 0 : (s.head + 1);
+            if (head_next == s.tail) {
+                s.tail = doorbell_mode(q) ? bar_load(queue_reg(q, REG_QUEUE_DOORBELL))
+                                          : host_read32(q, SB_FPGA_MODEL_TAIL_OFFSET);
+                if (head_next == s.tail) {
+                    break;
+                }
+            }
+
+            // like the RTL, write the whole slot with the unused bytes zeroed
+            uint8_t slot[SB_FPGA_MODEL_PACKET_SIZE] = {0};
+            memcpy(slot, &s.fifo.front(), sizeof(sb_packet));
+            s.fifo.pop_front();
+
+            m_dma_writes++;
+            memcpy(host_ptr(q, SB_FPGA_MODEL_PACKET_OFFSET + (s.head * SB_FPGA_MODEL_PACKET_SIZE)),
+                slot, sizeof slot);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+
+            s.head = head_next;
+            s.unreported++;
+            report(q, SB_FPGA_MODEL_HEAD_OFFSET, s.head, false);
+            busy = true;
+        }
+
+        report(q, SB_FPGA_MODEL_HEAD_OFFSET, s.head, !busy || s.fifo.empty());
+        return busy;
+    }
+
+    void dma_loop() {
+        while (!m_stop) {
+            bool busy = false;
+
+            for (int q = 0; q < (int)m_queues.size(); q++) {
+                std::lock_guard<std::mutex> guard(m_lock);
+
+                if (!bar_load(queue_reg(q, REG_ENABLE))) {
+                    continue;
+                }
+
+                uint32_t capacity =
+                    bar_load(queue_reg(q, REG_QUEUE_CAPACITY)) & REG_QUEUE_CAPACITY_MASK;
+                if (capacity < 2) {
+                    continue;
+                }
+
+                if ((q % 2) == 0) {
+                    busy |= service_rx(q, capacity);
+                } else {
+                    busy |= service_tx(q, capacity);
+                }
+            }
+
+            if (!busy) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    uint32_t* m_bar;
+    std::vector<queue_state> m_queues;
+    std::atomic<bool> m_loopback;
+    std::atomic<bool> m_stop;
+    std::atomic<uint64_t> m_dma_reads;
+    std::atomic<uint64_t> m_dma_writes;
+    std::mutex m_lock;
+    std::thread m_thread;
+};
+
+#endif // __SWITCHBOARD_FPGA_MODEL_HPP__
@@ -6,8 +6,12 @@
 #ifndef __SWITCHBOARD_PCIE_HPP__
 #define __SWITCHBOARD_PCIE_HPP__
 
+#include <algorithm>
 #include <array>
 #include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
 #include <string>
 #include <thread>
 #include <vector>
@@ -24,6 +28,9 @@
 #define REG_ID_FPGA 0x1234
 
 #define REG_CAP 0x004
+#define REG_CAP_PAGEMAP (1 << 0) // queues can be described by a page table
+#define REG_CAP_DOORBELL (1 << 1) // queues support doorbell mode
+#define REG_CAP_NUM_QUEUES(cap) (((cap) >> 16) & 0xff) // 0 if not reported
 
 #define REG_ENABLE 0x100
 #define REG_RESET 0x104
@@ -31,6 +38,11 @@
 #define REG_QUEUE_ADDRESS_LO 0x10c
 #define REG_QUEUE_ADDRESS_HI 0x110
 #define REG_QUEUE_CAPACITY 0x114
+#define REG_QUEUE_CAPACITY_MASK 0x00ffffff
+#define REG_QUEUE_CAPACITY_PAGEMAP (1U << 31) // queue address points to a page table
+#define REG_QUEUE_CAPACITY_DOORBELL (1U << 30) // queue is in doorbell mode
+#define REG_QUEUE_DOORBELL 0x118
+#define REG_QUEUE_COALESCE 0x11c
 
 #define REG_QUEUE_ADDR_SIZE 0x100 // size of addr space dedicated to each queue
 
@@ -40,6 +52,62 @@
 // Max nr of retries when resetting or disabling queue's.
 #define MAX_RETRY 3
 
+// Queues are polled for idle status with an exponential backoff, up to
+// this interval, and for at most MAX_RETRY * 100 ms in total.
+#define SB_PCIE_POLL_MAX_US 10000
+#define SB_PCIE_IDLE_TIMEOUT_US (MAX_RETRY * 100 * 1000)
+
+// Queues that span more than one page must either be contiguous in bus
+// address space (e.g. when backed by a huge page), or be described to the
+// device by a page table.  The page table is an array of 64-bit bus
+// addresses, one for each SB_PCIE_PAGE_SIZE chunk of the queue, and itself
+// occupies a single page.  REG_QUEUE_ADDRESS then points to the page table,
+// and REG_QUEUE_CAPACITY has REG_QUEUE_CAPACITY_PAGEMAP set.
+#define SB_PCIE_PAGE_SIZE 4096
+#define SB_PCIE_PAGEMAP_ENTRIES (SB_PCIE_PAGE_SIZE / sizeof(uint64_t))
+
+// In the default mode, the device polls the head (or tail) of a queue in
+// host memory, which costs a read over the bus for every poll.  In doorbell
+// mode, the host instead writes its pointer to REG_QUEUE_DOORBELL after
+// each batch of packets, and the device writes its own pointer back to the
+// queue's head/tail line in host memory only every REG_QUEUE_COALESCE
+// packets, or whenever it runs out of work.  The host then never reads
+// device registers on the data path, and the device never polls host memory.
+#define SB_PCIE_DOORBELL_COALESCE 16
+
+// Returns the bus address of byte "offset" within a queue, as the device
+// computes it.  "pagemap" is NULL for contiguous queues.  Queue slots never
+// straddle a chunk boundary, since they are 64-byte aligned.
+static inline uint64_t sb_pcie_queue_addr(uint64_t base, const uint64_t* pagemap,
+    uint64_t offset) {
+
+    if (pagemap) {
+        return pagemap[offset / SB_PCIE_PAGE_SIZE] + (offset % SB_PCIE_PAGE_SIZE);
+    } else {
+        return base + offset;
+    }
+}
+
+// Register access for SB_pcie.  By default, SB_pcie maps the PCIe BAR and
+// accesses registers directly; alternatively, anything implementing the same
+// register map (e.g. SB_fpga_model) can be attached with SB_pcie::set_regs().
+class SB_pcie_regs {
+  public:
+    virtual ~SB_pcie_regs() {}
+
+    virtual uint32_t read32(uint64_t offset) = 0;
+    virtual void write32(uint64_t offset, uint32_t v) = 0;
+
+    virtual void write32_strong(uint64_t offset, uint32_t v) {
+        write32(offset, v);
+        // Enforce ordering by reading back the same reg.
+        (void)read32(offset);
+    }
+
+    // Address that the device uses to reach host memory at "ptr".
+    virtual uint64_t dma_addr(void* ptr) = 0;
+};
+
 template <typename T> static inline void sb_pcie_deinit(T* s) {
 
     // Needs to be done in reverse order.
@@ -49,14 +117,27 @@ template <typename T> static inline void sb_pcie_deinit(T* s) {
 
 class SB_pcie {
   public:
-    SB_pcie(int queue_id) : m_queue_id(queue_id), m_map(NULL), m_addr(0) {}
+    SB_pcie(int queue_id)
+        : m_queue_id(queue_id), m_map(NULL), m_addr(0), m_cap(0), m_pagemap(NULL),
+          m_force_pagemap(false), m_pagemap_fd(-1), m_regs(NULL), m_doorbell(false),
+          m_doorbell_batch(1), m_doorbell_coalesce(SB_PCIE_DOORBELL_COALESCE),
+          m_doorbell_pending(0) {}
 
     ~SB_pcie() {
         sb_pcie_deinit(this);
     }
 
+    // Use "regs" for register access instead of mapping a PCIe BAR.  Must
+    // be called before init(), and "regs" must outlive this object.
+    void set_regs(SB_pcie_regs* regs) {
+        m_regs = regs;
+    }
+
     virtual bool init_host(const char* uri, const char* bdf, int bar_num, void* handle) {
-        m_addr = pagemap_virt_to_phys(handle);
+        m_addr = dma_addr(handle);
+        if (m_regs) {
+            return true;
+        }
         m_map = (char*)pcie_bar_map(bdf, bar_num, 0, PCIE_BAR_MAP_SIZE);
         if (m_map == MAP_FAILED) {
             m_map = NULL;
@@ -70,11 +151,119 @@ class SB_pcie {
             pcie_bar_unmap(m_map, PCIE_BAR_MAP_SIZE);
             m_map = NULL;
         }
+
+        // the backend isn't owned by us and may go away once deinitialized
+        m_regs = NULL;
+
+        if (m_pagemap) {
+            munlock(m_pagemap, SB_PCIE_PAGE_SIZE);
+            free(m_pagemap);
+            m_pagemap = NULL;
+        }
+
+        if (m_pagemap_fd >= 0) {
+            close(m_pagemap_fd);
+            m_pagemap_fd = -1;
+        }
     }
 
-    bool init_dev(int capacity) {
-        int qoffset = m_queue_id * REG_QUEUE_ADDR_SIZE;
-        int reset_retry = 0;
+    // Returns the address that the device uses to reach host memory at
+    // "ptr", or PAGEMAP_FAILED.  For PCIe this is the physical address.
+    virtual uint64_t dma_addr(void* ptr) {
+        if (m_regs) {
+            return m_regs->dma_addr(ptr);
+        }
+        if (m_pagemap_fd < 0) {
+            m_pagemap_fd = pagemap_open_self();
+            if (m_pagemap_fd < 0) {
+                return PAGEMAP_FAILED;
+            }
+        }
+        return pagemap_virt_to_phys_fd(m_pagemap_fd, ptr);
+    }
+
+    int queue_id(void) {
+        return m_queue_id;
+    }
+
+    // Always describe the queue with a page table, even if it happens to
+    // be contiguous.  Mainly useful for testing.
+    void force_pagemap(bool force) {
+        m_force_pagemap = force;
+    }
+
+    // Requests doorbell mode (see SB_PCIE_DOORBELL_COALESCE), ringing the
+    // doorbell every "batch" packets and whenever the queue stalls, or on
+    // flush().  Must be called before init(); devices without doorbell
+    // support fall back to the default mode.
+    void set_doorbell(bool enable, int batch = 1, int coalesce = SB_PCIE_DOORBELL_COALESCE) {
+        m_doorbell = enable;
+        m_doorbell_batch = std::max(batch, 1);
+        m_doorbell_coalesce = std::max(coalesce, 1);
+    }
+
+    bool doorbell_enabled(void) {
+        return m_doorbell;
+    }
+
+    // Works out how the device should address the queue at "handle":
+    // directly, if it is contiguous in bus address space, or otherwise
+    // through a page table.
+    bool init_queue_addr(void* handle, int capacity) {
+        size_t size = spsc_mapsize(capacity);
+        size_t npages = (size + SB_PCIE_PAGE_SIZE - 1) / SB_PCIE_PAGE_SIZE;
+        std::vector<uint64_t> pages(npages);
+        bool contiguous = true;
+
+        for (size_t i = 0; i < npages; i++) {
+            pages[i] = dma_addr((char*)handle + (i * SB_PCIE_PAGE_SIZE));
+            if (pages[i] == PAGEMAP_FAILED) {
+                printf("%s: Unable to translate queue address\n", __func__);
+                return false;
+            }
+            if (pages[i] != pages[0] + (i * SB_PCIE_PAGE_SIZE)) {
+                contiguous = false;
+            }
+        }
+
+        if (contiguous && !m_force_pagemap) {
+            m_addr = pages[0];
+            return true;
+        }
+
+        if (!(m_cap & REG_CAP_PAGEMAP)) {
+            printf("%s: Queue is not contiguous and the device lacks page table support\n",
+                __func__);
+            return false;
+        }
+
+        if (npages > SB_PCIE_PAGEMAP_ENTRIES) {
+            printf("%s: Queue capacity %d is too large for a page table\n", __func__, capacity);
+            return false;
+        }
+
+        void* p;
+        if (posix_memalign(&p, SB_PCIE_PAGE_SIZE, SB_PCIE_PAGE_SIZE)) {
+            return false;
+        }
+        m_pagemap = (uint64_t*)p;
+        memset(m_pagemap, 0, SB_PCIE_PAGE_SIZE);
+        memcpy(m_pagemap, pages.data(), npages * sizeof(uint64_t));
+
+        // the table must stay put while the device is using it
+        if (mlock(m_pagemap, SB_PCIE_PAGE_SIZE)) {
+            perror("mlock");
+            return false;
+        }
+
+        m_addr = dma_addr(m_pagemap);
+        return m_addr != PAGEMAP_FAILED;
+    }
+
+    // Configures and enables the device side of the queue.  If "handle" is
+    // given, the queue address is (re)computed from it, which is required
+    // for queues larger than a page.
+    bool init_dev(int capacity, void* handle = NULL) {
         uint32_t r;
 
         r = dev_read32(REG_ID);
@@ -84,69 +273,157 @@ class SB_pcie {
             return false;
         }
 
-        r = dev_read32(REG_CAP);
-        D(printf("SB pcie CAP=%x\n", r));
+        if (!init_dev_config(dev_read32(REG_CAP), capacity, handle)) {
+            return false;
+        }
 
         // Reset the device.
-        dev_write32(qoffset + REG_RESET, 0x1);
+        dev_reset();
         D(printf("Read reset state\n"));
-        while (dev_read32(qoffset + REG_STATUS) != 0x1) {
-            if (reset_retry++ >= MAX_RETRY) {
-                return false;
-            }
-            usleep(100 * 1000);
+        SB_pcie* self = this;
+        if (!wait_idle(&self, 1)) {
+            return false;
         }
 
-        dev_write32(qoffset + REG_QUEUE_ADDRESS_LO, m_addr);
-        dev_write32(qoffset + REG_QUEUE_ADDRESS_HI, m_addr >> 32);
-        D(printf("SB QUEUE_ADDR=%lx\n", m_addr));
-
-        dev_write32(qoffset + REG_QUEUE_CAPACITY, capacity);
-        D(printf("SB CAPACITY=%d\n", capacity));
-
-        dev_write32_strong(qoffset + REG_ENABLE, 0x1);
+        dev_configure(capacity);
+        dev_write32_strong(m_queue_id * REG_QUEUE_ADDR_SIZE + REG_ENABLE, 0x1);
         return true;
     }
 
     void deinit_dev() {
-        int disable_retry = 0;
-
-        if (!m_map) {
+        if (!m_map && !m_regs) {
             return;
         }
-        int qoffset = m_queue_id * REG_QUEUE_ADDR_SIZE;
 
         // Must disable queue and wait for it to quiesce before unmapping
         // queue shared memory, otherwise FPGA may read from/write to memory
         // that gets reallocated to another process.
-        dev_write32_strong(qoffset + REG_ENABLE, 0x0);
-        while (dev_read32(qoffset + REG_STATUS) != 0x1) {
-            if (disable_retry++ >= MAX_RETRY) {
-                return;
+        dev_write32_strong(m_queue_id * REG_QUEUE_ADDR_SIZE + REG_ENABLE, 0x0);
+        SB_pcie* self = this;
+        wait_idle(&self, 1);
+    }
+
+    // The steps of init_dev(), which SB_pcie_device also uses to bring up
+    // all queues of a device together.
+
+    // Checks the capabilities "cap" of the device against what was
+    // requested for this queue, and works out the queue address.
+    bool init_dev_config(uint32_t cap, int capacity, void* handle) {
+        m_cap = cap;
+        D(printf("SB pcie CAP=%x\n", m_cap));
+
+        if (m_doorbell && !(m_cap & REG_CAP_DOORBELL)) {
+            printf("%s: Device lacks doorbell support, polling instead\n", __func__);
+            m_doorbell = false;
+        }
+        m_doorbell_pending = 0;
+
+        return !handle || init_queue_addr(handle, capacity);
+    }
+
+    void dev_reset(void) {
+        dev_write32(m_queue_id * REG_QUEUE_ADDR_SIZE + REG_RESET, 0x1);
+    }
+
+    bool dev_idle(void) {
+        return dev_read32(m_queue_id * REG_QUEUE_ADDR_SIZE + REG_STATUS) == 0x1;
+    }
+
+    // Programs the queue address and capacity into the (idle) device.
+    void dev_configure(int capacity) {
+        int qoffset = m_queue_id * REG_QUEUE_ADDR_SIZE;
+
+        dev_write32(qoffset + REG_QUEUE_ADDRESS_LO, m_addr);
+        dev_write32(qoffset + REG_QUEUE_ADDRESS_HI, m_addr >> 32);
+        D(printf("SB QUEUE_ADDR=%lx\n", m_addr));
+
+        if (m_doorbell) {
+            dev_write32(qoffset + REG_QUEUE_COALESCE, m_doorbell_coalesce);
+        }
+
+        dev_write32(qoffset + REG_QUEUE_CAPACITY,
+            capacity | (m_pagemap ? REG_QUEUE_CAPACITY_PAGEMAP : 0) |
+                (m_doorbell ? REG_QUEUE_CAPACITY_DOORBELL : 0));
+        D(printf("SB CAPACITY=%d\n", capacity));
+    }
+
+    // Posted write; follow with a register read to make sure it has landed.
+    void dev_enable(bool enable) {
+        dev_write32(m_queue_id * REG_QUEUE_ADDR_SIZE + REG_ENABLE, enable ? 0x1 : 0x0);
+    }
+
+    // Waits until all "queues" are idle, polling with an exponential
+    // backoff rather than fixed sleeps, since queues normally go idle
+    // within microseconds.
+    static bool wait_idle(SB_pcie* const* queues, size_t n) {
+        uint64_t start = tsc_monotonic_ns();
+        long delay_us = 1;
+        size_t i = 0;
+
+        while (true) {
+            // once idle, a queue stays idle until it is enabled again
+            while ((i < n) && queues[i]->dev_idle()) {
+                i++;
             }
-            usleep(100 * 1000);
+            if (i == n) {
+                return true;
+            }
+            if ((tsc_monotonic_ns() - start) > (SB_PCIE_IDLE_TIMEOUT_US * 1000ULL)) {
+                printf("%s: Timed out waiting for queue %d\n", __func__, queues[i]->m_queue_id);
+                return false;
+            }
+            usleep(delay_us);
+            delay_us = std::min(delay_us * 2, (long)SB_PCIE_POLL_MAX_US);
         }
     }
 
     virtual uint32_t dev_read32(uint64_t offset) {
+        if (m_regs) {
+            return m_regs->read32(offset);
+        }
         assert(m_map);
         assert(offset <= PCIE_BAR_MAP_SIZE - 4);
         return pcie_read32(m_map + offset);
     }
 
     virtual void dev_write32(uint64_t offset, uint32_t v) {
+        if (m_regs) {
+            m_regs->write32(offset, v);
+            return;
+        }
         assert(m_map);
         assert(offset <= PCIE_BAR_MAP_SIZE - 4);
         pcie_write32(m_map + offset, v);
     }
 
     virtual void dev_write32_strong(uint64_t offset, uint32_t v) {
+        if (m_regs) {
+            m_regs->write32_strong(offset, v);
+            return;
+        }
         assert(m_map);
         assert(offset <= PCIE_BAR_MAP_SIZE - 4);
         pcie_write32_strong(m_map + offset, v);
     }
 
   protected:
+    // Counts a packet moved by the host, and rings the doorbell with the
+    // host's pointer "ptr" once a batch is complete.
+    void doorbell_count(int32_t ptr) {
+        if (++m_doorbell_pending >= m_doorbell_batch) {
+            doorbell_ring(ptr);
+        }
+    }
+
+    // Tells the device about any packets not announced yet.  Doorbells are
+    // posted writes, so this doesn't wait for the device.
+    void doorbell_ring(int32_t ptr) {
+        if (m_doorbell_pending > 0) {
+            dev_write32(m_queue_id * REG_QUEUE_ADDR_SIZE + REG_QUEUE_DOORBELL, ptr);
+            m_doorbell_pending = 0;
+        }
+    }
+
     // Queue index.
     int m_queue_id;
 
@@ -157,15 +434,35 @@ class SB_pcie {
     // m_addr holds an address to the SPSC queue's SHM area. For some
     // implementations this will simply be a user-space virtual address
     // and for others it may be a physical address for HW DMA implementations
-    // to access.
+    // to access.  If m_pagemap is set, m_addr is the address of the page
+    // table instead.
     uint64_t m_addr;
-};
 
-static inline bool sb_init_queue(SB_base* s, const char* uri) {
-    int capacity;
+    // Contents of REG_CAP.
+    uint32_t m_cap;
+
+    // Page table for queues that aren't contiguous, or NULL.
+    uint64_t* m_pagemap;
+    bool m_force_pagemap;
+
+    // /proc/self/pagemap, opened on first use.
+    int m_pagemap_fd;
+
+    // Register backend set with set_regs(), or NULL to use m_map.
+    SB_pcie_regs* m_regs;
 
-    // Create queue's that fit into a single page.
-    capacity = spsc_capacity(getpagesize());
+    // Doorbell mode, and packets moved since the doorbell was last rung.
+    bool m_doorbell;
+    int m_doorbell_batch;
+    int m_doorbell_coalesce;
+    int m_doorbell_pending;
+};
+
+static inline bool sb_init_queue(SB_base* s, const char* uri, int capacity = 0) {
+    // By default, create queue's that fit into a single page.
+    if (capacity <= 0) {
+        capacity = spsc_capacity(getpagesize());
+    }
     s->init(uri, capacity);
 
     // Lock pages into RAM (avoid ondemand allocation or swapping).
@@ -178,15 +475,19 @@ static inline bool sb_init_queue(SB_base* s, const char* uri) {
 }
 
 template <typename T>
-static inline bool sb_pcie_init(T* s, const char* uri, const char* bdf, int bar_num) {
-    sb_init_queue(s, uri);
+static inline bool sb_pcie_init(T* s, const char* uri, const char* bdf, int bar_num,
+    int capacity = 0) {
+
+    if (!sb_init_queue(s, uri, capacity)) {
+        return false;
+    }
 
     if (!s->init_host(uri, bdf, bar_num, s->get_shm_handle())) {
         s->deinit();
         return false;
     }
 
-    if (!s->init_dev(s->get_capacity())) {
+    if (!s->init_dev(s->get_capacity(), s->get_shm_handle())) {
         s->deinit();
         return false;
     }
@@ -197,38 +498,334 @@ class SBTX_pcie : public SBTX, public SB_pcie {
   public:
     SBTX_pcie(int queue_id) : SB_pcie(queue_id) {}
 
-    bool init(std::string uri, std::string bdf, int bar_num) {
-        return init(uri.c_str(), bdf.c_str(), bar_num);
+    bool init(std::string uri, std::string bdf, int bar_num, int capacity = 0) {
+        return init(uri.c_str(), bdf.c_str(), bar_num, capacity);
+    }
+
+    bool init(const char* uri, const char* bdf, int bar_num, int capacity = 0) {
+        return sb_pcie_init(this, uri, bdf, bar_num, capacity);
     }
 
-    bool init(const char* uri, const char* bdf, int bar_num) {
-        return sb_pcie_init(this, uri, bdf, bar_num);
+    bool init(const char* uri, SB_pcie_regs* regs, int capacity = 0) {
+        set_regs(regs);
+        return sb_pcie_init(this, uri, NULL, -1, capacity);
     }
 
     void deinit(void) {
         sb_pcie_deinit(this);
     }
 
-  private:
+    // announces packets sent since the last doorbell
+    void flush(void) {
+        if (m_doorbell) {
+            doorbell_ring(m_q->shm->head);
+        }
+    }
+
+  protected:
+    // rings the doorbell in doorbell mode.  this runs for every send, so
+    // that it also covers packets sent through an SBTX&, e.g. by umisb_send.
+    void transferred(bool sent) override {
+        if (m_doorbell) {
+            if (sent) {
+                doorbell_count(m_q->shm->head);
+            } else {
+                // the device may be waiting for packets already queued
+                doorbell_ring(m_q->shm->head);
+            }
+        }
+    }
 };
 
 class SBRX_pcie : public SBRX, public SB_pcie {
   public:
     SBRX_pcie(int queue_id) : SB_pcie(queue_id) {}
 
-    bool init(std::string uri, std::string bdf, int bar_num) {
-        return init(uri.c_str(), bdf.c_str(), bar_num);
+    bool init(std::string uri, std::string bdf, int bar_num, int capacity = 0) {
+        return init(uri.c_str(), bdf.c_str(), bar_num, capacity);
+    }
+
+    bool init(const char* uri, const char* bdf, int bar_num, int capacity = 0) {
+        return sb_pcie_init(this, uri, bdf, bar_num, capacity);
     }
 
-    bool init(const char* uri, const char* bdf, int bar_num) {
-        return sb_pcie_init(this, uri, bdf, bar_num);
+    bool init(const char* uri, SB_pcie_regs* regs, int capacity = 0) {
+        set_regs(regs);
+        return sb_pcie_init(this, uri, NULL, -1, capacity);
     }
 
     void deinit(void) {
         sb_pcie_deinit(this);
     }
 
+    // returns slots freed since the last doorbell to the device
+    void flush(void) {
+        if (m_doorbell) {
+            doorbell_ring(m_q->shm->tail);
+        }
+    }
+
+  protected:
+    // returns freed slots in doorbell mode, for every receive and failed
+    // peek, including those made through an SBRX&, e.g. by umisb_recv
+    void transferred(bool received) override {
+        if (m_doorbell) {
+            if (received) {
+                doorbell_count(m_q->shm->tail);
+            } else {
+                // the device may be waiting for space already freed
+                doorbell_ring(m_q->shm->tail);
+            }
+        }
+    }
+};
+
+// Manages the queues of one device together: the BAR is mapped once and
+// /proc/self/pagemap opened once for all queues, and queues are brought up
+// and down in bulk, so that the reset and disable handshakes of all queues
+// overlap instead of being waited for one queue at a time.
+//
+//   SB_pcie_device dev;
+//   dev.open(bdf, bar_num);
+//   SBTX_pcie& tx = dev.add_tx(0, "tx.q");
+//   SBRX_pcie& rx = dev.add_rx(1, "rx.q");
+//   dev.start();
+//
+// Queue objects are owned by the device, and remain valid until close().
+class SB_pcie_device : public SB_pcie_regs {
+  public:
+    SB_pcie_device()
+        : m_map(NULL), m_regs(NULL), m_pagemap_fd(-1), m_cap(0), m_open(false),
+          m_started(false) {}
+
+    ~SB_pcie_device() {
+        close();
+    }
+
+    bool open(const char* bdf, int bar_num) {
+        m_map = (char*)pcie_bar_map(bdf, bar_num, 0, PCIE_BAR_MAP_SIZE);
+        if (m_map == MAP_FAILED) {
+            m_map = NULL;
+            return false;
+        }
+        return probe();
+    }
+
+    // Accesses the device through "regs" (e.g. SB_fpga_model) instead.
+    bool open(SB_pcie_regs* regs) {
+        m_regs = regs;
+        return probe();
+    }
+
+    uint32_t cap(void) {
+        return m_cap;
+    }
+
+    // Number of queues reported by the device, or 0 if unknown.
+    int num_queues(void) {
+        return REG_CAP_NUM_QUEUES(m_cap);
+    }
+
+    // Adds a queue, which must be a device RX (even) queue for add_tx() and
+    // a device TX (odd) queue for add_rx().  Queues are configured on the
+    // device by start().
+    SBTX_pcie& add_tx(int queue_id, std::string uri, int capacity = 0) {
+        check_queue(queue_id, 0);
+        SBTX_pcie* q = new SBTX_pcie(queue_id);
+        m_queues.push_back(entry(q, q, uri, capacity));
+        m_tx.push_back(std::unique_ptr<SBTX_pcie>(q));
+        return *q;
+    }
+
+    SBRX_pcie& add_rx(int queue_id, std::string uri, int capacity = 0) {
+        check_queue(queue_id, 1);
+        SBRX_pcie* q = new SBRX_pcie(queue_id);
+        m_queues.push_back(entry(q, q, uri, capacity));
+        m_rx.push_back(std::unique_ptr<SBRX_pcie>(q));
+        return *q;
+    }
+
+    // Brings up all queues added so far.  Every phase is applied to all
+    // queues before moving on to the next one, so there is a single wait
+    // for the resets to complete and a single read-back at the end.
+    bool start(void) {
+        if (!m_open) {
+            printf("%s: Device is not open\n", __func__);
+            return false;
+        }
+
+        if (m_started) {
+            return true;
+        }
+
+        std::vector<SB_pcie*> pcie;
+        for (auto& e : m_queues) {
+            e.pcie->set_regs(this);
+            pcie.push_back(e.pcie);
+            if (!sb_init_queue(e.base, e.uri.c_str(), e.capacity) ||
+                !e.pcie->init_dev_config(m_cap, e.base->get_capacity(),
+                    e.base->get_shm_handle())) {
+                release();
+                return false;
+            }
+        }
+
+        for (SB_pcie* q : pcie) {
+            q->dev_reset();
+        }
+
+        if (!SB_pcie::wait_idle(pcie.data(), pcie.size())) {
+            release();
+            return false;
+        }
+
+        for (auto& e : m_queues) {
+            e.pcie->dev_configure(e.base->get_capacity());
+        }
+
+        for (SB_pcie* q : pcie) {
+            q->dev_enable(true);
+        }
+
+        // Enforce ordering of all of the above by reading back once.
+        (void)read32(REG_ID);
+
+        m_started = true;
+        return true;
+    }
+
+    // Disables all queues and waits for them to quiesce.  The queue
+    // objects remain, but have to be started again to be used.
+    void stop(void) {
+        if (!m_started) {
+            return;
+        }
+
+        std::vector<SB_pcie*> pcie;
+        for (auto& e : m_queues) {
+            e.pcie->dev_enable(false);
+            pcie.push_back(e.pcie);
+        }
+        (void)read32(REG_ID);
+        SB_pcie::wait_idle(pcie.data(), pcie.size());
+
+        release();
+        m_started = false;
+    }
+
+    void close(void) {
+        stop();
+
+        m_queues.clear();
+        m_tx.clear();
+        m_rx.clear();
+
+        if (m_map) {
+            pcie_bar_unmap(m_map, PCIE_BAR_MAP_SIZE);
+            m_map = NULL;
+        }
+
+        if (m_pagemap_fd >= 0) {
+            ::close(m_pagemap_fd);
+            m_pagemap_fd = -1;
+        }
+
+        m_regs = NULL;
+        m_open = false;
+    }
+
+    // SB_pcie_regs interface, used by the queues of this device.
+
+    uint32_t read32(uint64_t offset) {
+        if (m_regs) {
+            return m_regs->read32(offset);
+        }
+        assert(m_map);
+        assert(offset <= PCIE_BAR_MAP_SIZE - 4);
+        return pcie_read32(m_map + offset);
+    }
+
+    void write32(uint64_t offset, uint32_t v) {
+        if (m_regs) {
+            m_regs->write32(offset, v);
+            return;
+        }
+        assert(m_map);
+        assert(offset <= PCIE_BAR_MAP_SIZE - 4);
+        pcie_write32(m_map + offset, v);
+    }
+
+    uint64_t dma_addr(void* ptr) {
+        if (m_regs) {
+            return m_regs->dma_addr(ptr);
+        }
+        if (m_pagemap_fd < 0) {
+            m_pagemap_fd = pagemap_open_self();
+            if (m_pagemap_fd < 0) {
+                return PAGEMAP_FAILED;
+            }
+        }
+        return pagemap_virt_to_phys_fd(m_pagemap_fd, ptr);
+    }
+
   private:
+    struct entry {
+        entry(SB_base* base, SB_pcie* pcie, std::string uri, int capacity)
+            : base(base), pcie(pcie), uri(uri), capacity(capacity) {}
+
+        SB_base* base;
+        SB_pcie* pcie;
+        std::string uri;
+        int capacity;
+    };
+
+    bool probe(void) {
+        uint32_t id = read32(REG_ID);
+        if (id >> 16 != REG_ID_FPGA) {
+            printf("%s: Incompatible REG_ID=%x\n", __func__, id);
+            close();
+            return false;
+        }
+
+        m_cap = read32(REG_CAP);
+        m_open = true;
+        return true;
+    }
+
+    void check_queue(int queue_id, int parity) {
+        if (m_started) {
+            throw std::runtime_error("Queues must be added before starting the device.");
+        }
+        if ((queue_id < 0) || ((queue_id % 2) != parity) ||
+            ((num_queues() > 0) && (queue_id >= num_queues()))) {
+            throw std::runtime_error("Invalid queue index " + std::to_string(queue_id) + ".");
+        }
+        for (auto& e : m_queues) {
+            if (e.pcie->queue_id() == queue_id) {
+                throw std::runtime_error("Queue " + std::to_string(queue_id) + " added twice.");
+            }
+        }
+    }
+
+    // Releases host-side resources of the queues once the device is done
+    // with them, and detaches them from this device.
+    void release(void) {
+        for (auto& e : m_queues) {
+            e.pcie->deinit_host();
+            e.base->deinit();
+        }
+    }
+
+    char* m_map;
+    SB_pcie_regs* m_regs;
+    int m_pagemap_fd;
+    uint32_t m_cap;
+    bool m_open;
+    bool m_started;
+
+    std::vector<entry> m_queues;
+    std::vector<std::unique_ptr<SBTX_pcie>> m_tx;
+    std::vector<std::unique_ptr<SBRX_pcie>> m_rx;
 };
 
 #endif // __SWITCHBOARD_PCIE_HPP__
@@ -8,6 +8,7 @@
 
 #include <array>
 #include <cstdio>
+#include <cstring>
 #include <string>
 #include <thread>
 #include <vector>
@@ -26,12 +27,22 @@ using namespace std;
 #include "tlm.h"
 #include "tlm_utils/simple_initiator_socket.h"
 #include "tlm_utils/simple_target_socket.h"
-
+#include "tlm_utils/tlm_quantumkeeper.h"
+
+// Register accesses are loosely timed: delays annotated by the target are
+// accumulated by a quantum keeper, and the calling thread only yields to
+// the SystemC kernel once the local time exceeds the global quantum (see
+// tlm::tlm_global_quantum), or on sync().  If the target grants DMI,
+// subsequent accesses within the granted range go through the DMI pointer
+// and don't call b_transport() at all.
 class SB_tlm : public SB_pcie {
   public:
     tlm_utils::simple_initiator_socket<SB_tlm> socket;
 
-    SB_tlm(int queue_id) : SB_pcie(queue_id) {}
+    SB_tlm(int queue_id) : SB_pcie(queue_id), m_dmi_valid(false) {
+        socket.register_invalidate_direct_mem_ptr(this, &SB_tlm::invalidate_direct_mem_ptr);
+        m_qk.reset();
+    }
 
     bool init_host(const char* uri, const char* bdf, int bar_num, void* handle) {
         assert(handle);
@@ -39,21 +50,49 @@ class SB_tlm : public SB_pcie {
         return true;
     }
 
+    // the TLM side addresses host memory by virtual address
+    uint64_t dma_addr(void* ptr) {
+        return (uintptr_t)ptr;
+    }
+
     void dev_access(tlm::tlm_command cmd, uint64_t offset, void* buf, unsigned int len) {
         unsigned char* buf8 = (unsigned char*)buf;
-        sc_time delay = SC_ZERO_TIME;
-        tlm::tlm_generic_payload tr;
-
-        tr.set_command(cmd);
-        tr.set_address(offset);
-        tr.set_data_ptr(buf8);
-        tr.set_data_length(len);
-        tr.set_streaming_width(len);
-        tr.set_dmi_allowed(false);
-        tr.set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
-
-        socket->b_transport(tr, delay);
-        assert(tr.get_response_status() == tlm::TLM_OK_RESPONSE);
+
+        if (!dmi_access(cmd, offset, buf8, len)) {
+            // reuse one payload, since it is reset on every access anyway
+            tlm::tlm_generic_payload& tr = m_tr;
+            sc_time delay = m_qk.get_local_time();
+
+            tr.set_command(cmd);
+            tr.set_address(offset);
+            tr.set_data_ptr(buf8);
+            tr.set_data_length(len);
+            tr.set_streaming_width(len);
+            tr.set_byte_enable_ptr(NULL);
+            tr.set_dmi_allowed(false);
+            tr.set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+
+            socket->b_transport(tr, delay);
+            assert(tr.get_response_status() == tlm::TLM_OK_RESPONSE);
+            m_qk.set(delay);
+
+            if (tr.is_dmi_allowed() && !m_dmi_valid) {
+                m_dmi.init();
+                m_dmi_valid = socket->get_direct_mem_ptr(tr, m_dmi);
+            }
+        }
+
+        // with no time to catch up on, don't force a delta cycle either
+        if ((m_qk.get_local_time() > SC_ZERO_TIME) && m_qk.need_sync()) {
+            sync();
+        }
+    }
+
+    // Catches up with the SystemC kernel, if called from a thread.
+    void sync(void) {
+        if (sc_get_current_process_handle().proc_kind() == SC_THREAD_PROC_) {
+            m_qk.sync();
+        }
     }
 
     uint32_t dev_read32(uint64_t offset) {
@@ -76,14 +115,47 @@ class SB_tlm : public SB_pcie {
         dummy = dev_read32(offset);
         dummy = dummy;
     }
+
+  private:
+    bool dmi_access(tlm::tlm_command cmd, uint64_t offset, unsigned char* buf, unsigned int len) {
+        if (!m_dmi_valid || (offset < m_dmi.get_start_address()) ||
+            ((offset + len - 1) > m_dmi.get_end_address())) {
+            return false;
+        }
+
+        unsigned char* ptr = m_dmi.get_dmi_ptr() + (offset - m_dmi.get_start_address());
+
+        if ((cmd == tlm::TLM_READ_COMMAND) && m_dmi.is_read_allowed()) {
+            memcpy(buf, ptr, len);
+            m_qk.inc(m_dmi.get_read_latency());
+            return true;
+        } else if ((cmd == tlm::TLM_WRITE_COMMAND) && m_dmi.is_write_allowed()) {
+            memcpy(ptr, buf, len);
+            m_qk.inc(m_dmi.get_write_latency());
+            return true;
+        }
+
+        return false;
+    }
+
+    void invalidate_direct_mem_ptr(sc_dt::uint64 start, sc_dt::uint64 end) {
+        if ((start <= m_dmi.get_end_address()) && (end >= m_dmi.get_start_address())) {
+            m_dmi_valid = false;
+        }
+    }
+
+    tlm::tlm_generic_payload m_tr;
+    tlm_utils::tlm_quantumkeeper m_qk;
+    tlm::tlm_dmi m_dmi;
+    bool m_dmi_valid;
 };
 
 class SBTX_tlm : public SBTX, public SB_tlm {
   public:
     SBTX_tlm(int queue_id) : SB_tlm(queue_id) {}
 
-    bool init(const char* uri) {
-        return sb_pcie_init(this, uri, NULL, -1);
+    bool init(const char* uri, int capacity = 0) {
+        return sb_pcie_init(this, uri, NULL, -1, capacity);
     }
 };
 
@@ -91,8 +163,8 @@ class SBRX_tlm : public SBRX, public SB_tlm {
   public:
     SBRX_tlm(int queue_id) : SB_tlm(queue_id) {}
 
-    bool init(const char* uri) {
-        return sb_pcie_init(this, uri, NULL, -1);
+    bool init(const char* uri, int capacity = 0) {
+        return sb_pcie_init(this, uri, NULL, -1, capacity);
     }
 };
 #endif
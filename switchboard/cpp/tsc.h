@@ -0,0 +1,43 @@
+// Cheap cycle-counter reads for timestamps on hot paths
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+#ifndef TSC_H__
+#define TSC_H__
+
+#include <stdint.h>
+#include <time.h>
+
+static inline uint64_t tsc_monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+// Returns a free-running counter that increases at a constant rate.  On
+// x86 this is the invariant TSC and on aarch64 the generic timer; other
+// targets fall back to CLOCK_MONOTONIC in nanoseconds.  The rate is not
+// known up front and has to be measured against CLOCK_MONOTONIC.
+static inline uint64_t tsc_read(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    return tsc_monotonic_ns();
+#endif
+}
+
+// Hint to the CPU that we're in a spin-wait loop.
+static inline void tsc_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+#endif // TSC_H__
@@ -110,4 +110,38 @@ static inline std::string umi_opcode_to_str(uint32_t cmd) {
     }
 }
 
+// Applies a UMI atomic operation of 1 << size bytes, returning the new
+// memory value.
+static inline uint64_t umi_atomic_apply(uint32_t atype, uint32_t size, uint64_t mem,
+    uint64_t data) {
+
+    int shift = 64 - (8 << size);
+    int64_t mems = (int64_t)(mem << shift) >> shift;
+    int64_t datas = (int64_t)(data << shift) >> shift;
+    uint64_t memu = (mem << shift) >> shift;
+    uint64_t datau = (data << shift) >> shift;
+
+    switch (atype) {
+    case UMI_REQ_ATOMICADD:
+        return mem + data;
+    case UMI_REQ_ATOMICAND:
+        return mem & data;
+    case UMI_REQ_ATOMICOR:
+        return mem | data;
+    case UMI_REQ_ATOMICXOR:
+        return mem ^ data;
+    case UMI_REQ_ATOMICMAX:
+        return (mems >= datas) ? mem : data;
+    case UMI_REQ_ATOMICMIN:
+        return (mems <= datas) ? mem : data;
+    case UMI_REQ_ATOMICMAXU:
+        return (memu >= datau) ? mem : data;
+    case UMI_REQ_ATOMICMINU:
+        return (memu <= datau) ? mem : data;
+    case UMI_REQ_ATOMICSWAP:
+    default:
+        return data;
+    }
+}
+
 #endif // __UMILIB_HPP__
@@ -0,0 +1,809 @@
+// Sparse memory model for UMI memory servers
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// UmiMemory holds the contents of an address map made up of one or more
+// regions.  Each region is reserved as an anonymous MAP_NORESERVE mapping,
+// so the host only allocates pages that are actually touched: a 64 GB
+// address space costs nothing until it is used, and untouched memory reads
+// as zero.  Binary and ELF images are loaded by mapping the image file
+// copy-on-write (MAP_PRIVATE) over the region wherever the alignment
+// allows it, so loading is nearly instant and the page cache is shared
+// until the model writes to the image:
+//
+//   UmiMemory mem;
+//   mem.add_region(0x80000000, 64ull << 30, "dram");
+//   mem.load_image("vmlinux");
+//
+// Accessors return false (or NULL) for addresses outside of the map.  Once
+// the map is set up and images are loaded, the accessors may be called
+// from several threads at once.
+//
+// Pages modified through write(), atomic(), and loads are tracked, so that
+// checkpoint() can save just the pages touched so far, or just the ones
+// modified since the previous checkpoint.  Checkpoint files are sparse:
+// zero pages are recorded without data, and the rest are stored
+// page-aligned, so that restore() maps them back in copy-on-write.
+
+#ifndef __UMIMEM_HPP__
+#define __UMIMEM_HPP__
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <elf.h>
+#include <fcntl.h>
+#include <mutex>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#include "umilib.h"
+#include "umilib.hpp"
+
+// number of locks used to serialize misaligned atomics
+#define UMIMEM_LOCK_STRIPES 64
+
+// checkpoint file format: a header, followed by the parent checkpoint's
+// path and the caller's state, then a record for each region with a list
+// of the pages it holds.  page data starts at the next page-aligned
+// offset, in list order; zero pages are flagged in the list and have no
+// data.
+
+#define UMIMEM_CKPT_MAGIC "UMIMEMCK"
+#define UMIMEM_CKPT_VERSION 1
+#define UMIMEM_CKPT_ZERO (1ull << 63)
+
+struct UmiCheckpointHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t page_size;
+    uint32_t num_regions;
+    uint32_t parent_len;
+    uint64_t state_len;
+};
+
+struct UmiCheckpointRegion {
+    uint64_t base;
+    uint64_t size;
+    uint64_t num_pages;
+    uint64_t data_offset;
+};
+
+class UmiMemory {
+  public:
+    UmiMemory() : m_last(0), m_page(sysconf(_SC_PAGESIZE)) {}
+
+    ~UmiMemory() {
+        for (Region& r : m_regions) {
+            munmap(r.mem, r.len);
+            munmap(r.touched, r.bitmap_len);
+            munmap(r.dirty, r.bitmap_len);
+        }
+    }
+
+    UmiMemory(const UmiMemory&) = delete;
+    UmiMemory& operator=(const UmiMemory&) = delete;
+
+    // adds "size" bytes of zero-initialized memory at "base".  returns
+    // false if the region is empty, overlaps another, or can't be reserved.
+    bool add_region(uint64_t base, uint64_t size, std::string name = "") {
+        if ((size == 0) || (base + size - 1 < base)) {
+            fprintf(stderr, "UmiMemory: invalid region 0x%" PRIx64 "+0x%" PRIx64 "\n", base, size);
+            return false;
+        }
+
+        for (const Region& r : m_regions) {
+            if ((base <= r.base + r.size - 1) && (r.base <= base + size - 1)) {
+                fprintf(stderr, "UmiMemory: region 0x%" PRIx64 "+0x%" PRIx64 " overlaps %s\n",
+                    base, size, r.name.c_str());
+                return false;
+            }
+        }
+
+        Region r;
+        r.base = base;
+        r.size = size;
+        r.len = round_up(size);
+        r.name = (name != "") ? name : ("region" + std::to_string(m_regions.size()));
+        r.mem = (uint8_t*)anon_map(NULL, r.len);
+
+        // one bit per page for pages touched since the region was created
+        // (or restored), and for pages modified since the last checkpoint
+        r.bitmap_len = round_up((r.len / m_page + 63) / 64 * 8);
+        r.touched = (uint64_t*)anon_map(NULL, r.bitmap_len);
+        r.dirty = (uint64_t*)anon_map(NULL, r.bitmap_len);
+
+        if ((r.mem == MAP_FAILED) || (r.touched == MAP_FAILED) || (r.dirty == MAP_FAILED)) {
+            perror("UmiMemory: mmap");
+            return false;
+        }
+
+        m_regions.insert(std::upper_bound(m_regions.begin(), m_regions.end(), r,
+                             [](const Region& a, const Region& b) { return a.base < b.base; }),
+            r);
+        m_last = 0;
+
+        return true;
+    }
+
+    // returns a host pointer to "nbytes" of memory starting at "addr", or
+    // NULL if that range doesn't lie entirely within one region.  the
+    // pointer remains valid until the region is remapped by a load.
+    // writes made through this pointer aren't tracked for checkpoints,
+    // unless they are reported with mark_dirty().
+    uint8_t* ptr(uint64_t addr, uint64_t nbytes = 1) {
+        Region* r = find(addr, nbytes);
+        return r ? (r->mem + (addr - r->base)) : NULL;
+    }
+
+    void mark_dirty(uint64_t addr, uint64_t nbytes) {
+        Region* r = find(addr, nbytes);
+        if (r) {
+            mark(*r, addr - r->base, nbytes);
+        }
+    }
+
+    bool read(uint64_t addr, void* data, uint64_t nbytes) {
+        uint8_t* p = ptr(addr, nbytes);
+        if (!p) {
+            return false;
+        }
+        memcpy(data, p, nbytes);
+        return true;
+    }
+
+    bool write(uint64_t addr, const void* data, uint64_t nbytes) {
+        Region* r = find(addr, nbytes);
+        if (!r) {
+            return false;
+        }
+        memcpy(r->mem + (addr - r->base), data, nbytes);
+        mark(*r, addr - r->base, nbytes);
+        return true;
+    }
+
+    // applies UMI atomic operation "atype" to 1 << size bytes at "addr",
+    // using "operand", and stores the previous value in "old".  atomics
+    // may be issued from several threads at once: naturally aligned ones
+    // are lock-free, and misaligned ones lock the 8-byte words they touch.
+    bool atomic(uint64_t addr, uint32_t atype, uint32_t size, const void* operand, void* old) {
+        if (size > 3) {
+            return false;
+        }
+
+        uint32_t nbytes = 1 << size;
+        Region* r = find(addr, nbytes);
+        if (!r) {
+            return false;
+        }
+
+        uint8_t* p = r->mem + (addr - r->base);
+        mark(*r, addr - r->base, nbytes);
+
+        uint64_t data = 0;
+        memcpy(&data, operand, nbytes);
+
+        if (((uintptr_t)p % nbytes) == 0) {
+            uint64_t prev;
+            switch (size) {
+            case 0:
+                prev = atomic_rmw<uint8_t>(p, atype, size, data);
+                break;
+            case 1:
+                prev = atomic_rmw<uint16_t>(p, atype, size, data);
+                break;
+            case 2:
+                prev = atomic_rmw<uint32_t>(p, atype, size, data);
+                break;
+            default:
+                prev = atomic_rmw<uint64_t>(p, atype, size, data);
+                break;
+            }
+            memcpy(old, &prev, nbytes);
+        } else {
+            // lock stripes in a consistent order to avoid deadlock
+            size_t lo = stripe(addr), hi = stripe(addr + nbytes - 1);
+            std::lock_guard<std::mutex> lock_lo(m_stripes[std::min(lo, hi)]);
+            std::unique_lock<std::mutex> lock_hi(m_stripes[std::max(lo, hi)], std::defer_lock);
+            if (lo != hi) {
+                lock_hi.lock();
+            }
+
+            uint64_t mem = 0;
+            memcpy(&mem, p, nbytes);
+            uint64_t result = umi_atomic_apply(atype, size, mem, data);
+            memcpy(old, &mem, nbytes);
+            memcpy(p, &result, nbytes);
+        }
+
+        return true;
+    }
+
+    // sets "nbytes" starting at "addr" to zero.  whole pages are replaced
+    // with fresh anonymous memory, which releases whatever backed them.
+    bool zero(uint64_t addr, uint64_t nbytes) {
+        Region* r = find(addr, nbytes);
+        if (!r) {
+            return false;
+        }
+
+        uint8_t* p = r->mem + (addr - r->base);
+        uint64_t head = std::min(nbytes, (uint64_t)(round_up((uintptr_t)p) - (uintptr_t)p));
+        uint64_t body = (nbytes - head) / m_page * m_page;
+
+        memset(p, 0, head);
+        if ((body > 0) && (anon_map(p + head, body) == MAP_FAILED)) {
+            memset(p + head, 0, body);
+        }
+        memset(p + head + body, 0, nbytes - head - body);
+
+        mark(*r, addr - r->base, nbytes);
+
+        return true;
+    }
+
+    // loads the contents of a raw binary file at "addr"
+    bool load_binary(std::string path, uint64_t addr) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            perror(path.c_str());
+            return false;
+        }
+
+        struct stat st;
+        bool ok = (fstat(fd, &st) == 0) && load_file(fd, path, 0, addr, st.st_size);
+        close(fd);
+
+        return ok;
+    }
+
+    // loads the PT_LOAD segments of a 32- or 64-bit little-endian ELF file
+    // at their physical addresses, zeroing the part of each segment that
+    // isn't in the file (e.g. .bss).  the entry point is stored in "entry"
+    // if it is provided.
+    bool load_elf(std::string path, uint64_t* entry = NULL) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            perror(path.c_str());
+            return false;
+        }
+
+        unsigned char ident[EI_NIDENT];
+        bool ok = pread_all(fd, ident, sizeof(ident), 0) && is_elf(ident) &&
+                  (ident[EI_DATA] == ELFDATA2LSB);
+
+        if (!ok) {
+            fprintf(stderr, "UmiMemory: %s is not a little-endian ELF file\n", path.c_str());
+        } else if (ident[EI_CLASS] == ELFCLASS64) {
+            ok = load_elf_segments<Elf64_Ehdr, Elf64_Phdr>(fd, path, entry);
+        } else if (ident[EI_CLASS] == ELFCLASS32) {
+            ok = load_elf_segments<Elf32_Ehdr, Elf32_Phdr>(fd, path, entry);
+        } else {
+            fprintf(stderr, "UmiMemory: unsupported ELF class in %s\n", path.c_str());
+            ok = false;
+        }
+
+        close(fd);
+        return ok;
+    }
+
+    // loads an ELF file if "path" is one, otherwise loads it as a raw
+    // binary at "addr"
+    bool load_image(std::string path, uint64_t addr = 0, uint64_t* entry = NULL) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            perror(path.c_str());
+            return false;
+        }
+
+        unsigned char ident[EI_NIDENT];
+        bool elf = pread_all(fd, ident, sizeof(ident), 0) && is_elf(ident);
+        close(fd);
+
+        if (elf) {
+            return load_elf(path, entry);
+        } else {
+            if (entry) {
+                *entry = addr;
+            }
+            return load_binary(path, addr);
+        }
+    }
+
+    // prints the address map
+    void print_map(FILE* f = stderr) {
+        for (const Region& r : m_regions) {
+            fprintf(f, "  %-12s 0x%016" PRIx64 "-0x%016" PRIx64 "\n", r.name.c_str(), r.base,
+                r.base + r.size - 1);
+        }
+    }
+
+    // writes the memory contents to "path".  the first checkpoint (or any
+    // checkpoint with "full" set) holds every page touched so far; later
+    // ones only hold the pages modified since the previous checkpoint (or
+    // restore), and refer back to it by path.  "state" is stored alongside
+    // the memory, e.g. for the state of the server using it.  no other
+    // thread may modify the memory while a checkpoint is being written.
+    bool checkpoint(std::string path, const std::string& state = "", bool full = false) {
+        std::string parent = full ? "" : m_parent;
+
+        UmiCheckpointHeader hdr;
+        memcpy(hdr.magic, UMIMEM_CKPT_MAGIC, sizeof(hdr.magic));
+        hdr.version = UMIMEM_CKPT_VERSION;
+        hdr.page_size = m_page;
+        hdr.num_regions = m_regions.size();
+        hdr.parent_len = parent.size();
+        hdr.state_len = state.size();
+
+        std::string meta((const char*)&hdr, sizeof(hdr));
+        meta += parent;
+        meta += state;
+
+        // list the pages to save in each region
+        std::vector<std::vector<uint64_t>> pages(m_regions.size());
+        std::vector<UmiCheckpointRegion> records(m_regions.size());
+        uint64_t meta_len = meta.size();
+        uint64_t data_len = 0;
+
+        for (size_t i = 0; i < m_regions.size(); i++) {
+            Region& r = m_regions[i];
+            const uint64_t* bitmap = parent.empty() ? r.touched : r.dirty;
+
+            records[i].base = r.base;
+            records[i].size = r.size;
+            records[i].data_offset = data_len;
+
+            for (uint64_t w = 0; w < r.bitmap_len / 8; w++) {
+                for (uint64_t bits = bitmap[w]; bits; bits &= bits - 1) {
+                    uint64_t page = w * 64 + __builtin_ctzll(bits);
+                    if (is_zero(r.mem + page * m_page)) {
+                        pages[i].push_back(page | UMIMEM_CKPT_ZERO);
+                    } else {
+                        pages[i].push_back(page);
+                        data_len += m_page;
+                    }
+                }
+            }
+
+            records[i].num_pages = pages[i].size();
+            meta_len += sizeof(UmiCheckpointRegion) + pages[i].size() * sizeof(uint64_t);
+        }
+
+        uint64_t data_start = round_up(meta_len);
+        for (size_t i = 0; i < m_regions.size(); i++) {
+            records[i].data_offset += data_start;
+            meta.append((const char*)&records[i], sizeof(records[i]));
+            meta.append((const char*)pages[i].data(), pages[i].size() * sizeof(uint64_t));
+        }
+
+        // write to a temporary file first, so that a crash while writing
+        // doesn't clobber an earlier checkpoint
+        std::string tmp = path + ".tmp";
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            perror(tmp.c_str());
+            return false;
+        }
+
+        bool ok = pwrite_all(fd, meta.data(), meta.size(), 0) &&
+                  (ftruncate(fd, data_start + data_len) == 0);
+
+        // write runs of consecutive pages at once
+        for (size_t i = 0; ok && (i < m_regions.size()); i++) {
+            uint64_t offset = records[i].data_offset;
+            for (size_t j = 0; ok && (j < pages[i].size());) {
+                if (pages[i][j] & UMIMEM_CKPT_ZERO) {
+                    j++;
+                    continue;
+                }
+                size_t k = j + 1;
+                while ((k < pages[i].size()) && (pages[i][k] == pages[i][j] + (k - j))) {
+                    k++;
+                }
+                ok = pwrite_all(fd, m_regions[i].mem + pages[i][j] * m_page, (k - j) * m_page,
+                    offset);
+                offset += (k - j) * m_page;
+                j = k;
+            }
+        }
+
+        ok = (close(fd) == 0) && ok && (rename(tmp.c_str(), path.c_str()) == 0);
+        if (!ok) {
+            fprintf(stderr, "UmiMemory: unable to write checkpoint %s\n", path.c_str());
+            unlink(tmp.c_str());
+            return false;
+        }
+
+        clear_dirty();
+        m_parent = abs_path(path);
+
+        return true;
+    }
+
+    // restores the memory contents from a checkpoint, including any
+    // checkpoints it depends on.  the address map must be the same as when
+    // the checkpoint was written.  pages are mapped copy-on-write from the
+    // checkpoint files, so restoring is fast regardless of their size.  the
+    // state stored with the checkpoint is returned in "state".
+    bool restore(std::string path, std::string* state = NULL) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            perror(path.c_str());
+            return false;
+        }
+
+        bool ok = restore_file(fd, path, state);
+        close(fd);
+
+        if (ok) {
+            clear_dirty();
+            m_parent = abs_path(path);
+        }
+
+        return ok;
+    }
+
+    // discards the memory contents, returning every region to zero
+    void reset() {
+        for (Region& r : m_regions) {
+            anon_map(r.mem, r.len);
+            anon_map(r.touched, r.bitmap_len);
+            anon_map(r.dirty, r.bitmap_len);
+        }
+        m_parent = "";
+    }
+
+  private:
+    struct Region {
+        uint64_t base;
+        uint64_t size;
+        uint64_t len; // size of the mapping, rounded up to a whole page
+        uint8_t* mem;
+        std::string name;
+
+        // page bitmaps for checkpoints
+        uint64_t* touched;
+        uint64_t* dirty;
+        uint64_t bitmap_len;
+
+        bool contains(uint64_t addr, uint64_t nbytes) const {
+            return (base <= addr) && (nbytes <= size) && ((addr - base) <= (size - nbytes));
+        }
+    };
+
+    uint64_t round_up(uint64_t x) {
+        return (x + m_page - 1) / m_page * m_page;
+    }
+
+    // maps fresh, zeroed memory at "addr" (anywhere if NULL), replacing
+    // whatever was mapped there before
+    static void* anon_map(void* addr, uint64_t len) {
+        return mmap(addr, len, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | (addr ? MAP_FIXED : 0), -1, 0);
+    }
+
+    Region* find(uint64_t addr, uint64_t nbytes) {
+        // requests tend to hit the same region repeatedly
+        size_t last = m_last.load(std::memory_order_relaxed);
+        if ((last < m_regions.size()) && m_regions[last].contains(addr, nbytes)) {
+            return &m_regions[last];
+        }
+
+        size_t i = std::upper_bound(m_regions.begin(), m_regions.end(), addr,
+                       [](uint64_t a, const Region& r) { return a < r.base; }) -
+                   m_regions.begin();
+
+        if ((i == 0) || !m_regions[i - 1].contains(addr, nbytes)) {
+            return NULL;
+        }
+
+        m_last.store(i - 1, std::memory_order_relaxed);
+        return &m_regions[i - 1];
+    }
+
+    static bool test_bit(const uint64_t* bitmap, uint64_t i) {
+        return (__atomic_load_n(&bitmap[i / 64], __ATOMIC_RELAXED) >> (i % 64)) & 1;
+    }
+
+    static void set_bit(uint64_t* bitmap, uint64_t i) {
+        // avoid the read-modify-write if the bit is already set, which is
+        // the common case
+        if (!test_bit(bitmap, i)) {
+            __atomic_fetch_or(&bitmap[i / 64], 1ull << (i % 64), __ATOMIC_RELAXED);
+        }
+    }
+
+    // records that "nbytes" starting at "offset" into region "r" changed
+    void mark(Region& r, uint64_t offset, uint64_t nbytes) {
+        if (nbytes == 0) {
+            return;
+        }
+        for (uint64_t i = offset / m_page; i <= (offset + nbytes - 1) / m_page; i++) {
+            if (!test_bit(r.dirty, i)) {
+                set_bit(r.dirty, i);
+                set_bit(r.touched, i);
+            }
+        }
+    }
+
+    template <typename T>
+    static uint64_t atomic_rmw(uint8_t* p, uint32_t atype, uint32_t size, uint64_t data) {
+        T* mem = (T*)p;
+        T prev = __atomic_load_n(mem, __ATOMIC_RELAXED);
+        T result;
+        do {
+            result = (T)umi_atomic_apply(atype, size, prev, data);
+        } while (!__atomic_compare_exchange_n(mem, &prev, result, true, __ATOMIC_SEQ_CST,
+            __ATOMIC_RELAXED));
+        return prev;
+    }
+
+    static size_t stripe(uint64_t addr) {
+        return (addr / 8) % UMIMEM_LOCK_STRIPES;
+    }
+
+    static bool is_elf(const unsigned char* ident) {
+        return memcmp(ident, ELFMAG, SELFMAG) == 0;
+    }
+
+    static bool pwrite_all(int fd, const void* buf, uint64_t nbytes, uint64_t offset) {
+        const uint8_t* p = (const uint8_t*)buf;
+        while (nbytes > 0) {
+            ssize_t n = pwrite(fd, p, nbytes, offset);
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+            offset += n;
+            nbytes -= n;
+        }
+        return true;
+    }
+
+    bool is_zero(const uint8_t* page) {
+        const uint64_t* p = (const uint64_t*)page;
+        for (long i = 0; i < m_page / 8; i++) {
+            if (p[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // checkpoints refer to their parents by absolute path, so that they
+    // can be restored from any directory
+    static std::string abs_path(std::string path) {
+        char* p = realpath(path.c_str(), NULL);
+        if (!p) {
+            return path;
+        }
+        std::string result(p);
+        free(p);
+        return result;
+    }
+
+    void clear_dirty() {
+        for (Region& r : m_regions) {
+            anon_map(r.dirty, r.bitmap_len);
+        }
+    }
+
+    bool restore_file(int fd, std::string path, std::string* state) {
+        UmiCheckpointHeader hdr;
+        if (!pread_all(fd, &hdr, sizeof(hdr), 0) ||
+            (memcmp(hdr.magic, UMIMEM_CKPT_MAGIC, sizeof(hdr.magic)) != 0) ||
+            (hdr.version != UMIMEM_CKPT_VERSION) || (hdr.page_size != m_page)) {
+            fprintf(stderr, "UmiMemory: %s is not a compatible checkpoint\n", path.c_str());
+            return false;
+        }
+
+        if (hdr.num_regions != m_regions.size()) {
+            fprintf(stderr, "UmiMemory: %s was written with a different address map\n",
+                path.c_str());
+            return false;
+        }
+
+        std::string parent(hdr.parent_len, '\0');
+        std::string st(hdr.state_len, '\0');
+        uint64_t pos = sizeof(hdr);
+        if (!pread_all(fd, &parent[0], parent.size(), pos) ||
+            !pread_all(fd, &st[0], st.size(), pos + parent.size())) {
+            fprintf(stderr, "UmiMemory: %s is truncated\n", path.c_str());
+            return false;
+        }
+        pos += parent.size() + st.size();
+
+        // start from the parent checkpoint, or from scratch
+        if (parent.empty()) {
+            reset();
+        } else if (!restore(parent)) {
+            return false;
+        }
+
+        for (Region& r : m_regions) {
+            UmiCheckpointRegion rec;
+            if (!pread_all(fd, &rec, sizeof(rec), pos) || (rec.base != r.base) ||
+                (rec.size != r.size)) {
+                fprintf(stderr, "UmiMemory: %s was written with a different address map\n",
+                    path.c_str());
+                return false;
+            }
+            pos += sizeof(rec);
+
+            std::vector<uint64_t> pages(rec.num_pages);
+            if (!pread_all(fd, pages.data(), pages.size() * sizeof(uint64_t), pos)) {
+                fprintf(stderr, "UmiMemory: %s is truncated\n", path.c_str());
+                return false;
+            }
+            pos += pages.size() * sizeof(uint64_t);
+
+            uint64_t offset = rec.data_offset;
+            for (size_t j = 0; j < pages.size();) {
+                uint64_t page = pages[j] & ~UMIMEM_CKPT_ZERO;
+                if (page >= r.len / m_page) {
+                    fprintf(stderr, "UmiMemory: %s is corrupt\n", path.c_str());
+                    return false;
+                }
+
+                if (pages[j] & UMIMEM_CKPT_ZERO) {
+                    // only pages restored from a parent can be nonzero
+                    if (test_bit(r.touched, page)) {
+                        memset(r.mem + page * m_page, 0, m_page);
+                    }
+                    set_bit(r.touched, page);
+                    j++;
+                    continue;
+                }
+
+                size_t k = j + 1;
+                while ((k < pages.size()) && (pages[k] == pages[j] + (k - j)) &&
+                       (pages[k] < r.len / m_page)) {
+                    k++;
+                }
+
+                // map runs of pages copy-on-write, falling back to copying
+                // them (e.g. if the process runs out of mappings)
+                uint8_t* p = r.mem + page * m_page;
+                uint64_t len = (k - j) * m_page;
+                if ((mmap(p, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset) ==
+                        MAP_FAILED) &&
+                    ((anon_map(p, len) == MAP_FAILED) || !pread_all(fd, p, len, offset))) {
+                    fprintf(stderr, "UmiMemory: %s is truncated\n", path.c_str());
+                    return false;
+                }
+
+                for (size_t n = j; n < k; n++) {
+                    set_bit(r.touched, pages[n]);
+                }
+                offset += len;
+                j = k;
+            }
+        }
+
+        if (state) {
+            *state = st;
+        }
+
+        return true;
+    }
+
+    static bool pread_all(int fd, void* buf, uint64_t nbytes, uint64_t offset) {
+        uint8_t* p = (uint8_t*)buf;
+        while (nbytes > 0) {
+            ssize_t n = pread(fd, p, nbytes, offset);
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+            offset += n;
+            nbytes -= n;
+        }
+        return true;
+    }
+
+    // places "nbytes" of the file starting at "offset" into memory at
+    // "addr".  the pages in the middle are mapped copy-on-write if the file
+    // offset and the destination share the same alignment within a page;
+    // partial pages at either end are copied, so that neighboring memory
+    // isn't disturbed.
+    bool load_file(int fd, std::string path, uint64_t offset, uint64_t addr, uint64_t nbytes) {
+        Region* r = find(addr, nbytes);
+        uint8_t* p = r ? (r->mem + (addr - r->base)) : NULL;
+        if (!p) {
+            fprintf(stderr,
+                "UmiMemory: %s doesn't fit in the address map at 0x%" PRIx64 "+0x%" PRIx64 "\n",
+                path.c_str(), addr, nbytes);
+            return false;
+        }
+
+        uint64_t head = nbytes;
+        uint64_t body = 0;
+
+        if (((uintptr_t)p % m_page) == (offset % m_page)) {
+            head = std::min(nbytes, (uint64_t)(round_up((uintptr_t)p) - (uintptr_t)p));
+            body = (nbytes - head) / m_page * m_page;
+
+            if ((body > 0) && (mmap(p + head, body, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_FIXED, fd, offset + head) == MAP_FAILED)) {
+                // fall back to copying the whole thing
+                head = nbytes;
+                body = 0;
+            }
+        }
+
+        if (!pread_all(fd, p, head, offset) ||
+            !pread_all(fd, p + head + body, nbytes - head - body, offset + head + body)) {
+            fprintf(stderr, "UmiMemory: unable to read %s\n", path.c_str());
+            return false;
+        }
+
+        mark(*r, addr - r->base, nbytes);
+
+        return true;
+    }
+
+    template <typename Ehdr, typename Phdr>
+    bool load_elf_segments(int fd, std::string path, uint64_t* entry) {
+        Ehdr eh;
+        if (!pread_all(fd, &eh, sizeof(eh), 0) || (eh.e_phentsize != sizeof(Phdr))) {
+            fprintf(stderr, "UmiMemory: invalid ELF header in %s\n", path.c_str());
+            return false;
+        }
+
+        for (uint32_t i = 0; i < eh.e_phnum; i++) {
+            Phdr ph;
+            if (!pread_all(fd, &ph, sizeof(ph), eh.e_phoff + (uint64_t)i * sizeof(ph))) {
+                fprintf(stderr, "UmiMemory: invalid program header in %s\n", path.c_str());
+                return false;
+            }
+
+            if ((ph.p_type != PT_LOAD) || (ph.p_memsz == 0)) {
+                continue;
+            }
+
+            uint64_t filesz = std::min((uint64_t)ph.p_filesz, (uint64_t)ph.p_memsz);
+
+            if (!ptr(ph.p_paddr, ph.p_memsz)) {
+                fprintf(stderr,
+                    "UmiMemory: segment 0x%" PRIx64 "+0x%" PRIx64 " of %s is outside of the "
+                    "address map\n",
+                    (uint64_t)ph.p_paddr, (uint64_t)ph.p_memsz, path.c_str());
+                return false;
+            }
+
+            if ((filesz > 0) && !load_file(fd, path, ph.p_offset, ph.p_paddr, filesz)) {
+                return false;
+            }
+
+            if (ph.p_memsz > filesz) {
+                zero(ph.p_paddr + filesz, ph.p_memsz - filesz);
+            }
+        }
+
+        if (entry) {
+            *entry = eh.e_entry;
+        }
+
+        return true;
+    }
+
+    std::vector<Region> m_regions; // sorted by base address
+    std::atomic<size_t> m_last;    // index of the most recently used region
+    long m_page;
+
+    // path of the most recent checkpoint written or restored, which the
+    // next checkpoint is relative to
+    std::string m_parent;
+
+    // serializes misaligned atomics
+    std::mutex m_stripes[UMIMEM_LOCK_STRIPES];
+};
+
+#endif // __UMIMEM_HPP__
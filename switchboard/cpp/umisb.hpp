@@ -236,6 +236,8 @@ static inline bool umisb_send(T& x, SBTX& tx, bool blocking = true, void (*loop)
         return false;
     }
 
+    SB_TRACE_START(t0);
+
     // load fields into an SB packet
 
     sb_packet p;
@@ -290,6 +292,7 @@ static inline bool umisb_send(T& x, SBTX& tx, bool blocking = true, void (*loop)
     }
 
     // if we reach this point, we succeeded in sending the packet
+    SB_TRACE_SPAN(SB_TRACE_UMI_SEND, tx.trace_id(), 1, t0);
     return true;
 }
 
@@ -301,6 +304,8 @@ static inline bool umisb_recv(T& x, SBRX& rx, bool blocking = true, void (*loop)
         return false;
     }
 
+    SB_TRACE_START(t0);
+
     // get a response
 
     sb_packet p;
@@ -358,6 +363,7 @@ static inline bool umisb_recv(T& x, SBRX& rx, bool blocking = true, void (*loop)
         memcpy(x.ptr(), up->data, nbytes);
     }
 
+    SB_TRACE_SPAN(SB_TRACE_UMI_RECV, rx.trace_id(), 1, t0);
     return true;
 }
 
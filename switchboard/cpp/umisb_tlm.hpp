@@ -0,0 +1,477 @@
+// Bridges between switchboard UMI queues and SystemC TLM-2.0 sockets
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// sb_tlm_target is a TLM target that turns the transactions it receives
+// into UMI requests on an SBTX queue, and completes them with the UMI
+// responses that come back on an SBRX queue.  sb_tlm_initiator does the
+// reverse: UMI requests arriving on an SBRX queue are issued through a TLM
+// initiator socket, and the results are sent back as UMI responses.  This
+// lets a SystemC model talk to an RTL simulation (or anything else with a
+// UMI port) directly, without emulating the PCIe queue registers:
+//
+//   sb_tlm_target mem("mem", "to_rtl.q", "from_rtl.q");
+//   cpu.socket.bind(mem.socket);
+//
+// Both modules support the blocking and the non-blocking (base protocol)
+// transport interfaces.  sb_tlm_target splits bursts into UMI packets and
+// honors byte enables; sb_tlm_initiator draws its payloads from a pool
+// managed through tlm::tlm_mm_interface.
+//
+// The queues are polled from SystemC threads, which wait for "poll_period"
+// of simulation time whenever there is nothing to do.
+
+#ifndef __UMISB_TLM_HPP__
+#define __UMISB_TLM_HPP__
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "switchboard.hpp"
+#include "umilib.h"
+#include "umilib.hpp"
+
+#define SC_INCLUDE_DYNAMIC_PROCESSES
+
+#include "systemc"
+#include "tlm.h"
+#include "tlm_utils/peq_with_get.h"
+#include "tlm_utils/simple_initiator_socket.h"
+#include "tlm_utils/simple_target_socket.h"
+
+// Pool of generic payloads.  Payloads return to the pool when their
+// reference count drops to zero, so they can be passed to targets that
+// hold on to them (e.g. across non-blocking transport phases).
+class sb_tlm_mm : public tlm::tlm_mm_interface {
+  public:
+    ~sb_tlm_mm() {
+        for (tlm::tlm_generic_payload* tr : m_free) {
+            delete tr;
+        }
+    }
+
+    tlm::tlm_generic_payload* allocate(void) {
+        if (m_free.empty()) {
+            return new tlm::tlm_generic_payload(this);
+        }
+
+        tlm::tlm_generic_payload* tr = m_free.back();
+        m_free.pop_back();
+        return tr;
+    }
+
+    void free(tlm::tlm_generic_payload* tr) {
+        tr->reset();
+        m_free.push_back(tr);
+    }
+
+  private:
+    std::vector<tlm::tlm_generic_payload*> m_free;
+};
+
+// TLM transactions in, UMI requests out.
+class sb_tlm_target : public sc_core::sc_module {
+  public:
+    tlm_utils::simple_target_socket<sb_tlm_target> socket;
+
+    SC_HAS_PROCESS(sb_tlm_target);
+
+    sb_tlm_target(sc_core::sc_module_name name, const char* req_uri, const char* resp_uri,
+        sc_core::sc_time poll_period = sc_core::sc_time(1, sc_core::SC_NS))
+        : sc_core::sc_module(name), socket("socket"), m_peq("peq"), m_poll_period(poll_period),
+          m_srcaddr(0), m_posted(false), m_end_resp(false) {
+
+        m_req.init(req_uri);
+        m_resp.init(resp_uri);
+
+        socket.register_b_transport(this, &sb_tlm_target::b_transport);
+        socket.register_nb_transport_fw(this, &sb_tlm_target::nb_transport_fw);
+
+        SC_THREAD(nb_worker);
+    }
+
+    // return address placed in UMI requests
+    void set_srcaddr(uint64_t srcaddr) {
+        m_srcaddr = srcaddr;
+    }
+
+    // if set, writes are sent as posted writes and complete immediately
+    void set_posted_writes(bool posted) {
+        m_posted = posted;
+    }
+
+    void b_transport(tlm::tlm_generic_payload& tr, sc_core::sc_time& delay) {
+        // the other side runs in real time, so catch up first
+        wait(delay);
+        delay = sc_core::SC_ZERO_TIME;
+        process(tr);
+    }
+
+    tlm::tlm_sync_enum nb_transport_fw(tlm::tlm_generic_payload& tr, tlm::tlm_phase& phase,
+        sc_core::sc_time& delay) {
+
+        if (phase == tlm::BEGIN_REQ) {
+            tr.acquire();
+            m_peq.notify(tr, delay);
+            phase = tlm::END_REQ;
+            return tlm::TLM_UPDATED;
+        } else if (phase == tlm::END_RESP) {
+            m_end_resp = true;
+            m_end_resp_event.notify(delay);
+            return tlm::TLM_COMPLETED;
+        }
+
+        return tlm::TLM_ACCEPTED;
+    }
+
+  private:
+    void nb_worker(void) {
+        while (true) {
+            wait(m_peq.get_event());
+
+            tlm::tlm_generic_payload* tr;
+            while ((tr = m_peq.get_next_transaction()) != NULL) {
+                process(*tr);
+
+                tlm::tlm_phase phase = tlm::BEGIN_RESP;
+                sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+                m_end_resp = false;
+
+                // the next response may only start once this one has ended
+                if (socket->nb_transport_bw(*tr, phase, delay) == tlm::TLM_ACCEPTED) {
+                    while (!m_end_resp) {
+                        wait(m_end_resp_event);
+                    }
+                }
+
+                tr->release();
+            }
+        }
+    }
+
+    void process(tlm::tlm_generic_payload& tr) {
+        uint64_t addr = tr.get_address();
+        uint8_t* data = tr.get_data_ptr();
+        unsigned int len = tr.get_data_length();
+        uint8_t* be = tr.get_byte_enable_ptr();
+        unsigned int be_len = tr.get_byte_enable_length();
+
+        // streaming (wrapping) bursts don't map onto UMI
+        if (tr.get_streaming_width() < len) {
+            tr.set_response_status(tlm::TLM_BURST_ERROR_RESPONSE);
+            return;
+        }
+
+        bool ok = true;
+
+        if (tr.is_write()) {
+            // without byte enables, this is a single run of enabled bytes
+            unsigned int i = 0;
+            while (i < len) {
+                if (be && (be[i % be_len] != tlm::TLM_BYTE_ENABLED)) {
+                    i++;
+                    continue;
+                }
+
+                unsigned int start = i;
+                while ((i < len) && (!be || (be[i % be_len] == tlm::TLM_BYTE_ENABLED))) {
+                    i++;
+                }
+
+                ok = ok && umi_write(addr + start, data + start, i - start);
+            }
+        } else if (tr.is_read()) {
+            if (be) {
+                std::vector<uint8_t> buf(len);
+                ok = umi_read(addr, buf.data(), len);
+                for (unsigned int i = 0; i < len; i++) {
+                    if (be[i % be_len] == tlm::TLM_BYTE_ENABLED) {
+                        data[i] = buf[i];
+                    }
+                }
+            } else {
+                ok = umi_read(addr, data, len);
+            }
+        }
+
+        tr.set_response_status(ok ? tlm::TLM_OK_RESPONSE : tlm::TLM_GENERIC_ERROR_RESPONSE);
+    }
+
+    // builds requests of up to UMI_PACKET_DATA_BYTES each
+    void build(uint32_t opcode, uint64_t addr, const uint8_t* data, size_t len,
+        std::vector<sb_packet>& reqs) {
+
+        for (size_t offset = 0; offset < len; offset += UMI_PACKET_DATA_BYTES) {
+            size_t n = std::min(len - offset, (size_t)UMI_PACKET_DATA_BYTES);
+
+            sb_packet p;
+            memset(&p, 0, sizeof p);
+            umi_packet* up = (umi_packet*)p.data;
+            up->cmd = umi_pack(opcode, 0, 0, n - 1, 1, 1);
+            up->dstaddr = addr + offset;
+            up->srcaddr = m_srcaddr;
+            if (data) {
+                memcpy(up->data, data + offset, n);
+            }
+            reqs.push_back(p);
+        }
+    }
+
+    bool umi_write(uint64_t addr, const uint8_t* data, size_t len) {
+        std::vector<sb_packet> reqs;
+        build(m_posted ? UMI_REQ_POSTED : UMI_REQ_WRITE, addr, data, len, reqs);
+        return exchange(reqs, UMI_RESP_WRITE, addr, NULL, m_posted ? 0 : len);
+    }
+
+    bool umi_read(uint64_t addr, uint8_t* data, size_t len) {
+        std::vector<sb_packet> reqs;
+        build(UMI_REQ_READ, addr, NULL, len, reqs);
+        return exchange(reqs, UMI_RESP_READ, addr, data, len);
+    }
+
+    // Sends "reqs", while collecting responses until "nbytes" have been
+    // acknowledged.  Read data is placed according to the response srcaddr,
+    // since responders may split responses differently than requests.
+    bool exchange(std::vector<sb_packet>& reqs, uint32_t resp_opcode, uint64_t addr,
+        uint8_t* data, size_t nbytes) {
+
+        size_t sent = 0;
+        size_t received = 0;
+
+        while ((sent < reqs.size()) || (received < nbytes)) {
+            bool progress = false;
+
+            if ((sent < reqs.size()) && m_req.send(reqs[sent])) {
+                sent++;
+                progress = true;
+            }
+
+            sb_packet p;
+            if ((received < nbytes) && m_resp.recv(p)) {
+                umi_packet* up = (umi_packet*)p.data;
+                uint32_t opcode = umi_opcode(up->cmd);
+                size_t n = (umi_len(up->cmd) + 1) << umi_size(up->cmd);
+                uint64_t offset = up->srcaddr - addr;
+
+                if ((opcode != resp_opcode) || (offset + n > nbytes)) {
+                    fprintf(stderr, "%s: unexpected %s response (srcaddr=0x%" PRIx64 ")\n",
+                        name(), umi_opcode_to_str(up->cmd).c_str(), up->srcaddr);
+                    return false;
+                }
+
+                if (data) {
+                    memcpy(data + offset, up->data, n);
+                }
+
+                received += n;
+                progress = true;
+            }
+
+            if (!progress) {
+                wait(m_poll_period);
+            }
+        }
+
+        return true;
+    }
+
+    SBTX m_req;
+    SBRX m_resp;
+
+    tlm_utils::peq_with_get<tlm::tlm_generic_payload> m_peq;
+    sc_core::sc_time m_poll_period;
+    uint64_t m_srcaddr;
+    bool m_posted;
+
+    bool m_end_resp;
+    sc_core::sc_event m_end_resp_event;
+};
+
+// UMI requests in, TLM transactions out.
+class sb_tlm_initiator : public sc_core::sc_module {
+  public:
+    tlm_utils::simple_initiator_socket<sb_tlm_initiator> socket;
+
+    SC_HAS_PROCESS(sb_tlm_initiator);
+
+    sb_tlm_initiator(sc_core::sc_module_name name, const char* req_uri, const char* resp_uri,
+        sc_core::sc_time poll_period = sc_core::sc_time(1, sc_core::SC_NS))
+        : sc_core::sc_module(name), socket("socket"), m_poll_period(poll_period),
+          m_nonblocking(false), m_resp_done(false) {
+
+        m_req.init(req_uri);
+        m_resp.init(resp_uri);
+
+        socket.register_nb_transport_bw(this, &sb_tlm_initiator::nb_transport_bw);
+
+        SC_THREAD(run);
+    }
+
+    // use nb_transport_fw() instead of b_transport()
+    void set_nonblocking(bool nonblocking) {
+        m_nonblocking = nonblocking;
+    }
+
+  private:
+    void run(void) {
+        while (true) {
+            sb_packet p;
+            if (m_req.recv(p)) {
+                handle((umi_packet*)p.data);
+            } else {
+                wait(m_poll_period);
+            }
+        }
+    }
+
+    void handle(umi_packet* req) {
+        uint32_t opcode = umi_opcode(req->cmd);
+        uint32_t size = umi_size(req->cmd);
+        uint32_t len = umi_len(req->cmd);
+        size_t nbytes = (opcode == UMI_REQ_ATOMIC) ? (1 << size) : ((len + 1) << size);
+
+        if ((opcode == UMI_REQ_WRITE) || (opcode == UMI_REQ_POSTED)) {
+            if (nbytes > sizeof(req->data)) {
+                fprintf(stderr, "%s: write of %zu bytes exceeds a UMI packet\n", name(), nbytes);
+                return;
+            }
+
+            transport(tlm::TLM_WRITE_COMMAND, req->dstaddr, req->data, nbytes);
+
+            if (opcode == UMI_REQ_WRITE) {
+                respond(req, UMI_RESP_WRITE, size, len, NULL);
+            }
+        } else if (opcode == UMI_REQ_READ) {
+            std::vector<uint8_t> buf(nbytes);
+            transport(tlm::TLM_READ_COMMAND, req->dstaddr, buf.data(), nbytes);
+
+            // split the response into packets of whole words
+            size_t words = sizeof(req->data) >> size;
+            size_t total = len + 1;
+            for (size_t word = 0; word < total; word += words) {
+                size_t n = std::min(words, total - word);
+                respond(req, UMI_RESP_READ, size, n - 1, buf.data() + (word << size),
+                    word << size, (word + n) == total);
+            }
+        } else if (opcode == UMI_REQ_ATOMIC) {
+            uint64_t mem = 0;
+            uint64_t operand = 0;
+            memcpy(&operand, req->data, nbytes);
+
+            // TLM has no atomics, but the module is the only thread issuing
+            // transactions here, so read-modify-write is equivalent
+            transport(tlm::TLM_READ_COMMAND, req->dstaddr, (uint8_t*)&mem, nbytes);
+            uint64_t result = umi_atomic_apply(umi_atype(req->cmd), size, mem, operand);
+            transport(tlm::TLM_WRITE_COMMAND, req->dstaddr, (uint8_t*)&result, nbytes);
+
+            respond(req, UMI_RESP_READ, size, 0, (uint8_t*)&mem);
+        } else {
+            fprintf(stderr, "%s: unsupported %s request, skipping\n", name(),
+                umi_opcode_to_str(req->cmd).c_str());
+        }
+    }
+
+    void respond(umi_packet* req, uint32_t opcode, uint32_t size, uint32_t len,
+        const uint8_t* data, uint64_t offset = 0, bool eom = true) {
+
+        sb_packet p;
+        memset(&p, 0, sizeof p);
+        umi_packet* resp = (umi_packet*)p.data;
+
+        resp->cmd = umi_pack(opcode, 0, size, len, eom, umi_eof(req->cmd), umi_qos(req->cmd),
+            umi_prot(req->cmd), umi_ex(req->cmd));
+        resp->dstaddr = req->srcaddr + offset;
+        resp->srcaddr = req->dstaddr + offset;
+        if (data) {
+            memcpy(resp->data, data, (len + 1) << size);
+        }
+
+        while (!m_resp.send(p)) {
+            wait(m_poll_period);
+        }
+    }
+
+    bool transport(tlm::tlm_command cmd, uint64_t addr, uint8_t* data, unsigned int len) {
+        tlm::tlm_generic_payload* tr = m_mm.allocate();
+        tr->acquire();
+
+        tr->set_command(cmd);
+        tr->set_address(addr);
+        tr->set_data_ptr(data);
+        tr->set_data_length(len);
+        tr->set_streaming_width(len);
+        tr->set_byte_enable_ptr(NULL);
+        tr->set_dmi_allowed(false);
+        tr->set_response_status(tlm::TLM_INCOMPLETE_RESPONSE);
+
+        sc_core::sc_time delay = sc_core::SC_ZERO_TIME;
+        if (m_nonblocking) {
+            nb_transport(*tr, delay);
+        } else {
+            socket->b_transport(*tr, delay);
+        }
+        wait(delay);
+
+        bool ok = tr->is_response_ok();
+        if (!ok) {
+            fprintf(stderr, "%s: %s\n", name(), tr->get_response_string().c_str());
+        }
+
+        tr->release();
+        return ok;
+    }
+
+    // runs a transaction through the base protocol phases
+    void nb_transport(tlm::tlm_generic_payload& tr, sc_core::sc_time& delay) {
+        tlm::tlm_phase phase = tlm::BEGIN_REQ;
+        m_resp_done = false;
+
+        tlm::tlm_sync_enum status = socket->nb_transport_fw(tr, phase, delay);
+
+        if (status == tlm::TLM_COMPLETED) {
+            return;
+        }
+
+        if ((status == tlm::TLM_UPDATED) && (phase == tlm::BEGIN_RESP)) {
+            phase = tlm::END_RESP;
+            socket->nb_transport_fw(tr, phase, delay);
+            return;
+        }
+
+        // wait for BEGIN_RESP on the backward path, which completes the
+        // transaction there
+        wait(delay);
+        delay = sc_core::SC_ZERO_TIME;
+        while (!m_resp_done) {
+            wait(m_resp_event);
+        }
+    }
+
+    tlm::tlm_sync_enum nb_transport_bw(tlm::tlm_generic_payload&, tlm::tlm_phase& phase,
+        sc_core::sc_time& delay) {
+
+        if (phase == tlm::BEGIN_RESP) {
+            m_resp_done = true;
+            m_resp_event.notify(delay);
+            return tlm::TLM_COMPLETED;
+        }
+
+        return tlm::TLM_ACCEPTED;
+    }
+
+    SBRX m_req;
+    SBTX m_resp;
+
+    sb_tlm_mm m_mm;
+    sc_core::sc_time m_poll_period;
+    bool m_nonblocking;
+
+    bool m_resp_done;
+    sc_core::sc_event m_resp_event;
+};
+
+#endif // __UMISB_TLM_HPP__
@@ -0,0 +1,197 @@
+// Timing model for UMI memory servers
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// UmiTiming computes when the response to a memory access is ready, given
+// the cycle at which the request arrived.  It combines a fixed latency, an
+// optional set of DRAM-like banks with one open row each (so row hits are
+// faster than row conflicts, and accesses to a busy bank wait for it), and
+// an optional bandwidth cap per port.  The model is functional-first: the
+// memory is updated when a request is accepted, and only the response is
+// delayed.
+//
+// UmiCalendar is a calendar queue used to release responses once their
+// ready cycle is reached.  Pushing and popping take constant time on
+// average, as long as most events are scheduled within one "year"
+// (number of buckets times bucket width) of the current time.
+
+#ifndef __UMITIMING_HPP__
+#define __UMITIMING_HPP__
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct UmiTimingConfig {
+    uint64_t latency = 0;        // cycles added to every access
+    uint32_t banks = 0;          // number of banks, or zero to disable the bank model
+    uint64_t row_bytes = 2048;   // size of a row, which is also the bank interleave
+    uint64_t row_hit = 0;        // cycles a bank is busy for a row hit
+    uint64_t row_miss = 0;       // cycles a bank is busy for a row conflict
+    double bytes_per_cycle = 0;  // bandwidth cap per port, or zero for unlimited
+
+    bool enabled() const {
+        return (latency > 0) || (banks > 0) || (bytes_per_cycle > 0);
+    }
+};
+
+class UmiTiming {
+  public:
+    // timing state of one port.  each port should only be used by one
+    // thread at a time.
+    struct Port {
+        uint64_t busy_until = 0; // end of the last transfer on this port
+        uint64_t last = 0;       // ready cycle of the last response
+    };
+
+    UmiTiming(UmiTimingConfig config = UmiTimingConfig()) {
+        configure(config);
+    }
+
+    void configure(UmiTimingConfig config) {
+        m_config = config;
+        m_config.row_bytes = std::max(m_config.row_bytes, (uint64_t)1);
+        m_banks.assign(m_config.banks, Bank());
+    }
+
+    const UmiTimingConfig& config() const {
+        return m_config;
+    }
+
+    bool enabled() const {
+        return m_config.enabled();
+    }
+
+    // returns the cycle at which the response to an access of "nbytes" at
+    // "addr", arriving on "port" at cycle "now", is ready.  responses on a
+    // port are kept in order, so the result is never earlier than that of
+    // the previous access on the same port.
+    uint64_t access(Port& port, uint64_t now, uint64_t addr, uint64_t nbytes) {
+        uint64_t t = now;
+
+        if (!m_banks.empty()) {
+            uint64_t row = addr / m_config.row_bytes;
+            Bank& bank = m_banks[row % m_banks.size()];
+            row /= m_banks.size();
+
+            // banks are shared by all ports
+            std::lock_guard<std::mutex> lock(m_mutex);
+            t = std::max(t, bank.busy_until);
+            t += (bank.open && (bank.row == row)) ? m_config.row_hit : m_config.row_miss;
+            bank.open = true;
+            bank.row = row;
+            bank.busy_until = t;
+        }
+
+        if (m_config.bytes_per_cycle > 0) {
+            t = std::max(t, port.busy_until);
+            t += (uint64_t)std::ceil(nbytes / m_config.bytes_per_cycle);
+            port.busy_until = t;
+        }
+
+        t += m_config.latency;
+        port.last = std::max(t, port.last);
+
+        return port.last;
+    }
+
+  private:
+    struct Bank {
+        bool open = false;
+        uint64_t row = 0;
+        uint64_t busy_until = 0;
+    };
+
+    UmiTimingConfig m_config;
+    std::vector<Bank> m_banks;
+    std::mutex m_mutex;
+};
+
+template <typename T> class UmiCalendar {
+  public:
+    UmiCalendar(size_t num_buckets = 256, uint64_t width = 16)
+        : m_buckets(std::max(num_buckets, (size_t)1)), m_width(std::max(width, (uint64_t)1)),
+          m_start(0), m_size(0) {}
+
+    size_t size() const {
+        return m_size;
+    }
+
+    void push(uint64_t time, T item) {
+        if (m_size == 0) {
+            m_start = time / m_width * m_width;
+        }
+
+        // events in the past go into the current bucket
+        m_buckets[bucket(std::max(time, m_start))].push_back(std::make_pair(time, item));
+        m_size++;
+    }
+
+    // removes the earliest event scheduled at or before "now", returning
+    // false if there is none
+    bool pop(uint64_t now, T& item) {
+        size_t skipped = 0;
+
+        while ((m_size > 0) && (m_start <= now)) {
+            std::vector<std::pair<uint64_t, T>>& b = m_buckets[bucket(m_start)];
+
+            // find the earliest event in this bucket that belongs to the
+            // current year
+            size_t best = b.size();
+            for (size_t i = 0; i < b.size(); i++) {
+                if ((b[i].first < m_start + m_width) &&
+                    ((best == b.size()) || (b[i].first < b[best].first))) {
+                    best = i;
+                }
+            }
+
+            if (best < b.size()) {
+                if (b[best].first > now) {
+                    return false;
+                }
+                item = b[best].second;
+                b[best] = b.back();
+                b.pop_back();
+                m_size--;
+                return true;
+            }
+
+            m_start += m_width;
+
+            // after a whole year of empty buckets, jump straight to the
+            // earliest event
+            if (++skipped == m_buckets.size()) {
+                m_start = earliest() / m_width * m_width;
+                skipped = 0;
+            }
+        }
+
+        return false;
+    }
+
+  private:
+    size_t bucket(uint64_t time) const {
+        return (time / m_width) % m_buckets.size();
+    }
+
+    uint64_t earliest() const {
+        uint64_t t = UINT64_MAX;
+        for (const std::vector<std::pair<uint64_t, T>>& b : m_buckets) {
+            for (const std::pair<uint64_t, T>& e : b) {
+                t = std::min(t, e.first);
+            }
+        }
+        return t;
+    }
+
+    std::vector<std::vector<std::pair<uint64_t, T>>> m_buckets;
+    uint64_t m_width;
+    uint64_t m_start; // start of the current bucket
+    size_t m_size;
+};
+
+#endif // __UMITIMING_HPP__
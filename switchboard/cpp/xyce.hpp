@@ -1,8 +1,17 @@
 // Copyright (c) 2024 Zero ASIC Corporation
 // This code is licensed under Apache License 2.0 (see LICENSE for details)
 
+#ifndef __XYCE_HPP__
+#define __XYCE_HPP__
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
 #include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
 #include <stdio.h>
@@ -10,11 +19,53 @@
 
 #include <N_CIR_XyceCInterface.h>
 
+// XyceIntf drives the DAC inputs and reads the ADC outputs of a Xyce
+// simulation.  signals are resolved to integer handles once, via dac() and
+// adc(), so that the put() and get() calls made every cycle don't have to
+// build strings or search maps.  the string-based put() and get() are kept
+// for convenience and simply look up the handle first.
+//
+// the waveform of each DAC is kept in a sliding window: points that Xyce
+// has already simulated past are dropped (except for the last one, which
+// the DAC still needs to interpolate from), so the amount of data passed
+// to Xyce on each update stays bounded no matter how long the simulation
+// runs.  DAC updates are batched, and only sent to Xyce right before it
+// is advanced.
+//
+// by default, Xyce is advanced in lockstep with the digital simulation,
+// whenever an ADC is read at a time it hasn't reached yet.  if a lookahead
+// is set (with set_lookahead() or the SB_XYCE_LOOKAHEAD environment
+// variable, in seconds), DAC inputs instead reach the analog circuit that
+// much later than they were written.  this means that Xyce never needs
+// inputs beyond the current digital time plus the lookahead, so it can run
+// on its own thread, in steps of up to SB_XYCE_STEP seconds (the lookahead
+// by default) regardless of how often the ADCs are read.  to keep results
+// independent of thread timing, Xyce is only allowed to run up to inputs
+// that can no longer change: once a put() or get() is made at a digital
+// time later than t, no more inputs for t can arrive, so Xyce may run up
+// to t plus the lookahead.  ADC outputs are recorded after every step, and
+// reads are served by interpolating between those samples.  a read beyond
+// the point that Xyce may run up to returns the value at that point, so
+// the lookahead should be at least the interval between reads.
+
 class XyceIntf {
   public:
-    XyceIntf() {}
+    XyceIntf() {
+        const char* lookahead = getenv("SB_XYCE_LOOKAHEAD");
+        const char* step = getenv("SB_XYCE_STEP");
+        set_lookahead(lookahead ? atof(lookahead) : 0, step ? atof(step) : 0);
+    }
 
     ~XyceIntf() {
+        if (m_thread.joinable()) {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_cv.notify_all();
+            m_thread.join();
+        }
+
         if (m_opened) {
             xyce_close(m_xyceObj);
         }
@@ -24,6 +75,13 @@ class XyceIntf {
         }
     }
 
+    // has to be called before init().  a lookahead of zero runs Xyce in
+    // lockstep; a step of zero means the same as the lookahead.
+    void set_lookahead(double lookahead, double step = 0) {
+        m_lookahead = std::max(lookahead, 0.0);
+        m_step = (step > 0) ? step : m_lookahead;
+    }
+
     void init(std::string file) {
         // pointer to N_CIR_Xyce object
         m_xyceObj = (void**)malloc(sizeof(void* [1]));
@@ -39,52 +97,291 @@ class XyceIntf {
 
         // Initialize N_CIR_Xyce object
         xyce_initialize(m_xyceObj, argc, argv);
-        m_initialized = true;
 
         // Simulate for a small amount of time
         xyce_simulateUntil(m_xyceObj, 1e-10, &m_simTime);
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_initialized = true;
+            m_horizon = m_simTime;
+
+            // send any waveforms that were written before initialization
+            flush();
+        }
+
+        if (m_lookahead > 0) {
+            m_thread = std::thread(&XyceIntf::run, this);
+        }
     }
 
-    void put(std::string name, double time, double value) {
-        if (!m_time.count(name)) {
-            m_time[name] = std::vector<double>();
+    // returns the handle of the DAC driving the node "name"
+    int dac(std::string name) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::map<std::string, int>::iterator it = m_dac_ids.find(name);
+        if (it != m_dac_ids.end()) {
+            return it->second;
         }
 
-        m_time[name].push_back(time);
+        Dac dac;
+        dac.name = "YDAC!" + name;
+        m_dacs.push_back(dac);
+
+        int id = m_dacs.size() - 1;
+        m_dac_ids[name] = id;
+        return id;
+    }
+
+    // returns the handle of the ADC output "name"
+    int adc(std::string name) {
+        std::lock_guard<std::mutex> lock(m_mutex);
 
-        if (!m_value.count(name)) {
-            m_value[name] = std::vector<double>();
+        std::map<std::string, int>::iterator it = m_adc_ids.find(name);
+        if (it != m_adc_ids.end()) {
+            return it->second;
         }
 
-        m_value[name].push_back(value);
+        Adc adc;
+        adc.name = name;
+        m_adcs.push_back(adc);
 
-        // TODO: prune old values for higher performance?
+        // the Xyce thread takes the first sample
+        m_new_adcs = true;
+        m_cv.notify_all();
 
-        if (m_initialized) {
-            std::string fullName = "YDAC!" + name;
+        int id = m_adcs.size() - 1;
+        m_adc_ids[name] = id;
+        return id;
+    }
+
+    void put(int handle, double time, double value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        Dac& dac = m_dacs[handle];
+        dac.time.push_back(time + m_lookahead);
+        dac.value.push_back(value);
+
+        if (!dac.dirty) {
+            dac.dirty = true;
+            m_dirty.push_back(handle);
+        }
 
-            xyce_updateTimeVoltagePairs(m_xyceObj, (char*)fullName.c_str(), m_time[name].size(),
-                m_time[name].data(), m_value[name].data());
+        if (m_thread.joinable()) {
+            advance(time);
         }
     }
 
-    void get(std::string name, double time, double* value) {
-        if (m_initialized) {
+    void get(int handle, double time, double* value) {
+        if (!m_initialized) {
+            return;
+        }
+
+        if (!m_thread.joinable()) {
             // advance simulation if necessary
             if (time > m_simTime) {
-                int status = xyce_simulateUntil(m_xyceObj, time, &m_simTime);
+                flush();
+                xyce_simulateUntil(m_xyceObj, time, &m_simTime);
             }
 
             // read out the value
-            xyce_obtainResponse(m_xyceObj, (char*)name.c_str(), value);
+            xyce_obtainResponse(m_xyceObj, (char*)m_adcs[handle].name.c_str(), value);
+            return;
         }
+
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        advance(time);
+
+        m_cv.wait(lock, [&] {
+            return m_failed || ((m_simTime >= std::min(time, m_horizon)) &&
+                                   !m_adcs[handle].samples.empty());
+        });
+
+        if (!m_adcs[handle].samples.empty()) {
+            *value = sample(m_adcs[handle], time);
+        }
+    }
+
+    void put(std::string name, double time, double value) {
+        put(dac(name), time, value);
+    }
+
+    void get(std::string name, double time, double* value) {
+        get(adc(name), time, value);
     }
 
   private:
-    void** m_xyceObj;
-    double m_simTime;
-    bool m_opened;
-    bool m_initialized;
-    std::map<std::string, std::vector<double>> m_time;
-    std::map<std::string, std::vector<double>> m_value;
+    struct Dac {
+        std::string name; // full name, including the "YDAC!" prefix
+        std::vector<double> time;
+        std::vector<double> value;
+        size_t start = 0; // first point of the window
+        bool dirty = false;
+    };
+
+    struct Adc {
+        std::string name;
+        std::deque<std::pair<double, double>> samples; // (time, value), oldest first
+    };
+
+    // notes that the digital simulation has reached "time".  digital time
+    // never goes backwards, so when it moves on, the inputs for the previous
+    // time are final, and the Xyce thread can run up to the point where they
+    // reach the circuit.  m_mutex must be held.
+    void advance(double time) {
+        if (time <= m_digital) {
+            return;
+        }
+
+        if ((m_digital >= 0) && ((m_digital + m_lookahead) > m_horizon)) {
+            m_horizon = m_digital + m_lookahead;
+            m_cv.notify_all();
+        }
+
+        m_digital = time;
+    }
+
+    // sends all DAC updates since the last flush to Xyce
+    void flush() {
+        if (!m_initialized) {
+            return;
+        }
+
+        for (int handle : m_dirty) {
+            update(m_dacs[handle]);
+            m_dacs[handle].dirty = false;
+        }
+
+        m_dirty.clear();
+    }
+
+    void update(Dac& dac) {
+        // drop points that are no longer needed: Xyce has simulated up to
+        // m_simTime, so only the last point at or before that time and the
+        // points after it matter.
+        while (((dac.start + 1) < dac.time.size()) && (dac.time[dac.start + 1] <= m_simTime)) {
+            dac.start++;
+        }
+
+        // reclaim the space of dropped points once they make up half of the
+        // buffer, so that trimming is amortized constant time per point
+        if ((dac.start > 0) && ((2 * dac.start) >= dac.time.size())) {
+            dac.time.erase(dac.time.begin(), dac.time.begin() + dac.start);
+            dac.value.erase(dac.value.begin(), dac.value.begin() + dac.start);
+            dac.start = 0;
+        }
+
+        size_t n = dac.time.size() - dac.start;
+
+        if (n > 0) {
+            xyce_updateTimeVoltagePairs(m_xyceObj, (char*)dac.name.c_str(), n,
+                dac.time.data() + dac.start, dac.value.data() + dac.start);
+        }
+    }
+
+    // records the value of "adc" at the current Xyce time.  m_mutex must
+    // be held.
+    void record(Adc& adc) {
+        double value = 0;
+        xyce_obtainResponse(m_xyceObj, (char*)adc.name.c_str(), &value);
+        adc.samples.push_back(std::make_pair(m_simTime, value));
+    }
+
+    // interpolates the value of "adc" at "time".  since reads are made in
+    // time order, samples before the one at or just before "time" are
+    // dropped along the way.
+    double sample(Adc& adc, double time) {
+        std::deque<std::pair<double, double>>& s = adc.samples;
+
+        while ((s.size() >= 2) && (s[1].first <= time)) {
+            s.pop_front();
+        }
+
+        if ((s.size() < 2) || (time <= s[0].first)) {
+            return s[0].second;
+        }
+
+        double frac = (time - s[0].first) / (s[1].first - s[0].first);
+        return s[0].second + frac * (s[1].second - s[0].second);
+    }
+
+    // body of the Xyce thread
+    void run() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+
+        while (true) {
+            m_cv.wait(lock, [&] { return m_stop || m_new_adcs || (m_horizon > m_simTime); });
+
+            if (m_stop) {
+                break;
+            }
+
+            // ADCs that were just added get a first sample at the current
+            // time, so that they can be read right away
+            if (m_new_adcs) {
+                for (Adc& adc : m_adcs) {
+                    if (adc.samples.empty()) {
+                        record(adc);
+                    }
+                }
+                m_new_adcs = false;
+                m_cv.notify_all();
+            }
+
+            if (m_horizon <= m_simTime) {
+                continue;
+            }
+
+            // all DAC updates up to now go to Xyce as one batch
+            flush();
+
+            double until = std::min(m_horizon, m_simTime + m_step);
+            double reached = m_simTime;
+
+            lock.unlock();
+            xyce_simulateUntil(m_xyceObj, until, &reached);
+            lock.lock();
+
+            if (reached <= m_simTime) {
+                fprintf(stderr, "ERROR: Xyce failed to advance past t=%g\n", m_simTime);
+                m_failed = true;
+                m_cv.notify_all();
+                break;
+            }
+
+            m_simTime = reached;
+
+            for (Adc& adc : m_adcs) {
+                record(adc);
+            }
+
+            m_cv.notify_all();
+        }
+    }
+
+    void** m_xyceObj = NULL;
+    double m_simTime = 0;
+    bool m_opened = false;
+    bool m_initialized = false;
+
+    std::vector<Dac> m_dacs;
+    std::vector<Adc> m_adcs;
+    std::vector<int> m_dirty;
+    std::map<std::string, int> m_dac_ids;
+    std::map<std::string, int> m_adc_ids;
+
+    // lookahead mode
+    double m_lookahead = 0;
+    double m_step = 0;
+    double m_horizon = 0;  // time up to which DAC inputs are final
+    double m_digital = -1; // latest digital time seen, if any
+    bool m_new_adcs = false;
+    bool m_stop = false;
+    bool m_failed = false;
+    std::thread m_thread;
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
 };
+
+#endif // __XYCE_HPP__
@@ -6,6 +6,7 @@
 #include <memory>
 #include <vector>
 
+#include "signal_bank.hpp"
 #include "svdpi.h"
 #include "switchboard.hpp"
 
@@ -19,6 +20,13 @@ extern void pi_sb_recv(int id, svBitVecVal* rdata, svBitVecVal* rdest, svBit* rl
 extern void pi_sb_send(int id, const svBitVecVal* sdata, const svBitVecVal* sdest, svBit slast,
     int* success);
 extern void pi_time_taken(double* t);
+extern void pi_start_delay(double value);
+extern void pi_max_rate_tick(svBitVecVal* pacer_vec, double max_rate);
+extern void pi_sb_bank_init(int* id, const char* uri, int width);
+extern void pi_sb_bank_poll(int id, int* changed);
+extern void pi_sb_bank_next(int id, int* idx, int* value);
+extern void pi_sb_bank_put(int id, int idx, int value);
+extern void pi_sb_bank_flush(int id);
 #ifdef __cplusplus
 }
 #endif
@@ -27,6 +35,8 @@ static std::vector<std::unique_ptr<SBRX>> rxconn;
 static std::vector<std::unique_ptr<SBTX>> txconn;
 static std::vector<int> rxwidth;
 static std::vector<int> txwidth;
+static std::vector<std::unique_ptr<SBSignalBank>> banks;
+static sb_pacer_table pacers;
 
 void pi_sb_rx_init(int* id, const char* uri, int width) {
     rxconn.push_back(std::unique_ptr<SBRX>(new SBRX()));
@@ -102,18 +112,48 @@ void pi_start_delay(double value) {
     start_delay(value);
 }
 
-void pi_max_rate_tick(svBitVecVal* t_us_vec, svBitVecVal* min_period_us_vec) {
+void pi_max_rate_tick(svBitVecVal* pacer_vec, double max_rate) {
     // WARNING: not tested yet since Icarus Verilog uses VPI and Verilator
-    // uses max_rate_tick in main(), not through DPI
+    // uses sb_pacer in main(), not through DPI
 
-    // retrieve the previous timestamp and minimum period
-    long t_us, min_period_us;
-    memcpy(&t_us, t_us_vec, 8);
-    memcpy(&min_period_us, min_period_us_vec, 8);
+    // retrieve the handle of the pacer
+    long pacer;
+    memcpy(&pacer, pacer_vec, 8);
 
     // call the underlying switchboard function
-    max_rate_tick(t_us, min_period_us);
+    pacers.tick(pacer, max_rate);
 
-    // store the new timestamp
-    memcpy(t_us_vec, &t_us, 8);
+    // store the handle, which is assigned on the first call
+    memcpy(pacer_vec, &pacer, 8);
+}
+
+// signal banks are exchanged 32 bits at a time, and only the words that
+// changed are passed in either direction
+
+void pi_sb_bank_init(int* id, const char* uri, int width) {
+    banks.push_back(std::unique_ptr<SBSignalBank>(new SBSignalBank()));
+    banks.back()->init(uri, width);
+
+    *id = banks.size() - 1;
+}
+
+void pi_sb_bank_poll(int id, int* changed) {
+    *changed = banks[id]->poll() ? 1 : 0;
+}
+
+void pi_sb_bank_next(int id, int* idx, int* value) {
+    uint32_t word;
+    if (banks[id]->next(*idx, word)) {
+        *value = word;
+    } else {
+        *idx = -1;
+    }
+}
+
+void pi_sb_bank_put(int id, int idx, int value) {
+    banks[id]->put(idx, value);
+}
+
+void pi_sb_bank_flush(int id) {
+    banks[id]->flush();
 }
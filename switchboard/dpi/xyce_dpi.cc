@@ -19,6 +19,10 @@ extern "C" {
 extern void pi_sb_xyce_init(int* id, char* file);
 extern void pi_sb_xyce_put(int id, char* name, double time, double value);
 extern void pi_sb_xyce_get(int id, char* name, double time, double* val);
+extern void pi_sb_xyce_dac(int id, char* name, int* handle);
+extern void pi_sb_xyce_adc(int id, char* name, int* handle);
+extern void pi_sb_xyce_put_id(int id, int handle, double time, double value);
+extern void pi_sb_xyce_get_id(int id, int handle, double time, double* val);
 #ifdef __cplusplus
 }
 #endif
@@ -41,3 +45,19 @@ void pi_sb_xyce_put(int id, char* name, double time, double value) {
 void pi_sb_xyce_get(int id, char* name, double time, double* value) {
     xyceIntfs[id]->get(std::string(name), time, value);
 }
+
+void pi_sb_xyce_dac(int id, char* name, int* handle) {
+    *handle = xyceIntfs[id]->dac(std::string(name));
+}
+
+void pi_sb_xyce_adc(int id, char* name, int* handle) {
+    *handle = xyceIntfs[id]->adc(std::string(name));
+}
+
+void pi_sb_xyce_put_id(int id, int handle, double time, double value) {
+    xyceIntfs[id]->put(handle, time, value);
+}
+
+void pi_sb_xyce_get_id(int id, int handle, double time, double* value) {
+    xyceIntfs[id]->get(handle, time, value);
+}
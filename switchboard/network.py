@@ -16,7 +16,7 @@ from .autowrap import (directions_are_compatible, normalize_intf_type,
     autowrap, flip_intf, normalize_direction, WireExpr, types_are_compatible)
 from .cmdline import get_cmdline_args
 from .sbtcp import start_tcp_bridge
-from .util import ProcessCollection
+from .util import ProcessCollection, numa_nodes
 
 from _switchboard import delete_queues
 
@@ -111,12 +111,16 @@ class TcpIntf:
 
 
 class SbInst:
-    def __init__(self, name, block):
+    def __init__(self, name, block, cpus=None, numa=None):
         self.name = name
         self.block = block
         self.mapping = {}
         self.external = set()
 
+        # CPU and NUMA placement of this instance's simulation (see SbDut.simulate)
+        self.cpus = cpus
+        self.numa = numa
+
         for name, value in block.intf_defs.items():
             if value['type'] != 'plusarg':
                 self.mapping[name] = dict(uri=None, wire=None)
@@ -198,11 +202,15 @@ class SbNetwork:
         args=None,
         single_netlist: bool = False,
         threads: int = None,
-        name: str = None
+        name: str = None,
+        placement: str = None
     ):
 
         self.insts = {}
 
+        # pairs of instance names that are connected by queues
+        self.links = []
+
         self.inst_name_set = set()
         self.inst_name_counters = {}
 
@@ -259,6 +267,11 @@ class SbNetwork:
 
         self.single_netlist = single_netlist
 
+        # "colocate" places each group of instances that communicate with each
+        # other on one NUMA node (see place())
+        assert placement in [None, 'colocate'], f'Unknown placement "{placement}"'
+        self.placement = placement
+
         if single_netlist:
             self.single_netlist_dut = SbDut(design="single_netlist_network", args=self.args)
         else:
@@ -285,7 +298,7 @@ class SbNetwork:
         else:
             return self._intf_defs
 
-    def instantiate(self, block, name: str = None):
+    def instantiate(self, block, name: str = None, cpus=None, numa=None):
         # generate a name if needed
         if name is None:
             if isinstance(block, SbDut):
@@ -306,7 +319,7 @@ class SbNetwork:
         self.inst_name_set.add(name)
 
         # create the instance object
-        self.insts[name] = SbInst(name=name, block=block)
+        self.insts[name] = SbInst(name=name, block=block, cpus=cpus, numa=numa)
 
         # return the instance object
         return self.insts[name]
@@ -399,6 +412,14 @@ class SbNetwork:
                     input.slice, f'{wire}{output.slice_as_str()}')
                 output.inst.mapping[output.name]['wire'] = wire
 
+        # make a note of which instances communicate, for placement
+
+        inst_a = getattr(a, 'inst', None)
+        inst_b = getattr(b, 'inst', None)
+
+        if isinstance(inst_a, SbInst) and isinstance(inst_b, SbInst):
+            self.links.append((inst_a.name, inst_b.name))
+
         # make a note of TCP bridges that need to be started
 
         for intf, intf_def in [(a, intf_def_a), (b, intf_def_b)]:
@@ -598,6 +619,9 @@ class SbNetwork:
                 import time
                 start = time.time()
 
+            if self.placement == 'colocate':
+                self.place()
+
             insts = self.insts.values()
 
             if len(insts) > 1:
@@ -635,8 +659,14 @@ class SbNetwork:
                 else:
                     inst_plusargs = plusargs
 
+                placement = {}
+                if inst.cpus is not None:
+                    placement['cpus'] = inst.cpus
+                if inst.numa is not None:
+                    placement['numa'] = inst.numa
+
                 process = block.simulate(start_delay=start_delay, run=inst.name,
-                    intf_objs=False, plusargs=inst_plusargs)
+                    intf_objs=False, plusargs=inst_plusargs, **placement)
 
                 self.process_collection.add(process)
 
@@ -647,6 +677,49 @@ class SbNetwork:
 
         return self.process_collection
 
+    def place(self):
+        """Assigns a NUMA node to each instance that doesn't have a placement yet,
+        pinning it to the CPUs of that node and placing its queues there.  Instances
+        that are connected to each other, directly or indirectly, are kept on the same
+        node, so that their queues are polled without crossing sockets, and groups of
+        instances are spread over nodes in proportion to their numbers of CPUs."""
+
+        nodes = numa_nodes()
+
+        if len(nodes) == 0:
+            return
+
+        # find the groups of connected instances
+
+        group_of = {name: name for name in self.insts}
+
+        def find(name):
+            while group_of[name] != name:
+                group_of[name] = group_of[group_of[name]]
+                name = group_of[name]
+            return name
+
+        for a, b in self.links:
+            group_of[find(a)] = find(b)
+
+        groups = {}
+        for name in self.insts:
+            groups.setdefault(find(name), []).append(name)
+
+        # place the largest groups first, each on the least loaded node
+
+        load = {node: 0 for node in nodes}
+
+        for members in sorted(groups.values(), key=len, reverse=True):
+            node = min(nodes, key=lambda n: (load[n] + len(members)) / len(nodes[n]))
+            load[node] += len(members)
+
+            for name in members:
+                inst = self.insts[name]
+                if isinstance(inst.block, SbDut) and (inst.cpus is None) and (inst.numa is None):
+                    inst.cpus = nodes[node]
+                    inst.numa = node
+
     def terminate(
         self,
         stop_timeout=10,
@@ -11,6 +11,7 @@ automatically configured to abstract away setup of files that are required by al
 testbenches.
 """
 
+import os
 import subprocess
 
 from copy import deepcopy
@@ -20,7 +21,8 @@ from typing import List, Dict, Any, Union
 from .switchboard import path as sb_path
 from .icarus import icarus_build_vpi, icarus_find_vpi, icarus_run
 from .verilator_run import verilator_run
-from .util import plusargs_to_args, binary_run, ProcessCollection
+from .util import (plusargs_to_args, binary_run, ProcessCollection, parse_cpulist,
+    format_cpulist)
 from .ams import make_ams_spice_wrapper, make_ams_verilog_wrapper, parse_spice_subckts
 from .autowrap import (normalize_clocks, normalize_interfaces, normalize_resets, normalize_tieoffs,
     normalize_parameters, create_intf_objs, type_is_axi, type_is_axil, type_is_apb)
@@ -366,7 +368,9 @@ class SbDut(Sim):
         max_rate: float = None,
         start_delay: float = None,
         run: str = None,
-        intf_objs: bool = True
+        intf_objs: bool = True,
+        cpus=None,
+        numa=None
     ) -> subprocess.Popen:
         """
         Parameters
@@ -392,6 +396,15 @@ class SbDut(Sim):
         period: float, optional
             If provided, the period of the clock generated in the testbench,
             in seconds.
+
+        cpus: str or list of int, optional
+            If provided, the simulation (including any worker threads) is pinned
+            to these CPUs, given as a list or in the kernel's format, e.g. "0-3".
+
+        numa: int or str, optional
+            If provided, the NUMA placement of the queues opened by the simulation:
+            a node number, or "consumer" to place each queue on the node that its
+            consumer runs on.
         """
 
         # set up interfaces if needed
@@ -449,6 +462,24 @@ class SbDut(Sim):
             carefully_add_plusarg(
                 key='start-delay', value=start_delay, args=args, plusargs=plusargs)
 
+        # CPU and NUMA placement.  Icarus Verilog doesn't use the switchboard
+        # testbench, so it is pinned after launch and picks up the NUMA placement
+        # from the environment instead.
+
+        env = None
+
+        if cpus is not None:
+            cpus = format_cpulist(cpus)
+
+        if self.tool == 'icarus':
+            if numa is not None:
+                env = dict(os.environ, SB_NUMA=str(numa))
+        else:
+            if cpus is not None:
+                carefully_add_plusarg(key='cpu', value=cpus, args=args, plusargs=plusargs)
+            if numa is not None:
+                carefully_add_plusarg(key='numa', value=numa, args=args, plusargs=plusargs)
+
         # add plusargs that define queue connections
 
         for name, value in self.intf_defs.items():
@@ -489,8 +520,12 @@ class SbDut(Sim):
                 sim,
                 plusargs=plusargs,
                 modules=modules,
-                extra_args=args + extra_args
+                extra_args=args + extra_args,
+                env=env
             )
+
+            if (cpus is not None) and hasattr(os, 'sched_setaffinity'):
+                os.sched_setaffinity(p.pid, parse_cpulist(cpus))
         else:
             # make sure that the simulator was built with tracing enabled
             if trace and not self.trace:
@@ -16,18 +16,30 @@ import socket
 import argparse
 import numpy as np
 
+from numbers import Integral
 from switchboard import PySbRx, PySbTx, PySbPacket
 
+# an sb_packet (destination, flags, data), same as the native bridge
+# (sbtcp.cc).  with tstamp=True, each packet is followed by its 32-bit
+# sim-time stamp, as in a queue slot; both ends of a bridge must agree on
+# this, since the two formats can't be told apart.
 SB_PACKET_SIZE_BYTES = 60
+SB_TSTAMP_SIZE_BYTES = 4
 
 
-def tcp2sb(outputs, conn):
+def packet_size(tstamp=False):
+    return SB_PACKET_SIZE_BYTES + (SB_TSTAMP_SIZE_BYTES if tstamp else 0)
+
+
+def tcp2sb(outputs, conn, tstamp=False):
+    size = packet_size(tstamp)
+
     while True:
         # receive data from TCP
         data_rx_from_tcp = bytes([])
 
-        while len(data_rx_from_tcp) < SB_PACKET_SIZE_BYTES:
-            b = conn.recv(SB_PACKET_SIZE_BYTES - len(data_rx_from_tcp))
+        while len(data_rx_from_tcp) < size:
+            b = conn.recv(size - len(data_rx_from_tcp))
 
             if len(b) == 0:
                 # connection is not alive anymore
@@ -36,7 +48,7 @@ def tcp2sb(outputs, conn):
             data_rx_from_tcp += b
 
         # convert to a switchboard packet
-        p = bytes2sb(data_rx_from_tcp)
+        p = bytes2sb(data_rx_from_tcp, tstamp=tstamp)
 
         # figure out which queue this packet is going to
         for rule, output in outputs:
@@ -47,7 +59,7 @@ def tcp2sb(outputs, conn):
             raise Exception(f"No rule for destination {p.destination}")
 
 
-def sb2tcp(inputs, conn):
+def sb2tcp(inputs, conn, tstamp=False):
     tcp_data_to_send = bytes([])
 
     while True:
@@ -66,7 +78,7 @@ def sb2tcp(inputs, conn):
                 break
 
         # convert the switchboard packet to bytes
-        tcp_data_to_send = sb2bytes(p)
+        tcp_data_to_send = sb2bytes(p, tstamp=tstamp)
 
         # send the packet out over TCP
         while len(tcp_data_to_send) > 0:
@@ -79,7 +91,8 @@ def sb2tcp(inputs, conn):
             tcp_data_to_send = tcp_data_to_send[n:]
 
 
-def run_client(host, port, quiet=False, max_rate=None, inputs=None, outputs=None, run_once=False):
+def run_client(host, port, quiet=False, max_rate=None, inputs=None, outputs=None, run_once=False,
+    tstamp=False):
     """
     Connect to a server, retrying until a connection is made.
     """
@@ -106,15 +119,16 @@ def run_client(host, port, quiet=False, max_rate=None, inputs=None, outputs=None
 
         # communicate with the server
         if outputs is not None:
-            tcp2sb(outputs=outputs, conn=conn)
+            tcp2sb(outputs=outputs, conn=conn, tstamp=tstamp)
         elif inputs is not None:
-            sb2tcp(inputs=inputs, conn=conn)
+            sb2tcp(inputs=inputs, conn=conn, tstamp=tstamp)
 
         if run_once:
             break
 
 
-def run_server(host, port=0, quiet=False, max_rate=None, run_once=False, outputs=None, inputs=None):
+def run_server(host, port=0, quiet=False, max_rate=None, run_once=False, outputs=None, inputs=None,
+    tstamp=False):
     """
     Accepts client connections in a loop until Ctrl-C is pressed.
     """
@@ -142,9 +156,9 @@ def run_server(host, port=0, quiet=False, max_rate=None, run_once=False, outputs
 
         # communicate with the client
         if outputs is not None:
-            tcp2sb(outputs=outputs, conn=conn)
+            tcp2sb(outputs=outputs, conn=conn, tstamp=tstamp)
         elif inputs is not None:
-            sb2tcp(inputs=inputs, conn=conn)
+            sb2tcp(inputs=inputs, conn=conn, tstamp=tstamp)
 
         if run_once:
             break
@@ -187,19 +201,21 @@ def normalize_inputs(inputs, max_rate):
     return retval
 
 
-def sb2bytes(p):
+def sb2bytes(p, tstamp=False):
     # construct a bytes object from a Switchboard packet
-    arr = np.concatenate((
+    fields = [
         np.array([p.destination, p.flags], dtype=np.uint32),
         p.data.view(np.uint32)
-    ))
-    return arr.tobytes()
+    ]
+    if tstamp:
+        fields.append(np.array([p.tstamp & 0xffffffff], dtype=np.uint32))
+    return np.concatenate(fields).tobytes()
 
 
-def bytes2sb(b):
+def bytes2sb(b, tstamp=False):
     # construct a Switchboard packet from a bytes object
     arr = np.frombuffer(b, dtype=np.uint32)
-    return PySbPacket(arr[0], arr[1], arr[2:].view(np.uint8))
+    return PySbPacket(arr[0], arr[1], arr[2:15].view(np.uint8), int(arr[15]) if tstamp else 0)
 
 
 def convert_to_queue(q, cls, max_rate=None):
@@ -255,15 +271,107 @@ def parse_rule(rule):
     return retval
 
 
+def rule_to_str(rule):
+    # inverse of parse_rule(), used to pass rules to the native bridge
+
+    if rule == '*':
+        return '*'
+    elif isinstance(rule, Integral):
+        return str(rule)
+    elif isinstance(rule, range):
+        assert rule.step == 1, 'Only contiguous ranges are supported'
+        return f'{rule.start}-{rule.stop - 1}'
+    elif isinstance(rule, (list, tuple)):
+        return ','.join(rule_to_str(subrule) for subrule in rule)
+    else:
+        raise Exception(f'Unsupported rule type: {type(rule)}')
+
+
+def native_bridge_args(inputs=None, outputs=None, host='localhost', port=5555,
+    quiet=True, max_rate=None, mode='auto', run_once=False, tstamp=False):
+    """
+    Returns the command-line arguments for running a bridge with the native
+    sbtcp daemon, or None if the bridge can't be expressed that way (e.g.,
+    because queue objects rather than names were provided).
+    """
+
+    args = []
+
+    if outputs is not None:
+        args += ['--outputs']
+        for rule, output in outputs:
+            if not isinstance(output, str):
+                return None
+            args += [f'{rule_to_str(rule)}:{output}']
+    elif inputs is not None:
+        args += ['--inputs']
+        for input in inputs:
+            if isinstance(input, (list, tuple)):
+                destination, input = input
+                if not isinstance(input, str):
+                    return None
+                if destination is not None:
+                    input = f'{destination}:{input}'
+            elif not isinstance(input, str):
+                return None
+            args += [input]
+
+    args += ['--host', host, '--port', port]
+
+    if mode == 'server':
+        args += ['--server']
+    elif mode == 'client':
+        args += ['--client']
+
+    if max_rate is not None:
+        args += ['--max-rate', max_rate]
+
+    if run_once:
+        args += ['--run-once']
+
+    if tstamp:
+        args += ['--tstamp']
+
+    if quiet:
+        args += ['-q']
+
+    return args
+
+
 def start_tcp_bridge(inputs=None, outputs=None, host='localhost', port=5555,
-    quiet=True, max_rate=None, mode='auto', run_once=False):
+    quiet=True, max_rate=None, mode='auto', run_once=False, native=None, tstamp=False):
+    """
+    Starts a TCP bridge in the background.  If native is True, or None and
+    the sbtcp daemon has been built (make -C switchboard/cpp sbtcp), the
+    bridge runs as a native process that moves packets in batches; otherwise
+    it runs in Python.  If tstamp is True, sim-time stamps are carried
+    across the bridge; the other end must be started with tstamp=True (or
+    --tstamp) as well.
+    """
+
+    if native is not False:
+        from .switchboard import path as sb_path
+        from .util import binary_run
+
+        bin = sb_path() / 'cpp' / 'sbtcp'
+
+        if bin.exists():
+            args = native_bridge_args(inputs=inputs, outputs=outputs, host=host, port=port,
+                quiet=quiet, max_rate=max_rate, mode=mode, run_once=run_once, tstamp=tstamp)
+
+            if args is not None:
+                return binary_run(bin, args)
+
+        if native:
+            raise Exception('Native TCP bridge is not available for these arguments.')
 
     kwargs = dict(
         host=host,
         port=port,
         quiet=quiet,
         max_rate=max_rate,
-        run_once=run_once
+        run_once=run_once,
+        tstamp=tstamp
     )
 
     target = None
@@ -313,6 +421,8 @@ def get_parser():
         ' queues are read or written.')
     parser.add_argument('--run-once', action='store_true', help="Process only one connection"
         " in server mode, then exit.")
+    parser.add_argument('--tstamp', action='store_true', help="Carry sim-time stamps across"
+        " the bridge.  The other end must use --tstamp as well.")
 
     return parser
 
@@ -333,10 +443,10 @@ def main():
             outputs.append((parse_rule(rule), output))
 
         run_server(outputs=outputs, host=args.host, port=args.port,
-            quiet=args.q, max_rate=args.max_rate, run_once=args.run_once)
+            quiet=args.q, max_rate=args.max_rate, run_once=args.run_once, tstamp=args.tstamp)
     elif args.inputs is not None:
         run_client(inputs=args.inputs, host=args.host, port=args.port,
-            quiet=args.q, max_rate=args.max_rate)
+            quiet=args.q, max_rate=args.max_rate, tstamp=args.tstamp)
     else:
         raise ValueError("Must specify either --inputs or --outputs")
 
@@ -79,6 +79,69 @@ def binary_run(bin, args=None, stop_timeout=10, use_sigint=False,
     return p
 
 
+def parse_cpulist(cpulist):
+    """Converts a CPU list in the kernel's format (e.g. "0-3,8") to a list of ints."""
+
+    cpus = []
+
+    for part in cpulist.strip().split(','):
+        if part == '':
+            continue
+        if '-' in part:
+            first, last = part.split('-')
+            cpus += list(range(int(first), int(last) + 1))
+        else:
+            cpus.append(int(part))
+
+    return cpus
+
+
+def format_cpulist(cpus):
+    """Converts a collection of CPU numbers to the kernel's format, e.g. "0-3,8"."""
+
+    if isinstance(cpus, str):
+        return cpus
+
+    ranges = []
+
+    for cpu in sorted(set(cpus)):
+        if ranges and (ranges[-1][1] == cpu - 1):
+            ranges[-1][1] = cpu
+        else:
+            ranges.append([cpu, cpu])
+
+    return ','.join(str(a) if a == b else f'{a}-{b}' for a, b in ranges)
+
+
+def numa_nodes():
+    """Returns a dictionary mapping each NUMA node to a list of the CPUs on that
+    node that this process is allowed to run on.  Nodes without any such CPUs are
+    left out, and the dictionary is empty if the topology isn't available."""
+
+    from pathlib import Path
+
+    try:
+        import os
+        allowed = os.sched_getaffinity(0)
+    except (AttributeError, OSError):
+        return {}
+
+    nodes = {}
+
+    for path in Path('/sys/devices/system/node').glob('node[0-9]*'):
+        try:
+            cpus = parse_cpulist((path / 'cpulist').read_text())
+        except (OSError, ValueError):
+            continue
+
+        cpus = [cpu for cpu in cpus if cpu in allowed]
+
+        if cpus:
+            nodes[int(path.name[4:])] = cpus
+
+    return dict(sorted(nodes.items()))
+
+
 class ProcessCollection:
     def __init__(self):
         self.processes = []
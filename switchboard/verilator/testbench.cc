@@ -81,6 +81,21 @@ int main(int argc, char** argv, char** env) {
     // This needs to be called before you create any model
     contextp->commandArgs(argc, argv);
 
+    // optionally pin the simulation to a list of CPUs, e.g. +cpu=0-3, and
+    // set the NUMA placement of its queues, e.g. +numa=0 (see sbplace.h).
+    // this is done before the model is constructed, so that Verilator's
+    // worker threads inherit the affinity.
+
+    std::string cpus = extract_plusarg_value(contextp->commandArgsPlusMatch("cpu"), "cpu");
+    if (!cpus.empty() && !sb_set_affinity(cpus.c_str())) {
+        return 1;
+    }
+
+    std::string numa = extract_plusarg_value(contextp->commandArgsPlusMatch("numa"), "numa");
+    if (!numa.empty()) {
+        sb_numa_default() = sb_numa_parse(numa.c_str());
+    }
+
     // Construct the Verilated model, from Vtop.h generated from Verilating "top.v".
     // Using unique_ptr is similar to "Vtop* top = new Vtop" then deleting at end.
     // "TOP" will be the hierarchical name of the module.
@@ -91,13 +106,34 @@ int main(int argc, char** argv, char** env) {
     const char* period_match = contextp->commandArgsPlusMatch("period");
     parse_plusarg<double>(period_match, "period", period);
 
-    // parse the maximum simulation rate, if provided.  convert it to a target
-    // period in microseconds
+    // parse the maximum simulation rate, if provided, along with the number
+    // of cycles that may run back-to-back after a stall
 
     double max_rate = -1;
     const char* rate_match = contextp->commandArgsPlusMatch("max-rate");
     parse_plusarg<double>(rate_match, "max-rate", max_rate);
 
+    double rate_burst = 1;
+    const char* burst_match = contextp->commandArgsPlusMatch("rate-burst");
+    parse_plusarg<double>(burst_match, "rate-burst", rate_burst);
+
+    // optionally stamp outbound packets with the simulation cycle, and
+    // optionally release inbound packets only at their stamped cycle plus
+    // a fixed link latency (replay mode).  both have to be configured
+    // before the first eval(), which is when queues are opened.
+
+    int tstamp = 0;
+    const char* tstamp_match = contextp->commandArgsPlusMatch("tstamp");
+    parse_plusarg<int>(tstamp_match, "tstamp", tstamp);
+
+    long link_latency = -1;
+    const char* latency_match = contextp->commandArgsPlusMatch("link-latency");
+    parse_plusarg<long>(latency_match, "link-latency", link_latency);
+
+    sb_sim_clock& sim_clock = sb_sim_clock_get();
+    sim_clock.stamp = (tstamp != 0);
+    sim_clock.latency = link_latency;
+
     // convert the clock period an integer, scaling by the time precision
     uint64_t iperiod = std::round(period * std::pow(10.0, -1.0 * contextp->timeprecision()));
     uint64_t duration0 = iperiod / 2;
@@ -120,11 +156,11 @@ int main(int argc, char** argv, char** env) {
 
     // Main loop
 
-    long t_us = -1;
-    long min_period_us = (1.0e6 / max_rate) + 0.5;
+    sb_pacer pacer;
+    pacer.set_rate(max_rate, rate_burst);
 
     while (!(contextp->gotFinish() || got_sigint)) {
-        max_rate_tick(t_us, min_period_us);
+        pacer.tick();
 
         contextp->timeInc(duration0);
         top->clk = 1;
@@ -132,6 +168,8 @@ int main(int argc, char** argv, char** env) {
         contextp->timeInc(duration1);
         top->clk = 0;
         top->eval();
+
+        sim_clock.cycle++;
     }
 
     // Final model cleanup
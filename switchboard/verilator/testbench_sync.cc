@@ -53,6 +53,17 @@ int main(int argc, char** argv, char** env) {
     contextp->traceEverOn(true);
     contextp->commandArgs(argc, argv);
 
+    // pin before constructing the model, so that its threads inherit the
+    // affinity (see testbench.cc)
+    std::string cpus = get_plusarg_string(contextp.get(), "cpu");
+    if (!cpus.empty() && !sb_set_affinity(cpus.c_str())) {
+        return 1;
+    }
+    std::string numa = get_plusarg_string(contextp.get(), "numa");
+    if (!numa.empty()) {
+        sb_numa_default() = sb_numa_parse(numa.c_str());
+    }
+
     const std::unique_ptr<Vtestbench> top{new Vtestbench{contextp.get(), "TOP"}};
 
     double period = 10e-9;
@@ -68,6 +79,15 @@ int main(int argc, char** argv, char** env) {
     uint64_t max_cycles = 0;
     const char* cycles_match = contextp->commandArgsPlusMatch("max_cycles");
     parse_plusarg<uint64_t>(cycles_match, "max_cycles", max_cycles);
+    int tstamp = 0;
+    const char* tstamp_match = contextp->commandArgsPlusMatch("tstamp");
+    parse_plusarg<int>(tstamp_match, "tstamp", tstamp);
+    long link_latency = -1;
+    const char* latency_match = contextp->commandArgsPlusMatch("link-latency");
+    parse_plusarg<long>(latency_match, "link-latency", link_latency);
+    sb_sim_clock& sim_clock = sb_sim_clock_get();
+    sim_clock.stamp = (tstamp != 0);
+    sim_clock.latency = link_latency;
     uint64_t iperiod = std::round(period * std::pow(10.0, -1.0 * contextp->timeprecision()));
     uint64_t duration0 = iperiod / 2;
     uint64_t duration1 = iperiod - duration0;
@@ -120,6 +140,7 @@ int main(int argc, char** argv, char** env) {
         top->eval();
 
         cycle++;
+        sim_clock.cycle = cycle;
     }
     if (barrier) {
         barrier_close(barrier);
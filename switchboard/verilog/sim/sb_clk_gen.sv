@@ -35,8 +35,8 @@ module sb_clk_gen #(
         );
 
         import "DPI-C" function void pi_max_rate_tick (
-            inout signed [63:0] t_us,
-            input signed [63:0] min_period_us
+            inout signed [63:0] pacer,
+            input real max_rate
         );
     `endif
 
@@ -47,8 +47,8 @@ module sb_clk_gen #(
     real max_rate = DEFAULT_MAX_RATE;
     real start_delay = DEFAULT_START_DELAY;
 
-    reg signed [63:0] t_us = -(64'sd1);
-    reg signed [63:0] min_period_us = -(64'sd1);
+    // handle to the pacer kept by the DPI/VPI shim
+    reg signed [63:0] pacer = -(64'sd1);
 
     initial begin
         void'($value$plusargs("period=%f", period));
@@ -56,10 +56,6 @@ module sb_clk_gen #(
         void'($value$plusargs("start-delay=%f", start_delay));
 
         void'($value$plusargs("max-rate=%f", max_rate));
-
-        if (max_rate > 0) begin
-            min_period_us = 1.0e6 / max_rate;  // rounds according to LRM
-        end
     end
 
     // main clock generation code
@@ -71,7 +67,7 @@ module sb_clk_gen #(
         `SB_EXT_FUNC(pi_start_delay)(start_delay);
 
         forever begin
-            `SB_EXT_FUNC(pi_max_rate_tick)(t_us, min_period_us);
+            `SB_EXT_FUNC(pi_max_rate_tick)(pacer, max_rate);
 
             clk_r = 1'b0;
             `SB_DELAY((1.0 - duty_cycle) * period);
@@ -0,0 +1,140 @@
+// sb_signal_bank_sim
+
+// Connects wide, slowly-changing signals to shared-memory signal banks
+// (see signal_bank.h), as an alternative to umi_gpio when there are many
+// signals and few of them change at a time.  gpio_in is published to the
+// bank at IN_FILE, and gpio_out mirrors the bank at OUT_FILE, which is
+// written by the host.  the banks are checked on each clock edge, but only
+// the 32-bit words that changed are passed through DPI/VPI, and nothing is
+// passed at all on cycles where neither side changed.
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+`default_nettype none
+
+module sb_signal_bank_sim #(
+    parameter integer IWIDTH=32,
+    parameter integer OWIDTH=32,
+    parameter IN_FILE="",
+    parameter OUT_FILE=""
+) (
+    input clk,
+    input [IWIDTH-1:0] gpio_in,
+    output [OWIDTH-1:0] gpio_out
+);
+    // number of 32-bit words on each side
+    localparam integer IWORDS = (IWIDTH + 31) / 32;
+    localparam integer OWORDS = (OWIDTH + 31) / 32;
+
+    `ifdef __ICARUS__
+        `define SB_EXT_FUNC(x) $``x``
+        `define SB_START_FUNC task
+        `define SB_END_FUNC endtask
+    `else
+        `define SB_EXT_FUNC(x) x
+        `define SB_START_FUNC function void
+        `define SB_END_FUNC endfunction
+
+        import "DPI-C" function void pi_sb_bank_init(output int id,
+            input string uri, input int width);
+        import "DPI-C" function void pi_sb_bank_poll(input int id, output int changed);
+        import "DPI-C" function void pi_sb_bank_next(input int id, output int idx,
+            output int value);
+        import "DPI-C" function void pi_sb_bank_put(input int id, input int idx,
+            input int value);
+        import "DPI-C" function void pi_sb_bank_flush(input int id);
+    `endif
+
+    integer in_id = -1;
+    integer out_id = -1;
+
+    `SB_START_FUNC init(input string in_uri, input string out_uri);
+        /* verilator lint_off IGNOREDRETURN */
+        if (in_uri != "") begin
+            `SB_EXT_FUNC(pi_sb_bank_init)(in_id, in_uri, IWIDTH);
+        end
+        if (out_uri != "") begin
+            `SB_EXT_FUNC(pi_sb_bank_init)(out_id, out_uri, OWIDTH);
+        end
+        /* verilator lint_on IGNOREDRETURN */
+    `SB_END_FUNC
+
+    // both banks start out as zero
+
+    reg [32*IWORDS-1:0] in_padded;
+    reg [32*IWORDS-1:0] in_prev = 'b0;
+    reg [32*OWORDS-1:0] out_padded = 'b0;
+
+    always @(*) begin
+        in_padded = 'b0;
+        in_padded[IWIDTH-1:0] = gpio_in;
+    end
+
+    assign gpio_out = out_padded[OWIDTH-1:0];
+
+    integer i;
+    integer changed;
+    integer idx;
+    integer value;
+
+    always @(posedge clk) begin
+        /* verilator lint_off BLKSEQ */
+
+        // publish the words of gpio_in that changed, as one write
+
+        if ((in_id != -1) && (in_padded != in_prev)) begin
+            for (i = 0; i < IWORDS; i = i + 1) begin
+                if (in_padded[32*i +: 32] != in_prev[32*i +: 32]) begin
+                    /* verilator lint_off IGNOREDRETURN */
+                    `SB_EXT_FUNC(pi_sb_bank_put)(in_id, i, in_padded[32*i +: 32]);
+                    /* verilator lint_on IGNOREDRETURN */
+                end
+            end
+            /* verilator lint_off IGNOREDRETURN */
+            `SB_EXT_FUNC(pi_sb_bank_flush)(in_id);
+            /* verilator lint_on IGNOREDRETURN */
+            in_prev = in_padded;
+        end
+
+        // mirror the words of the host's bank that changed
+
+        if (out_id != -1) begin
+            /* verilator lint_off IGNOREDRETURN */
+            `SB_EXT_FUNC(pi_sb_bank_poll)(out_id, changed);
+            /* verilator lint_on IGNOREDRETURN */
+            if (changed != 0) begin
+                /* verilator lint_off IGNOREDRETURN */
+                `SB_EXT_FUNC(pi_sb_bank_next)(out_id, idx, value);
+                /* verilator lint_on IGNOREDRETURN */
+                while (idx != -1) begin
+                    out_padded[32*idx +: 32] <= value;
+                    /* verilator lint_off IGNOREDRETURN */
+                    `SB_EXT_FUNC(pi_sb_bank_next)(out_id, idx, value);
+                    /* verilator lint_on IGNOREDRETURN */
+                end
+            end
+        end
+
+        /* verilator lint_on BLKSEQ */
+    end
+
+    // initialize
+
+    initial begin
+        if ((IN_FILE != "") || (OUT_FILE != "")) begin
+            /* verilator lint_off IGNOREDRETURN */
+            init(IN_FILE, OUT_FILE);
+            /* verilator lint_on IGNOREDRETURN */
+        end
+    end
+
+    // clean up macros
+
+    `undef SB_EXT_FUNC
+    `undef SB_START_FUNC
+    `undef SB_END_FUNC
+
+endmodule
+
+`default_nettype wire
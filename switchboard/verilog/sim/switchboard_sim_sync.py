@@ -38,6 +38,7 @@ class SwitchboardSimSync(Design):
             "sb_axil_s.sv",
             "sb_clk_gen.sv",
             "sb_rx_sim.sv",
+            "sb_signal_bank_sim.sv",
             "sb_tx_sim.sv",
             "umi_rx_sim.sv",
             "umi_tx_sim.sv",
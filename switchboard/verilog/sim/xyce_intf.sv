@@ -35,6 +35,28 @@ module xyce_intf;
             input real t,
             output real value
         );
+        import "DPI-C" function void pi_sb_xyce_dac (
+            input int id,
+            input string name,
+            output int handle
+        );
+        import "DPI-C" function void pi_sb_xyce_adc (
+            input int id,
+            input string name,
+            output int handle
+        );
+        import "DPI-C" function void pi_sb_xyce_put_id (
+            input int id,
+            input int handle,
+            input real t,
+            input real value
+        );
+        import "DPI-C" function void pi_sb_xyce_get_id (
+            input int id,
+            input int handle,
+            input real t,
+            output real value
+        );
     `endif
 
     integer id = -1;
@@ -57,6 +79,33 @@ module xyce_intf;
         /* verilator lint_on IGNOREDRETURN */
     `SB_END_FUNC
 
+    // dac() and adc() look up the handle of a signal once, after init(),
+    // so that put_id() and get_id() don't pass strings on every call
+
+   `SB_START_FUNC dac(input string name, output int handle);
+        /* verilator lint_off IGNOREDRETURN */
+        `SB_EXT_FUNC(pi_sb_xyce_dac)(id, name, handle);
+        /* verilator lint_on IGNOREDRETURN */
+    `SB_END_FUNC
+
+   `SB_START_FUNC adc(input string name, output int handle);
+        /* verilator lint_off IGNOREDRETURN */
+        `SB_EXT_FUNC(pi_sb_xyce_adc)(id, name, handle);
+        /* verilator lint_on IGNOREDRETURN */
+    `SB_END_FUNC
+
+   `SB_START_FUNC put_id(input int handle, input real value);
+        /* verilator lint_off IGNOREDRETURN */
+        `SB_EXT_FUNC(pi_sb_xyce_put_id)(id, handle, `SB_ABSTIME, value);
+        /* verilator lint_on IGNOREDRETURN */
+    `SB_END_FUNC
+
+   `SB_START_FUNC get_id(input int handle, output real value);
+        /* verilator lint_off IGNOREDRETURN */
+        `SB_EXT_FUNC(pi_sb_xyce_get_id)(id, handle, `SB_ABSTIME, value);
+        /* verilator lint_on IGNOREDRETURN */
+    `SB_END_FUNC
+
     // clean up macros
 
     `undef SB_EXT_FUNC
@@ -5,6 +5,7 @@
 #include <memory>
 #include <vector>
 
+#include "signal_bank.hpp"
 #include "switchboard.hpp"
 
 #include <vpi_user.h>
@@ -13,6 +14,8 @@ static std::vector<std::unique_ptr<SBRX>> rxconn;
 static std::vector<std::unique_ptr<SBTX>> txconn;
 static std::vector<int> rxwidth;
 static std::vector<int> txwidth;
+static std::vector<std::unique_ptr<SBSignalBank>> banks;
+static sb_pacer_table pacers;
 static std::chrono::steady_clock::time_point start_time;
 
 PLI_INT32 pi_sb_rx_init(PLI_BYTE8* userdata) {
@@ -355,16 +358,16 @@ PLI_INT32 pi_max_rate_tick(PLI_BYTE8* userdata) {
         }
     }
 
-    // get the timestamp
-    long t_us = 0;
+    // get the handle of the pacer
+    long pacer = 0;
     {
         t_vpi_value argval;
         argval.format = vpiVectorVal;
         vpi_get_value(argh[0], &argval);
 
-        t_us |= argval.value.vector[1].aval & 0xffffffff;
-        t_us <<= 32;
-        t_us |= argval.value.vector[0].aval & 0xffffffff;
+        pacer |= argval.value.vector[1].aval & 0xffffffff;
+        pacer <<= 32;
+        pacer |= argval.value.vector[0].aval & 0xffffffff;
     }
 
     // get max rate
@@ -377,19 +380,19 @@ PLI_INT32 pi_max_rate_tick(PLI_BYTE8* userdata) {
     }
 
     // call the underlying switchboard function
-    max_rate_tick(t_us, max_rate);
+    pacers.tick(pacer, max_rate);
 
-    // set the timestamp
+    // store the handle, which is assigned on the first call
     {
         t_vpi_value argval;
         argval.format = vpiVectorVal;
         s_vpi_vecval vecval[2]; // two 32-bit words
         argval.value.vector = vecval;
 
-        argval.value.vector[0].aval = t_us & 0xffffffff;
+        argval.value.vector[0].aval = pacer & 0xffffffff;
         argval.value.vector[0].bval = 0;
 
-        argval.value.vector[1].aval = (t_us >> 32) & 0xffffffff;
+        argval.value.vector[1].aval = (pacer >> 32) & 0xffffffff;
         argval.value.vector[1].bval = 0;
 
         vpi_put_value(argh[0], &argval, NULL, vpiNoDelay);
@@ -402,6 +405,103 @@ PLI_INT32 pi_max_rate_tick(PLI_BYTE8* userdata) {
     return 0;
 }
 
+// signal banks are exchanged 32 bits at a time, and only the words that
+// changed are passed in either direction.  all of their arguments are
+// integers or strings, so these helpers keep the tasks short.
+
+static std::vector<vpiHandle> get_args(size_t n) {
+    std::vector<vpiHandle> argh;
+
+    vpiHandle systfref = vpi_handle(vpiSysTfCall, NULL);
+    vpiHandle args_iter = vpi_iterate(vpiArgument, systfref);
+    for (size_t i = 0; i < n; i++) {
+        argh.push_back(vpi_scan(args_iter));
+    }
+    vpi_free_object(args_iter);
+
+    return argh;
+}
+
+static int get_int_arg(vpiHandle h) {
+    t_vpi_value argval;
+    argval.format = vpiIntVal;
+    vpi_get_value(h, &argval);
+    return argval.value.integer;
+}
+
+static void put_int_arg(vpiHandle h, int value) {
+    t_vpi_value argval;
+    argval.format = vpiIntVal;
+    argval.value.integer = value;
+    vpi_put_value(h, &argval, NULL, vpiNoDelay);
+}
+
+PLI_INT32 pi_sb_bank_init(PLI_BYTE8* userdata) {
+    (void)userdata; // unused
+
+    std::vector<vpiHandle> argh = get_args(3);
+
+    // get uri
+    std::string uri;
+    {
+        t_vpi_value argval;
+        argval.format = vpiStringVal;
+        vpi_get_value(argh[1], &argval);
+        uri = std::string(argval.value.str);
+    }
+
+    banks.push_back(std::unique_ptr<SBSignalBank>(new SBSignalBank()));
+    banks.back()->init(uri, get_int_arg(argh[2]));
+
+    put_int_arg(argh[0], banks.size() - 1);
+
+    return 0;
+}
+
+PLI_INT32 pi_sb_bank_poll(PLI_BYTE8* userdata) {
+    (void)userdata; // unused
+
+    std::vector<vpiHandle> argh = get_args(2);
+    put_int_arg(argh[1], banks[get_int_arg(argh[0])]->poll() ? 1 : 0);
+
+    return 0;
+}
+
+PLI_INT32 pi_sb_bank_next(PLI_BYTE8* userdata) {
+    (void)userdata; // unused
+
+    std::vector<vpiHandle> argh = get_args(3);
+
+    int idx;
+    uint32_t value;
+    if (banks[get_int_arg(argh[0])]->next(idx, value)) {
+        put_int_arg(argh[1], idx);
+        put_int_arg(argh[2], value);
+    } else {
+        put_int_arg(argh[1], -1);
+    }
+
+    return 0;
+}
+
+PLI_INT32 pi_sb_bank_put(PLI_BYTE8* userdata) {
+    (void)userdata; // unused
+
+    std::vector<vpiHandle> argh = get_args(3);
+    banks[get_int_arg(argh[0])]->put(get_int_arg(argh[1]), get_int_arg(argh[2]));
+
+    return 0;
+}
+
+PLI_INT32 pi_sb_bank_flush(PLI_BYTE8* userdata) {
+    (void)userdata; // unused
+
+    std::vector<vpiHandle> argh = get_args(1);
+    banks[get_int_arg(argh[0])]->flush();
+
+    return 0;
+}
+
 // macro that creates a function to register PLI functions
 
 #define VPI_REGISTER_FUNC_NAME(name) register_##name
@@ -421,11 +521,18 @@ VPI_REGISTER_FUNC(pi_sb_send)
 VPI_REGISTER_FUNC(pi_time_taken)
 VPI_REGISTER_FUNC(pi_start_delay)
 VPI_REGISTER_FUNC(pi_max_rate_tick)
+VPI_REGISTER_FUNC(pi_sb_bank_init)
+VPI_REGISTER_FUNC(pi_sb_bank_poll)
+VPI_REGISTER_FUNC(pi_sb_bank_next)
+VPI_REGISTER_FUNC(pi_sb_bank_put)
+VPI_REGISTER_FUNC(pi_sb_bank_flush)
 
 void (*vlog_startup_routines[])(void) = {
     VPI_REGISTER_FUNC_NAME(pi_sb_rx_init), VPI_REGISTER_FUNC_NAME(pi_sb_tx_init),
     VPI_REGISTER_FUNC_NAME(pi_sb_recv), VPI_REGISTER_FUNC_NAME(pi_sb_send),
     VPI_REGISTER_FUNC_NAME(pi_time_taken), VPI_REGISTER_FUNC_NAME(pi_start_delay),
-    VPI_REGISTER_FUNC_NAME(pi_max_rate_tick),
+    VPI_REGISTER_FUNC_NAME(pi_max_rate_tick), VPI_REGISTER_FUNC_NAME(pi_sb_bank_init),
+    VPI_REGISTER_FUNC_NAME(pi_sb_bank_poll), VPI_REGISTER_FUNC_NAME(pi_sb_bank_next),
+    VPI_REGISTER_FUNC_NAME(pi_sb_bank_put), VPI_REGISTER_FUNC_NAME(pi_sb_bank_flush),
     0 // last entry must be 0
 };
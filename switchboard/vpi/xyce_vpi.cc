@@ -14,164 +14,153 @@
 
 static std::vector<std::unique_ptr<XyceIntf>> xyceIntfs;
 
-PLI_INT32 pi_sb_xyce_init(PLI_BYTE8* userdata) {
-    (void)userdata; // unused
-
-    // get arguments
-    vpiHandle args_iter;
-    std::vector<vpiHandle> argh;
-    {
-        vpiHandle systfref;
-        systfref = vpi_handle(vpiSysTfCall, NULL);
-        args_iter = vpi_iterate(vpiArgument, systfref);
-        for (size_t i = 0; i < 2; i++) {
-            argh.push_back(vpi_scan(args_iter));
+// returns the argument handles of the system task being called.  they are
+// looked up on the first call from each call site, and then cached on the
+// call handle, so that later calls don't have to iterate over them again.
+
+static std::vector<vpiHandle>& get_args() {
+    vpiHandle systfref = vpi_handle(vpiSysTfCall, NULL);
+
+    std::vector<vpiHandle>* argh = (std::vector<vpiHandle>*)vpi_get_userdata(systfref);
+
+    if (!argh) {
+        // intentionally never freed, since call sites live as long as the
+        // simulation
+        argh = new std::vector<vpiHandle>();
+
+        vpiHandle args_iter = vpi_iterate(vpiArgument, systfref);
+        if (args_iter) {
+            // vpi_scan() frees the iterator when it returns NULL
+            while (vpiHandle arg = vpi_scan(args_iter)) {
+                argh->push_back(arg);
+            }
         }
-    }
 
-    // get file
-    std::string file;
-    {
-        t_vpi_value argval;
-        argval.format = vpiStringVal;
-        vpi_get_value(argh[1], &argval);
-        file = std::string(argval.value.str);
+        vpi_put_userdata(systfref, argh);
     }
 
+    return *argh;
+}
+
+// typed accessors for arguments
+
+static int get_int(vpiHandle h) {
+    t_vpi_value argval;
+    argval.format = vpiIntVal;
+    vpi_get_value(h, &argval);
+    return argval.value.integer;
+}
+
+static double get_real(vpiHandle h) {
+    t_vpi_value argval;
+    argval.format = vpiRealVal;
+    vpi_get_value(h, &argval);
+    return argval.value.real;
+}
+
+static std::string get_string(vpiHandle h) {
+    t_vpi_value argval;
+    argval.format = vpiStringVal;
+    vpi_get_value(h, &argval);
+    return std::string(argval.value.str);
+}
+
+static void put_int(vpiHandle h, int value) {
+    t_vpi_value argval;
+    argval.format = vpiIntVal;
+    argval.value.integer = value;
+    vpi_put_value(h, &argval, NULL, vpiNoDelay);
+}
+
+static void put_real(vpiHandle h, double value) {
+    t_vpi_value argval;
+    argval.format = vpiRealVal;
+    argval.value.real = value;
+    vpi_put_value(h, &argval, NULL, vpiNoDelay);
+}
+
+PLI_INT32 pi_sb_xyce_init(PLI_BYTE8* userdata) {
+    (void)userdata; // unused
+
+    std::vector<vpiHandle>& argh = get_args();
+
     xyceIntfs.push_back(std::unique_ptr<XyceIntf>(new XyceIntf()));
-    xyceIntfs.back()->init(file);
+    xyceIntfs.back()->init(get_string(argh[1]));
 
     // put ID
-    {
-        t_vpi_value argval;
-        argval.format = vpiIntVal;
-        argval.value.integer = xyceIntfs.size() - 1;
-        vpi_put_value(argh[0], &argval, NULL, vpiNoDelay);
-    }
-
-    // clean up
-    vpi_free_object(args_iter);
+    put_int(argh[0], xyceIntfs.size() - 1);
 
     // return value unused?
     return 0;
 }
 
-PLI_INT32 pi_sb_xyce_put(PLI_BYTE8* userdata) {
+// $pi_sb_xyce_dac(id, name, handle) and $pi_sb_xyce_adc(id, name, handle)
+// resolve a signal name to a handle once, so that the put_id/get_id tasks
+// called every cycle only have to pass numbers
+
+PLI_INT32 pi_sb_xyce_dac(PLI_BYTE8* userdata) {
     (void)userdata; // unused
 
-    // get arguments
-    vpiHandle args_iter;
-    std::vector<vpiHandle> argh;
-    {
-        vpiHandle systfref;
-        systfref = vpi_handle(vpiSysTfCall, NULL);
-        args_iter = vpi_iterate(vpiArgument, systfref);
-        for (size_t i = 0; i < 4; i++) {
-            argh.push_back(vpi_scan(args_iter));
-        }
-    }
+    std::vector<vpiHandle>& argh = get_args();
+    int id = get_int(argh[0]);
+    put_int(argh[2], xyceIntfs[id]->dac(get_string(argh[1])));
 
-    // get ID
-    int id;
-    {
-        t_vpi_value argval;
-        argval.format = vpiIntVal;
-        vpi_get_value(argh[0], &argval);
-        id = argval.value.integer;
-    }
+    return 0;
+}
 
-    // get name
-    std::string name;
-    {
-        t_vpi_value argval;
-        argval.format = vpiStringVal;
-        vpi_get_value(argh[1], &argval);
-        name = std::string(argval.value.str);
-    }
+PLI_INT32 pi_sb_xyce_adc(PLI_BYTE8* userdata) {
+    (void)userdata; // unused
 
-    // get time
-    double time;
-    {
-        t_vpi_value argval;
-        argval.format = vpiRealVal;
-        vpi_get_value(argh[2], &argval);
-        time = argval.value.real;
-    }
+    std::vector<vpiHandle>& argh = get_args();
+    int id = get_int(argh[0]);
+    put_int(argh[2], xyceIntfs[id]->adc(get_string(argh[1])));
 
-    // get value
-    double value;
-    {
-        t_vpi_value argval;
-        argval.format = vpiRealVal;
-        vpi_get_value(argh[3], &argval);
-        value = argval.value.real;
-    }
+    return 0;
+}
 
-    xyceIntfs[id]->put(name, time, value);
+PLI_INT32 pi_sb_xyce_put_id(PLI_BYTE8* userdata) {
+    (void)userdata; // unused
 
-    // clean up
-    vpi_free_object(args_iter);
+    std::vector<vpiHandle>& argh = get_args();
+    int id = get_int(argh[0]);
+    xyceIntfs[id]->put(get_int(argh[1]), get_real(argh[2]), get_real(argh[3]));
 
-    // return value unused?
     return 0;
 }
 
-PLI_INT32 pi_sb_xyce_get(PLI_BYTE8* userdata) {
+PLI_INT32 pi_sb_xyce_get_id(PLI_BYTE8* userdata) {
     (void)userdata; // unused
 
-    // get arguments
-    vpiHandle args_iter;
-    std::vector<vpiHandle> argh;
-    {
-        vpiHandle systfref;
-        systfref = vpi_handle(vpiSysTfCall, NULL);
-        args_iter = vpi_iterate(vpiArgument, systfref);
-        for (size_t i = 0; i < 4; i++) {
-            argh.push_back(vpi_scan(args_iter));
-        }
-    }
+    std::vector<vpiHandle>& argh = get_args();
+    int id = get_int(argh[0]);
 
-    // get ID
-    int id;
-    {
-        t_vpi_value argval;
-        argval.format = vpiIntVal;
-        vpi_get_value(argh[0], &argval);
-        id = argval.value.integer;
-    }
+    double value;
+    xyceIntfs[id]->get(get_int(argh[1]), get_real(argh[2]), &value);
+    put_real(argh[3], value);
 
-    // get name
-    std::string name;
-    {
-        t_vpi_value argval;
-        argval.format = vpiStringVal;
-        vpi_get_value(argh[1], &argval);
-        name = std::string(argval.value.str);
-    }
+    return 0;
+}
 
-    // get time
-    double time;
-    {
-        t_vpi_value argval;
-        argval.format = vpiRealVal;
-        vpi_get_value(argh[2], &argval);
-        time = argval.value.real;
-    }
+PLI_INT32 pi_sb_xyce_put(PLI_BYTE8* userdata) {
+    (void)userdata; // unused
 
-    // get value
-    double value;
-    xyceIntfs[id]->get(name, time, &value);
-
-    // put value
-    {
-        t_vpi_value argval;
-        argval.format = vpiRealVal;
-        argval.value.real = value;
-        vpi_put_value(argh[3], &argval, NULL, vpiNoDelay);
-    }
+    std::vector<vpiHandle>& argh = get_args();
+    int id = get_int(argh[0]);
+    xyceIntfs[id]->put(get_string(argh[1]), get_real(argh[2]), get_real(argh[3]));
 
-    // clean up
-    vpi_free_object(args_iter);
+    // return value unused?
+    return 0;
+}
+
+PLI_INT32 pi_sb_xyce_get(PLI_BYTE8* userdata) {
+    (void)userdata; // unused
+
+    std::vector<vpiHandle>& argh = get_args();
+    int id = get_int(argh[0]);
+
+    double value;
+    xyceIntfs[id]->get(get_string(argh[1]), get_real(argh[2]), &value);
+    put_real(argh[3], value);
 
     // return value unused?
     return 0;
@@ -192,9 +181,15 @@ PLI_INT32 pi_sb_xyce_get(PLI_BYTE8* userdata) {
 VPI_REGISTER_FUNC(pi_sb_xyce_init)
 VPI_REGISTER_FUNC(pi_sb_xyce_put)
 VPI_REGISTER_FUNC(pi_sb_xyce_get)
+VPI_REGISTER_FUNC(pi_sb_xyce_dac)
+VPI_REGISTER_FUNC(pi_sb_xyce_adc)
+VPI_REGISTER_FUNC(pi_sb_xyce_put_id)
+VPI_REGISTER_FUNC(pi_sb_xyce_get_id)
 
 void (*vlog_startup_routines[])(void) = {
     VPI_REGISTER_FUNC_NAME(pi_sb_xyce_init), VPI_REGISTER_FUNC_NAME(pi_sb_xyce_put),
-    VPI_REGISTER_FUNC_NAME(pi_sb_xyce_get),
+    VPI_REGISTER_FUNC_NAME(pi_sb_xyce_get), VPI_REGISTER_FUNC_NAME(pi_sb_xyce_dac),
+    VPI_REGISTER_FUNC_NAME(pi_sb_xyce_adc), VPI_REGISTER_FUNC_NAME(pi_sb_xyce_put_id),
+    VPI_REGISTER_FUNC_NAME(pi_sb_xyce_get_id),
     0 // last entry must be 0
 };
@@ -0,0 +1,223 @@
+// Exercises the native AXI / AXI-Lite master against a memory model
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "axisb.hpp"
+
+#define MEM_BITS 16
+#define ID_WIDTH 4
+#define NUM_IDS 4
+#define ITERATIONS 200
+
+static void fail(const char* msg) {
+    fprintf(stderr, "FAIL: %s\n", msg);
+    exit(1);
+}
+
+// subordinate side of the five queues, backed by a byte array.  read
+// bursts for different IDs are answered with their beats interleaved.
+class AxiMemory {
+  public:
+    AxiMemory(std::string uri, uint32_t data_bytes, bool lite)
+        : m_mem(1 << MEM_BITS, 0), m_data_bytes(data_bytes), m_lite(lite), m_done(false) {
+        m_aw.init(uri + "-aw.q");
+        m_w.init(uri + "-w.q");
+        m_b.init(uri + "-b.q");
+        m_ar.init(uri + "-ar.q");
+        m_r.init(uri + "-r.q");
+        m_thread = std::thread(&AxiMemory::run, this);
+    }
+
+    ~AxiMemory() {
+        m_done = true;
+        m_thread.join();
+    }
+
+    std::vector<uint8_t> m_mem;
+
+  private:
+    struct Burst {
+        uint64_t addr;
+        uint32_t id;
+        uint32_t beats;
+        uint32_t size;
+    };
+
+    Burst unpack_addr(sb_packet& p) {
+        Burst b;
+        uint32_t pos = 0;
+        b.addr = axisb_get(p.data, pos, MEM_BITS);
+        axisb_get(p.data, pos, 3);
+        if (m_lite) {
+            b.id = 0;
+            b.beats = 1;
+            b.size = __builtin_ctz(m_data_bytes);
+        } else {
+            b.id = axisb_get(p.data, pos, ID_WIDTH);
+            b.beats = axisb_get(p.data, pos, 8) + 1;
+            b.size = axisb_get(p.data, pos, 3);
+        }
+        return b;
+    }
+
+    void run() {
+        std::deque<Burst> reads;
+        bool have_write = false;
+        Burst wr;
+        sb_packet p;
+
+        while (!m_done) {
+            bool progress = false;
+
+            if (!have_write && m_aw.recv(p)) {
+                progress = true;
+                wr = unpack_addr(p);
+                have_write = true;
+            }
+
+            if (have_write && m_w.recv(p)) {
+                progress = true;
+                uint32_t pos = 8 * m_data_bytes;
+                uint64_t strb = axisb_get(p.data, pos, m_data_bytes);
+                for (uint32_t j = 0; j < (1u << wr.size); j++) {
+                    if ((strb >> j) & 1) {
+                        m_mem[wr.addr + j] = p.data[j];
+                    }
+                }
+                wr.addr += 1 << wr.size;
+
+                if (--wr.beats == 0) {
+                    sb_packet b;
+                    memset(&b, 0, sizeof(b));
+                    pos = 0;
+                    axisb_put(b.data, pos, AXI_RESP_OKAY, 2);
+                    axisb_put(b.data, pos, wr.id, m_lite ? 0 : ID_WIDTH);
+                    while (!m_b.send(b)) {
+                        std::this_thread::yield();
+                    }
+                    have_write = false;
+                }
+            }
+
+            if (m_ar.recv(p)) {
+                reads.push_back(unpack_addr(p));
+            }
+
+            if (reads.empty()) {
+                if (!progress) {
+                    std::this_thread::yield();
+                }
+            } else {
+                // answer a beat of a random ID's oldest burst
+                size_t k = rand() % reads.size();
+                for (size_t i = 0; i < k; i++) {
+                    if (reads[i].id == reads[k].id) {
+                        k = i;
+                        break;
+                    }
+                }
+
+                Burst& rd = reads[k];
+                sb_packet r;
+                memset(&r, 0, sizeof(r));
+                memcpy(r.data, &m_mem[rd.addr], 1 << rd.size);
+                uint32_t pos = 8 * m_data_bytes;
+                axisb_put(r.data, pos, AXI_RESP_OKAY, 2);
+                if (!m_lite) {
+                    axisb_put(r.data, pos, rd.id, ID_WIDTH);
+                    axisb_put(r.data, pos, rd.beats == 1 ? 1 : 0, 1);
+                }
+                while (!m_r.send(r)) {
+                    std::this_thread::yield();
+                }
+
+                rd.addr += 1 << rd.size;
+                if (--rd.beats == 0) {
+                    reads.erase(reads.begin() + k);
+                }
+            }
+        }
+    }
+
+    SBRX m_aw;
+    SBRX m_w;
+    SBTX m_b;
+    SBRX m_ar;
+    SBTX m_r;
+
+    uint32_t m_data_bytes;
+    bool m_lite;
+    std::atomic<bool> m_done;
+    std::thread m_thread;
+};
+
+// writes random data to random addresses and reads it back, checking
+// against a local copy of the memory
+static void check(uint32_t data_width, bool lite, uint32_t max_beats) {
+    printf("axi: data_width=%u lite=%d max_beats=%u\n", data_width, lite, max_beats);
+
+    std::string uri = lite ? "axi-test-lite" : "axi-test";
+    const char* names[] = {"-aw.q", "-w.q", "-b.q", "-ar.q", "-r.q"};
+    for (const char* name : names) {
+        delete_shared_queue(uri + name);
+    }
+
+    AxiMaster axi(uri, ".q", true, -1, data_width, MEM_BITS, ID_WIDTH, lite);
+    AxiMemory mem(uri, data_width / 8, lite);
+    std::vector<uint8_t> model(1 << MEM_BITS, 0);
+
+    for (int i = 0; i < ITERATIONS; i++) {
+        uint64_t addr = rand() % (1 << MEM_BITS);
+        size_t nbytes = 1 + rand() % std::min((size_t)(3 * AXI_BOUNDARY), model.size() - addr);
+
+        std::vector<uint8_t> data(nbytes);
+        for (size_t j = 0; j < nbytes; j++) {
+            data[j] = rand();
+        }
+
+        if (axi.write(addr, data.data(), nbytes, 0, 0, NUM_IDS, -1, max_beats) !=
+            AXI_RESP_OKAY) {
+            fail("unexpected write response");
+        }
+        memcpy(&model[addr], data.data(), nbytes);
+
+        addr = rand() % (1 << MEM_BITS);
+        nbytes = 1 + rand() % std::min((size_t)(3 * AXI_BOUNDARY), model.size() - addr);
+        data.resize(nbytes);
+        if (axi.read(addr, data.data(), nbytes, 0, 0, NUM_IDS, -1, max_beats) != AXI_RESP_OKAY) {
+            fail("unexpected read response");
+        }
+        if (memcmp(data.data(), &model[addr], nbytes) != 0) {
+            fail("read data mismatch");
+        }
+    }
+
+    if (mem.m_mem != model) {
+        fail("memory contents mismatch");
+    }
+
+    for (const char* name : names) {
+        delete_shared_queue(uri + name);
+    }
+}
+
+int main() {
+    srand(0);
+
+    check(32, false, 256);
+    check(64, false, 16);
+    check(32, true, 1);
+
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,687 @@
+// Switchboard benchmark suite
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// Sweeps a matrix of configurations over the switchboard building blocks and
+// reports throughput and latency percentiles as JSON.  Usage:
+//
+//   bench.out [--bench spsc,sbtxrx,router,umisb,barrier] [--sizes 8,60]
+//       [--capacities 62,1024] [--batches 1,16,0] [--placements same,smt,core,socket]
+//       [--policies spin,yield] [--iterations n] [--router path] [--out file]
+//
+// Benchmarks:
+//   spsc     raw spsc_send()/spsc_recv() with packets of --sizes bytes
+//   sbtxrx   SBTX::send()/SBRX::recv()
+//   router   SBTX -> router process -> SBRX (needs --router)
+//   umisb    umisb_send()/umisb_recv() write request/response round trips,
+//            with --sizes bytes of write data
+//   barrier  barrier_wait() between two threads
+//
+// For the streaming benchmarks (spsc, sbtxrx, router), the producer sends
+// --batches packets back to back and then waits for the consumer to drain
+// them, so a batch of 1 measures unloaded one-way latency and larger
+// batches measure latency under load.  A batch of 0 streams without waiting.
+// Latency is taken from a timestamp carried in each packet, so both ends run
+// as threads of this process.
+//
+// Placements pin the two ends to the same CPU, SMT siblings, different cores
+// on one socket, or different sockets; placements that this machine can't
+// provide are reported as skipped.  Policies control what an end does while
+// its queue is full or empty: "spin" busy-polls, "yield" gives up the CPU.
+
+#include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "barrier_sync.h"
+#include "switchboard.hpp"
+#include "tsc.h"
+#include "umisb.hpp"
+
+// log-linear histogram: values below 2^HIST_SUB_BITS are counted exactly, and
+// each power of two above that is split into 2^HIST_SUB_BITS buckets
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB_COUNT)
+
+static inline int hist_index(uint64_t v) {
+    if (v < HIST_SUB_COUNT) {
+        return v;
+    }
+    int shift = (63 - __builtin_clzll(v)) - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + ((v >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+static inline uint64_t hist_value(int idx) {
+    if (idx < HIST_SUB_COUNT) {
+        return idx;
+    }
+    int shift = (idx >> HIST_SUB_BITS) - 1;
+    return ((uint64_t)(HIST_SUB_COUNT | (idx & (HIST_SUB_COUNT - 1)))) << shift;
+}
+
+struct histogram {
+    histogram() : counts(HIST_BUCKETS, 0), total(0), min(UINT64_MAX), max(0) {}
+
+    void add(uint64_t v) {
+        counts[hist_index(v)]++;
+        total++;
+        min = std::min(min, v);
+        max = std::max(max, v);
+    }
+
+    // lower bound of the bucket holding the given percentile
+    uint64_t percentile(double p) {
+        uint64_t target = (uint64_t)(p * 0.01 * total);
+        uint64_t seen = 0;
+        for (int i = 0; i < HIST_BUCKETS; i++) {
+            seen += counts[i];
+            if (seen > target) {
+                return hist_value(i);
+            }
+        }
+        return max;
+    }
+
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+};
+
+struct bench_config {
+    std::string bench;
+    int size;
+    int capacity;
+    int batch;
+    std::string placement;
+    std::string policy;
+    long iterations;
+};
+
+struct bench_result {
+    bool skipped;
+    std::string note;
+    long count;
+    uint64_t ticks;
+    histogram hist; // in ticks
+};
+
+static std::string router_path = "";
+static double ns_per_tick = 1.0;
+
+// CPU placement
+
+static int read_topology(int cpu, const char* field) {
+    char path[128];
+    snprintf(path, sizeof path, "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, field);
+
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+
+    int value = -1;
+    if (fscanf(f, "%d", &value) != 1) {
+        value = -1;
+    }
+    fclose(f);
+
+    return value;
+}
+
+// Picks a pair of CPUs for the given placement, returning false if this
+// machine (or our affinity mask) doesn't provide one.
+static bool placement_cpus(const std::string& placement, int& a, int& b) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof set, &set) != 0) {
+        return false;
+    }
+
+    std::vector<int> cpus;
+    for (int i = 0; i < CPU_SETSIZE; i++) {
+        if (CPU_ISSET(i, &set)) {
+            cpus.push_back(i);
+        }
+    }
+
+    if (cpus.empty()) {
+        return false;
+    }
+
+    a = cpus[0];
+    if (placement == "same") {
+        b = a;
+        return true;
+    }
+
+    int core_a = read_topology(a, "core_id");
+    int pkg_a = read_topology(a, "physical_package_id");
+
+    for (size_t i = 1; i < cpus.size(); i++) {
+        int core = read_topology(cpus[i], "core_id");
+        int pkg = read_topology(cpus[i], "physical_package_id");
+
+        bool match = false;
+        if (placement == "smt") {
+            match = (pkg == pkg_a) && (core == core_a);
+        } else if (placement == "core") {
+            match = (pkg == pkg_a) && (core != core_a);
+        } else if (placement == "socket") {
+            match = (pkg != pkg_a);
+        }
+
+        if (match) {
+            b = cpus[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void pin_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+}
+
+static bool spin_policy = true;
+
+static inline void poll_wait() {
+    if (!spin_policy) {
+        std::this_thread::yield();
+    }
+}
+
+static void poll_wait_loop(void) {
+    poll_wait();
+}
+
+// streaming benchmarks: both ends are wrapped in a small interface so
+// that the same producer/consumer loop drives each of them
+
+struct stream_endpoints {
+    virtual ~stream_endpoints() {}
+    virtual bool send(uint64_t stamp) = 0;
+    virtual bool recv(uint64_t& stamp) = 0;
+};
+
+struct spsc_endpoints : stream_endpoints {
+    spsc_endpoints(const char* name, int capacity, int size) : size(size) {
+        spsc_remove_shmfile(name);
+        q = spsc_open(name, capacity);
+        memset(buf, 0, sizeof buf);
+    }
+
+    ~spsc_endpoints() {
+        spsc_remove_shmfile(q->name);
+        spsc_close(q);
+    }
+
+    bool send(uint64_t stamp) {
+        memcpy(buf, &stamp, sizeof stamp);
+        return spsc_send(q, buf, size);
+    }
+
+    bool recv(uint64_t& stamp) {
+        if (!spsc_recv(q, buf_rx, size)) {
+            return false;
+        }
+        memcpy(&stamp, buf_rx, sizeof stamp);
+        return true;
+    }
+
+    spsc_queue* q;
+    int size;
+    uint8_t buf[SPSC_QUEUE_MAX_PACKET_SIZE];
+    uint8_t buf_rx[SPSC_QUEUE_MAX_PACKET_SIZE];
+};
+
+struct sb_endpoints : stream_endpoints {
+    sb_endpoints(std::string tx_uri, std::string rx_uri, int capacity) {
+        tx.init(tx_uri, capacity, true);
+        rx.init(rx_uri, capacity, tx_uri != rx_uri);
+        memset(&p, 0, sizeof p);
+    }
+
+    bool send(uint64_t stamp) {
+        memcpy(p.data, &stamp, sizeof stamp);
+        return tx.send(p);
+    }
+
+    bool recv(uint64_t& stamp) {
+        if (!rx.recv(p_rx)) {
+            return false;
+        }
+        memcpy(&stamp, p_rx.data, sizeof stamp);
+        return true;
+    }
+
+    SBTX tx;
+    SBRX rx;
+    sb_packet p;
+    sb_packet p_rx;
+};
+
+static void run_stream(stream_endpoints& ep, const bench_config& cfg, int cpu_tx, int cpu_rx,
+    bench_result& res) {
+
+    std::atomic<long> consumed(0);
+
+    std::thread consumer([&]() {
+        pin_thread(cpu_rx);
+        uint64_t stamp;
+        long count = 0;
+        while (count < cfg.iterations) {
+            if (ep.recv(stamp)) {
+                res.hist.add(tsc_read() - stamp);
+                count++;
+                consumed.store(count, std::memory_order_release);
+            } else {
+                poll_wait();
+            }
+        }
+    });
+
+    pin_thread(cpu_tx);
+    uint64_t start = tsc_read();
+
+    for (long i = 0; i < cfg.iterations; i++) {
+        if ((cfg.batch > 0) && (i > 0) && ((i % cfg.batch) == 0)) {
+            while (consumed.load(std::memory_order_acquire) < i) {
+                poll_wait();
+            }
+        }
+        while (!ep.send(tsc_read())) {
+            poll_wait();
+        }
+    }
+
+    consumer.join();
+
+    res.ticks = tsc_read() - start;
+    res.count = cfg.iterations;
+}
+
+static std::string unique_name(const char* kind, int n) {
+    std::ostringstream oss;
+    oss << "queue-bench-" << kind << "-" << getpid() << "-" << n;
+    return oss.str();
+}
+
+static void bench_spsc(const bench_config& cfg, int cpu_tx, int cpu_rx, bench_result& res) {
+    spsc_endpoints ep(unique_name("spsc", 0).c_str(), cfg.capacity, cfg.size);
+    run_stream(ep, cfg, cpu_tx, cpu_rx, res);
+}
+
+static void bench_sbtxrx(const bench_config& cfg, int cpu_tx, int cpu_rx, bench_result& res) {
+    std::string uri = unique_name("sb", 0);
+    {
+        sb_endpoints ep(uri, uri, cfg.capacity);
+        run_stream(ep, cfg, cpu_tx, cpu_rx, res);
+    }
+    delete_shared_queue(uri);
+}
+
+static void bench_router(const bench_config& cfg, int cpu_tx, int cpu_rx, bench_result& res) {
+    if (router_path == "") {
+        res.skipped = true;
+        res.note = "no --router given";
+        return;
+    }
+
+    // the router opens "queue-<n>" in the current directory
+    int n = 100000 + 2 * (getpid() % 100000);
+    std::string in = "queue-" + std::to_string(n);
+    std::string out = "queue-" + std::to_string(n + 1);
+
+    {
+        sb_endpoints ep(in, out, 0);
+
+        std::string rx_arg = std::to_string(n);
+        std::string tx_arg = std::to_string(n + 1);
+        std::string route_arg = "0:" + tx_arg;
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            execl(router_path.c_str(), router_path.c_str(), "--rx", rx_arg.c_str(), "--tx",
+                tx_arg.c_str(), "--route", route_arg.c_str(), (char*)NULL);
+            perror(router_path.c_str());
+            _exit(1);
+        } else if (pid < 0) {
+            perror("fork");
+            res.skipped = true;
+            res.note = "fork failed";
+            return;
+        }
+
+        run_stream(ep, cfg, cpu_tx, cpu_rx, res);
+
+        kill(pid, SIGTERM);
+        waitpid(pid, NULL, 0);
+    }
+
+    delete_shared_queue(in);
+    delete_shared_queue(out);
+}
+
+static void bench_umisb(const bench_config& cfg, int cpu_tx, int cpu_rx, bench_result& res) {
+    std::string req_uri = unique_name("umi", 0);
+    std::string resp_uri = unique_name("umi", 1);
+
+    {
+        SBTX req_tx, resp_tx;
+        SBRX req_rx, resp_rx;
+        req_tx.init(req_uri, cfg.capacity, true);
+        req_rx.init(req_uri, cfg.capacity);
+        resp_tx.init(resp_uri, cfg.capacity, true);
+        resp_rx.init(resp_uri, cfg.capacity);
+
+        void (*loop)(void) = spin_policy ? NULL : poll_wait_loop;
+
+        // the responder acknowledges each write, like a memory model would
+        std::thread responder([&]() {
+            pin_thread(cpu_rx);
+            for (long i = 0; i < cfg.iterations; i++) {
+                UmiTransaction req;
+                umisb_recv(req, req_rx, true, loop);
+
+                UmiTransaction resp(umi_pack(UMI_RESP_WRITE, 0, umi_size(req.cmd), umi_len(req.cmd),
+                                        1, 1),
+                    req.srcaddr, req.dstaddr);
+                umisb_send(resp, resp_tx, true, loop);
+            }
+        });
+
+        pin_thread(cpu_tx);
+
+        std::vector<uint8_t> data(cfg.size, 0xa5);
+        uint32_t cmd = umi_pack(UMI_REQ_WRITE, 0, 0, cfg.size - 1, 1, 1);
+
+        uint64_t start = tsc_read();
+
+        for (long i = 0; i < cfg.iterations; i++) {
+            uint64_t t0 = tsc_read();
+
+            UmiTransaction req(cmd, 0x1000, 0x2000, data.data(), data.size());
+            umisb_send(req, req_tx, true, loop);
+
+            UmiTransaction resp;
+            umisb_recv(resp, resp_rx, true, loop);
+
+            res.hist.add(tsc_read() - t0);
+        }
+
+        responder.join();
+
+        res.ticks = tsc_read() - start;
+        res.count = cfg.iterations;
+    }
+
+    delete_shared_queue(req_uri);
+    delete_shared_queue(resp_uri);
+}
+
+static void bench_barrier(const bench_config& cfg, int cpu_a, int cpu_b, bench_result& res) {
+    std::string name = unique_name("barrier", 0);
+    cycle_barrier* leader = barrier_open(name.c_str(), true, 2);
+    cycle_barrier* follower = barrier_open(name.c_str(), false, 2);
+
+    if (!leader || !follower) {
+        res.skipped = true;
+        res.note = "barrier_open() failed";
+        return;
+    }
+
+    std::thread other([&]() {
+        pin_thread(cpu_b);
+        for (long i = 0; i < cfg.iterations; i++) {
+            barrier_wait(follower);
+        }
+    });
+
+    pin_thread(cpu_a);
+    uint64_t start = tsc_read();
+
+    for (long i = 0; i < cfg.iterations; i++) {
+        uint64_t t0 = tsc_read();
+        barrier_wait(leader);
+        res.hist.add(tsc_read() - t0);
+    }
+
+    other.join();
+
+    res.ticks = tsc_read() - start;
+    res.count = cfg.iterations;
+
+    barrier_close(follower);
+    barrier_close(leader);
+}
+
+static void run_bench(const bench_config& cfg, bench_result& res) {
+    res.skipped = false;
+    res.count = 0;
+    res.ticks = 0;
+
+    int cpu_a, cpu_b;
+    if (!placement_cpus(cfg.placement, cpu_a, cpu_b)) {
+        res.skipped = true;
+        res.note = "placement not available";
+        return;
+    }
+
+    spin_policy = (cfg.policy == "spin");
+
+    if ((cpu_a == cpu_b) && spin_policy) {
+        // each end would spin through its whole time slice waiting on the other
+        res.skipped = true;
+        res.note = "spinning on a single CPU";
+        return;
+    }
+
+    if (cfg.bench == "spsc") {
+        bench_spsc(cfg, cpu_a, cpu_b, res);
+    } else if (cfg.bench == "sbtxrx") {
+        bench_sbtxrx(cfg, cpu_a, cpu_b, res);
+    } else if (cfg.bench == "router") {
+        bench_router(cfg, cpu_a, cpu_b, res);
+    } else if (cfg.bench == "umisb") {
+        bench_umisb(cfg, cpu_a, cpu_b, res);
+    } else if (cfg.bench == "barrier") {
+        bench_barrier(cfg, cpu_a, cpu_b, res);
+    }
+}
+
+// output
+
+static void print_result(FILE* f, const bench_config& cfg, bench_result& res, bool first) {
+    fprintf(f, "%s    {\"bench\": \"%s\", \"size\": %d, \"capacity\": %d, \"batch\": %d, ",
+        first ? "" : ",\n", cfg.bench.c_str(), cfg.size, cfg.capacity, cfg.batch);
+    fprintf(f, "\"placement\": \"%s\", \"policy\": \"%s\", ", cfg.placement.c_str(),
+        cfg.policy.c_str());
+
+    if (res.skipped) {
+        fprintf(f, "\"skipped\": \"%s\"}", res.note.c_str());
+        return;
+    }
+
+    double seconds = 1.0e-9 * ns_per_tick * res.ticks;
+    histogram& h = res.hist;
+
+    fprintf(f, "\"count\": %ld, \"seconds\": %.6f, \"rate\": %.1f, ", res.count, seconds,
+        (seconds > 0) ? (res.count / seconds) : 0.0);
+    fprintf(f,
+        "\"latency_ns\": {\"min\": %.1f, \"p50\": %.1f, \"p99\": %.1f, \"p99.9\": %.1f, "
+        "\"max\": %.1f}, ",
+        ns_per_tick * h.min, ns_per_tick * h.percentile(50), ns_per_tick * h.percentile(99),
+        ns_per_tick * h.percentile(99.9), ns_per_tick * h.max);
+
+    // non-empty buckets as [lower bound in ns, count]
+    fprintf(f, "\"histogram\": [");
+    bool first_bucket = true;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        if (h.counts[i] > 0) {
+            fprintf(f, "%s[%.1f, %" PRIu64 "]", first_bucket ? "" : ", ",
+                ns_per_tick * hist_value(i), h.counts[i]);
+            first_bucket = false;
+        }
+    }
+    fprintf(f, "]}");
+}
+
+static std::vector<std::string> split_list(const std::string& arg) {
+    std::vector<std::string> items;
+    std::stringstream ss(arg);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item != "") {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+static std::vector<int> split_ints(const std::string& arg) {
+    std::vector<int> items;
+    for (auto& item : split_list(arg)) {
+        items.push_back(atoi(item.c_str()));
+    }
+    return items;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> benches = {"spsc", "sbtxrx", "router", "umisb", "barrier"};
+    std::vector<int> sizes = {8, 32, 60};
+    std::vector<int> capacities = {62, 1024};
+    std::vector<int> batches = {1, 16, 0};
+    std::vector<std::string> placements = {"same", "smt", "core", "socket"};
+    std::vector<std::string> policies = {"spin", "yield"};
+    long iterations = 1000000;
+    std::string out_file = "";
+
+    int arg_idx = 1;
+    while (arg_idx < argc) {
+        std::string arg = std::string(argv[arg_idx++]);
+        if (arg_idx >= argc) {
+            fprintf(stderr, "ERROR: missing value for %s\n", arg.c_str());
+            return 1;
+        }
+        std::string value = std::string(argv[arg_idx++]);
+
+        if (arg == "--bench") {
+            benches = split_list(value);
+        } else if (arg == "--sizes") {
+            sizes = split_ints(value);
+        } else if (arg == "--capacities") {
+            capacities = split_ints(value);
+        } else if (arg == "--batches") {
+            batches = split_ints(value);
+        } else if (arg == "--placements") {
+            placements = split_list(value);
+        } else if (arg == "--policies") {
+            policies = split_list(value);
+        } else if (arg == "--iterations") {
+            iterations = atol(value.c_str());
+        } else if (arg == "--router") {
+            router_path = value;
+        } else if (arg == "--out") {
+            out_file = value;
+        } else {
+            fprintf(stderr, "ERROR: unknown argument %s\n", arg.c_str());
+            return 1;
+        }
+    }
+
+    for (int size : sizes) {
+        if ((size < (int)sizeof(uint64_t)) || (size > (int)sizeof(sb_packet))) {
+            fprintf(stderr, "ERROR: sizes must be between %zu and %zu bytes\n", sizeof(uint64_t),
+                sizeof(sb_packet));
+            return 1;
+        }
+    }
+
+    FILE* f = stdout;
+    if (out_file != "") {
+        f = fopen(out_file.c_str(), "w");
+        if (!f) {
+            perror(out_file.c_str());
+            return 1;
+        }
+    }
+
+    ns_per_tick = 1.0 / sb_tsc_ticks_per_ns();
+
+    fprintf(f, "{\n  \"ns_per_tick\": %.6f,\n  \"results\": [\n", ns_per_tick);
+
+    bool first = true;
+    for (auto& bench : benches) {
+        // collapse the dimensions that don't apply to a benchmark, so
+        // that it isn't run repeatedly with identical settings
+        bool sized = (bench == "spsc") || (bench == "umisb");
+        bool queued = (bench != "barrier") && (bench != "router");
+        bool batched = (bench == "spsc") || (bench == "sbtxrx") || (bench == "router");
+        bool polled = (bench != "barrier"); // barrier_wait() always spins
+
+        std::vector<int> bench_sizes = sized ? sizes : std::vector<int>{(int)sizeof(sb_packet)};
+        std::vector<int> bench_capacities = queued ? capacities : std::vector<int>{0};
+        std::vector<int> bench_batches = batched ? batches : std::vector<int>{1};
+        std::vector<std::string> bench_policies =
+            polled ? policies : std::vector<std::string>{"spin"};
+
+        if (bench == "umisb") {
+            // a single UMI packet carries at most 32 bytes of data
+            bench_sizes.erase(std::remove_if(bench_sizes.begin(), bench_sizes.end(),
+                                  [](int s) { return s > UMI_PACKET_DATA_BYTES; }),
+                bench_sizes.end());
+        }
+
+        for (int size : bench_sizes) {
+            for (int capacity : bench_capacities) {
+                for (int batch : bench_batches) {
+                    for (auto& placement : placements) {
+                        for (auto& policy : bench_policies) {
+                            bench_config cfg = {
+                                bench, size, capacity, batch, placement, policy, iterations};
+                            bench_result res;
+
+                            fprintf(stderr, "%s size=%d capacity=%d batch=%d %s %s\n",
+                                bench.c_str(), size, capacity, batch, placement.c_str(),
+                                policy.c_str());
+
+                            run_bench(cfg, res);
+                            print_result(f, cfg, res, first);
+                            fflush(f);
+                            first = false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    fprintf(f, "\n  ]\n}\n");
+
+    if (f != stdout) {
+        fclose(f);
+    }
+
+    return 0;
+}
@@ -0,0 +1,70 @@
+// Checks the accuracy of the pacers used by the DPI/VPI clock generators,
+// including at MHz rates
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "switchboard.hpp"
+
+static void fail(const char* msg) {
+    fprintf(stderr, "FAIL: %s\n", msg);
+    exit(1);
+}
+
+// runs a clock generator at "max_rate" for about 50 ms, and returns the
+// rate achieved
+static double measure(sb_pacer_table& pacers, long& handle, double max_rate) {
+    long ticks = max_rate * 0.05;
+
+    // the first tick starts the bucket
+    pacers.tick(handle, max_rate);
+
+    uint64_t t0 = tsc_monotonic_ns();
+    for (long i = 0; i < ticks; i++) {
+        pacers.tick(handle, max_rate);
+    }
+    uint64_t t1 = tsc_monotonic_ns();
+
+    return ticks * 1.0e9 / (t1 - t0);
+}
+
+int main() {
+    sb_pacer_table pacers;
+
+    // rates that used to round to a period of 0, 1 or 2 us
+    double rates[] = {100e3, 700e3, 1.5e6, 5e6};
+
+    for (double max_rate : rates) {
+        long handle = -1;
+        double rate = measure(pacers, handle, max_rate);
+        printf("max_rate=%.0f Hz: %.0f Hz\n", max_rate, rate);
+
+        // being descheduled can only make the rate lower, so there's more
+        // slack below than above
+        if ((rate > 1.02 * max_rate) || (rate < 0.8 * max_rate)) {
+            fail("rate is off");
+        }
+    }
+
+    // each clock generator gets its own pacer
+    long a = -1;
+    long b = -1;
+    pacers.tick(a, 1e6);
+    pacers.tick(b, 1e6);
+    if ((a < 0) || (b < 0) || (a == b)) {
+        fail("clock generators share a pacer");
+    }
+
+    // pacing is off for max_rate <= 0
+    long off = -1;
+    pacers.tick(off, -1);
+    if (off != -1) {
+        fail("pacer created with pacing off");
+    }
+
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,229 @@
+// Exercises the PCIe queue driver against the software FPGA model
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "switchboard_fpga_model.hpp"
+#include "umisb.hpp"
+
+#define NPACKETS 1024
+
+static void fail(const char* msg) {
+    fprintf(stderr, "FAIL: %s\n", msg);
+    exit(1);
+}
+
+// sends packets through the model in loopback and checks that they come
+// back unchanged and in order
+static void loopback(SB_fpga_model& model, int capacity, bool pagemap, bool doorbell = false) {
+    printf("loopback: capacity=%d pagemap=%d doorbell=%d\n", capacity, pagemap, doorbell);
+
+    // start from empty queues, since the device side is reset on init
+    delete_shared_queue("pcie-model-tx.q");
+    delete_shared_queue("pcie-model-rx.q");
+
+    SBTX_pcie tx(0);
+    SBRX_pcie rx(1);
+
+    tx.force_pagemap(pagemap);
+    rx.force_pagemap(pagemap);
+
+    // ring the TX doorbell per 8 packets, to exercise batching and flush()
+    tx.set_doorbell(doorbell, 8);
+    rx.set_doorbell(doorbell);
+
+    if (!tx.init("pcie-model-tx.q", &model, capacity) ||
+        !rx.init("pcie-model-rx.q", &model, capacity)) {
+        fail("unable to init queues");
+    }
+
+    for (int i = 0; i < NPACKETS; i++) {
+        sb_packet p;
+        memset(&p, 0, sizeof p);
+        p.destination = i;
+        p.last = i & 1;
+        for (int j = 0; j < (int)sizeof(p.data); j++) {
+            p.data[j] = i + j;
+        }
+        tx.send_blocking(p);
+        if ((i % 32) == 31) {
+            tx.flush();
+        }
+
+        // keep at most a queue's worth in flight, so the test doesn't rely
+        // on how much buffering the model has
+        if ((i % 32) == 31) {
+            for (int k = i - 31; k <= i; k++) {
+                sb_packet q;
+                rx.recv_blocking(q);
+                if ((q.destination != (uint32_t)k) || (q.last != (k & 1)) ||
+                    (q.data[0] != (uint8_t)k) || (q.data[31] != (uint8_t)(k + 31))) {
+                    fail("packet mismatch");
+                }
+            }
+        }
+    }
+
+    sb_packet p;
+    usleep(10000);
+    if (rx.recv(p)) {
+        fail("unexpected extra packet");
+    }
+
+    tx.deinit();
+    rx.deinit();
+}
+
+// waits up to a second for "done" to return true
+template <typename F> static bool poll_for(F done) {
+    for (int i = 0; i < 100000; i++) {
+        if (done()) {
+            return true;
+        }
+        usleep(10);
+    }
+    return false;
+}
+
+// drives doorbell queues only through SBTX& / SBRX&, as umisb_send and
+// umisb_recv do, so the doorbell has to be rung on that path as well
+static void umi_doorbell(SB_fpga_model& model) {
+    printf("umi_doorbell\n");
+
+    delete_shared_queue("pcie-model-tx.q");
+    delete_shared_queue("pcie-model-rx.q");
+
+    SBTX_pcie tx_pcie(0);
+    SBRX_pcie rx_pcie(1);
+
+    tx_pcie.set_doorbell(true);
+    rx_pcie.set_doorbell(true);
+
+    if (!tx_pcie.init("pcie-model-tx.q", &model) || !rx_pcie.init("pcie-model-rx.q", &model)) {
+        fail("unable to init queues");
+    }
+
+    SBTX& tx = tx_pcie;
+    SBRX& rx = rx_pcie;
+
+    for (int i = 0; i < NPACKETS; i++) {
+        uint8_t data[8];
+        for (int j = 0; j < 8; j++) {
+            data[j] = i + j;
+        }
+
+        UmiTransaction req(umi_pack(UMI_REQ_WRITE, 0, 0, 7, 1, 1), 0x1000 + i, 0x2000 + i, data,
+            sizeof data);
+        if (!poll_for([&] { return umisb_send(req, tx, false); })) {
+            fail("umisb_send stalled on a doorbell queue");
+        }
+
+        UmiTransaction resp(0, 0, 0, NULL, 8);
+        if (!poll_for([&] { return umisb_recv(resp, rx, false); })) {
+            fail("umisb_recv stalled on a doorbell queue");
+        }
+
+        if ((resp.cmd != req.cmd) || (resp.dstaddr != req.dstaddr) ||
+            (resp.srcaddr != req.srcaddr) || (memcmp(resp.data, data, sizeof data) != 0)) {
+            fail("UMI transaction mismatch");
+        }
+    }
+
+    tx_pcie.deinit();
+    rx_pcie.deinit();
+}
+
+// brings up several queue pairs at once through SB_pcie_device
+static void device(int pairs) {
+    printf("device: pairs=%d\n", pairs);
+
+    SB_fpga_model model(2 * pairs);
+    model.set_loopback(true);
+
+    SB_pcie_device dev;
+    if (!dev.open(&model) || (dev.num_queues() != (2 * pairs))) {
+        fail("unable to open device");
+    }
+
+    std::vector<SBTX_pcie*> tx;
+    std::vector<SBRX_pcie*> rx;
+    for (int i = 0; i < pairs; i++) {
+        std::string name = "pcie-model-" + std::to_string(i);
+        delete_shared_queue(name + "-tx.q");
+        delete_shared_queue(name + "-rx.q");
+        tx.push_back(&dev.add_tx(2 * i, name + "-tx.q"));
+        rx.push_back(&dev.add_rx(2 * i + 1, name + "-rx.q"));
+    }
+
+    // restart once, to check that queues can be brought up again
+    for (int run = 0; run < 2; run++) {
+        if (!dev.start()) {
+            fail("unable to start device");
+        }
+
+        for (int i = 0; i < pairs; i++) {
+            sb_packet p;
+            memset(&p, 0, sizeof p);
+            p.destination = i;
+            tx[i]->send_blocking(p);
+        }
+
+        for (int i = 0; i < pairs; i++) {
+            sb_packet p;
+            rx[i]->recv_blocking(p);
+            if (p.destination != (uint32_t)i) {
+                fail("packet mismatch");
+            }
+        }
+
+        dev.stop();
+    }
+
+    dev.close();
+
+    for (int i = 0; i < pairs; i++) {
+        std::string name = "pcie-model-" + std::to_string(i);
+        delete_shared_queue(name + "-tx.q");
+        delete_shared_queue(name + "-rx.q");
+    }
+}
+
+int main() {
+    SB_fpga_model model(2);
+    model.set_loopback(true);
+
+    loopback(model, 0, false);
+    loopback(model, 1000, true);
+
+    // queues are reset and re-initialized between runs
+    loopback(model, 0, false);
+
+    if ((model.dma_reads() == 0) || (model.dma_writes() == 0)) {
+        fail("no DMA traffic recorded");
+    }
+
+    // in doorbell mode the device no longer polls host memory for pointers,
+    // so it only reads packets
+    uint64_t reads = model.dma_reads();
+    loopback(model, 0, false, true);
+    loopback(model, 1000, true, true);
+    if ((model.dma_reads() - reads) != (2 * NPACKETS)) {
+        fail("unexpected DMA reads in doorbell mode");
+    }
+
+    umi_doorbell(model);
+
+    delete_shared_queue("pcie-model-tx.q");
+    delete_shared_queue("pcie-model-rx.q");
+
+    device(16);
+
+    printf("PASS\n");
+    return 0;
+}
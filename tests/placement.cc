@@ -0,0 +1,173 @@
+// Checks the +cpu and +numa plusargs of testbench.cc and testbench_sync.cc,
+// and SB_NUMA and SB_PLACEMENT_REPORT, on the node that the test runs on
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// the testbenches are built against a stub of Verilator (verilator_stub),
+// whose model opens a queue and prints the placement it was given
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#include "Vtestbench.h"
+#include "switchboard.hpp"
+
+#define OUTPUT "placement-out.txt"
+#define REPORT "placement-report.txt"
+
+static int cpu;
+static int node;
+static bool pages_known;
+
+static void fail(const char* msg) {
+    fprintf(stderr, "FAIL: %s\n", msg);
+    exit(1);
+}
+
+static std::vector<std::string> read_lines(const char* file) {
+    std::vector<std::string> lines;
+    std::ifstream in(file);
+    std::string line;
+    while (std::getline(in, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+// runs a testbench with its output going to OUTPUT, and SB_NUMA set to
+// "numa" unless it is NULL.  returns the pid of the testbench.
+static pid_t run(const char* const* argv, const char* numa) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int fd = open(OUTPUT, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if ((fd < 0) || (dup2(fd, STDOUT_FILENO) < 0)) {
+            perror(OUTPUT);
+            _exit(1);
+        }
+        setenv("SB_PLACEMENT_REPORT", REPORT, 1);
+        if (numa) {
+            setenv("SB_NUMA", numa, 1);
+        } else {
+            unsetenv("SB_NUMA");
+        }
+        execv(argv[0], (char* const*)argv);
+        perror(argv[0]);
+        _exit(1);
+    } else if (pid < 0) {
+        fail("fork");
+    }
+
+    int status;
+    if ((waitpid(pid, &status, 0) != pid) || !WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+        fail("testbench failed");
+    }
+    return pid;
+}
+
+// the report has a line for each end of the queue, from the testbench's
+// process, on the CPU and node that it was pinned to, with the queue's
+// pages on that node
+static void check_report(pid_t pid) {
+    std::vector<std::string> lines = read_lines(REPORT);
+    const char* roles[] = {"producer", "consumer"};
+
+    if (lines.size() != 2) {
+        fail("expected two lines in the placement report");
+    }
+
+    for (int i = 0; i < 2; i++) {
+        char prefix[256];
+        snprintf(prefix, sizeof prefix, "queue-placement: pid %d %s cpu %d node %d pages",
+            (int)pid, roles[i], cpu, node);
+
+        std::string expected = prefix;
+        if (!pages_known) {
+            expected += " unknown";
+        } else if (node >= 0) {
+            expected += " node" + std::to_string(node) + ":";
+        }
+
+        if (lines[i].compare(0, expected.size(), expected) != 0) {
+            fprintf(stderr, "expected: %s\ngot:      %s\n", expected.c_str(), lines[i].c_str());
+            fail("unexpected placement report");
+        }
+
+        // and none anywhere else
+        if (pages_known && (node >= 0) &&
+            (lines[i].find(" node", expected.size()) != std::string::npos)) {
+            fail("queue pages on more than one node");
+        }
+    }
+}
+
+static void check_output(int numa) {
+    std::vector<std::string> lines = read_lines(OUTPUT);
+    char expected[256];
+    snprintf(expected, sizeof expected, "cpus 1 first %d numa %d received %d", cpu, numa,
+        VTESTBENCH_CYCLES);
+
+    for (const std::string& line : lines) {
+        if (line == expected) {
+            return;
+        }
+    }
+
+    fprintf(stderr, "expected: %s\n", expected);
+    fail("testbench not placed as requested");
+}
+
+static void test(const char* testbench, bool plusarg) {
+    printf("%s with %s\n", testbench, plusarg ? "+numa" : "SB_NUMA");
+
+    std::string node_arg = (node >= 0) ? std::to_string(node) : "none";
+    std::string cpu_plusarg = "+cpu=" + std::to_string(cpu);
+    std::string numa_plusarg = "+numa=" + node_arg;
+
+    const char* argv[] = {testbench, cpu_plusarg.c_str(), plusarg ? numa_plusarg.c_str() : NULL,
+        NULL};
+
+    delete_shared_queue(VTESTBENCH_QUEUE);
+    unlink(REPORT);
+
+    pid_t pid = run(argv, plusarg ? NULL : node_arg.c_str());
+
+    check_output((node >= 0) ? node : SB_NUMA_NONE);
+    check_report(pid);
+
+    delete_shared_queue(VTESTBENCH_QUEUE);
+}
+
+int main() {
+    cpu = sb_current_cpu();
+    if (cpu < 0) {
+        fail("could not get the current CPU");
+    }
+    node = sb_cpu_node(cpu);
+
+    // page locations can't be queried everywhere, in which case the report
+    // says so
+    int counts[1];
+    pages_known = (sb_numa_page_nodes(&counts, sizeof counts, counts, 1) >= 0);
+
+    printf("cpu %d node %d\n", cpu, node);
+
+    for (const char* testbench : {"./testbench.out", "./testbench_sync.out"}) {
+        test(testbench, true);
+        test(testbench, false);
+    }
+
+    unlink(OUTPUT);
+    unlink(REPORT);
+
+    printf("PASS!\n");
+    return 0;
+}
@@ -0,0 +1,297 @@
+// Checks sbcap: taps queues, checks the capture file, and replays it
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sbcap.h"
+#include "switchboard.hpp"
+
+#define NPACKETS 200
+
+static std::string sbcap;
+
+static void fail(const char* msg) {
+    fprintf(stderr, "FAIL: %s\n", msg);
+    exit(1);
+}
+
+static pid_t spawn(const char* const* argv) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv(argv[0], (char* const*)argv);
+        perror(argv[0]);
+        _exit(1);
+    } else if (pid < 0) {
+        fail("fork");
+    }
+    return pid;
+}
+
+static int wait_status(pid_t pid) {
+    int status;
+    if ((waitpid(pid, &status, 0) != pid) || !WIFEXITED(status)) {
+        return -1;
+    }
+    return WEXITSTATUS(status);
+}
+
+static void wait_ok(pid_t pid, const char* msg) {
+    if (wait_status(pid) != 0) {
+        fail(msg);
+    }
+}
+
+static void recv_timeout(SBRX& rx, sb_packet& p) {
+    for (int i = 0; i < 500000; i++) {
+        if (rx.recv(p)) {
+            return;
+        }
+        usleep(10);
+    }
+    fail("timed out waiting for a packet");
+}
+
+// packet "i" sent on queue "q"
+static void make_packet(sb_packet& p, int q, int i) {
+    memset(&p, 0, sizeof p);
+    p.destination = 100 * q + i;
+    p.last = i & 1;
+    for (int j = 0; j < (int)sizeof(p.data); j++) {
+        p.data[j] = i + j + q;
+    }
+}
+
+static bool check_packet(const sb_packet& p, int q, int i) {
+    sb_packet expected;
+    make_packet(expected, q, i);
+    return memcmp(&p, &expected, sizeof p) == 0;
+}
+
+// sim-time capture of one queue, and its replay
+static void sim_time() {
+    printf("sim_time\n");
+
+    const char* queues[] = {"sbcap-in.q", "sbcap-out.q", "sbcap-replay.q"};
+    for (const char* q : queues) {
+        delete_shared_queue(q);
+    }
+    remove("sbcap-sim.cap");
+
+    std::string count = std::to_string(NPACKETS);
+    const char* capture_argv[] = {sbcap.c_str(), "--tap", "sbcap-in.q:sbcap-out.q", "--out",
+        "sbcap-sim.cap", "--sim-time", "--count", count.c_str(), NULL};
+    pid_t pid = spawn(capture_argv);
+
+    // the tap is transparent: packets and stamps come out unchanged
+    SBTX tx;
+    SBRX rx;
+    tx.init("sbcap-in.q");
+    rx.init("sbcap-out.q");
+    rx.set_tstamp(true);
+
+    for (int i = 0; i < NPACKETS; i++) {
+        sb_packet p;
+        make_packet(p, 0, i);
+        while (!tx.send(p, 1000 + 10 * i)) {
+            usleep(10);
+        }
+
+        recv_timeout(rx, p);
+        if (!check_packet(p, 0, i) || (rx.last_tstamp() != (uint64_t)(1000 + 10 * i))) {
+            fail("tapped packet mismatch");
+        }
+    }
+
+    wait_ok(pid, "capture failed");
+
+    sbcap_file cap;
+    if (!sbcap_open(&cap, "sbcap-sim.cap")) {
+        fail("can't open capture");
+    }
+    if ((cap.hdr->clock != SBCAP_CLOCK_SIM) || (cap.hdr->num_queues != 1) ||
+        (strcmp(cap.queues[0].name, "sbcap-out.q") != 0) || (cap.num_records != NPACKETS)) {
+        fail("bad capture header");
+    }
+    for (int i = 0; i < NPACKETS; i++) {
+        const sbcap_record& rec = cap.records[i];
+        if ((rec.queue != 0) || !check_packet(rec.pkt, 0, i) ||
+            (rec.tstamp != (uint64_t)(1000 + 10 * i)) ||
+            (rec.pkt_tstamp != (uint32_t)(1000 + 10 * i))) {
+            fail("capture record mismatch");
+        }
+    }
+    sbcap_close(&cap);
+
+    // replay into another queue, with the receiver in replay mode, so that
+    // packets come out at their stamps plus the link latency
+    SBRX replay;
+    replay.init("sbcap-replay.q");
+    replay.set_link_latency(5);
+
+    const char* replay_argv[] = {sbcap.c_str(), "--replay", "sbcap-sim.cap", "--map",
+        "0:sbcap-replay.q", NULL};
+    pid = spawn(replay_argv);
+
+    for (int i = 0; i < NPACKETS; i++) {
+        sb_packet p;
+
+        sb_sim_clock_get().cycle = 1000 + 10 * i + 4;
+        usleep((i == 0) ? 100000 : 0);
+        if (replay.recv(p)) {
+            fail("replayed packet released early");
+        }
+
+        sb_sim_clock_get().cycle = 1000 + 10 * i + 5;
+        recv_timeout(replay, p);
+        if (!check_packet(p, 0, i) || (replay.last_tstamp() != (uint64_t)(1000 + 10 * i))) {
+            fail("replayed packet mismatch");
+        }
+    }
+
+    wait_ok(pid, "replay failed");
+
+    // --rate doesn't apply to sim-time captures, which is an error rather
+    // than being silently ignored
+    const char* rate_argv[] = {sbcap.c_str(), "--replay", "sbcap-sim.cap", "--map",
+        "0:sbcap-replay.q", "--rate", NULL};
+    pid = spawn(rate_argv);
+    if (wait_status(pid) != 1) {
+        fail("--rate accepted for a sim-time capture");
+    }
+    sb_packet p;
+    if (replay.recv(p)) {
+        fail("packet replayed despite --rate error");
+    }
+
+    for (const char* q : queues) {
+        delete_shared_queue(q);
+    }
+    remove("sbcap-sim.cap");
+}
+
+// monotonic capture of two queues, and its replay
+static void monotonic() {
+    printf("monotonic\n");
+
+    const char* queues[] = {"sbcap-a-in.q", "sbcap-a-out.q", "sbcap-b-in.q", "sbcap-b-out.q"};
+    for (const char* q : queues) {
+        delete_shared_queue(q);
+    }
+    remove("sbcap-mono.cap");
+
+    std::string count = std::to_string(2 * NPACKETS);
+    const char* capture_argv[] = {sbcap.c_str(), "--tap", "sbcap-a-in.q:sbcap-a-out.q",
+        "sbcap-b-in.q:sbcap-b-out.q", "--out", "sbcap-mono.cap", "--count", count.c_str(), NULL};
+    pid_t pid = spawn(capture_argv);
+
+    SBTX tx[2];
+    SBRX rx[2];
+    for (int q = 0; q < 2; q++) {
+        tx[q].init(queues[2 * q]);
+        rx[q].init(queues[2 * q + 1]);
+        rx[q].set_tstamp(true);
+    }
+
+    // queue 1 is unstamped, so its packets carry a zero stamp
+    uint64_t t0 = tsc_monotonic_ns();
+    for (int i = 0; i < NPACKETS; i++) {
+        for (int q = 0; q < 2; q++) {
+            sb_packet p;
+            make_packet(p, q, i);
+            while (!((q == 0) ? tx[q].send(p, 77 + i) : tx[q].send(p))) {
+                usleep(10);
+            }
+
+            recv_timeout(rx[q], p);
+            uint64_t tstamp = (q == 0) ? 77 + i : 0;
+            if (!check_packet(p, q, i) || (rx[q].last_tstamp() != tstamp)) {
+                fail("tapped packet mismatch");
+            }
+        }
+    }
+    uint64_t t1 = tsc_monotonic_ns();
+
+    wait_ok(pid, "capture failed");
+
+    sbcap_file cap;
+    if (!sbcap_open(&cap, "sbcap-mono.cap")) {
+        fail("can't open capture");
+    }
+    if ((cap.hdr->clock != SBCAP_CLOCK_MONOTONIC) || (cap.hdr->num_queues != 2) ||
+        (strcmp(cap.queues[1].name, "sbcap-b-out.q") != 0) || (cap.num_records != 2 * NPACKETS)) {
+        fail("bad capture header");
+    }
+
+    // each packet was forwarded before the next one was sent, so the
+    // capture holds them in the order they were sent
+    uint64_t prev = t0;
+    for (int n = 0; n < 2 * NPACKETS; n++) {
+        const sbcap_record& rec = cap.records[n];
+        int q = n % 2;
+        int i = n / 2;
+        if ((rec.queue != (uint32_t)q) || !check_packet(rec.pkt, q, i) ||
+            (rec.pkt_tstamp != (uint32_t)((q == 0) ? 77 + i : 0)) || (rec.tstamp < prev) ||
+            (rec.tstamp > t1)) {
+            fail("capture record mismatch");
+        }
+        prev = rec.tstamp;
+    }
+    sbcap_close(&cap);
+
+    // dumping works
+    const char* dump_argv[] = {sbcap.c_str(), "--dump", "sbcap-mono.cap", "--umi", NULL};
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        if (!freopen("/dev/null", "w", stdout)) {
+            _exit(1);
+        }
+        execv(dump_argv[0], (char* const*)dump_argv);
+        _exit(1);
+    }
+    wait_ok(pid, "dump failed");
+
+    // replay to the recorded queues, keeping the packets' own stamps
+    const char* replay_argv[] = {sbcap.c_str(), "--replay", "sbcap-mono.cap", NULL};
+    pid = spawn(replay_argv);
+
+    for (int i = 0; i < NPACKETS; i++) {
+        for (int q = 0; q < 2; q++) {
+            sb_packet p;
+            recv_timeout(rx[q], p);
+            uint64_t tstamp = (q == 0) ? 77 + i : 0;
+            if (!check_packet(p, q, i) || (rx[q].last_tstamp() != tstamp)) {
+                fail("replayed packet mismatch");
+            }
+        }
+    }
+
+    wait_ok(pid, "replay failed");
+
+    for (const char* q : queues) {
+        delete_shared_queue(q);
+    }
+    remove("sbcap-mono.cap");
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <path to sbcap>\n", argv[0]);
+        return 1;
+    }
+    sbcap = argv[1];
+
+    sim_time();
+    monotonic();
+
+    printf("PASS\n");
+    return 0;
+}
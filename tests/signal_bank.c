@@ -0,0 +1,195 @@
+// Signal bank tests
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+#include <assert.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "signal_bank.h"
+
+#define NBITS 4000
+#define NWRITES 100000
+
+static char name[64];
+static bool done;
+
+// checks bit-level access, and that writes which don't change anything
+// leave the generation alone
+static void check_bits(void) {
+    uint64_t mirror[(NBITS + 63) / 64] = {0};
+    sb_bank* w = sb_bank_open(name, NBITS);
+    sb_bank* r = sb_bank_open(name, NBITS);
+    assert(w && r);
+
+    assert(sb_bank_read(r, mirror) == 0);
+
+    sb_bank_set_bits(w, 60, 8, 0xa5);
+    assert(sb_bank_generation(r) == 1);
+    assert(sb_bank_read(r, mirror) == 1);
+    assert(sb_bank_get_bits(mirror, 60, 8) == 0xa5);
+    assert(mirror[0] == (0x5ULL << 60));
+    assert(mirror[1] == 0xa);
+
+    // only the chunk that was written is tagged with the new generation
+    sb_bank_set_bits(w, NBITS - 1, 1, 1);
+    assert(sb_bank_chunk_generation(r, 0) == 1);
+    assert(sb_bank_chunk_generation(r, r->nchunks - 1) == 2);
+    assert(sb_bank_read(r, mirror) == 1);
+    assert(sb_bank_get_bits(mirror, NBITS - 1, 1) == 1);
+
+    sb_bank_set_bits(w, 60, 8, 0xa5);
+    assert(sb_bank_generation(r) == 2);
+    assert(sb_bank_read(r, mirror) == 0);
+
+    // a bank can't be reopened with a different width
+    assert(sb_bank_open(name, NBITS + 1) == NULL);
+
+    sb_bank_close(w);
+    sb_bank_close(r);
+    sb_bank_remove_shmfile(name);
+}
+
+// the writer sets every word to the same value in each write, so a
+// consistent read never sees two different values
+static void* writer(void* arg) {
+    (void)arg;
+
+    sb_bank* w = sb_bank_open(name, NBITS);
+    assert(w);
+
+    for (uint64_t n = 1; n <= NWRITES; n++) {
+        sb_bank_write_begin(w);
+        for (int i = 0; i < w->nwords; i++) {
+            sb_bank_write_word(w, i, n, ~(uint64_t)0);
+        }
+        sb_bank_write_end(w);
+
+        if ((n % 64) == 0) {
+            sched_yield();
+        }
+    }
+
+    __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+    sb_bank_close(w);
+    return NULL;
+}
+
+static void check_consistency(void) {
+    uint64_t mirror[(NBITS + 63) / 64] = {0};
+    uint64_t last = 0;
+    uint64_t reads = 0;
+    pthread_t thread;
+
+    sb_bank* r = sb_bank_open(name, NBITS);
+    assert(r);
+
+    pthread_create(&thread, NULL, writer, NULL);
+
+    while (true) {
+        bool finished = __atomic_load_n(&done, __ATOMIC_ACQUIRE);
+        int status = sb_bank_read(r, mirror);
+
+        if (status == 1) {
+            for (int i = 1; i < r->nwords; i++) {
+                if (mirror[i] != mirror[0]) {
+                    printf("ERROR: torn read, word %d is %" PRIu64 " but word 0 is %" PRIu64 "\n",
+                        i, mirror[i], mirror[0]);
+                    exit(1);
+                }
+            }
+            assert(mirror[0] >= last);
+            last = mirror[0];
+            reads++;
+        } else if (status < 0) {
+            sched_yield();
+        } else if (finished) {
+            break;
+        }
+    }
+
+    pthread_join(thread, NULL);
+
+    assert(last == NWRITES);
+    assert(sb_bank_generation(r) == NWRITES);
+
+    printf("%" PRIu64 " consistent reads\n", reads);
+
+    sb_bank_close(r);
+    sb_bank_remove_shmfile(name);
+}
+
+// a writer that dies during a write leaves the sequence number odd; the
+// next writer has to restore its parity, and make readers copy everything
+static void check_recover(void) {
+    uint64_t mirror[(NBITS + 63) / 64] = {0};
+    sb_bank* w = sb_bank_open(name, NBITS);
+    sb_bank* r = sb_bank_open(name, NBITS);
+    assert(w && r);
+
+    sb_bank_set_bits(w, 0, 8, 0x11);
+    assert(sb_bank_read(r, mirror) == 1);
+
+    // die after touching two chunks
+    sb_bank_write_begin(w);
+    sb_bank_write_bits(w, 0, 8, 0x22);
+    sb_bank_write_bits(w, NBITS - 8, 8, 0x33);
+    sb_bank_close(w);
+    assert(sb_bank_read(r, mirror) < 0);
+
+    // explicit recovery by a restarted writer
+    w = sb_bank_open(name, NBITS);
+    assert(w);
+    sb_bank_recover(w);
+    assert((w->shm->seq & 1) == 0);
+    for (int c = 0; c < r->nchunks; c++) {
+        assert(sb_bank_chunk_generation(r, c) == sb_bank_generation(r));
+    }
+    assert(sb_bank_read(r, mirror) == 1);
+    assert(sb_bank_get_bits(mirror, 0, 8) == 0x22);
+    assert(sb_bank_get_bits(mirror, NBITS - 8, 8) == 0x33);
+    assert(sb_bank_read(r, mirror) == 0);
+
+    // writes behave normally afterwards: reads back off during a write,
+    // and succeed after it
+    sb_bank_write_begin(w);
+    sb_bank_write_bits(w, 0, 8, 0x44);
+    assert(sb_bank_read(r, mirror) < 0);
+    sb_bank_write_end(w);
+    assert(sb_bank_read(r, mirror) == 1);
+    assert(sb_bank_get_bits(mirror, 0, 8) == 0x44);
+    assert(sb_bank_read(r, mirror) == 0);
+
+    // implicit recovery on the first write of a restarted writer
+    sb_bank_write_begin(w);
+    sb_bank_write_bits(w, 0, 8, 0x55);
+    sb_bank_close(w);
+    w = sb_bank_open(name, NBITS);
+    assert(w);
+    sb_bank_set_bits(w, 8, 8, 0x66);
+    assert((w->shm->seq & 1) == 0);
+    assert(sb_bank_read(r, mirror) == 1);
+    assert(sb_bank_get_bits(mirror, 0, 16) == 0x6655);
+    assert(sb_bank_read(r, mirror) == 0);
+
+    sb_bank_close(w);
+    sb_bank_close(r);
+    sb_bank_remove_shmfile(name);
+}
+
+int main(void) {
+    snprintf(name, sizeof(name), "queue-bank-%d", (int)getpid());
+    sb_bank_remove_shmfile(name);
+
+    check_bits();
+    check_recover();
+    check_consistency();
+
+    printf("PASS!\n");
+    return 0;
+}
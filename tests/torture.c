@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include "spsc_queue.h"
@@ -335,6 +336,104 @@ void torture_test_mapsize(struct torture_state* ts) {
     printf("done\n");
 }
 
+void torture_test_header(struct torture_state* ts) {
+    uint8_t buf[SPSC_QUEUE_MAX_PACKET_SIZE] = {0};
+    spsc_queue* a;
+    spsc_queue* b;
+    uint32_t generation;
+    pid_t pid;
+    int status;
+
+    (void)ts;
+
+    printf("%s: ", __func__);
+    fflush(NULL);
+
+    // the second peer adopts the capacity of the existing queue
+    a = torture_open("hdr", 10);
+    b = torture_open("hdr", 20);
+    assert(a && b);
+    assert(a->capacity == 10);
+    assert(b->capacity == 10);
+    assert(a->shm->magic == SPSC_QUEUE_MAGIC);
+    assert(a->shm->slot_size == SPSC_QUEUE_MAX_PACKET_SIZE);
+
+    // a producer that dies without closing the queue is replaced by the
+    // next one, and what it sent is still there
+    spsc_attach(b, SPSC_ROLE_CONSUMER);
+    generation = spsc_generation(b);
+
+    pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+        spsc_attach(a, SPSC_ROLE_PRODUCER);
+        buf[0] = 42;
+        spsc_send(a, buf, sizeof buf);
+        _exit(0);
+    }
+    waitpid(pid, &status, 0);
+
+    spsc_attach(a, SPSC_ROLE_PRODUCER);
+    assert(spsc_generation(b) == generation + 1);
+    assert(spsc_recv(b, buf, sizeof buf));
+    assert(buf[0] == 42);
+
+    // closing the queue detaches cleanly
+    spsc_close(a);
+    assert(b->shm->producer == 0);
+
+    // a queue with corrupted pointers is reset when it is opened
+    b->shm->head = 1000;
+    a = torture_open("hdr", 10);
+    assert(a);
+    assert(a->shm->head == 0);
+    assert(a->shm->tail == 0);
+    assert(spsc_generation(a) == generation + 2);
+
+    spsc_close(b);
+    torture_close(a);
+    printf("done\n");
+}
+
+void torture_test_placement(struct torture_state* ts) {
+    unsigned long mask[SB_PLACE_MASK_WORDS(SB_PLACE_MAX_CPUS)];
+    char name[64];
+    int counts[64] = {0};
+    spsc_queue* q;
+    int node;
+    int found;
+
+    (void)ts;
+
+    printf("%s: ", __func__);
+    fflush(NULL);
+
+    assert(sb_cpulist_parse("0-3,8", mask, SB_PLACE_MAX_CPUS) == 5);
+    assert(mask[0] == 0x10f);
+    assert(sb_cpulist_parse("2,1-2", mask, SB_PLACE_MAX_CPUS) == 2);
+    assert(sb_cpulist_parse("3-1", mask, SB_PLACE_MAX_CPUS) < 0);
+    assert(sb_cpulist_parse("1,,2", mask, SB_PLACE_MAX_CPUS) < 0);
+    assert(sb_cpulist_parse("x", mask, SB_PLACE_MAX_CPUS) < 0);
+
+    assert(sb_numa_parse(NULL) == SB_NUMA_NONE);
+    assert(sb_numa_parse("consumer") == SB_NUMA_CONSUMER);
+    assert(sb_numa_parse("1") == 1);
+
+    // a queue placed on our own node should end up there
+    snprintf(name, sizeof name, "queue-place-%d", (int)getpid());
+    node = sb_current_node();
+    q = spsc_open_node(name, 100, (node >= 0) ? node : SB_NUMA_NONE);
+    assert(q);
+
+    found = sb_numa_page_nodes(q->shm, spsc_mapsize(q->capacity), counts, 64);
+    if ((found > 0) && (node >= 0) && (node < 64)) {
+        assert(counts[node] == found);
+    }
+
+    torture_close(q);
+    printf("done\n");
+}
+
 int main(int argc, char* argv[]) {
     struct torture_state ts = {0};
     unsigned long runs = 1;
@@ -344,6 +443,8 @@ int main(int argc, char* argv[]) {
     }
 
     torture_test_mapsize(&ts);
+    torture_test_header(&ts);
+    torture_test_placement(&ts);
 
     while (runs--) {
         torture_test_open(&ts);
@@ -0,0 +1,185 @@
+// Checks the trace drained by a build with SB_TRACE, with a producer and a
+// consumer in separate processes
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "switchboard.hpp"
+
+#define NPACKETS 1000
+
+static void fail(const char* msg) {
+    fprintf(stderr, "FAIL: %s\n", msg);
+    exit(1);
+}
+
+// runs one side of the queue in a child process, which drains its trace
+// to "file" when it exits
+static pid_t run(bool producer, const char* file) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        fail("fork");
+    } else if (pid > 0) {
+        return pid;
+    }
+
+    setenv("SB_TRACE_FILE", file, 1);
+
+    sb_packet p;
+    memset(&p, 0, sizeof p);
+
+    if (producer) {
+        SBTX tx;
+        tx.init("trace-test.q");
+        for (int i = 0; i < NPACKETS; i++) {
+            p.destination = i;
+            tx.send_blocking(p);
+        }
+    } else {
+        SBRX rx;
+        rx.init("trace-test.q");
+        for (int i = 0; i < NPACKETS; i++) {
+            rx.recv_blocking(p);
+            if (p.destination != (uint32_t)i) {
+                _exit(1);
+            }
+        }
+    }
+
+    exit(0);
+}
+
+struct trace_summary {
+    int sends;
+    int recvs;
+    double first_ok; // ts of the first successful event, in us
+    double min_ts;
+    double max_ts;
+};
+
+// scans a JSON trace, which has one event per line
+static trace_summary check_json(const char* file, const char* event) {
+    trace_summary sum = {0, 0, -1, 1e300, -1};
+    char line[1024];
+    int events = 0;
+
+    FILE* f = fopen(file, "r");
+    if (!f) {
+        fail("trace file missing");
+    }
+
+    if (!fgets(line, sizeof line, f) || (strncmp(line, "{\"traceEvents\":[", 16) != 0)) {
+        fail("trace file doesn't start with traceEvents");
+    }
+
+    while (fgets(line, sizeof line, f)) {
+        const char* ts = strstr(line, "\"ts\":");
+        if (!ts) {
+            continue;
+        }
+        events++;
+
+        if (!strstr(line, "\"queue\":\"trace-test.q\"")) {
+            fail("event without the queue name");
+        }
+
+        double t = atof(ts + 5);
+        sum.min_ts = std::min(sum.min_ts, t);
+        sum.max_ts = std::max(sum.max_ts, t);
+
+        if (strstr(line, "\"name\":\"send\"")) {
+            sum.sends++;
+        } else if (strstr(line, "\"name\":\"recv\"")) {
+            sum.recvs++;
+        }
+
+        if (strstr(line, event) && strstr(line, "\"ok\":1") && (sum.first_ok < 0)) {
+            sum.first_ok = t;
+        }
+    }
+
+    fclose(f);
+
+    if (events == 0) {
+        fail("no events in trace");
+    }
+
+    return sum;
+}
+
+int main() {
+    delete_shared_queue("trace-test.q");
+    remove("trace-tx.json");
+    remove("trace-rx.json");
+    remove("trace-tx.bin");
+
+    // bracket both processes with CLOCK_MONOTONIC, in us
+    double t0 = 1.0e-3 * tsc_monotonic_ns();
+
+    pid_t rx = run(false, "trace-rx.json");
+    pid_t tx = run(true, "trace-tx.json");
+
+    int status;
+    if ((waitpid(tx, &status, 0) != tx) || !WIFEXITED(status) || WEXITSTATUS(status) ||
+        (waitpid(rx, &status, 0) != rx) || !WIFEXITED(status) || WEXITSTATUS(status)) {
+        fail("producer or consumer failed");
+    }
+
+    double t1 = 1.0e-3 * tsc_monotonic_ns();
+
+    trace_summary tx_sum = check_json("trace-tx.json", "\"name\":\"send\"");
+    trace_summary rx_sum = check_json("trace-rx.json", "\"name\":\"recv\"");
+
+    // each successful send or recv is one record, and failed attempts in a
+    // row are folded into one more
+    if ((tx_sum.sends < NPACKETS) || (tx_sum.recvs != 0) || (rx_sum.recvs < NPACKETS) ||
+        (rx_sum.sends != 0)) {
+        fail("unexpected event counts");
+    }
+
+    // timestamps are on the shared CLOCK_MONOTONIC timeline, rather than
+    // relative to each process's start, so the two traces line up
+    if ((tx_sum.min_ts < t0) || (tx_sum.max_ts > t1) || (rx_sum.min_ts < t0) ||
+        (rx_sum.max_ts > t1)) {
+        fail("trace timestamps aren't absolute");
+    }
+    if (rx_sum.first_ok < tx_sum.first_ok) {
+        fail("first packet received before it was sent");
+    }
+
+    // the binary format records what's needed to convert to the same clock
+    delete_shared_queue("trace-test.q");
+    pid_t rx2 = run(false, "/dev/null");
+    pid_t tx2 = run(true, "trace-tx.bin");
+    waitpid(tx2, &status, 0);
+    waitpid(rx2, &status, 0);
+
+    sb_trace_file_header hdr;
+    FILE* f = fopen("trace-tx.bin", "rb");
+    if (!f || (fread(&hdr, sizeof hdr, 1, f) != 1)) {
+        fail("binary trace missing");
+    }
+    fclose(f);
+
+    double ns0 = hdr.ns0;
+    if ((memcmp(hdr.magic, SB_TRACE_MAGIC, sizeof hdr.magic) != 0) || (hdr.num_threads != 1) ||
+        (hdr.num_queues != 2) || (hdr.ns_per_tick <= 0) || (1.0e-3 * ns0 < t0) ||
+        (1.0e-3 * ns0 > 1.0e-3 * tsc_monotonic_ns())) {
+        fail("bad binary trace header");
+    }
+
+    delete_shared_queue("trace-test.q");
+    remove("trace-tx.json");
+    remove("trace-rx.json");
+    remove("trace-tx.bin");
+
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,215 @@
+// Checks sim-time stamps: stale stamps, replay mode, and stamps passed on
+// through the router and the TCP bridge
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "switchboard.hpp"
+
+#define NPACKETS 100
+
+static void fail(const char* msg) {
+    fprintf(stderr, "FAIL: %s\n", msg);
+    exit(1);
+}
+
+// waits up to a few seconds for "rx" to release a packet
+static bool recv_timeout(SBRX& rx, sb_packet& p) {
+    for (int i = 0; i < 500000; i++) {
+        if (rx.recv(p)) {
+            return true;
+        }
+        usleep(10);
+    }
+    return false;
+}
+
+// a queue file that is reused must not hand stamps of earlier packets to
+// packets sent without stamping
+static void stale_stamps() {
+    printf("stale_stamps\n");
+
+    delete_shared_queue("tstamp-stale.q");
+
+    SBTX tx;
+    SBRX rx;
+    tx.init("tstamp-stale.q", 4);
+    rx.init("tstamp-stale.q", 4);
+    rx.set_tstamp(true);
+
+    // fill every slot with a stamp
+    sb_packet p;
+    memset(&p, 0, sizeof p);
+    for (int i = 0; i < 8; i++) {
+        if (!tx.send(p, 0x12345678) || !rx.recv(p) || (rx.last_tstamp() != 0x12345678)) {
+            fail("stamped packet");
+        }
+    }
+
+    // the same slots, now without stamping
+    for (int i = 0; i < 8; i++) {
+        uint64_t tstamp;
+        if (!tx.send(p) || !rx.recv_peek(p, tstamp) || (tstamp != 0)) {
+            fail("unstamped packet carries a stale stamp");
+        }
+        rx.recv();
+    }
+
+    delete_shared_queue("tstamp-stale.q");
+}
+
+// in replay mode, packets are held until the sim clock reaches their
+// stamp plus the link latency
+static void replay() {
+    printf("replay\n");
+
+    delete_shared_queue("tstamp-replay.q");
+
+    SBTX tx;
+    SBRX rx;
+    tx.init("tstamp-replay.q");
+    rx.init("tstamp-replay.q");
+    rx.set_link_latency(10);
+
+    sb_packet p;
+    memset(&p, 0, sizeof p);
+    p.destination = 1;
+    tx.send(p, 100);
+    p.destination = 2;
+    tx.send(p, 200);
+
+    sb_sim_clock_get().cycle = 109;
+    if (rx.recv(p)) {
+        fail("packet released early");
+    }
+
+    sb_sim_clock_get().cycle = 110;
+    if (!rx.recv(p) || (p.destination != 1) || (rx.last_tstamp() != 100)) {
+        fail("first packet not released");
+    }
+
+    sb_sim_clock_get().cycle = 209;
+    if (rx.recv(p)) {
+        fail("second packet released early");
+    }
+
+    sb_sim_clock_get().cycle = 210;
+    if (!rx.recv(p) || (p.destination != 2) || (rx.last_tstamp() != 200)) {
+        fail("second packet not released");
+    }
+
+    delete_shared_queue("tstamp-replay.q");
+}
+
+static pid_t spawn(const char* const* argv) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execv(argv[0], (char* const*)argv);
+        perror(argv[0]);
+        _exit(1);
+    } else if (pid < 0) {
+        fail("fork");
+    }
+    return pid;
+}
+
+static void stop(pid_t pid) {
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+}
+
+// producer -> router -> sbtcp client -> TCP -> sbtcp server -> consumer,
+// with the consumer in replay mode and stamps carried over TCP (--tstamp)
+static void forward(std::string bindir) {
+    printf("forward\n");
+
+    const char* queues[] = {"queue-5000", "queue-5001", "queue-5002"};
+    for (const char* q : queues) {
+        delete_shared_queue(q);
+    }
+
+    std::string router = bindir + "/router";
+    std::string sbtcp = bindir + "/sbtcp";
+    std::string port = std::to_string(20000 + (getpid() % 10000));
+
+    const char* router_argv[] = {router.c_str(), "--rx", "5000", "--tx", "5001", "--route",
+        "0:5001", "--route", "1:5001", NULL};
+    const char* server_argv[] = {sbtcp.c_str(), "--outputs", "*:queue-5002", "--port",
+        port.c_str(), "--tstamp", "-q", NULL};
+    const char* client_argv[] = {sbtcp.c_str(), "--inputs", "queue-5001", "--port",
+        port.c_str(), "--tstamp", "-q", NULL};
+
+    pid_t pids[] = {spawn(router_argv), spawn(server_argv), spawn(client_argv)};
+
+    SBTX tx;
+    SBRX rx;
+    tx.init(queues[0]);
+    rx.init(queues[2]);
+    rx.set_link_latency(3);
+
+    // stamps start well above the sim clock, so nothing may be released
+    // until the clock gets there, even though the packets arrive
+    sb_sim_clock_get().cycle = 500;
+
+    for (int i = 0; i < NPACKETS; i++) {
+        sb_packet p;
+        memset(&p, 0, sizeof p);
+        p.destination = i & 1;
+        p.data[0] = i;
+        while (!tx.send(p, 1000 + 7 * i)) {
+            usleep(10);
+        }
+    }
+
+    // give the packets time to get through
+    usleep(200000);
+
+    sb_packet p;
+    if (rx.recv(p)) {
+        fail("forwarded packet released before its stamp");
+    }
+
+    for (int i = 0; i < NPACKETS; i++) {
+        sb_sim_clock_get().cycle = 1000 + 7 * i + 3;
+        if (!recv_timeout(rx, p)) {
+            fail("forwarded packet not released");
+        }
+        if ((p.destination != (uint32_t)(i & 1)) || (p.data[0] != (uint8_t)i) ||
+            (rx.last_tstamp() != (uint64_t)(1000 + 7 * i))) {
+            fail("forwarded packet mismatch");
+        }
+        if (rx.recv(p)) {
+            fail("forwarded packet released early");
+        }
+    }
+
+    for (pid_t pid : pids) {
+        stop(pid);
+    }
+
+    for (const char* q : queues) {
+        delete_shared_queue(q);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s <directory with router and sbtcp>\n", argv[0]);
+        return 1;
+    }
+
+    stale_stamps();
+    replay();
+    forward(argv[1]);
+
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,368 @@
+// Exercises the UMI memory model: address maps, image loading, atomics,
+// checkpoints, and timing
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "umimem.hpp"
+#include "umitiming.hpp"
+
+static void fail(const char* msg) {
+    fprintf(stderr, "FAIL: %s\n", msg);
+    exit(1);
+}
+
+static void write_file(std::string path, const std::vector<uint8_t>& data) {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f || (fwrite(data.data(), 1, data.size(), f) != data.size())) {
+        fail("unable to write test file");
+    }
+    fclose(f);
+}
+
+static std::vector<uint8_t> random_bytes(size_t n) {
+    std::vector<uint8_t> data(n);
+    for (size_t i = 0; i < n; i++) {
+        data[i] = rand();
+    }
+    return data;
+}
+
+static void check_mem(UmiMemory& mem, uint64_t addr, const uint8_t* expected, size_t n,
+    const char* msg) {
+
+    std::vector<uint8_t> data(n);
+    if (!mem.read(addr, data.data(), n) || (memcmp(data.data(), expected, n) != 0)) {
+        fail(msg);
+    }
+}
+
+static void check_map() {
+    UmiMemory mem;
+
+    // large regions should only cost what is touched
+    if (!mem.add_region(0x80000000, 64ull << 30, "dram") || !mem.add_region(0x1000, 0x100)) {
+        fail("add_region");
+    }
+    if (mem.add_region(0x1080, 0x1000) || mem.add_region(0x90000000, 0x1000)) {
+        fail("overlapping region accepted");
+    }
+
+    uint64_t value = 0x0123456789abcdefull;
+    uint64_t top = 0x80000000 + (64ull << 30) - 8;
+    if (!mem.write(top, &value, 8) || !mem.write(0x10f8, &value, 8)) {
+        fail("write");
+    }
+    check_mem(mem, top, (uint8_t*)&value, 8, "read back at top of region");
+    check_mem(mem, 0x10f8, (uint8_t*)&value, 8, "read back in small region");
+
+    uint8_t buf[16];
+    if (mem.read(top, buf, 16) || mem.read(0x10f8, buf, 16) || mem.read(0x0, buf, 1) ||
+        mem.write(0x7ffffffc, buf, 8)) {
+        fail("access outside of the address map accepted");
+    }
+
+    // untouched memory reads as zero
+    uint8_t zeros[16] = {0};
+    check_mem(mem, 0x80000000 + (12ull << 30), zeros, 16, "untouched memory not zero");
+}
+
+static void check_atomics() {
+    UmiMemory mem;
+    mem.add_region(0, 0x1000);
+
+    uint32_t init = 0xfffffff0, operand = 0x20, old;
+    mem.write(0x100, &init, 4);
+
+    if (!mem.atomic(0x100, UMI_REQ_ATOMICMAX, 2, &operand, &old) || (old != init)) {
+        fail("atomic max");
+    }
+    check_mem(mem, 0x100, (uint8_t*)&operand, 4, "signed max result");
+
+    mem.write(0x100, &init, 4);
+    mem.atomic(0x100, UMI_REQ_ATOMICMAXU, 2, &operand, &old);
+    check_mem(mem, 0x100, (uint8_t*)&init, 4, "unsigned max result");
+
+    mem.atomic(0x100, UMI_REQ_ATOMICADD, 2, &operand, &old);
+    uint32_t sum = init + operand;
+    check_mem(mem, 0x100, (uint8_t*)&sum, 4, "add result");
+
+    if (mem.atomic(0xffe, UMI_REQ_ATOMICADD, 2, &operand, &old)) {
+        fail("atomic outside of the address map accepted");
+    }
+}
+
+static void check_threads() {
+    UmiMemory mem;
+    mem.add_region(0, 0x1000);
+
+    // concurrent atomics on aligned (lock-free) and misaligned (locked)
+    // addresses must not lose updates
+    const int num_threads = 4, iterations = 20000;
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; i++) {
+        threads.push_back(std::thread([&mem]() {
+            uint64_t one = 1, old;
+            for (int j = 0; j < iterations; j++) {
+                mem.atomic(0x100, UMI_REQ_ATOMICADD, 3, &one, &old);
+                mem.atomic(0x203, UMI_REQ_ATOMICADD, 2, &one, &old);
+            }
+        }));
+    }
+    for (std::thread& t : threads) {
+        t.join();
+    }
+
+    uint64_t aligned = 0;
+    uint32_t misaligned = 0;
+    mem.read(0x100, &aligned, 8);
+    mem.read(0x203, &misaligned, 4);
+    if ((aligned != num_threads * iterations) || (misaligned != num_threads * iterations)) {
+        fail("lost atomic updates");
+    }
+}
+
+static void check_binary() {
+    UmiMemory mem;
+    mem.add_region(0x10000000, 16 << 20);
+
+    // aligned (mapped copy-on-write) and unaligned (copied) loads, with
+    // memory on either side that must not be disturbed
+    std::vector<uint8_t> image = random_bytes(5 * 4096 + 123);
+    write_file("umimem-test.bin", image);
+
+    uint64_t offsets[] = {0x2000, 0x40011};
+    for (uint64_t offset : offsets) {
+        uint64_t addr = 0x10000000 + offset;
+        std::vector<uint8_t> guard = random_bytes(64);
+        mem.write(addr - 64, guard.data(), 64);
+        mem.write(addr + image.size(), guard.data(), 64);
+
+        if (!mem.load_image("umimem-test.bin", addr)) {
+            fail("load_image");
+        }
+
+        check_mem(mem, addr, image.data(), image.size(), "binary contents");
+        check_mem(mem, addr - 64, guard.data(), 64, "memory before image disturbed");
+        check_mem(mem, addr + image.size(), guard.data(), 64, "memory after image disturbed");
+
+        // writes must not reach the file
+        uint32_t value = 0xdeadbeef;
+        mem.write(addr + 4096, &value, 4);
+    }
+
+    FILE* f = fopen("umimem-test.bin", "rb");
+    std::vector<uint8_t> check(image.size());
+    if (!f || (fread(check.data(), 1, check.size(), f) != check.size()) || (check != image)) {
+        fail("image file modified");
+    }
+    fclose(f);
+    remove("umimem-test.bin");
+}
+
+static void check_elf() {
+    // a minimal ELF file with two segments: one page-aligned with a .bss
+    // tail, and one that isn't page-aligned
+    std::vector<uint8_t> seg0 = random_bytes(3 * 4096 + 100);
+    std::vector<uint8_t> seg1 = random_bytes(300);
+    uint64_t off0 = 0x1000, off1 = off0 + seg0.size();
+    uint64_t addr0 = 0x80001000, addr1 = 0x80200000 + (off1 % 4096);
+
+    std::vector<uint8_t> file(off1 + seg1.size(), 0);
+
+    Elf64_Ehdr eh;
+    memset(&eh, 0, sizeof(eh));
+    memcpy(eh.e_ident, ELFMAG, SELFMAG);
+    eh.e_ident[EI_CLASS] = ELFCLASS64;
+    eh.e_ident[EI_DATA] = ELFDATA2LSB;
+    eh.e_ident[EI_VERSION] = EV_CURRENT;
+    eh.e_type = ET_EXEC;
+    eh.e_entry = addr0;
+    eh.e_phoff = sizeof(eh);
+    eh.e_ehsize = sizeof(eh);
+    eh.e_phentsize = sizeof(Elf64_Phdr);
+    eh.e_phnum = 2;
+    memcpy(&file[0], &eh, sizeof(eh));
+
+    Elf64_Phdr ph[2];
+    memset(ph, 0, sizeof(ph));
+    ph[0].p_type = PT_LOAD;
+    ph[0].p_offset = off0;
+    ph[0].p_vaddr = 0xffffffff80001000ull;
+    ph[0].p_paddr = addr0;
+    ph[0].p_filesz = seg0.size();
+    ph[0].p_memsz = seg0.size() + 3 * 4096;
+    ph[1].p_type = PT_LOAD;
+    ph[1].p_offset = off1;
+    ph[1].p_paddr = addr1 + 8;
+    ph[1].p_filesz = seg1.size();
+    ph[1].p_memsz = seg1.size();
+    memcpy(&file[sizeof(eh)], ph, sizeof(ph));
+
+    memcpy(&file[off0], seg0.data(), seg0.size());
+    memcpy(&file[off1], seg1.data(), seg1.size());
+    write_file("umimem-test.elf", file);
+
+    UmiMemory mem;
+    mem.add_region(0x80000000, 4ull << 30);
+
+    // the .bss part must be cleared even if the memory was used before
+    std::vector<uint8_t> junk = random_bytes(4 * 4096);
+    mem.write(addr0 + seg0.size(), junk.data(), junk.size());
+
+    uint64_t entry = 0;
+    if (!mem.load_image("umimem-test.elf", 0, &entry) || (entry != addr0)) {
+        fail("load_image (ELF)");
+    }
+
+    check_mem(mem, addr0, seg0.data(), seg0.size(), "ELF segment 0 contents");
+    check_mem(mem, addr1 + 8, seg1.data(), seg1.size(), "ELF segment 1 contents");
+
+    std::vector<uint8_t> zeros(3 * 4096, 0);
+    check_mem(mem, addr0 + seg0.size(), zeros.data(), zeros.size(), ".bss not cleared");
+    check_mem(mem, addr0 + seg0.size() + zeros.size(), junk.data() + zeros.size(),
+        junk.size() - zeros.size(), "memory after .bss disturbed");
+
+    remove("umimem-test.elf");
+}
+
+static void check_checkpoint() {
+    std::vector<uint8_t> a = random_bytes(3 * 4096), b = random_bytes(100);
+    std::vector<uint8_t> zeros(4096, 0);
+
+    {
+        UmiMemory mem;
+        mem.add_region(0, 1ull << 30);
+        mem.add_region(1ull << 32, 1ull << 30);
+
+        mem.write(0x10000, a.data(), a.size());
+        mem.write((1ull << 32) + 0x123, b.data(), b.size());
+        if (!mem.checkpoint("umimem-test.ckpt.0", "first")) {
+            fail("full checkpoint");
+        }
+
+        // only these pages should go into the incremental checkpoint
+        mem.write(0x11000, b.data(), b.size());
+        mem.zero(0x12000, 4096);
+        if (!mem.checkpoint("umimem-test.ckpt.1", "second")) {
+            fail("incremental checkpoint");
+        }
+    }
+
+    UmiMemory mem;
+    mem.add_region(0, 1ull << 30);
+    mem.add_region(1ull << 32, 1ull << 30);
+
+    // junk that the restore must discard
+    mem.write(0x20000, a.data(), a.size());
+
+    std::string state;
+    if (!mem.restore("umimem-test.ckpt.1", &state) || (state != "second")) {
+        fail("restore");
+    }
+
+    check_mem(mem, 0x10000, a.data(), 4096, "restored page from full checkpoint");
+    check_mem(mem, 0x11000, b.data(), b.size(), "restored page from incremental checkpoint");
+    check_mem(mem, 0x11000 + b.size(), a.data() + 4096 + b.size(), 4096 - b.size(),
+        "rest of restored page");
+    check_mem(mem, 0x12000, zeros.data(), 4096, "restored zero page");
+    check_mem(mem, (1ull << 32) + 0x123, b.data(), b.size(), "restored second region");
+    check_mem(mem, 0x20000, zeros.data(), 4096, "memory not reset by restore");
+
+    // restored pages are copy-on-write
+    mem.write(0x10000, b.data(), b.size());
+    UmiMemory mem2;
+    mem2.add_region(0, 1ull << 30);
+    mem2.add_region(1ull << 32, 1ull << 30);
+    if (!mem2.restore("umimem-test.ckpt.0", &state) || (state != "first")) {
+        fail("restore of parent");
+    }
+    check_mem(mem2, 0x10000, a.data(), a.size(), "checkpoint modified through restored memory");
+
+    UmiMemory mem3;
+    mem3.add_region(0, 1ull << 30);
+    if (mem3.restore("umimem-test.ckpt.1")) {
+        fail("restore with a different address map accepted");
+    }
+
+    remove("umimem-test.ckpt.0");
+    remove("umimem-test.ckpt.1");
+}
+
+static void check_timing() {
+    UmiTimingConfig config;
+    config.latency = 10;
+    config.banks = 4;
+    config.row_bytes = 2048;
+    config.row_hit = 5;
+    config.row_miss = 30;
+    config.bytes_per_cycle = 8;
+
+    UmiTiming timing(config);
+    UmiTiming::Port a, b;
+
+    // row miss, then a row hit whose transfer waits for the port, then a
+    // conflict in the same bank from another port
+    if ((timing.access(a, 100, 0x0, 64) != 100 + 30 + 8 + 10) ||
+        (timing.access(a, 100, 0x40, 64) != 100 + 30 + 8 + 8 + 10) ||
+        (timing.access(b, 100, 4 * 2048, 8) != 100 + 30 + 5 + 30 + 1 + 10)) {
+        fail("bank timing");
+    }
+
+    // a different bank is independent, but transfers on a port are not
+    if ((timing.access(b, 100, 2048, 8) != 100 + 30 + 5 + 30 + 1 + 1 + 10) ||
+        (timing.access(b, 1000, 2048, 8) != 1000 + 5 + 1 + 10)) {
+        fail("port timing");
+    }
+}
+
+static void check_calendar() {
+    UmiCalendar<int> calendar(8, 4);
+    int item;
+
+    // events in random order, spread over several years, come out sorted
+    std::vector<uint64_t> times;
+    for (int i = 0; i < 1000; i++) {
+        times.push_back(1000 + rand() % 500);
+        calendar.push(times.back(), i);
+    }
+    calendar.push(1000000, -1);
+
+    uint64_t prev = 0;
+    for (uint64_t now = 0; now < 2000; now += 7) {
+        while (calendar.pop(now, item)) {
+            if ((times[item] > now) || (times[item] < prev)) {
+                fail("calendar order");
+            }
+            prev = times[item];
+        }
+    }
+
+    if ((calendar.size() != 1) || calendar.pop(999999, item) || !calendar.pop(1000000, item) ||
+        (item != -1)) {
+        fail("far-future calendar event");
+    }
+}
+
+int main() {
+    srand(0);
+
+    check_map();
+    check_atomics();
+    check_threads();
+    check_binary();
+    check_elf();
+    check_checkpoint();
+    check_timing();
+    check_calendar();
+
+    printf("PASS\n");
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Stand-in for a Verilated testbench, for testing testbench.cc and
+// testbench_sync.cc without Verilator
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// the "testbench" opens both ends of a queue on its first eval(), as the
+// DPI/VPI shims do, loops packets through it for a few cycles, and then
+// finishes.  final() prints the CPU affinity and NUMA placement that the
+// testbench's plusargs set up, for tests/placement.cc to check.
+
+#ifndef VTESTBENCH_H
+#define VTESTBENCH_H
+
+#include <cstdio>
+#include <cstring>
+#include <sched.h>
+
+#include "switchboard.hpp"
+#include "verilated.h"
+
+#define VTESTBENCH_QUEUE "queue-placement"
+#define VTESTBENCH_CYCLES 10
+
+class Vtestbench {
+  public:
+    uint8_t clk = 0;
+
+    Vtestbench(VerilatedContext* contextp, const char*) : m_contextp(contextp) {}
+
+    void eval() {
+        if (!m_tx.is_active()) {
+            m_tx.init(VTESTBENCH_QUEUE);
+            m_rx.init(VTESTBENCH_QUEUE);
+        }
+
+        if (clk && !m_clk) {
+            sb_packet p;
+            memset(&p, 0, sizeof p);
+            p.destination = m_cycles;
+            m_tx.send(p);
+
+            if (m_rx.recv(p) && (p.destination == (uint32_t)m_received)) {
+                m_received++;
+            }
+
+            if (++m_cycles == VTESTBENCH_CYCLES) {
+                m_contextp->gotFinish(true);
+            }
+        }
+
+        m_clk = clk;
+    }
+
+    void final() {
+        cpu_set_t set;
+        int first = -1;
+
+        CPU_ZERO(&set);
+        sched_getaffinity(0, sizeof set, &set);
+        for (int i = 0; (i < CPU_SETSIZE) && (first < 0); i++) {
+            if (CPU_ISSET(i, &set)) {
+                first = i;
+            }
+        }
+
+        printf("cpus %d first %d numa %d received %d\n", CPU_COUNT(&set), first,
+            sb_numa_default(), m_received);
+    }
+
+  private:
+    VerilatedContext* m_contextp;
+    SBTX m_tx;
+    SBRX m_rx;
+    uint8_t m_clk = 0;
+    int m_cycles = 0;
+    int m_received = 0;
+};
+
+#endif // VTESTBENCH_H
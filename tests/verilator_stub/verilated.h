@@ -0,0 +1,58 @@
+// Stand-in for Verilator's runtime, for testing testbench.cc and
+// testbench_sync.cc without Verilator
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// only the parts of VerilatedContext that the testbenches use are here.
+// time isn't tracked, and the model (Vtestbench.h) ends the simulation.
+
+#ifndef VERILATED_H
+#define VERILATED_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class VerilatedContext {
+  public:
+    void traceEverOn(bool) {}
+
+    void commandArgs(int argc, char** argv) {
+        for (int i = 1; i < argc; i++) {
+            m_args.push_back(argv[i]);
+        }
+    }
+
+    // like Verilator, returns the first argument that starts with "+prefix",
+    // or an empty string
+    const char* commandArgsPlusMatch(const char* prefix) {
+        std::string plus = std::string("+") + prefix;
+        for (const std::string& arg : m_args) {
+            if (arg.compare(0, plus.size(), plus) == 0) {
+                return arg.c_str();
+            }
+        }
+        return "";
+    }
+
+    int timeprecision() const {
+        return -12;
+    }
+
+    void timeInc(uint64_t) {}
+
+    bool gotFinish() const {
+        return m_finish;
+    }
+
+    void gotFinish(bool finish) {
+        m_finish = finish;
+    }
+
+  private:
+    std::vector<std::string> m_args;
+    bool m_finish = false;
+};
+
+#endif // VERILATED_H
@@ -0,0 +1,103 @@
+// Stand-in for Xyce's C interface, for testing XyceIntf without Xyce
+
+// Copyright (c) 2024 Zero ASIC Corporation
+// This code is licensed under Apache License 2.0 (see LICENSE for details)
+
+// The "circuit" has one output, "out", which is the sum of the DAC inputs.
+// Like Xyce's YDAC, each DAC holds the value of its last point at or before
+// the current time.  The stub also checks that once it has simulated up to
+// some time, it is never given a new input at or before that time, since
+// that would make the result depend on when the input happened to arrive.
+
+#ifndef N_CIR_XYCE_C_INTERFACE_H
+#define N_CIR_XYCE_C_INTERFACE_H
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct xyce_stub_state {
+    std::mutex lock;
+    double time = 0;
+    int steps = 0;
+    int late_inputs = 0;
+    std::map<std::string, std::vector<std::pair<double, double>>> dacs;
+};
+
+inline xyce_stub_state& xyce_stub() {
+    static xyce_stub_state state;
+    return state;
+}
+
+inline void xyce_open(void** ptr) {
+    (void)ptr;
+}
+
+inline void xyce_close(void** ptr) {
+    (void)ptr;
+}
+
+inline int xyce_initialize(void** ptr, int argc, char** argv) {
+    (void)ptr;
+    (void)argc;
+    (void)argv;
+    return 1;
+}
+
+inline int xyce_simulateUntil(void** ptr, double until, double* reached) {
+    (void)ptr;
+
+    std::lock_guard<std::mutex> guard(xyce_stub().lock);
+    xyce_stub().time = until;
+    xyce_stub().steps++;
+    *reached = until;
+    return 1;
+}
+
+inline int xyce_updateTimeVoltagePairs(void** ptr, char* name, int n, double* t, double* v) {
+    (void)ptr;
+
+    std::lock_guard<std::mutex> guard(xyce_stub().lock);
+    std::vector<std::pair<double, double>>& known = xyce_stub().dacs[name];
+    std::vector<std::pair<double, double>> points;
+
+    for (int i = 0; i < n; i++) {
+        points.push_back(std::make_pair(t[i], v[i]));
+
+        bool seen = false;
+        for (auto& p : known) {
+            seen = seen || (p == points.back());
+        }
+
+        if (!seen && (t[i] <= xyce_stub().time)) {
+            xyce_stub().late_inputs++;
+        }
+    }
+
+    known = points;
+    return 1;
+}
+
+inline int xyce_obtainResponse(void** ptr, char* name, double* value) {
+    (void)ptr;
+    (void)name;
+
+    std::lock_guard<std::mutex> guard(xyce_stub().lock);
+    *value = 0;
+
+    for (auto& dac : xyce_stub().dacs) {
+        double held = 0;
+        for (auto& p : dac.second) {
+            if (p.first <= xyce_stub().time) {
+                held = p.second;
+            }
+        }
+        *value += held;
+    }
+
+    return 1;
+}
+
+#endif // N_CIR_XYCE_C_INTERFACE_H